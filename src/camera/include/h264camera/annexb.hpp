@@ -0,0 +1,86 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ANNEXB_HPP__
+#define ANNEXB_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <linux/videodev2.h>
+
+namespace h264camera {
+
+/// Find the next start code 00 00 01, which may not begin before *cur*.
+/// Returns a pointer to the 01 byte or *end*.  The search jumps from one 01
+/// byte to the next with memchr, which is much faster than looking at every
+/// byte since 01 is rare in slice data.
+inline const uint8_t *find_start_code(const uint8_t *cur, const uint8_t *end) {
+  if (end - cur < 3) {
+    return end;
+  }
+  for (cur += 2; cur < end; ++cur) {
+    cur = static_cast<const uint8_t *>(std::memchr(cur, 1, end - cur));
+    if (!cur) {
+      return end;
+    }
+    if (cur[-1] == 0 && cur[-2] == 0) {
+      return cur;
+    }
+  }
+  return end;
+}
+
+/// Call *func(start, header)* for every NALU in the Annex-B byte stream
+/// [*data*, *data* + *size*).  *start* is the offset of the start code
+/// including a leading zero byte, *header* the offset of the NALU header.
+template <typename FUNC>
+void for_each_nalu(const uint8_t *data, std::size_t size, FUNC func) {
+  const auto end = data + size;
+  for (auto one = find_start_code(data, end); one != end;
+       one = find_start_code(one + 2, end)) {
+    const auto header = static_cast<std::size_t>(one + 1 - data);
+    if (header >= size) {
+      break;
+    }
+    const std::size_t pos = header - 3;
+    const std::size_t start = (pos > 0 && data[pos - 1] == 0) ? pos - 1 : pos;
+    func(start, header);
+  }
+}
+
+/// Check for an IDR slice in the Annex-B byte stream
+inline bool contains_idr(const uint8_t *data, std::size_t size) {
+  bool idr = false;
+  for_each_nalu(data, size, [&](std::size_t, std::size_t header) {
+    idr = idr || (data[header] & 0x1F) == 5;
+  });
+  return idr;
+}
+
+/// The frame starts a GOP: the driver set V4L2_BUF_FLAG_KEYFRAME in
+/// *flags* or the frame holds an IDR slice, since not every camera sets the
+/// flag
+inline bool is_keyframe(const uint8_t *data, std::size_t size,
+                        uint32_t flags) {
+  return (flags & V4L2_BUF_FLAG_KEYFRAME) || contains_idr(data, size);
+}
+
+} // namespace h264camera
+
+#endif // ANNEXB_HPP__
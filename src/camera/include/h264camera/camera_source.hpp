@@ -0,0 +1,78 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CAMERA_SOURCE_HPP__
+#define CAMERA_SOURCE_HPP__
+
+#include <memory>
+#include <optional>
+
+#include "device_watch.hpp"
+#include "elp_usb100w04h.hpp"
+#include "frame_source.hpp"
+
+namespace h264camera {
+
+/// Frame source reading from a ELP USB100W04H camera.
+///
+/// The camera is reattachable: after it vanished from the USB bus,
+/// waitUntilAvailable() watches for the device node to come back.  The
+/// next reopen() connects the extended controls again, which the driver
+/// forgets with the device, and start() restores bitrate and mode.
+class CameraSource : public FrameSource {
+public:
+  /// @param dev_path Device path, e.g., /dev/elp-h264
+  explicit CameraSource(const std::string &dev_path);
+
+  void reopen() override;
+  void close() override;
+  bool isOpen() const override;
+  void configure(const VideoSize &vsize, uint32_t fps) override;
+  void start() override;
+  void stop() override;
+
+  Device::Mem *dequeue(std::chrono::milliseconds timeout) override;
+  int queue(std::size_t index) override;
+  void requestIFrame() override;
+  void lockMemory() override;
+  void requeue() override;
+  void restartStream() override;
+
+  const std::string &name() const override;
+  bool reattachable() const override { return true; }
+  bool waitUntilAvailable(std::chrono::milliseconds timeout) override;
+
+  /// Access to the camera for everything beyond the FrameSource interface
+  Usb100W04H &device() { return mDevice; }
+
+private:
+  /// Encoder settings to restore after the camera was attached again
+  struct Settings {
+    double bitrate;
+    Mode mode;
+  };
+
+  Usb100W04H mDevice;
+  /// Created on the first wait, the camera is usually never lost
+  std::unique_ptr<DeviceWatch> mWatch;
+  std::optional<Settings> mSettings;
+  bool mReattached{false};
+};
+
+} // namespace h264camera
+
+#endif // CAMERA_SOURCE_HPP__
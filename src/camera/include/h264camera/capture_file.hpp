@@ -0,0 +1,165 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CAPTURE_FILE_HPP__
+#define CAPTURE_FILE_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "v4l2_device.hpp"
+
+namespace h264camera {
+
+// Capture file format
+//
+// A capture file keeps the payload of every v4l2 buffer together with its
+// metadata.  The structs below are written as they are in memory, so all
+// numbers are in the byte order of the writing host.  A host of the other
+// byte order rejects the file due to its version.
+//
+//   CaptureHeader     header_size bytes at offset 0, at least 64
+//   payload           frames back to back, as dequeued from the device
+//   CaptureIndexEntry 40 bytes per frame
+//   CaptureTrailer    32 bytes at the end of the file
+//
+// The index is written when the file is closed.  Since the trailer has a
+// fixed size, a reader finds the index in O(1) and can map the whole file.
+
+constexpr char CAPTURE_MAGIC[8] = {'E', 'L', 'P', 'H', '2', '6', '4', 'C'};
+constexpr char CAPTURE_INDEX_MAGIC[8] = {'E', 'L', 'P', 'H', 'I', 'D', 'X',
+                                         '1'};
+constexpr uint32_t CAPTURE_VERSION{1};
+constexpr uint32_t CAPTURE_NO_FRAME{UINT32_MAX};
+
+struct CaptureHeader {
+  char magic[8];
+  uint32_t version;
+  /// Offset of the payload, readers skip fields added by later writers
+  uint32_t header_size;
+  uint32_t width;
+  uint32_t height;
+  uint32_t fps;
+  uint32_t pixelformat;
+  uint8_t reserved[32];
+};
+static_assert(sizeof(CaptureHeader) == 64, "Unexpected header size");
+
+struct CaptureIndexEntry {
+  /// Offset of the payload from the begin of the file
+  uint64_t offset;
+  /// Capture time in microseconds (v4l2_buffer::timestamp)
+  uint64_t timestamp_us;
+  /// Payload size (v4l2_buffer::bytesused)
+  uint32_t size;
+  /// v4l2_buffer::sequence
+  uint32_t sequence;
+  /// v4l2_buffer::flags
+  uint32_t flags;
+  /// Index of the latest key frame at or before this frame or
+  /// CAPTURE_NO_FRAME
+  uint32_t prev_keyframe;
+  /// Index of the next key frame after this frame or CAPTURE_NO_FRAME
+  uint32_t next_keyframe;
+  /// 1 if the frame holds an IDR slice
+  uint8_t keyframe;
+  uint8_t reserved[3];
+};
+static_assert(sizeof(CaptureIndexEntry) == 40, "Unexpected index size");
+
+struct CaptureTrailer {
+  char magic[8];
+  uint64_t index_offset;
+  uint64_t frame_count;
+  uint64_t reserved;
+};
+static_assert(sizeof(CaptureTrailer) == 32, "Unexpected trailer size");
+
+/// Write frames with their metadata into a capture file
+class CaptureWriter {
+public:
+  /// Create the file *path* for frames of the given format
+  CaptureWriter(const std::string &path, const VideoSize &vsize, uint32_t fps,
+                uint32_t pixelformat = V4L2_PIX_FMT_H264);
+  /// Close the file, if not done before
+  ~CaptureWriter();
+  CaptureWriter(const CaptureWriter &) = delete;
+  CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+  /// Append a dequeued frame
+  void write(const Device::Mem &frame);
+  /// Append *size* bytes of *data* with the metadata of *buf*
+  void write(const void *data, std::size_t size, const v4l2_buffer &buf);
+  /// Write index and trailer and close the file
+  void close();
+
+  /// Count of frames written
+  std::size_t frameCount() const { return mIndex.size(); }
+  /// Bytes written so far, without index
+  uint64_t size() const { return mOffset; }
+  const std::string &path() const { return mPath; }
+
+private:
+  const std::string mPath;
+  std::FILE *mStream{nullptr};
+  std::vector<char> mBuffer;
+  uint64_t mOffset{0};
+  std::vector<CaptureIndexEntry> mIndex;
+};
+
+/// Read a capture file.  The file is memory mapped, so frames can be
+/// accessed in any order without copying.  The constructor checks every
+/// index entry against the payload and throws std::runtime_error for a
+/// corrupt file, so the accessors never point beyond the mapping.
+class CaptureReader {
+public:
+  explicit CaptureReader(const std::string &path);
+  ~CaptureReader();
+  CaptureReader(const CaptureReader &) = delete;
+  CaptureReader &operator=(const CaptureReader &) = delete;
+
+  /// Check if *path* starts like a capture file
+  static bool probe(const std::string &path);
+
+  const CaptureHeader &header() const { return *mHeader; }
+  std::size_t frameCount() const { return mFrameCount; }
+  const CaptureIndexEntry &entry(std::size_t frame) const;
+  /// Payload of the frame
+  const uint8_t *data(std::size_t frame) const;
+
+  /// Index of the key frame at or before *frame* or CAPTURE_NO_FRAME
+  uint32_t keyframeAtOrBefore(std::size_t frame) const;
+  /// Index of the first key frame after *frame* or CAPTURE_NO_FRAME
+  uint32_t keyframeAfter(std::size_t frame) const;
+
+  /// The whole mapped file
+  const uint8_t *fileData() const { return mData; }
+  std::size_t fileSize() const { return mSize; }
+
+private:
+  const uint8_t *mData{nullptr};
+  std::size_t mSize{0};
+  const CaptureHeader *mHeader{nullptr};
+  const CaptureIndexEntry *mIndex{nullptr};
+  std::size_t mFrameCount{0};
+};
+
+} // namespace h264camera
+
+#endif // CAPTURE_FILE_HPP__
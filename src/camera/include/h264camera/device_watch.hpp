@@ -0,0 +1,57 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef DEVICE_WATCH_HPP__
+#define DEVICE_WATCH_HPP__
+
+#include <chrono>
+#include <string>
+
+namespace h264camera {
+
+/// Notices a device node appearing and disappearing, e.g., /dev/elp-h264,
+/// which udev creates when the camera enters the USB bus (see
+/// elp-camera.rules).  The directory of the node is watched with inotify,
+/// which needs no privileges and also sees the symlinks of udev.
+class DeviceWatch {
+public:
+  /// Throws std::system_error, if the directory of *path* cannot be
+  /// watched.
+  explicit DeviceWatch(const std::string &path);
+  ~DeviceWatch();
+  DeviceWatch(const DeviceWatch &) = delete;
+  DeviceWatch &operator=(const DeviceWatch &) = delete;
+
+  const std::string &path() const { return mPath; }
+  /// The node exists, for a symlink also its target
+  bool exists() const;
+  /// Wait up to *timeout* for the node to appear.  Returns exists().
+  bool waitForDevice(std::chrono::milliseconds timeout);
+  /// Wait up to *timeout* for the node to vanish.  Returns !exists().
+  bool waitForRemoval(std::chrono::milliseconds timeout);
+
+private:
+  bool waitFor(bool present, std::chrono::milliseconds timeout);
+
+  const std::string mPath;
+  int mFd{-1};
+};
+
+} // namespace h264camera
+
+#endif // DEVICE_WATCH_HPP__
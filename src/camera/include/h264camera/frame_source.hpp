@@ -0,0 +1,89 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FRAME_SOURCE_HPP__
+#define FRAME_SOURCE_HPP__
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "v4l2_device.hpp"
+
+namespace h264camera {
+
+/// Anything delivering frames in v4l2 buffers, H.264 unless stated
+/// otherwise (see PreviewSource).
+///
+/// The life cycle is reopen(), configure(), start(), then any number of
+/// dequeue() and queue() calls, stop() and finally close().
+class FrameSource {
+public:
+  virtual ~FrameSource() = default;
+
+  /// Open the source, after closing when necessary
+  virtual void reopen() = 0;
+  /// Close the source
+  virtual void close() = 0;
+  /// Check if the source is open
+  virtual bool isOpen() const = 0;
+  /// Set resolution and frame rate before starting
+  virtual void configure(const VideoSize &vsize, uint32_t fps) = 0;
+  /// Start delivering frames
+  virtual void start() = 0;
+  /// Stop delivering frames
+  virtual void stop() = 0;
+
+  /// Dequeue the next frame, nullptr on timeout
+  virtual Device::Mem *dequeue(std::chrono::milliseconds timeout) = 0;
+  /// Give a frame back to the source, see Device::Mem::done
+  virtual int queue(std::size_t index) = 0;
+  /// Request an I-frame as soon as possible
+  virtual void requestIFrame() = 0;
+  /// Lock the buffers of the started source into memory, see
+  /// ThreadPolicy.  Throws std::system_error.
+  virtual void lockMemory() {}
+  /// Give all buffers not in use back to the source, the first step when
+  /// no frame arrives anymore
+  virtual void requeue() {}
+  /// Restart delivering frames without configuring the source again, the
+  /// second step when no frame arrives anymore
+  virtual void restartStream() {}
+
+  /// The name the source was created with
+  virtual const std::string &name() const = 0;
+
+  /// The source may come back after a failure, e.g., a camera which is
+  /// unplugged and plugged again.  Then the life cycle starts over with
+  /// reopen() once waitUntilAvailable() returned true.
+  virtual bool reattachable() const { return false; }
+  /// Wait up to *timeout* for the source to be available again
+  virtual bool waitUntilAvailable(std::chrono::milliseconds /*timeout*/) {
+    return false;
+  }
+};
+
+/// Create a frame source from a camera name.
+///
+/// - "replay:<file>" replays the H.264 file in real time
+/// - "replay-max:<file>" replays the H.264 file as fast as possible
+/// - everything else is the path of an ELP USB100W04H device
+std::unique_ptr<FrameSource> make_frame_source(const std::string &name);
+
+} // namespace h264camera
+
+#endif // FRAME_SOURCE_HPP__
@@ -0,0 +1,78 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PREVIEW_SOURCE_HPP__
+#define PREVIEW_SOURCE_HPP__
+
+#include "frame_source.hpp"
+
+namespace h264camera {
+
+/// The buffer *mem* holds a whole frame of *pixelformat*.  A YUYV frame
+/// has the negotiated *sizeimage*, so a buffer filled up to its last byte
+/// is fine, unlike for compressed MJPEG (see Device::Mem::truncated()).
+bool preview_frame_complete(const Device::Mem &mem, uint32_t pixelformat,
+                            uint32_t sizeimage);
+
+/// Frame source reading the secondary video node of the camera, which
+/// delivers MJPEG or YUYV next to the H.264 node.  Both nodes are separate
+/// v4l2 devices, so a PreviewSource may stream while a CameraSource of the
+/// same camera does.  The low resolution stream serves for a local preview
+/// without decoding the H.264 stream.
+class PreviewSource : public FrameSource {
+public:
+  /// @param dev_path Device path, e.g., /dev/elp-mjpeg
+  /// @param pixelformat V4L2_PIX_FMT_MJPEG or V4L2_PIX_FMT_YUYV
+  explicit PreviewSource(const std::string &dev_path,
+                         uint32_t pixelformat = V4L2_PIX_FMT_MJPEG);
+
+  void reopen() override;
+  void close() override;
+  bool isOpen() const override;
+  void configure(const VideoSize &vsize, uint32_t fps) override;
+  void start() override;
+  void stop() override;
+
+  Device::Mem *dequeue(std::chrono::milliseconds timeout) override;
+  int queue(std::size_t index) override;
+  /// Every MJPEG or YUYV frame stands on its own, nothing to do
+  void requestIFrame() override {}
+
+  const std::string &name() const override;
+
+  uint32_t pixelformat() const { return mPixelformat; }
+  /// Takes effect with the next configure()
+  void setPixelformat(uint32_t pixelformat) { mPixelformat = pixelformat; }
+  /// The resolution set by the driver, which picks the closest supported
+  /// one on configure()
+  VideoSize vsize() { return mDevice.vsize(); }
+  /// The dequeued *mem* holds a whole frame without errors, see
+  /// preview_frame_complete()
+  bool complete(const Device::Mem &mem) const {
+    return preview_frame_complete(mem, mPixelformat, mSizeimage);
+  }
+
+private:
+  Device mDevice;
+  uint32_t mPixelformat;
+  /// Frame size of the configured format
+  uint32_t mSizeimage{0};
+};
+
+} // namespace h264camera
+
+#endif // PREVIEW_SOURCE_HPP__
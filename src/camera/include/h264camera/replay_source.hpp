@@ -0,0 +1,105 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef REPLAY_SOURCE_HPP__
+#define REPLAY_SOURCE_HPP__
+
+#include <vector>
+
+#include "frame_source.hpp"
+
+namespace h264camera {
+
+class CaptureReader;
+
+/// Frame source replaying a recorded H.264 Annex-B file or a capture file
+/// (see CaptureWriter), e.g., written by elph264_capture.  The file is
+/// memory mapped and the frames are handed out without copying.  At the end
+/// of the file the replay starts over again.
+///
+/// Capture files are replayed with the recorded frame timing and buffer
+/// flags, raw Annex-B files with the configured frame rate.
+///
+/// The replay ignores the configured resolution, since it is fixed by the
+/// recording.
+class ReplaySource : public FrameSource {
+public:
+  enum class Speed { REALTIME, MAX };
+
+  /// @param name Camera name for reference
+  /// @param file Path of the recording
+  /// @param speed Deliver frames paced by the frame rate or without pause
+  ReplaySource(const std::string &name, const std::string &file,
+               Speed speed = Speed::REALTIME);
+  ~ReplaySource() override;
+
+  void reopen() override;
+  void close() override;
+  bool isOpen() const override;
+  void configure(const VideoSize &vsize, uint32_t fps) override;
+  void start() override;
+  void stop() override;
+
+  Device::Mem *dequeue(std::chrono::milliseconds timeout) override;
+  int queue(std::size_t index) override;
+  /// Skip forward to the next IDR frame
+  void requestIFrame() override;
+
+  const std::string &name() const override { return mName; }
+
+  /// Number of frames found in the recording
+  std::size_t frameCount() const { return mFrames.size(); }
+
+private:
+  struct Frame {
+    std::size_t offset;
+    std::size_t size;
+    bool idr;
+    /// Recorded capture time in microseconds, 0 if unknown
+    uint64_t timestamp_us{0};
+    /// Recorded v4l2_buffer::flags
+    uint32_t flags{0};
+  };
+
+  void index();
+  void indexCapture();
+  std::chrono::steady_clock::duration delayAfter(std::size_t pos) const;
+
+  static const uint32_t REPLAY_BUFFER_COUNT{6};
+  const std::string mName;
+  const std::string mFile;
+  const Speed mSpeed;
+  /// Set for capture files, it owns the mapping then
+  std::unique_ptr<CaptureReader> mReader;
+  /// Memory mapped recording
+  const uint8_t *mData{nullptr};
+  std::size_t mSize{0};
+  std::vector<Frame> mFrames;
+  /// Next frame to deliver
+  std::size_t mPosition{0};
+  bool mSkipToIdr{false};
+  bool mStreaming{false};
+  uint32_t mSequence{0};
+  std::chrono::steady_clock::duration mInterval{std::chrono::seconds(1) / 30};
+  std::chrono::steady_clock::time_point mNextFrame;
+  /// Buffer slots pointing into the mapped recording
+  std::vector<Device::Mem> mSlots;
+};
+
+} // namespace h264camera
+
+#endif // REPLAY_SOURCE_HPP__
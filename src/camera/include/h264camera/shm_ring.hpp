@@ -0,0 +1,192 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SHM_RING_HPP__
+#define SHM_RING_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "v4l2_device.hpp"
+
+namespace h264camera {
+
+// Shared memory ring
+//
+// A ShmPublisher exports the frames of a camera to other processes on the
+// same host.  The ring is a memfd with a header and a fixed count of slots
+// of fixed size.  Frame n goes to slot n modulo the slot count.  There is a
+// single writer, readers only map the ring read-only, so a slow or dead
+// reader never holds up the capture.
+//
+//   ShmRingHeader  one cache line at offset 0
+//   slots          slot_count times slot_size bytes, each a ShmSlot
+//                  followed by the frame data
+//
+// Every slot has a generation, which is odd while the frame is written and
+// 2 * (n + 1) once frame n is complete.  Readers check the generation
+// before and after using a frame (seqlock), so they detect frames
+// overwritten under their feet.
+//
+// Subscribers connect to the abstract Unix socket named after the ring and
+// receive the memfd and an eventfd of their own via SCM_RIGHTS.  The
+// eventfd is signalled for every published frame and can be polled.  The
+// abstract socket has no file permissions, so the publisher only accepts
+// peers running as its user or group or as root (SO_PEERCRED).  The memfd
+// is sealed against writes and resizing, so subscribers can only map it
+// read-only.
+
+constexpr char SHM_RING_MAGIC[8] = {'E', 'L', 'P', 'H', 'S', 'H', 'M', '1'};
+constexpr uint32_t SHM_RING_VERSION{1};
+
+struct alignas(64) ShmRingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t slot_count;
+  /// Bytes per slot including the ShmSlot
+  uint32_t slot_size;
+  /// Count of frames published so far
+  std::atomic<uint64_t> write_index;
+};
+
+struct alignas(64) ShmSlot {
+  std::atomic<uint64_t> generation;
+  /// Capture time in microseconds (v4l2_buffer::timestamp)
+  uint64_t timestamp_us;
+  /// v4l2_buffer::sequence
+  uint32_t sequence;
+  /// v4l2_buffer::flags
+  uint32_t flags;
+  /// Bytes of frame data following the slot header
+  uint32_t size;
+  /// 1 if the frame holds an IDR slice
+  uint8_t keyframe;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "Shared memory needs lock free atomics");
+static_assert(sizeof(ShmRingHeader) == 64, "Unexpected header size");
+static_assert(sizeof(ShmSlot) == 64, "Unexpected slot size");
+
+/// Export frames over a shared memory ring, see above
+class ShmPublisher {
+public:
+  /// Create the ring *name* with *slot_count* slots for frames of up to
+  /// *max_frame_size* bytes and start accepting subscribers.
+  explicit ShmPublisher(const std::string &name, uint32_t slot_count = 16,
+                        uint32_t max_frame_size = 1 << 20);
+  ~ShmPublisher();
+  ShmPublisher(const ShmPublisher &) = delete;
+  ShmPublisher &operator=(const ShmPublisher &) = delete;
+
+  /// Publish a dequeued frame.  Returns false, if it exceeds the slot size.
+  bool publish(const Device::Mem &frame);
+  /// Publish *size* bytes of *data* with the metadata of *buf*
+  bool publish(const void *data, std::size_t size, const v4l2_buffer &buf);
+
+  const std::string &name() const { return mName; }
+  std::size_t subscribers() const;
+  uint64_t published() const;
+  /// Frames not published, since they exceeded the slot size
+  uint64_t oversized() const { return mOversized; }
+
+  /// Address of the Unix socket of the ring *name*
+  static std::string socketName(const std::string &name);
+
+private:
+  void serveLoop();
+  ShmSlot *slot(uint64_t index);
+
+  const std::string mName;
+  int mMemFd{-1};
+  uint8_t *mData{nullptr};
+  std::size_t mSize{0};
+  ShmRingHeader *mHeader{nullptr};
+  uint64_t mOversized{0};
+
+  int mListenFd{-1};
+  /// Wakes the serve thread for shutdown
+  int mStopFd{-1};
+  std::thread mServeThread;
+
+  struct Subscriber {
+    int socket;
+    int event;
+  };
+  mutable std::mutex mMutex;
+  std::vector<Subscriber> mSubscribers;
+};
+
+/// A frame in the ring, valid until the publisher reuses its slot
+struct ShmFrame {
+  /// Position in the stream of the publisher
+  uint64_t index;
+  const uint8_t *data;
+  std::size_t size;
+  uint64_t timestamp_us;
+  uint32_t sequence;
+  uint32_t flags;
+  bool keyframe;
+};
+
+/// Read the frames of a ShmPublisher in another process without copying
+class ShmSubscriber {
+public:
+  /// Connect to ring *name*.  At most *max_lag* frames are kept back, older
+  /// ones count as dropped.  0 takes half the slot count.
+  explicit ShmSubscriber(const std::string &name, uint32_t max_lag = 0);
+  ~ShmSubscriber();
+  ShmSubscriber(const ShmSubscriber &) = delete;
+  ShmSubscriber &operator=(const ShmSubscriber &) = delete;
+
+  /// Wait up to *timeout* for a frame.  Returns true, if one is available.
+  bool wait(std::chrono::milliseconds timeout);
+  /// The next frame, if any.  The data points into the ring.
+  std::optional<ShmFrame> next();
+  /// Check after using *frame* that it was not overwritten meanwhile
+  bool valid(const ShmFrame &frame) const;
+
+  /// The eventfd signalled for new frames, e.g., for poll()
+  int fd() const { return mEventFd; }
+  /// Frames skipped since they were overwritten or beyond the lag
+  uint64_t dropped() const { return mDropped; }
+  uint32_t slotCount() const { return mHeader->slot_count; }
+
+private:
+  const ShmSlot *slot(uint64_t index) const;
+
+  int mSocket{-1};
+  int mEventFd{-1};
+  const uint8_t *mData{nullptr};
+  std::size_t mSize{0};
+  const ShmRingHeader *mHeader{nullptr};
+  uint64_t mMaxLag;
+  uint64_t mNext{0};
+  uint64_t mDropped{0};
+};
+
+} // namespace h264camera
+
+#endif // SHM_RING_HPP__
@@ -0,0 +1,64 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef THREAD_POLICY_HPP__
+#define THREAD_POLICY_HPP__
+
+#include <string>
+#include <vector>
+
+namespace h264camera {
+
+/// Scheduling of a capture thread and locking of its buffers.  A capture
+/// competing with audio, SIP and analytics for the CPU dequeues late,
+/// which a real-time priority or a CPU of its own avoids.
+///
+/// The text form are items separated by spaces, e.g., "fifo:50 cpus:2-3
+/// mlock", for configuration files and environment variables:
+/// - "other", "nice:<n>", "fifo:<priority>" or "rr:<priority>"
+/// - "cpus:<list>", e.g., "2", "0,2" or "0-3"
+/// - "mlock" to lock the capture buffers into memory
+struct ThreadPolicy {
+  enum class Scheduler { OTHER, FIFO, RR };
+
+  Scheduler scheduler{Scheduler::OTHER};
+  /// Real-time priority of FIFO and RR, 1 to 99
+  int priority{0};
+  /// Nice value of OTHER, -20 to 19
+  int nice{0};
+  /// CPUs the thread may run on, those of the process at startup if empty
+  std::vector<int> cpus;
+  bool lock_memory{false};
+
+  /// Nothing to change
+  bool isDefault() const;
+};
+
+/// Parse the text form.  Throws std::invalid_argument.
+ThreadPolicy parse_thread_policy(const std::string &text);
+std::string to_string(const ThreadPolicy &policy);
+
+/// Apply scheduler, priority, nice value and CPUs to the calling thread.
+/// The parts are applied one by one, so a missing privilege, e.g.,
+/// CAP_SYS_NICE for a real-time priority, only costs that part.  Returns
+/// a message for every part that failed.
+std::vector<std::string> apply_thread_policy(const ThreadPolicy &policy);
+
+} // namespace h264camera
+
+#endif // THREAD_POLICY_HPP__
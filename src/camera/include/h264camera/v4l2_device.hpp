@@ -64,6 +64,9 @@ public:
 
   /// Create memory map
   void mmap();
+  /// Lock the mapped buffers into memory, so a dequeue never waits for a
+  /// page fault.  Throws std::system_error, e.g., beyond RLIMIT_MEMLOCK.
+  void lockBuffers();
 
   /// Wait for new data to be ready
   bool ready(std::chrono::milliseconds timeout) const;
@@ -76,14 +79,21 @@ public:
   void setFramerate(uint32_t framerate);
 
   VideoSize vsize();
+  /// Size of a whole frame in the current format as set by the driver.  A
+  /// raw frame, e.g., YUYV, always has this size.
+  uint32_t sizeimage();
 
   /// Enable capture stream
   int streamOn();
   /// Disable capture stream
   int streamOff();
+  /// Stop and start the capture stream with all buffers queued again, e.g.,
+  /// when the driver stopped filling them.  Buffers still held by the
+  /// caller are taken back as well.
+  void restartStream();
 
   struct Mem {
-    Mem(std::uint32_t index, void *ptr, std::size_t len);
+    Mem(std::uint32_t index, void *ptr, std::size_t len, bool mapped = true);
     ~Mem();
     Mem(Mem &&);
     /// - UNUSED : Ready to be queued again
@@ -96,9 +106,21 @@ public:
     void *ptr{nullptr};
     /// Length of the buffer
     std::uint32_t len{0};
+    /// The memory is unmapped on destruction, if true.  Frame sources not
+    /// owning the memory set it to false.
+    bool mapped{true};
     /// Count of bytes with data in the buffer
     v4l2_buffer video_buffer;
     std::uint32_t used() const { return video_buffer.bytesused; }
+    /// The driver marked the data as corrupt (V4L2_BUF_FLAG_ERROR), e.g.,
+    /// after a lost USB packet.  The buffer is returned anyway.
+    bool hasError() const {
+      return (video_buffer.flags & V4L2_BUF_FLAG_ERROR) != 0;
+    }
+    /// The data does not fit into the buffer.  A device buffer filled up to
+    /// the last byte is taken as cut off as well, since an encoded frame
+    /// matching the buffer size exactly is very unlikely.
+    bool truncated() const { return used() > len || (mapped && used() == len); }
     /// Call this when done with the buffered data so it might be
     /// requeued
     inline void done() { state = State::UNUSED; }
@@ -123,6 +145,8 @@ private:
   uint32_t requestBuffer(uint32_t count);
   v4l2_buffer bufferRequest(unsigned long int request, uint32_t index);
   int queue(Mem &mem);
+  /// VIDIOC_G_FMT
+  v4l2_format format() const;
 
   static const uint32_t V4L2_DEFAULT_BUFFER_COUNT{6};
   /// Device path string
@@ -0,0 +1,113 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "h264camera/camera_source.hpp"
+
+#include <system_error>
+
+using namespace std::chrono_literals;
+
+namespace h264camera {
+
+CameraSource::CameraSource(const std::string &dev_path) : mDevice(dev_path) {}
+
+void CameraSource::reopen() {
+  mDevice.reopen();
+  // Fails with EEXIST, which is ignored, unless the camera was attached
+  // again since the last call
+  mDevice.addXuCtrl();
+}
+
+void CameraSource::close() { mDevice.close(); }
+
+bool CameraSource::isOpen() const { return mDevice.isOpen(); }
+
+void CameraSource::configure(const VideoSize &vsize, uint32_t fps) {
+  mDevice.xuEnableSeiHeader(true);
+  mDevice.setFormat(vsize.width, vsize.height, V4L2_PIX_FMT_H264);
+  mDevice.setFramerate(fps);
+}
+
+void CameraSource::start() {
+  if (mReattached && mSettings) {
+    mDevice.xuSetBitrate(mSettings->bitrate);
+    mDevice.xuSetMode(mSettings->mode);
+  }
+  mReattached = false;
+  try {
+    mSettings = Settings{mDevice.xuBitrate(), mDevice.xuMode()};
+  } catch (const std::system_error &) {
+    // Nothing to restore then
+    mSettings.reset();
+  }
+
+  mDevice.mmap();
+  mDevice.streamOn();
+
+  // The camera is mounted upside down in SmartConnect door, so flip it
+  // before sending images.
+  //
+  // Toggle flip option between frames to take effect
+  if (auto frame = mDevice.dequeue(500ms)) {
+    frame->done();
+    mDevice.queue(frame->index);
+  }
+  mDevice.xuSetFlip(false);
+  if (auto frame = mDevice.dequeue(500ms)) {
+    frame->done();
+    mDevice.queue(frame->index);
+  }
+  mDevice.xuSetFlip(true);
+  if (auto frame = mDevice.dequeue(500ms)) {
+    frame->done();
+    mDevice.queue(frame->index);
+  }
+  mDevice.xuResetIFrame();
+}
+
+void CameraSource::stop() { mDevice.streamOff(); }
+
+Device::Mem *CameraSource::dequeue(std::chrono::milliseconds timeout) {
+  return mDevice.dequeue(timeout);
+}
+
+int CameraSource::queue(std::size_t index) { return mDevice.queue(index); }
+
+void CameraSource::requestIFrame() { mDevice.xuResetIFrame(); }
+
+void CameraSource::lockMemory() { mDevice.lockBuffers(); }
+
+void CameraSource::requeue() { mDevice.queue(); }
+
+void CameraSource::restartStream() {
+  mDevice.restartStream();
+  // The frames before the restart are gone
+  mDevice.xuResetIFrame();
+}
+
+const std::string &CameraSource::name() const { return mDevice.path(); }
+
+bool CameraSource::waitUntilAvailable(std::chrono::milliseconds timeout) {
+  if (!mWatch) {
+    mWatch = std::make_unique<DeviceWatch>(mDevice.path());
+  }
+  const bool available = mWatch->waitForDevice(timeout);
+  mReattached = mReattached || available;
+  return available;
+}
+
+} // namespace h264camera
@@ -0,0 +1,250 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "h264camera/capture_file.hpp"
+
+#include "h264camera/annexb.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace h264camera {
+
+namespace {
+constexpr std::size_t WRITE_BUFFER_SIZE = 1 << 20;
+
+void write_all(std::FILE *stream, const void *data, std::size_t size) {
+  if (size > 0 && 1 != std::fwrite(data, size, 1, stream)) {
+    throw std::system_error(errno, std::system_category(),
+                            "capture write failed");
+  }
+}
+} // namespace
+
+CaptureWriter::CaptureWriter(const std::string &path, const VideoSize &vsize,
+                             uint32_t fps, uint32_t pixelformat)
+    : mPath(path), mBuffer(WRITE_BUFFER_SIZE) {
+  mStream = std::fopen(mPath.c_str(), "wb");
+  if (!mStream) {
+    std::stringstream ss;
+    ss << "Cannot create '" << mPath << "'";
+    throw std::system_error(errno, std::system_category(), ss.str());
+  }
+  std::setvbuf(mStream, mBuffer.data(), _IOFBF, mBuffer.size());
+
+  CaptureHeader header;
+  std::memset(&header, 0, sizeof header);
+  std::memcpy(header.magic, CAPTURE_MAGIC, sizeof header.magic);
+  header.version = CAPTURE_VERSION;
+  header.header_size = sizeof header;
+  header.width = vsize.width;
+  header.height = vsize.height;
+  header.fps = fps;
+  header.pixelformat = pixelformat;
+  write_all(mStream, &header, sizeof header);
+  mOffset = sizeof header;
+}
+
+CaptureWriter::~CaptureWriter() {
+  try {
+    close();
+  } catch (const std::exception &) {
+    // Nothing left to do, the file lacks its index
+  }
+}
+
+void CaptureWriter::write(const Device::Mem &frame) {
+  write(frame.ptr, frame.used(), frame.video_buffer);
+}
+
+void CaptureWriter::write(const void *data, std::size_t size,
+                          const v4l2_buffer &buf) {
+  if (!mStream) {
+    throw std::runtime_error("capture file is closed");
+  }
+  CaptureIndexEntry entry;
+  std::memset(&entry, 0, sizeof entry);
+  entry.offset = mOffset;
+  entry.timestamp_us = static_cast<uint64_t>(buf.timestamp.tv_sec) * 1000000 +
+                       static_cast<uint64_t>(buf.timestamp.tv_usec);
+  entry.size = static_cast<uint32_t>(size);
+  entry.sequence = buf.sequence;
+  entry.flags = buf.flags;
+  entry.keyframe =
+      is_keyframe(static_cast<const uint8_t *>(data), size, buf.flags);
+  write_all(mStream, data, size);
+  mOffset += size;
+  mIndex.push_back(entry);
+}
+
+void CaptureWriter::close() {
+  if (!mStream) {
+    return;
+  }
+  // Link the key frames in both directions
+  uint32_t prev = CAPTURE_NO_FRAME;
+  for (std::size_t idx = 0; idx < mIndex.size(); ++idx) {
+    if (mIndex[idx].keyframe) {
+      prev = static_cast<uint32_t>(idx);
+    }
+    mIndex[idx].prev_keyframe = prev;
+  }
+  uint32_t next = CAPTURE_NO_FRAME;
+  for (std::size_t idx = mIndex.size(); idx-- > 0;) {
+    mIndex[idx].next_keyframe = next;
+    if (mIndex[idx].keyframe) {
+      next = static_cast<uint32_t>(idx);
+    }
+  }
+
+  CaptureTrailer trailer;
+  std::memset(&trailer, 0, sizeof trailer);
+  std::memcpy(trailer.magic, CAPTURE_INDEX_MAGIC, sizeof trailer.magic);
+  trailer.index_offset = mOffset;
+  trailer.frame_count = mIndex.size();
+
+  auto stream = mStream;
+  mStream = nullptr;
+  try {
+    write_all(stream, mIndex.data(),
+              mIndex.size() * sizeof(CaptureIndexEntry));
+    write_all(stream, &trailer, sizeof trailer);
+  } catch (...) {
+    std::fclose(stream);
+    throw;
+  }
+  if (0 != std::fclose(stream)) {
+    throw std::system_error(errno, std::system_category(),
+                            "capture close failed");
+  }
+}
+
+CaptureReader::CaptureReader(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (-1 == fd) {
+    std::stringstream ss;
+    ss << "Cannot open '" << path << "'";
+    throw std::system_error(errno, std::system_category(), ss.str());
+  }
+  struct stat st;
+  if (-1 == ::fstat(fd, &st)) {
+    auto err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::system_category(), "capture stat failed");
+  }
+  mSize = static_cast<std::size_t>(st.st_size);
+  if (mSize < sizeof(CaptureHeader) + sizeof(CaptureTrailer)) {
+    ::close(fd);
+    throw std::runtime_error("capture file too small");
+  }
+  void *ptr = ::mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+  auto err = errno;
+  ::close(fd);
+  if (ptr == MAP_FAILED) {
+    throw std::system_error(err, std::system_category(), "capture mmap failed");
+  }
+  mData = static_cast<const uint8_t *>(ptr);
+
+  mHeader = reinterpret_cast<const CaptureHeader *>(mData);
+  auto trailer = reinterpret_cast<const CaptureTrailer *>(
+      mData + mSize - sizeof(CaptureTrailer));
+  const char *error = nullptr;
+  // Bytes before the trailer, checked without any sum that might overflow
+  const uint64_t end = mSize - sizeof(CaptureTrailer);
+  if (0 != std::memcmp(mHeader->magic, CAPTURE_MAGIC, sizeof CAPTURE_MAGIC) ||
+      mHeader->version != CAPTURE_VERSION) {
+    error = "not a capture file";
+  } else if (0 != std::memcmp(trailer->magic, CAPTURE_INDEX_MAGIC,
+                              sizeof CAPTURE_INDEX_MAGIC)) {
+    error = "capture file without index, it was not closed";
+  } else if (mHeader->header_size < sizeof(CaptureHeader) ||
+             mHeader->header_size > trailer->index_offset ||
+             trailer->index_offset > end ||
+             (end - trailer->index_offset) % sizeof(CaptureIndexEntry) != 0 ||
+             (end - trailer->index_offset) / sizeof(CaptureIndexEntry) !=
+                 trailer->frame_count) {
+    error = "capture file index is corrupt";
+  } else {
+    auto index = reinterpret_cast<const CaptureIndexEntry *>(
+        mData + trailer->index_offset);
+    const uint64_t count = trailer->frame_count;
+    auto valid_link = [count](uint32_t frame) {
+      return frame == CAPTURE_NO_FRAME || frame < count;
+    };
+    for (uint64_t idx = 0; idx < count && !error; ++idx) {
+      const auto &entry = index[idx];
+      if (entry.offset < mHeader->header_size ||
+          entry.offset > trailer->index_offset ||
+          entry.size > trailer->index_offset - entry.offset ||
+          !valid_link(entry.prev_keyframe) ||
+          !valid_link(entry.next_keyframe)) {
+        error = "capture file index entry is corrupt";
+      }
+    }
+  }
+  if (error) {
+    ::munmap(const_cast<uint8_t *>(mData), mSize);
+    throw std::runtime_error(error);
+  }
+  mIndex = reinterpret_cast<const CaptureIndexEntry *>(mData +
+                                                       trailer->index_offset);
+  mFrameCount = trailer->frame_count;
+  ::madvise(const_cast<uint8_t *>(mData), mSize, MADV_WILLNEED);
+}
+
+CaptureReader::~CaptureReader() {
+  ::munmap(const_cast<uint8_t *>(mData), mSize);
+}
+
+bool CaptureReader::probe(const std::string &path) {
+  char magic[sizeof CAPTURE_MAGIC];
+  auto stream = std::fopen(path.c_str(), "rb");
+  if (!stream) {
+    return false;
+  }
+  bool rv = 1 == std::fread(magic, sizeof magic, 1, stream) &&
+            0 == std::memcmp(magic, CAPTURE_MAGIC, sizeof magic);
+  std::fclose(stream);
+  return rv;
+}
+
+const CaptureIndexEntry &CaptureReader::entry(std::size_t frame) const {
+  if (frame >= mFrameCount) {
+    throw std::out_of_range("capture frame out of range");
+  }
+  return mIndex[frame];
+}
+
+const uint8_t *CaptureReader::data(std::size_t frame) const {
+  return mData + entry(frame).offset;
+}
+
+uint32_t CaptureReader::keyframeAtOrBefore(std::size_t frame) const {
+  return entry(frame).prev_keyframe;
+}
+
+uint32_t CaptureReader::keyframeAfter(std::size_t frame) const {
+  return entry(frame).next_keyframe;
+}
+
+} // namespace h264camera
@@ -0,0 +1,81 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "h264camera/device_watch.hpp"
+
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace h264camera {
+
+DeviceWatch::DeviceWatch(const std::string &path) : mPath(path) {
+  const auto slash = path.rfind('/');
+  const std::string dir =
+      (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+  mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (mFd < 0) {
+    throw std::system_error(errno, std::system_category(), "inotify_init1");
+  }
+  // Any change of the directory is a reason to look again, the events of
+  // udev differ between node and symlink
+  const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM |
+                        IN_ATTRIB | IN_ONLYDIR;
+  if (inotify_add_watch(mFd, dir.c_str(), mask) < 0) {
+    const int error = errno;
+    ::close(mFd);
+    throw std::system_error(error, std::system_category(), "Watching " + dir);
+  }
+}
+
+DeviceWatch::~DeviceWatch() { ::close(mFd); }
+
+bool DeviceWatch::exists() const { return ::access(mPath.c_str(), F_OK) == 0; }
+
+bool DeviceWatch::waitForDevice(std::chrono::milliseconds timeout) {
+  return waitFor(true, timeout);
+}
+
+bool DeviceWatch::waitForRemoval(std::chrono::milliseconds timeout) {
+  return waitFor(false, timeout);
+}
+
+bool DeviceWatch::waitFor(bool present, std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (exists() != present) {
+    const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+      return false;
+    }
+    pollfd fd{mFd, POLLIN, 0};
+    if (::poll(&fd, 1, static_cast<int>(remaining.count())) < 0 &&
+        errno != EINTR) {
+      throw std::system_error(errno, std::system_category(), "inotify poll");
+    }
+    // The events themselves do not matter, only that something changed
+    alignas(inotify_event) char buffer[4096];
+    while (::read(mFd, buffer, sizeof buffer) > 0) {
+    }
+  }
+  return true;
+}
+
+} // namespace h264camera
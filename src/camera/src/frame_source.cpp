@@ -0,0 +1,45 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "h264camera/frame_source.hpp"
+
+#include "h264camera/camera_source.hpp"
+#include "h264camera/replay_source.hpp"
+
+namespace h264camera {
+
+namespace {
+bool starts_with(const std::string &str, const std::string &prefix) {
+  return str.compare(0, prefix.size(), prefix) == 0;
+}
+} // namespace
+
+std::unique_ptr<FrameSource> make_frame_source(const std::string &name) {
+  const std::string replay = "replay:";
+  const std::string replay_max = "replay-max:";
+  if (starts_with(name, replay)) {
+    return std::make_unique<ReplaySource>(name, name.substr(replay.size()),
+                                          ReplaySource::Speed::REALTIME);
+  }
+  if (starts_with(name, replay_max)) {
+    return std::make_unique<ReplaySource>(name, name.substr(replay_max.size()),
+                                          ReplaySource::Speed::MAX);
+  }
+  return std::make_unique<CameraSource>(name);
+}
+
+} // namespace h264camera
@@ -0,0 +1,63 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "h264camera/preview_source.hpp"
+
+namespace h264camera {
+
+bool preview_frame_complete(const Device::Mem &mem, uint32_t pixelformat,
+                            uint32_t sizeimage) {
+  if (mem.hasError() || mem.used() == 0 || mem.used() > mem.len) {
+    return false;
+  }
+  if (pixelformat == V4L2_PIX_FMT_YUYV) {
+    return mem.used() >= sizeimage;
+  }
+  return !mem.truncated();
+}
+
+PreviewSource::PreviewSource(const std::string &dev_path, uint32_t pixelformat)
+    : mDevice(dev_path), mPixelformat(pixelformat) {}
+
+void PreviewSource::reopen() { mDevice.reopen(); }
+
+void PreviewSource::close() { mDevice.close(); }
+
+bool PreviewSource::isOpen() const { return mDevice.isOpen(); }
+
+void PreviewSource::configure(const VideoSize &vsize, uint32_t fps) {
+  mDevice.setFormat(vsize.width, vsize.height, mPixelformat);
+  mDevice.setFramerate(fps);
+  mSizeimage = mDevice.sizeimage();
+}
+
+void PreviewSource::start() {
+  mDevice.mmap();
+  mDevice.streamOn();
+}
+
+void PreviewSource::stop() { mDevice.streamOff(); }
+
+Device::Mem *PreviewSource::dequeue(std::chrono::milliseconds timeout) {
+  return mDevice.dequeue(timeout);
+}
+
+int PreviewSource::queue(std::size_t index) { return mDevice.queue(index); }
+
+const std::string &PreviewSource::name() const { return mDevice.path(); }
+
+} // namespace h264camera
@@ -0,0 +1,276 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "h264camera/replay_source.hpp"
+
+#include "h264camera/annexb.hpp"
+#include "h264camera/capture_file.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+namespace h264camera {
+
+ReplaySource::ReplaySource(const std::string &name, const std::string &file,
+                           Speed speed)
+    : mName(name), mFile(file), mSpeed(speed) {
+  struct stat st;
+  if (-1 == ::stat(mFile.c_str(), &st)) {
+    std::stringstream ss;
+    ss << "Cannot identify '" << mFile << "'";
+    throw std::system_error(errno, std::system_category(), ss.str());
+  }
+}
+
+ReplaySource::~ReplaySource() { close(); }
+
+void ReplaySource::reopen() {
+  close();
+  if (CaptureReader::probe(mFile)) {
+    mReader = std::make_unique<CaptureReader>(mFile);
+    mData = mReader->fileData();
+    mSize = mReader->fileSize();
+    indexCapture();
+  } else {
+    index();
+  }
+  if (mFrames.empty()) {
+    close();
+    std::stringstream ss;
+    ss << "No H.264 frames found in '" << mFile << "'";
+    throw std::runtime_error(ss.str());
+  }
+  mPosition = 0;
+  mSequence = 0;
+}
+
+// Map a raw Annex-B file and find the frames
+void ReplaySource::index() {
+  int fd = ::open(mFile.c_str(), O_RDONLY);
+  if (-1 == fd) {
+    throw std::system_error(errno, std::system_category(),
+                            "replay open failed");
+  }
+  struct stat st;
+  if (-1 == ::fstat(fd, &st)) {
+    auto err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::system_category(), "replay stat failed");
+  }
+  mSize = static_cast<std::size_t>(st.st_size);
+  void *ptr = MAP_FAILED;
+  if (mSize > 0) {
+    ptr = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  auto err = errno;
+  ::close(fd);
+  if (ptr == MAP_FAILED) {
+    mSize = 0;
+    throw std::system_error(err, std::system_category(), "replay mmap failed");
+  }
+  ::madvise(ptr, mSize, MADV_WILLNEED);
+  mData = static_cast<const uint8_t *>(ptr);
+
+  // Group the NALUs of the recording into access units.  A new access unit
+  // starts with the first NALU after a slice, which is no slice or a slice
+  // with first_mb_in_slice equal to zero.
+  Frame cur{0, 0, false};
+  bool has_frame = false;
+  bool in_vcl = false;
+  mFrames.clear();
+  for_each_nalu(mData, mSize, [&](std::size_t start, std::size_t header) {
+    const uint8_t type = mData[header] & 0x1F;
+    const bool vcl = type >= 1 && type <= 5;
+    const bool first_slice =
+        vcl && header + 1 < mSize && (mData[header + 1] & 0x80);
+    if (in_vcl && (!vcl || first_slice)) {
+      cur.size = start - cur.offset;
+      mFrames.push_back(cur);
+      cur = Frame{start, 0, false};
+      in_vcl = false;
+    }
+    if (!has_frame) {
+      cur.offset = start;
+      has_frame = true;
+    }
+    if (vcl) {
+      in_vcl = true;
+      cur.idr = cur.idr || type == 5;
+    }
+  });
+  if (has_frame && in_vcl) {
+    cur.size = mSize - cur.offset;
+    mFrames.push_back(cur);
+  }
+}
+
+void ReplaySource::close() {
+  mStreaming = false;
+  mSlots.clear();
+  mFrames.clear();
+  if (mReader) {
+    mReader.reset();
+  } else if (mData) {
+    ::munmap(const_cast<uint8_t *>(mData), mSize);
+  }
+  mData = nullptr;
+  mSize = 0;
+}
+
+bool ReplaySource::isOpen() const { return mData != nullptr; }
+
+void ReplaySource::configure(const VideoSize &, uint32_t fps) {
+  if (fps > 0) {
+    mInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::seconds(1)) /
+                fps;
+  }
+}
+
+void ReplaySource::start() {
+  if (!isOpen()) {
+    throw std::runtime_error("replay source is not open");
+  }
+  mSlots.clear();
+  mSlots.reserve(REPLAY_BUFFER_COUNT);
+  for (std::uint32_t index = 0; index < REPLAY_BUFFER_COUNT; ++index) {
+    mSlots.emplace_back(index, nullptr, 0, false);
+    mSlots.back().state = Device::Mem::State::QUEUED;
+  }
+  mNextFrame = std::chrono::steady_clock::now();
+  mStreaming = true;
+}
+
+void ReplaySource::stop() { mStreaming = false; }
+
+Device::Mem *ReplaySource::dequeue(std::chrono::milliseconds timeout) {
+  if (!mStreaming) {
+    throw std::runtime_error("replay source is not streaming");
+  }
+  Device::Mem *slot = nullptr;
+  for (auto &mem : mSlots) {
+    if (mem.isQueued()) {
+      slot = &mem;
+      break;
+    }
+  }
+  if (!slot) {
+    // Like a device without queued buffers, nothing will arrive
+    std::this_thread::sleep_for(timeout);
+    return nullptr;
+  }
+
+  if (mSpeed == Speed::REALTIME) {
+    const auto now = std::chrono::steady_clock::now();
+    if (mNextFrame > now + timeout) {
+      std::this_thread::sleep_for(timeout);
+      return nullptr;
+    }
+    std::this_thread::sleep_until(mNextFrame);
+  }
+
+  if (mSkipToIdr) {
+    mSkipToIdr = false;
+    for (std::size_t cnt = 0; cnt < mFrames.size(); ++cnt) {
+      auto pos = (mPosition + cnt) % mFrames.size();
+      if (mFrames[pos].idr) {
+        mPosition = pos;
+        break;
+      }
+    }
+  }
+
+  const auto &frame = mFrames[mPosition];
+  if (mSpeed == Speed::REALTIME) {
+    // Do not try to catch up after the consumer stalled for a while
+    mNextFrame = std::max(mNextFrame + delayAfter(mPosition),
+                          std::chrono::steady_clock::now());
+  }
+  mPosition = (mPosition + 1) % mFrames.size();
+
+  slot->ptr = const_cast<uint8_t *>(mData + frame.offset);
+  slot->len = static_cast<std::uint32_t>(frame.size);
+  auto &buf = slot->video_buffer;
+  std::memset(&buf, 0, sizeof buf);
+  buf.index = slot->index;
+  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  buf.bytesused = slot->len;
+  buf.length = slot->len;
+  buf.sequence = mSequence++;
+  buf.flags = frame.flags | V4L2_BUF_FLAG_DONE |
+              V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC |
+              (frame.idr ? V4L2_BUF_FLAG_KEYFRAME : V4L2_BUF_FLAG_PFRAME);
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  buf.timestamp.tv_sec = ts.tv_sec;
+  buf.timestamp.tv_usec = ts.tv_nsec / 1000;
+  slot->state = Device::Mem::State::READY;
+  return slot;
+}
+
+int ReplaySource::queue(std::size_t index) {
+  auto &mem = mSlots.at(index);
+  if (!mem.isUnused()) {
+    return 0;
+  }
+  mem.state = Device::Mem::State::QUEUED;
+  return 1;
+}
+
+void ReplaySource::requestIFrame() { mSkipToIdr = true; }
+
+// Use the recorded timing if available and plausible, the frame rate
+// otherwise.
+std::chrono::steady_clock::duration
+ReplaySource::delayAfter(std::size_t pos) const {
+  const auto next = (pos + 1) % mFrames.size();
+  const auto cur_ts = mFrames[pos].timestamp_us;
+  const auto next_ts = mFrames[next].timestamp_us;
+  if (next != 0 && cur_ts != 0 && next_ts > cur_ts &&
+      next_ts - cur_ts < 1000000) {
+    return std::chrono::microseconds(next_ts - cur_ts);
+  }
+  return mInterval;
+}
+
+void ReplaySource::indexCapture() {
+  mFrames.clear();
+  mFrames.reserve(mReader->frameCount());
+  for (std::size_t idx = 0; idx < mReader->frameCount(); ++idx) {
+    const auto &entry = mReader->entry(idx);
+    Frame frame{entry.offset, entry.size, entry.keyframe != 0};
+    frame.timestamp_us = entry.timestamp_us;
+    // Keep error and similar flags, the rest is set on dequeue
+    frame.flags = entry.flags & ~(V4L2_BUF_FLAG_KEYFRAME |
+                                  V4L2_BUF_FLAG_PFRAME | V4L2_BUF_FLAG_BFRAME |
+                                  V4L2_BUF_FLAG_TIMESTAMP_MASK |
+                                  V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_MAPPED);
+    mFrames.push_back(frame);
+  }
+}
+
+} // namespace h264camera
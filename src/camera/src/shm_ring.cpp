@@ -0,0 +1,433 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "h264camera/shm_ring.hpp"
+
+#include "h264camera/annexb.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace h264camera {
+
+namespace {
+
+constexpr std::size_t SLOT_ALIGN{64};
+
+[[noreturn]] void throw_errno(const std::string &what) {
+  throw std::system_error(errno, std::system_category(), what);
+}
+
+sockaddr_un make_address(const std::string &name, socklen_t &len) {
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  // Abstract namespace, starts with a zero byte and vanishes with the socket
+  const auto socket_name = ShmPublisher::socketName(name);
+  const auto size = std::min(socket_name.size(), sizeof addr.sun_path - 1);
+  std::memcpy(addr.sun_path + 1, socket_name.data(), size);
+  len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + size);
+  return addr;
+}
+
+void close_fd(int &fd) {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+/// The peer of *socket* runs as the user or the group of this process or as
+/// root, anybody else must not see the camera
+bool peer_allowed(int socket) {
+  ucred cred;
+  socklen_t len = sizeof cred;
+  if (::getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+    return false;
+  }
+  return cred.uid == 0 || cred.uid == ::geteuid() || cred.gid == ::getegid();
+}
+
+} // namespace
+
+std::string ShmPublisher::socketName(const std::string &name) {
+  return "elph264-shm-" + name;
+}
+
+ShmPublisher::ShmPublisher(const std::string &name, uint32_t slot_count,
+                           uint32_t max_frame_size)
+    : mName(name) {
+  if (slot_count < 2 || max_frame_size == 0) {
+    throw std::invalid_argument("shm ring needs 2 slots and a frame size");
+  }
+  const std::size_t slot_size =
+      (sizeof(ShmSlot) + max_frame_size + SLOT_ALIGN - 1) / SLOT_ALIGN *
+      SLOT_ALIGN;
+  mSize = sizeof(ShmRingHeader) + slot_count * slot_size;
+
+  mMemFd = memfd_create(("elph264-" + name).c_str(),
+                        MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (mMemFd < 0) {
+    throw_errno("memfd_create");
+  }
+  if (ftruncate(mMemFd, static_cast<off_t>(mSize)) < 0) {
+    close_fd(mMemFd);
+    throw_errno("ftruncate");
+  }
+  auto data = ::mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     mMemFd, 0);
+  if (data == MAP_FAILED) {
+    close_fd(mMemFd);
+    throw_errno("mmap shm ring");
+  }
+  // Subscribers get the memfd as well, they must neither write nor resize
+  // it.  The mapping above stays writable.
+  if (::fcntl(mMemFd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE |
+                  F_SEAL_SEAL) < 0) {
+    const int error = errno;
+    ::munmap(data, mSize);
+    close_fd(mMemFd);
+    throw std::system_error(error, std::system_category(), "seal shm ring");
+  }
+  mData = static_cast<uint8_t *>(data);
+
+  // The memfd starts zeroed, which is generation 0 for every slot
+  mHeader = new (mData) ShmRingHeader;
+  std::memcpy(mHeader->magic, SHM_RING_MAGIC, sizeof mHeader->magic);
+  mHeader->version = SHM_RING_VERSION;
+  mHeader->header_size = sizeof(ShmRingHeader);
+  mHeader->slot_count = slot_count;
+  mHeader->slot_size = static_cast<uint32_t>(slot_size);
+  mHeader->write_index.store(0, std::memory_order_release);
+  for (uint32_t idx = 0; idx < slot_count; ++idx) {
+    new (slot(idx)) ShmSlot{};
+  }
+
+  socklen_t len;
+  const auto addr = make_address(name, len);
+  mListenFd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  mStopFd = eventfd(0, EFD_CLOEXEC);
+  if (mListenFd < 0 || mStopFd < 0 ||
+      ::bind(mListenFd, reinterpret_cast<const sockaddr *>(&addr), len) < 0 ||
+      ::listen(mListenFd, 8) < 0) {
+    const int error = errno;
+    close_fd(mListenFd);
+    close_fd(mStopFd);
+    ::munmap(mData, mSize);
+    close_fd(mMemFd);
+    throw std::system_error(error, std::system_category(),
+                            "shm ring socket " + name);
+  }
+  mServeThread = std::thread(&ShmPublisher::serveLoop, this);
+}
+
+ShmPublisher::~ShmPublisher() {
+  const uint64_t one{1};
+  if (::write(mStopFd, &one, sizeof one) < 0) {
+    // Nothing sensible to do, the join would hang
+    std::terminate();
+  }
+  mServeThread.join();
+  for (auto &subscriber : mSubscribers) {
+    close_fd(subscriber.socket);
+    close_fd(subscriber.event);
+  }
+  close_fd(mListenFd);
+  close_fd(mStopFd);
+  ::munmap(mData, mSize);
+  close_fd(mMemFd);
+}
+
+ShmSlot *ShmPublisher::slot(uint64_t index) {
+  return reinterpret_cast<ShmSlot *>(
+      mData + sizeof(ShmRingHeader) +
+      (index % mHeader->slot_count) * mHeader->slot_size);
+}
+
+bool ShmPublisher::publish(const Device::Mem &frame) {
+  return publish(frame.ptr, frame.used(), frame.video_buffer);
+}
+
+bool ShmPublisher::publish(const void *data, std::size_t size,
+                           const v4l2_buffer &buf) {
+  if (size > mHeader->slot_size - sizeof(ShmSlot)) {
+    ++mOversized;
+    return false;
+  }
+  const auto index = mHeader->write_index.load(std::memory_order_relaxed);
+  auto target = slot(index);
+  auto bytes = static_cast<const uint8_t *>(data);
+
+  target->generation.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  target->timestamp_us = static_cast<uint64_t>(buf.timestamp.tv_sec) * 1000000 +
+                         static_cast<uint64_t>(buf.timestamp.tv_usec);
+  target->sequence = buf.sequence;
+  target->flags = buf.flags;
+  target->size = static_cast<uint32_t>(size);
+  target->keyframe = is_keyframe(bytes, size, buf.flags);
+  std::memcpy(reinterpret_cast<uint8_t *>(target + 1), bytes, size);
+  target->generation.store(2 * index + 2, std::memory_order_release);
+  mHeader->write_index.store(index + 1, std::memory_order_release);
+
+  const uint64_t one{1};
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (const auto &subscriber : mSubscribers) {
+    // Fails only if the counter is about to overflow, the reader is
+    // signalled anyway
+    (void)!::write(subscriber.event, &one, sizeof one);
+  }
+  return true;
+}
+
+std::size_t ShmPublisher::subscribers() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mSubscribers.size();
+}
+
+uint64_t ShmPublisher::published() const {
+  return mHeader->write_index.load(std::memory_order_acquire);
+}
+
+void ShmPublisher::serveLoop() {
+  std::vector<pollfd> fds;
+  while (true) {
+    fds.clear();
+    fds.push_back({mStopFd, POLLIN, 0});
+    fds.push_back({mListenFd, POLLIN, 0});
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (const auto &subscriber : mSubscribers) {
+        fds.push_back({subscriber.socket, POLLIN, 0});
+      }
+    }
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    if (fds[0].revents) {
+      return;
+    }
+
+    // Subscribers never send anything, so any event is a hang up
+    for (std::size_t idx = 2; idx < fds.size(); ++idx) {
+      if (!fds[idx].revents) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto it = std::find_if(
+          mSubscribers.begin(), mSubscribers.end(),
+          [&](const Subscriber &sub) { return sub.socket == fds[idx].fd; });
+      if (it != mSubscribers.end()) {
+        close_fd(it->socket);
+        close_fd(it->event);
+        mSubscribers.erase(it);
+      }
+    }
+
+    if (fds[1].revents & POLLIN) {
+      Subscriber subscriber;
+      subscriber.socket = ::accept4(mListenFd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (subscriber.socket < 0) {
+        continue;
+      }
+      if (!peer_allowed(subscriber.socket)) {
+        close_fd(subscriber.socket);
+        continue;
+      }
+      subscriber.event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+      // Pass memfd and eventfd along with a single byte of payload
+      char byte{0};
+      iovec iov{&byte, 1};
+      alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+      msghdr msg;
+      std::memset(&msg, 0, sizeof msg);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof control;
+      auto cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+      const int fds_to_send[2] = {mMemFd, subscriber.event};
+      std::memcpy(CMSG_DATA(cmsg), fds_to_send, sizeof fds_to_send);
+      if (subscriber.event < 0 || ::sendmsg(subscriber.socket, &msg, 0) < 0) {
+        close_fd(subscriber.socket);
+        close_fd(subscriber.event);
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(mMutex);
+      mSubscribers.push_back(subscriber);
+    }
+  }
+}
+
+ShmSubscriber::ShmSubscriber(const std::string &name, uint32_t max_lag) {
+  socklen_t len;
+  const auto addr = make_address(name, len);
+  mSocket = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (mSocket < 0) {
+    throw_errno("shm subscriber socket");
+  }
+  if (::connect(mSocket, reinterpret_cast<const sockaddr *>(&addr), len) < 0) {
+    const int error = errno;
+    close_fd(mSocket);
+    throw std::system_error(error, std::system_category(),
+                            "No shm ring " + name);
+  }
+
+  char byte;
+  iovec iov{&byte, 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof msg);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof control;
+  int fds[2] = {-1, -1};
+  if (::recvmsg(mSocket, &msg, MSG_CMSG_CLOEXEC) > 0) {
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+      std::memcpy(fds, CMSG_DATA(cmsg), sizeof fds);
+    }
+  }
+  int mem_fd = fds[0];
+  mEventFd = fds[1];
+  struct stat st;
+  // Without the seal, the publisher might truncate the mapping
+  if (mem_fd < 0 || mEventFd < 0 || fstat(mem_fd, &st) < 0 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(ShmRingHeader) ||
+      !(::fcntl(mem_fd, F_GET_SEALS) & F_SEAL_SHRINK)) {
+    close_fd(mem_fd);
+    close_fd(mEventFd);
+    close_fd(mSocket);
+    throw std::runtime_error("Invalid shm ring " + name);
+  }
+  mSize = static_cast<std::size_t>(st.st_size);
+  auto data = ::mmap(nullptr, mSize, PROT_READ, MAP_SHARED, mem_fd, 0);
+  close_fd(mem_fd);
+  if (data == MAP_FAILED) {
+    close_fd(mEventFd);
+    close_fd(mSocket);
+    throw_errno("mmap shm ring");
+  }
+  mData = static_cast<const uint8_t *>(data);
+  mHeader = reinterpret_cast<const ShmRingHeader *>(mData);
+  if (std::memcmp(mHeader->magic, SHM_RING_MAGIC, sizeof mHeader->magic) !=
+          0 ||
+      mHeader->version != SHM_RING_VERSION || mHeader->slot_count == 0 ||
+      mHeader->slot_size < sizeof(ShmSlot) ||
+      sizeof(ShmRingHeader) +
+              std::size_t{mHeader->slot_count} * mHeader->slot_size >
+          mSize) {
+    ::munmap(const_cast<uint8_t *>(mData), mSize);
+    close_fd(mEventFd);
+    close_fd(mSocket);
+    throw std::runtime_error("Unsupported shm ring " + name);
+  }
+
+  const uint64_t limit = mHeader->slot_count - 1;
+  mMaxLag = (max_lag == 0) ? mHeader->slot_count / 2
+                           : std::min<uint64_t>(max_lag, limit);
+  mNext = mHeader->write_index.load(std::memory_order_acquire);
+}
+
+ShmSubscriber::~ShmSubscriber() {
+  ::munmap(const_cast<uint8_t *>(mData), mSize);
+  close_fd(mEventFd);
+  close_fd(mSocket);
+}
+
+const ShmSlot *ShmSubscriber::slot(uint64_t index) const {
+  return reinterpret_cast<const ShmSlot *>(
+      mData + sizeof(ShmRingHeader) +
+      (index % mHeader->slot_count) * mHeader->slot_size);
+}
+
+bool ShmSubscriber::wait(std::chrono::milliseconds timeout) {
+  if (mNext < mHeader->write_index.load(std::memory_order_acquire)) {
+    return true;
+  }
+  pollfd fd{mEventFd, POLLIN, 0};
+  if (::poll(&fd, 1, static_cast<int>(timeout.count())) > 0) {
+    uint64_t count;
+    (void)!::read(mEventFd, &count, sizeof count);
+  }
+  return mNext < mHeader->write_index.load(std::memory_order_acquire);
+}
+
+std::optional<ShmFrame> ShmSubscriber::next() {
+  while (true) {
+    const auto written = mHeader->write_index.load(std::memory_order_acquire);
+    if (mNext >= written) {
+      return std::nullopt;
+    }
+    if (written - mNext > mMaxLag) {
+      mDropped += written - mNext - mMaxLag;
+      mNext = written - mMaxLag;
+    }
+
+    const auto index = mNext++;
+    const auto source = slot(index);
+    if (source->generation.load(std::memory_order_acquire) !=
+        2 * index + 2) {
+      // Overwritten since reading the write index
+      ++mDropped;
+      continue;
+    }
+    ShmFrame frame;
+    frame.index = index;
+    frame.data = reinterpret_cast<const uint8_t *>(source + 1);
+    frame.size = source->size;
+    frame.timestamp_us = source->timestamp_us;
+    frame.sequence = source->sequence;
+    frame.flags = source->flags;
+    frame.keyframe = source->keyframe != 0;
+    if (frame.size > mHeader->slot_size - sizeof(ShmSlot) || !valid(frame)) {
+      ++mDropped;
+      continue;
+    }
+    return frame;
+  }
+}
+
+bool ShmSubscriber::valid(const ShmFrame &frame) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot(frame.index)->generation.load(std::memory_order_relaxed) ==
+         2 * frame.index + 2;
+}
+
+} // namespace h264camera
@@ -0,0 +1,207 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "h264camera/thread_policy.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace h264camera {
+
+namespace {
+
+int parse_int(const std::string &text, const std::string &item) {
+  std::size_t end{0};
+  int value{0};
+  try {
+    value = std::stoi(text, &end);
+  } catch (const std::exception &) {
+    end = 0;
+  }
+  if (text.empty() || end != text.size()) {
+    throw std::invalid_argument("invalid number in " + item);
+  }
+  return value;
+}
+
+std::vector<int> parse_cpus(const std::string &text, const std::string &item) {
+  std::vector<int> cpus;
+  std::stringstream ss(text);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    const auto dash = range.find('-');
+    const int first = parse_int(range.substr(0, dash), item);
+    const int last = (dash == std::string::npos)
+                         ? first
+                         : parse_int(range.substr(dash + 1), item);
+    if (first < 0 || last < first || last >= CPU_SETSIZE) {
+      throw std::invalid_argument("invalid CPU range in " + item);
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  if (cpus.empty()) {
+    throw std::invalid_argument("no CPU in " + item);
+  }
+  return cpus;
+}
+
+std::string error_text(const char *what, int error) {
+  std::string text = what;
+  text += ": ";
+  text += std::strerror(error);
+  return text;
+}
+
+cpu_set_t startup_affinity() {
+  cpu_set_t set;
+  // The process id names the main thread
+  if (-1 == ::sched_getaffinity(::getpid(), sizeof set, &set)) {
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return set;
+}
+
+/// CPUs of the process at startup, a policy without CPUs returns to them
+const cpu_set_t gStartupAffinity = startup_affinity();
+
+} // namespace
+
+bool ThreadPolicy::isDefault() const {
+  return scheduler == Scheduler::OTHER && nice == 0 && cpus.empty() &&
+         !lock_memory;
+}
+
+ThreadPolicy parse_thread_policy(const std::string &text) {
+  ThreadPolicy policy;
+  std::stringstream ss(text);
+  std::string item;
+  while (ss >> item) {
+    const auto colon = item.find(':');
+    const auto key = item.substr(0, colon);
+    const auto value =
+        (colon == std::string::npos) ? std::string{} : item.substr(colon + 1);
+    if (key == "other" && value.empty()) {
+      policy.scheduler = ThreadPolicy::Scheduler::OTHER;
+    } else if (key == "nice") {
+      policy.nice = parse_int(value, item);
+      if (policy.nice < -20 || policy.nice > 19) {
+        throw std::invalid_argument("nice value out of range in " + item);
+      }
+    } else if (key == "fifo" || key == "rr") {
+      policy.scheduler = (key == "fifo") ? ThreadPolicy::Scheduler::FIFO
+                                         : ThreadPolicy::Scheduler::RR;
+      policy.priority = parse_int(value, item);
+      if (policy.priority < 1 || policy.priority > 99) {
+        throw std::invalid_argument("priority out of range in " + item);
+      }
+    } else if (key == "cpus") {
+      policy.cpus = parse_cpus(value, item);
+    } else if (key == "mlock" && value.empty()) {
+      policy.lock_memory = true;
+    } else {
+      throw std::invalid_argument("unknown item " + item);
+    }
+  }
+  return policy;
+}
+
+std::string to_string(const ThreadPolicy &policy) {
+  std::stringstream ss;
+  switch (policy.scheduler) {
+  case ThreadPolicy::Scheduler::OTHER:
+    ss << "other";
+    if (policy.nice != 0) {
+      ss << " nice:" << policy.nice;
+    }
+    break;
+  case ThreadPolicy::Scheduler::FIFO:
+    ss << "fifo:" << policy.priority;
+    break;
+  case ThreadPolicy::Scheduler::RR:
+    ss << "rr:" << policy.priority;
+    break;
+  }
+  if (!policy.cpus.empty()) {
+    ss << " cpus:";
+    for (std::size_t idx = 0; idx < policy.cpus.size(); ++idx) {
+      ss << (idx ? "," : "") << policy.cpus[idx];
+    }
+  }
+  if (policy.lock_memory) {
+    ss << " mlock";
+  }
+  return ss.str();
+}
+
+std::vector<std::string> apply_thread_policy(const ThreadPolicy &policy) {
+  std::vector<std::string> errors;
+
+  sched_param param{};
+  int scheduler{SCHED_OTHER};
+  switch (policy.scheduler) {
+  case ThreadPolicy::Scheduler::OTHER:
+    break;
+  case ThreadPolicy::Scheduler::FIFO:
+    scheduler = SCHED_FIFO;
+    param.sched_priority = policy.priority;
+    break;
+  case ThreadPolicy::Scheduler::RR:
+    scheduler = SCHED_RR;
+    param.sched_priority = policy.priority;
+    break;
+  }
+  if (int error = pthread_setschedparam(pthread_self(), scheduler, &param)) {
+    errors.push_back(error_text("pthread_setschedparam", error) +
+                     " (needs CAP_SYS_NICE or RLIMIT_RTPRIO)");
+  }
+
+  // The nice value is per thread on Linux
+  if (policy.scheduler == ThreadPolicy::Scheduler::OTHER) {
+    const auto tid = static_cast<id_t>(::syscall(SYS_gettid));
+    if (-1 == ::setpriority(PRIO_PROCESS, tid, policy.nice)) {
+      errors.push_back(error_text("setpriority", errno) +
+                       " (needs CAP_SYS_NICE or RLIMIT_NICE)");
+    }
+  }
+
+  // Also without CPUs, the thread may have been pinned by a former policy
+  cpu_set_t set = gStartupAffinity;
+  if (!policy.cpus.empty()) {
+    CPU_ZERO(&set);
+    for (int cpu : policy.cpus) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  if (int error = pthread_setaffinity_np(pthread_self(), sizeof set, &set)) {
+    errors.push_back(error_text("pthread_setaffinity_np", error));
+  }
+  return errors;
+}
+
+} // namespace h264camera
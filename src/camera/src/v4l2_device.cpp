@@ -68,11 +68,14 @@ void Device::close() {
     streamOff();
     mQueuedBuffers = 0;
     mMap.clear();
-    if (-1 == ::close(fd)) {
+    // The descriptor is released even if close fails, e.g., after the
+    // camera was unplugged, so the device can be opened again
+    const int old_fd = fd;
+    fd = -1;
+    if (-1 == ::close(old_fd)) {
       throw std::system_error(errno, std::system_category(),
                               "v4l2 close failed");
     }
-    fd = -1;
   }
 }
 
@@ -139,7 +142,7 @@ void Device::setFramerate(uint32_t framerate) {
   }
 }
 
-VideoSize Device::vsize() {
+v4l2_format Device::format() const {
   struct v4l2_format fmt;
   std::memset(&fmt, 0, sizeof fmt);
   fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -148,9 +151,16 @@ VideoSize Device::vsize() {
     throw std::system_error(errno, std::system_category(),
                             "VIDIOC_G_FMT failed");
   }
+  return fmt;
+}
+
+VideoSize Device::vsize() {
+  const auto fmt = format();
   return {fmt.fmt.pix.width, fmt.fmt.pix.height};
 }
 
+uint32_t Device::sizeimage() { return format().fmt.pix.sizeimage; }
+
 int Device::streamOn() {
   int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   return ioctl(VIDIOC_STREAMON, &type);
@@ -161,6 +171,23 @@ int Device::streamOff() {
   return ioctl(VIDIOC_STREAMOFF, &type);
 }
 
+void Device::restartStream() {
+  if (-1 == streamOff()) {
+    throw std::system_error(errno, std::system_category(),
+                            "VIDIOC_STREAMOFF failed");
+  }
+  // STREAMOFF removes all buffers from the queues of the driver
+  for (auto &mem : mMap) {
+    mem.done();
+  }
+  mQueuedBuffers = 0;
+  queue();
+  if (-1 == streamOn()) {
+    throw std::system_error(errno, std::system_category(),
+                            "VIDIOC_STREAMON failed");
+  }
+}
+
 uint32_t Device::requestBuffer(uint32_t count) {
   struct v4l2_requestbuffers rb;
   std::memset(&rb, 0, sizeof rb);
@@ -215,6 +242,15 @@ void Device::mmap() {
   }
 }
 
+void Device::lockBuffers() {
+  for (const auto &mem : mMap) {
+    if (mem.mapped && -1 == ::mlock(mem.ptr, mem.len)) {
+      throw std::system_error(errno, std::system_category(),
+                              "locking buffers failed");
+    }
+  }
+}
+
 int Device::queue() {
   int count = 0;
   for (auto &mem : mMap) {
@@ -251,13 +287,19 @@ Device::Mem *Device::dequeue(std::chrono::milliseconds timeout) {
   return &mem;
 }
 
-Device::Mem::Mem(std::uint32_t index, void *ptr, std::size_t len)
-    : index(index), ptr(ptr), len(len) {}
+Device::Mem::Mem(std::uint32_t index, void *ptr, std::size_t len,
+                 bool mapped)
+    : index(index), ptr(ptr), len(len), mapped(mapped) {}
 
-Device::Mem::~Mem() { ::munmap(ptr, len); }
+Device::Mem::~Mem() {
+  if (mapped && ptr) {
+    ::munmap(ptr, len);
+  }
+}
 
 Device::Mem::Mem(Mem &&other)
-    : index(other.index), ptr(other.ptr), len(other.len) {
+    : state(other.state), index(other.index), ptr(other.ptr), len(other.len),
+      mapped(other.mapped), video_buffer(other.video_buffer) {
   other.ptr = nullptr;
   other.len = 0;
 }
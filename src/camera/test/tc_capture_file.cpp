@@ -0,0 +1,189 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <h264camera/capture_file.hpp>
+#include <h264camera/replay_source.hpp>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include <catch.hpp>
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+namespace {
+
+const std::vector<uint8_t> key_frame{0, 0, 0, 1, 0x67, 0x42, 0xC0, 0x1F,
+                                     0, 0, 0, 1, 0x65, 0x88, 0x84, 0x21};
+const std::vector<uint8_t> p_frame{0, 0, 0, 1, 0x41, 0x9A, 0x02, 0x03};
+
+v4l2_buffer make_buffer(uint32_t sequence, uint64_t timestamp_us) {
+  v4l2_buffer buf;
+  std::memset(&buf, 0, sizeof buf);
+  buf.sequence = sequence;
+  buf.timestamp.tv_sec = timestamp_us / 1000000;
+  buf.timestamp.tv_usec = timestamp_us % 1000000;
+  buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+  return buf;
+}
+
+/// Write two GOPs of 5 frames with 40ms frame distance
+std::string write_capture() {
+  std::string fname = "capture_file_test.elpcap";
+  CaptureWriter writer(fname, VIDEO_SIZE_VGA, 25);
+  for (uint32_t idx = 0; idx < 10; ++idx) {
+    auto buf = make_buffer(100 + idx, 5000000 + idx * 40000);
+    const auto &data = (idx % 5 == 0) ? key_frame : p_frame;
+    if (idx == 7) {
+      buf.flags |= V4L2_BUF_FLAG_ERROR;
+    }
+    writer.write(data.data(), data.size(), buf);
+  }
+  CHECK(10 == writer.frameCount());
+  writer.close();
+  return fname;
+}
+
+} // namespace
+
+TEST_CASE("Write and read capture file", "[capture]") {
+  auto fname = write_capture();
+  REQUIRE(CaptureReader::probe(fname));
+
+  CaptureReader reader(fname);
+  CHECK(640 == reader.header().width);
+  CHECK(480 == reader.header().height);
+  CHECK(25 == reader.header().fps);
+  CHECK(V4L2_PIX_FMT_H264 == reader.header().pixelformat);
+  REQUIRE(10 == reader.frameCount());
+
+  for (std::size_t idx = 0; idx < reader.frameCount(); ++idx) {
+    const auto &entry = reader.entry(idx);
+    const auto &data = (idx % 5 == 0) ? key_frame : p_frame;
+    CHECK(100 + idx == entry.sequence);
+    CHECK(5000000 + idx * 40000 == entry.timestamp_us);
+    CHECK((idx % 5 == 0) == (entry.keyframe != 0));
+    REQUIRE(data.size() == entry.size);
+    CHECK(0 == std::memcmp(data.data(), reader.data(idx), data.size()));
+  }
+  CHECK(reader.entry(7).flags & V4L2_BUF_FLAG_ERROR);
+
+  SECTION("Seek key frames") {
+    CHECK(0 == reader.keyframeAtOrBefore(0));
+    CHECK(0 == reader.keyframeAtOrBefore(4));
+    CHECK(5 == reader.keyframeAtOrBefore(5));
+    CHECK(5 == reader.keyframeAtOrBefore(9));
+    CHECK(5 == reader.keyframeAfter(0));
+    CHECK(5 == reader.keyframeAfter(3));
+    CHECK(CAPTURE_NO_FRAME == reader.keyframeAfter(5));
+  }
+
+  REQUIRE_THROWS(reader.entry(10));
+  std::remove(fname.c_str());
+}
+
+TEST_CASE("Reject incomplete capture file", "[capture]") {
+  std::string fname = "capture_file_incomplete.elpcap";
+  {
+    CaptureWriter writer(fname, VIDEO_SIZE_VGA, 25);
+    writer.write(key_frame.data(), key_frame.size(), make_buffer(0, 0));
+    // Drop the index by truncating the file after the payload
+    writer.close();
+    REQUIRE(0 == truncate(fname.c_str(), static_cast<off_t>(writer.size())));
+  }
+  CHECK(CaptureReader::probe(fname));
+  CHECK_THROWS(CaptureReader(fname));
+  std::remove(fname.c_str());
+}
+
+TEST_CASE("Reject corrupt capture index", "[capture]") {
+  auto fname = write_capture();
+  const auto size = [&fname] {
+    CaptureReader reader(fname);
+    return reader.fileSize();
+  }();
+  const long trailer = static_cast<long>(size - sizeof(CaptureTrailer));
+  const long index =
+      trailer - 10 * static_cast<long>(sizeof(CaptureIndexEntry));
+  auto patch = [&fname](long pos, const void *data, std::size_t len) {
+    auto stream = std::fopen(fname.c_str(), "r+b");
+    REQUIRE(stream);
+    REQUIRE(0 == std::fseek(stream, pos, SEEK_SET));
+    REQUIRE(1 == std::fwrite(data, len, 1, stream));
+    std::fclose(stream);
+  };
+
+  SECTION("Payload beyond the index") {
+    const uint32_t frame_size{1000};
+    patch(index + offsetof(CaptureIndexEntry, size), &frame_size,
+          sizeof frame_size);
+    CHECK_THROWS(CaptureReader(fname));
+  }
+  SECTION("Payload offset in the header") {
+    const uint64_t offset{16};
+    patch(index + offsetof(CaptureIndexEntry, offset), &offset, sizeof offset);
+    CHECK_THROWS(CaptureReader(fname));
+  }
+  SECTION("Frame count overflowing the index size") {
+    // Multiplied by the entry size, it wraps around to the actual count
+    const uint64_t count = 10 + (uint64_t{1} << 61);
+    patch(trailer + offsetof(CaptureTrailer, frame_count), &count,
+          sizeof count);
+    CHECK_THROWS(CaptureReader(fname));
+  }
+  SECTION("Key frame beyond the index") {
+    const uint32_t keyframe{10};
+    patch(index + offsetof(CaptureIndexEntry, next_keyframe), &keyframe,
+          sizeof keyframe);
+    CHECK_THROWS(CaptureReader(fname));
+  }
+  SECTION("Header size beyond the payload") {
+    const uint32_t header_size = static_cast<uint32_t>(size);
+    patch(offsetof(CaptureHeader, header_size), &header_size,
+          sizeof header_size);
+    CHECK_THROWS(CaptureReader(fname));
+  }
+  std::remove(fname.c_str());
+}
+
+TEST_CASE("Replay capture file", "[capture][replay]") {
+  auto fname = write_capture();
+  ReplaySource source("replay:" + fname, fname);
+  source.reopen();
+  REQUIRE(10 == source.frameCount());
+  source.configure(VIDEO_SIZE_VGA, 5);
+  source.start();
+  const auto begin = std::chrono::steady_clock::now();
+  for (int idx = 0; idx < 6; ++idx) {
+    auto frame = source.dequeue(500ms);
+    REQUIRE(frame);
+    CHECK((idx % 5 == 0) == bool(frame->video_buffer.flags &
+                                  V4L2_BUF_FLAG_KEYFRAME));
+    frame->done();
+    source.queue(frame->index);
+  }
+  // Recorded timing is 40ms per frame and not 200ms as configured.
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  CHECK(elapsed >= 160ms);
+  CHECK(elapsed < 800ms);
+  source.close();
+  std::remove(fname.c_str());
+}
@@ -0,0 +1,81 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <h264camera/device_watch.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+#include <catch.hpp>
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+TEST_CASE("Device watch", "[device_watch]") {
+  char dir_template[] = "/tmp/device_watch_XXXXXX";
+  const std::string dir = mkdtemp(dir_template);
+  const std::string node = dir + "/elp-h264";
+  DeviceWatch watch(node);
+  CHECK(node == watch.path());
+  CHECK_FALSE(watch.exists());
+
+  SECTION("Timeout") {
+    const auto start = std::chrono::steady_clock::now();
+    CHECK_FALSE(watch.waitForDevice(50ms));
+    CHECK(std::chrono::steady_clock::now() - start >= 50ms);
+  }
+
+  SECTION("Appear and vanish") {
+    std::thread plug([&node] {
+      std::this_thread::sleep_for(20ms);
+      std::ofstream{node};
+    });
+    CHECK(watch.waitForDevice(2s));
+    plug.join();
+    CHECK(watch.exists());
+    CHECK(watch.waitForDevice(0ms));
+
+    std::thread unplug([&node] {
+      std::this_thread::sleep_for(20ms);
+      std::remove(node.c_str());
+    });
+    CHECK(watch.waitForRemoval(2s));
+    unplug.join();
+    CHECK_FALSE(watch.exists());
+  }
+
+  SECTION("Symlink of udev") {
+    const std::string target = dir + "/video0";
+    REQUIRE(0 == symlink("video0", node.c_str()));
+    // The link alone is not the device
+    CHECK_FALSE(watch.waitForDevice(20ms));
+    std::thread plug([&target] {
+      std::this_thread::sleep_for(20ms);
+      std::ofstream{target};
+    });
+    CHECK(watch.waitForDevice(2s));
+    plug.join();
+    std::remove(target.c_str());
+    std::remove(node.c_str());
+  }
+
+  rmdir(dir.c_str());
+}
@@ -0,0 +1,82 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <h264camera/camera_source.hpp>
+#include <h264camera/preview_source.hpp>
+
+#include <catch.hpp>
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+constexpr auto dev_path_mjpeg = "/dev/elp-mjpeg";
+constexpr auto dev_path_h264 = "/dev/elp-h264";
+
+TEST_CASE("No preview device", "[preview]") {
+  REQUIRE_THROWS(PreviewSource("no_device"));
+}
+
+TEST_CASE("Complete preview frames", "[preview]") {
+  constexpr uint32_t yuyv_vga{640 * 480 * 2};
+  Device::Mem mem(0, nullptr, yuyv_vga, true);
+  mem.video_buffer = {};
+
+  // A raw frame fills a device buffer of its size
+  mem.video_buffer.bytesused = yuyv_vga;
+  CHECK(preview_frame_complete(mem, V4L2_PIX_FMT_YUYV, yuyv_vga));
+  CHECK_FALSE(preview_frame_complete(mem, V4L2_PIX_FMT_MJPEG, yuyv_vga));
+
+  mem.video_buffer.bytesused = yuyv_vga / 2;
+  CHECK_FALSE(preview_frame_complete(mem, V4L2_PIX_FMT_YUYV, yuyv_vga));
+  CHECK(preview_frame_complete(mem, V4L2_PIX_FMT_MJPEG, yuyv_vga));
+
+  mem.video_buffer.bytesused = 0;
+  CHECK_FALSE(preview_frame_complete(mem, V4L2_PIX_FMT_YUYV, 0));
+  CHECK_FALSE(preview_frame_complete(mem, V4L2_PIX_FMT_MJPEG, 0));
+
+  mem.video_buffer.bytesused = yuyv_vga;
+  mem.video_buffer.flags = V4L2_BUF_FLAG_ERROR;
+  CHECK_FALSE(preview_frame_complete(mem, V4L2_PIX_FMT_YUYV, yuyv_vga));
+}
+
+TEST_CASE("Stream H.264 and preview concurrently", "[preview][device]") {
+  CameraSource camera(dev_path_h264);
+  PreviewSource preview(dev_path_mjpeg);
+
+  camera.reopen();
+  camera.configure(VIDEO_SIZE_720P, 30);
+  preview.reopen();
+  preview.configure(VIDEO_SIZE_VGA, 15);
+  CHECK(preview.vsize() == VIDEO_SIZE_VGA);
+
+  camera.start();
+  preview.start();
+  for (int cnt = 0; cnt < 10; ++cnt) {
+    auto frame = camera.dequeue(500ms);
+    REQUIRE(frame);
+    frame->done();
+    camera.queue(frame->index);
+
+    auto image = preview.dequeue(500ms);
+    REQUIRE(image);
+    CHECK(image->used() > 0);
+    image->done();
+    preview.queue(image->index);
+  }
+  preview.stop();
+  camera.stop();
+}
@@ -0,0 +1,132 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <h264camera/frame_source.hpp>
+#include <h264camera/replay_source.hpp>
+
+#include <cstdio>
+#include <vector>
+
+#include <catch.hpp>
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+namespace {
+
+const std::vector<uint8_t> sps{0, 0, 0, 1, 0x67, 0x42, 0xC0, 0x1F};
+const std::vector<uint8_t> pps{0, 0, 0, 1, 0x68, 0xCE, 0x3C, 0x80};
+const std::vector<uint8_t> idr{0, 0, 0, 1, 0x65, 0x88, 0x84, 0x21};
+const std::vector<uint8_t> slice{0, 0, 0, 1, 0x41, 0x9A, 0x02, 0x03};
+
+/// Write a recording with *gops* times an IDR frame followed by
+/// *p_frames* P-frames.
+std::string write_recording(int gops, int p_frames) {
+  std::string fname = "replay_source_test.h264";
+  auto stream = std::fopen(fname.c_str(), "wb");
+  REQUIRE(stream);
+  for (int gop = 0; gop < gops; ++gop) {
+    for (const auto &nalu : {sps, pps, idr}) {
+      std::fwrite(nalu.data(), nalu.size(), 1, stream);
+    }
+    for (int idx = 0; idx < p_frames; ++idx) {
+      std::fwrite(slice.data(), slice.size(), 1, stream);
+    }
+  }
+  std::fclose(stream);
+  return fname;
+}
+
+} // namespace
+
+TEST_CASE("Replay missing file", "[replay]") {
+  REQUIRE_THROWS(make_frame_source("replay:no_file.h264"));
+}
+
+TEST_CASE("Replay recording", "[replay]") {
+  auto fname = write_recording(2, 4);
+  ReplaySource source("replay-max:" + fname, fname, ReplaySource::Speed::MAX);
+  source.reopen();
+  REQUIRE(source.isOpen());
+  CHECK(10 == source.frameCount());
+  source.configure(VIDEO_SIZE_VGA, 30);
+  source.start();
+
+  SECTION("Frames are in order and start over") {
+    for (int idx = 0; idx < 12; ++idx) {
+      auto frame = source.dequeue(10ms);
+      REQUIRE(frame);
+      CHECK(frame->isReady());
+      CHECK(static_cast<uint32_t>(idx) == frame->video_buffer.sequence);
+      const bool keyframe = frame->video_buffer.flags & V4L2_BUF_FLAG_KEYFRAME;
+      CHECK((idx % 5 == 0) == keyframe);
+      auto data = static_cast<const uint8_t *>(frame->ptr);
+      if (keyframe) {
+        CHECK(sps.size() + pps.size() + idr.size() == frame->used());
+        CHECK(0x67 == data[4]);
+      } else {
+        CHECK(slice.size() == frame->used());
+        CHECK(0x41 == data[4]);
+      }
+      frame->done();
+      source.queue(frame->index);
+    }
+  }
+
+  SECTION("Request IDR") {
+    auto frame = source.dequeue(10ms);
+    REQUIRE(frame);
+    frame->done();
+    source.queue(frame->index);
+    source.requestIFrame();
+    frame = source.dequeue(10ms);
+    REQUIRE(frame);
+    CHECK(frame->video_buffer.flags & V4L2_BUF_FLAG_KEYFRAME);
+    CHECK(1 == frame->video_buffer.sequence);
+  }
+
+  SECTION("Buffers have to be returned") {
+    for (int idx = 0; idx < 6; ++idx) {
+      CHECK(source.dequeue(10ms));
+    }
+    CHECK_FALSE(source.dequeue(10ms));
+  }
+
+  source.stop();
+  source.close();
+  CHECK_FALSE(source.isOpen());
+  std::remove(fname.c_str());
+}
+
+TEST_CASE("Replay in real time", "[replay]") {
+  auto fname = write_recording(1, 9);
+  auto source = make_frame_source("replay:" + fname);
+  source->reopen();
+  source->configure(VIDEO_SIZE_VGA, 50);
+  source->start();
+  const auto begin = std::chrono::steady_clock::now();
+  for (int idx = 0; idx < 6; ++idx) {
+    auto frame = source->dequeue(100ms);
+    REQUIRE(frame);
+    frame->done();
+    source->queue(frame->index);
+  }
+  // 5 intervals of 20 ms after the first frame
+  CHECK(std::chrono::steady_clock::now() - begin >= 100ms);
+  source->close();
+  std::remove(fname.c_str());
+}
@@ -0,0 +1,233 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <h264camera/shm_ring.hpp>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include <catch.hpp>
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+namespace {
+
+/// Ring name unique to the test process, the socket namespace is global
+std::string ring_name(const char *test) {
+  return std::string("test-") + test + "-" + std::to_string(getpid());
+}
+
+v4l2_buffer make_buffer(uint32_t sequence, bool keyframe) {
+  v4l2_buffer buf;
+  std::memset(&buf, 0, sizeof buf);
+  buf.sequence = sequence;
+  buf.timestamp.tv_sec = 1;
+  buf.timestamp.tv_usec = sequence;
+  buf.flags = keyframe ? V4L2_BUF_FLAG_KEYFRAME : 0;
+  return buf;
+}
+
+bool publish(ShmPublisher &ring, uint32_t sequence, bool keyframe = false) {
+  std::vector<uint8_t> data(100 + sequence, static_cast<uint8_t>(sequence));
+  return ring.publish(data.data(), data.size(),
+                      make_buffer(sequence, keyframe));
+}
+
+/// Serve *header* to one subscriber of the ring *name* like a ShmPublisher
+class FakePublisher {
+public:
+  FakePublisher(const std::string &name, const ShmRingHeader &header) {
+    mMemFd = memfd_create("fake-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    REQUIRE(mMemFd >= 0);
+    REQUIRE(sizeof header == ::write(mMemFd, &header, sizeof header));
+    REQUIRE(0 == ::fcntl(mMemFd, F_ADD_SEALS, F_SEAL_SHRINK));
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    const auto socket_name = ShmPublisher::socketName(name);
+    std::memcpy(addr.sun_path + 1, socket_name.data(), socket_name.size());
+    const auto len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) +
+                                            1 + socket_name.size());
+    mListenFd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    REQUIRE(0 == ::bind(mListenFd, reinterpret_cast<sockaddr *>(&addr), len));
+    REQUIRE(0 == ::listen(mListenFd, 1));
+    mThread = std::thread([this] { serve(); });
+  }
+  ~FakePublisher() {
+    mThread.join();
+    ::close(mListenFd);
+    ::close(mMemFd);
+  }
+
+private:
+  void serve() {
+    const int socket = ::accept(mListenFd, nullptr, nullptr);
+    const int event = eventfd(0, EFD_CLOEXEC);
+    char byte{0};
+    iovec iov{&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    msghdr msg;
+    std::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    const int fds[2] = {mMemFd, event};
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+    (void)!::sendmsg(socket, &msg, 0);
+    ::close(event);
+    ::close(socket);
+  }
+
+  int mMemFd{-1};
+  int mListenFd{-1};
+  std::thread mThread;
+};
+
+} // namespace
+
+TEST_CASE("Shared memory ring missing", "[shm]") {
+  REQUIRE_THROWS_AS(ShmSubscriber(ring_name("missing")), std::system_error);
+}
+
+TEST_CASE("Shared memory ring", "[shm]") {
+  ShmPublisher ring(ring_name("ring"), 8, 4096);
+  ShmSubscriber reader(ring.name(), 6);
+  CHECK(8 == reader.slotCount());
+  // Accepted by the serve thread after connect() returned
+  for (int idx = 0; idx < 100 && ring.subscribers() == 0; ++idx) {
+    std::this_thread::sleep_for(1ms);
+  }
+  REQUIRE(1 == ring.subscribers());
+  CHECK_FALSE(reader.next());
+  CHECK_FALSE(reader.wait(1ms));
+
+  SECTION("Frames with metadata") {
+    REQUIRE(publish(ring, 0, true));
+    REQUIRE(publish(ring, 1));
+    REQUIRE(reader.wait(100ms));
+    for (uint32_t seq = 0; seq < 2; ++seq) {
+      auto frame = reader.next();
+      REQUIRE(frame);
+      CHECK(seq == frame->index);
+      CHECK(seq == frame->sequence);
+      CHECK(1000000 + seq == frame->timestamp_us);
+      CHECK((seq == 0) == frame->keyframe);
+      REQUIRE(100 + seq == frame->size);
+      CHECK(seq == frame->data[0]);
+      CHECK(seq == frame->data[frame->size - 1]);
+      CHECK(reader.valid(*frame));
+    }
+    CHECK_FALSE(reader.next());
+    CHECK(0 == reader.dropped());
+    CHECK(2 == ring.published());
+  }
+
+  SECTION("Oversized frames are refused") {
+    std::vector<uint8_t> data(4097);
+    CHECK_FALSE(ring.publish(data.data(), data.size(), make_buffer(0, true)));
+    CHECK(1 == ring.oversized());
+    CHECK(0 == ring.published());
+  }
+
+  SECTION("Lagging reader drops the oldest frames") {
+    for (uint32_t seq = 0; seq < 10; ++seq) {
+      REQUIRE(publish(ring, seq));
+    }
+    auto frame = reader.next();
+    REQUIRE(frame);
+    CHECK(4 == frame->sequence);
+    CHECK(4 == reader.dropped());
+  }
+
+  SECTION("Overwritten frame is invalid") {
+    REQUIRE(publish(ring, 0));
+    auto frame = reader.next();
+    REQUIRE(frame);
+    for (uint32_t seq = 1; seq <= 8; ++seq) {
+      REQUIRE(publish(ring, seq));
+    }
+    CHECK_FALSE(reader.valid(*frame));
+  }
+
+  SECTION("Readers leave") {
+    {
+      ShmSubscriber other(ring.name());
+      CHECK(4 == other.slotCount() / 2);
+    }
+    for (int idx = 0; idx < 100 && ring.subscribers() != 1; ++idx) {
+      std::this_thread::sleep_for(1ms);
+    }
+    CHECK(1 == ring.subscribers());
+  }
+}
+
+TEST_CASE("Reject a shared memory ring without slots", "[shm]") {
+  ShmRingHeader header;
+  std::memset(static_cast<void *>(&header), 0, sizeof header);
+  std::memcpy(header.magic, SHM_RING_MAGIC, sizeof header.magic);
+  header.version = SHM_RING_VERSION;
+  header.header_size = sizeof header;
+  header.slot_count = 0;
+  header.slot_size = 4096;
+  const auto name = ring_name("no-slots");
+  FakePublisher publisher(name, header);
+  CHECK_THROWS_AS(ShmSubscriber(name), std::runtime_error);
+}
+
+TEST_CASE("Shared memory ring is sealed", "[shm]") {
+  ShmPublisher ring(ring_name("sealed"), 4, 4096);
+  ShmSubscriber reader(ring.name());
+  // The subscriber closed the memfd after mapping it, take the one of the
+  // publisher from /proc
+  bool found{false};
+  for (int fd = 3; fd < 1024 && !found; ++fd) {
+    char link[64];
+    char target[256];
+    std::snprintf(link, sizeof link, "/proc/self/fd/%d", fd);
+    const auto len = ::readlink(link, target, sizeof target - 1);
+    if (len <= 0) {
+      continue;
+    }
+    target[len] = 0;
+    if (std::strstr(target, ("elph264-" + ring.name()).c_str())) {
+      found = true;
+      const int seals = ::fcntl(fd, F_GET_SEALS);
+      CHECK((seals & F_SEAL_FUTURE_WRITE) != 0);
+      CHECK((seals & F_SEAL_SHRINK) != 0);
+      CHECK((seals & F_SEAL_GROW) != 0);
+      CHECK(MAP_FAILED == ::mmap(nullptr, 4096, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, fd, 0));
+    }
+  }
+  CHECK(found);
+}
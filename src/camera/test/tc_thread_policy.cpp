@@ -0,0 +1,94 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <h264camera/thread_policy.hpp>
+
+#include <sched.h>
+#include <stdexcept>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#include <catch.hpp>
+
+using namespace h264camera;
+
+TEST_CASE("Parse thread policy", "[thread_policy]") {
+  CHECK(parse_thread_policy("").isDefault());
+  CHECK(parse_thread_policy("other").isDefault());
+
+  auto policy = parse_thread_policy("fifo:50 cpus:0,2-3 mlock");
+  CHECK(policy.scheduler == ThreadPolicy::Scheduler::FIFO);
+  CHECK(policy.priority == 50);
+  CHECK(policy.cpus == std::vector<int>{0, 2, 3});
+  CHECK(policy.lock_memory);
+  CHECK(to_string(policy) == "fifo:50 cpus:0,2,3 mlock");
+  CHECK(to_string(parse_thread_policy(to_string(policy))) == to_string(policy));
+
+  policy = parse_thread_policy("  rr:1  ");
+  CHECK(policy.scheduler == ThreadPolicy::Scheduler::RR);
+  CHECK(to_string(parse_thread_policy("nice:-5")) == "other nice:-5");
+
+  for (auto text : {"fifo:0", "rr:100", "fifo", "nice:20", "cpus:", "cpus:3-1",
+                    "cpus:a", "mlock:1", "realtime"}) {
+    INFO(text);
+    CHECK_THROWS_AS(parse_thread_policy(text), std::invalid_argument);
+  }
+}
+
+TEST_CASE("Apply thread policy", "[thread_policy]") {
+  // Raising the nice value and choosing an allowed CPU need no privilege
+  cpu_set_t allowed;
+  REQUIRE(0 == sched_getaffinity(0, sizeof allowed, &allowed));
+  int cpu{0};
+  while (!CPU_ISSET(cpu, &allowed)) {
+    ++cpu;
+  }
+  ThreadPolicy policy;
+  policy.nice = 5;
+  policy.cpus = {cpu};
+
+  std::vector<std::string> errors;
+  int nice{0};
+  cpu_set_t applied;
+  cpu_set_t restored;
+  std::vector<std::string> restore_errors;
+  std::thread thread([&] {
+    errors = apply_thread_policy(policy);
+    nice = getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+    sched_getaffinity(0, sizeof applied, &applied);
+    // Without CPUs the thread may run everywhere again
+    policy.cpus.clear();
+    restore_errors = apply_thread_policy(policy);
+    sched_getaffinity(0, sizeof restored, &restored);
+  });
+  thread.join();
+  CHECK(errors.empty());
+  CHECK(nice == 5);
+  CHECK(CPU_COUNT(&applied) == 1);
+  CHECK(CPU_ISSET(cpu, &applied));
+  CHECK(restore_errors.empty());
+  CHECK(CPU_EQUAL(&restored, &allowed));
+
+  INFO("A real-time priority may fail, but never throws");
+  policy = parse_thread_policy("fifo:10");
+  std::thread rt([&] { errors = apply_thread_policy(policy); });
+  rt.join();
+  CHECK(errors.size() <= 1);
+}
@@ -101,3 +101,23 @@ TEST_CASE("Reopen with new configuration", "[v4l2][device]") {
   CHECK(0 == dev.streamOn());
   CHECK(0 == dev.streamOff());
 }
+
+TEST_CASE("Buffer sanity", "[v4l2]") {
+  Device::Mem mem(0, nullptr, 1024, false);
+  mem.video_buffer = {};
+  mem.video_buffer.bytesused = 512;
+  CHECK_FALSE(mem.hasError());
+  CHECK_FALSE(mem.truncated());
+
+  mem.video_buffer.flags = V4L2_BUF_FLAG_ERROR;
+  CHECK(mem.hasError());
+
+  mem.video_buffer.bytesused = 2048;
+  CHECK(mem.truncated());
+  // Frames of a replay exactly fill their slot
+  mem.video_buffer.bytesused = 1024;
+  CHECK_FALSE(mem.truncated());
+  mem.mapped = true;
+  CHECK(mem.truncated());
+  mem.mapped = false;
+}
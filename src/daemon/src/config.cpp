@@ -0,0 +1,235 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "config.hpp"
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <netinet/in.h>
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace elph264d {
+
+namespace {
+
+std::string trim(const std::string &text) {
+  const auto begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return {};
+  }
+  const auto end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+
+/// Parse the whole *text* as an unsigned number up to *max*
+uint64_t to_number(const std::string &text, uint64_t max, int base = 10) {
+  std::size_t used = 0;
+  const auto value = std::stoull(text, &used, base);
+  if (used != text.size() || text[0] == '-' || value > max) {
+    throw std::invalid_argument("invalid number " + text);
+  }
+  return value;
+}
+
+std::string hostname() {
+  char name[256] = {0};
+  if (gethostname(name, sizeof name - 1) != 0) {
+    return "elph264d";
+  }
+  return name;
+}
+
+} // namespace
+
+uint16_t Destination::port() const {
+  if (family() == AF_INET) {
+    return ntohs(reinterpret_cast<const sockaddr_in *>(&addr)->sin_port);
+  }
+  return ntohs(reinterpret_cast<const sockaddr_in6 *>(&addr)->sin6_port);
+}
+
+bool Destination::isMulticast() const {
+  if (family() == AF_INET) {
+    const auto ip = reinterpret_cast<const sockaddr_in *>(&addr)->sin_addr;
+    return IN_MULTICAST(ntohl(ip.s_addr));
+  }
+  return IN6_IS_ADDR_MULTICAST(
+      &reinterpret_cast<const sockaddr_in6 *>(&addr)->sin6_addr);
+}
+
+Destination Destination::rtcp() const {
+  Destination next = *this;
+  const uint16_t port = htons(static_cast<uint16_t>(this->port() + 1));
+  if (family() == AF_INET) {
+    reinterpret_cast<sockaddr_in *>(&next.addr)->sin_port = port;
+  } else {
+    reinterpret_cast<sockaddr_in6 *>(&next.addr)->sin6_port = port;
+  }
+  return next;
+}
+
+Destination parse_destination(const std::string &text) {
+  std::string host;
+  std::string port;
+  if (!text.empty() && text[0] == '[') {
+    const auto close = text.find("]:");
+    if (close == std::string::npos) {
+      throw std::invalid_argument("invalid destination " + text);
+    }
+    host = text.substr(1, close - 1);
+    port = text.substr(close + 2);
+  } else {
+    const auto colon = text.rfind(':');
+    if (colon == std::string::npos) {
+      throw std::invalid_argument("destination without port " + text);
+    }
+    host = text.substr(0, colon);
+    port = text.substr(colon + 1);
+  }
+  const auto port_number = to_number(port, 65534);
+  if (port_number == 0) {
+    throw std::invalid_argument("invalid port in " + text);
+  }
+
+  Destination dest;
+  std::memset(&dest.addr, 0, sizeof dest.addr);
+  dest.text = text;
+  auto v4 = reinterpret_cast<sockaddr_in *>(&dest.addr);
+  auto v6 = reinterpret_cast<sockaddr_in6 *>(&dest.addr);
+  if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1) {
+    v4->sin_family = AF_INET;
+    v4->sin_port = htons(static_cast<uint16_t>(port_number));
+    dest.len = sizeof(sockaddr_in);
+  } else if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1) {
+    v6->sin6_family = AF_INET6;
+    v6->sin6_port = htons(static_cast<uint16_t>(port_number));
+    dest.len = sizeof(sockaddr_in6);
+  } else {
+    throw std::invalid_argument("invalid address " + host);
+  }
+  return dest;
+}
+
+Config parse_config(std::istream &in) {
+  Config config;
+  std::string line;
+  int number = 0;
+  while (std::getline(in, line)) {
+    ++number;
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    try {
+      const auto equal = line.find('=');
+      if (equal == std::string::npos) {
+        throw std::invalid_argument("expected key = value");
+      }
+      const auto key = trim(line.substr(0, equal));
+      const auto value = trim(line.substr(equal + 1));
+      if (value.empty()) {
+        throw std::invalid_argument("no value for " + key);
+      }
+      if (key == "device") {
+        config.device = value;
+      } else if (key == "size") {
+        if (std::sscanf(value.c_str(), "%ux%u", &config.vsize.width,
+                        &config.vsize.height) != 2) {
+          throw std::invalid_argument("invalid size " + value);
+        }
+      } else if (key == "fps") {
+        config.fps = static_cast<uint32_t>(to_number(value, 240));
+      } else if (key == "bitrate") {
+        config.bitrate = static_cast<double>(to_number(value, UINT32_MAX));
+      } else if (key == "mode") {
+        if (value != "cbr" && value != "vbr") {
+          throw std::invalid_argument("mode is cbr or vbr");
+        }
+        config.mode =
+            (value == "cbr") ? h264camera::Mode::CBR : h264camera::Mode::VBR;
+        config.set_mode = true;
+      } else if (key == "capture_policy") {
+        config.capture_policy = h264camera::parse_thread_policy(value);
+      } else if (key == "destination") {
+        config.destinations.push_back(parse_destination(value));
+      } else if (key == "port") {
+        config.port = static_cast<uint16_t>(to_number(value, 65534));
+      } else if (key == "payload_type") {
+        config.payload_type = static_cast<uint8_t>(to_number(value, 127));
+      } else if (key == "ssrc") {
+        config.ssrc = static_cast<uint32_t>(to_number(value, UINT32_MAX, 0));
+        config.random_ssrc = false;
+      } else if (key == "mtu") {
+        config.mtu = static_cast<std::size_t>(to_number(value, 65000));
+      } else if (key == "ttl") {
+        config.ttl = static_cast<int>(to_number(value, 255));
+      } else if (key == "iframe_interval_ms") {
+        config.iframe_interval_ms =
+            static_cast<uint32_t>(to_number(value, UINT32_MAX));
+      } else if (key == "rtcp_interval_ms") {
+        config.rtcp_interval_ms =
+            static_cast<uint32_t>(to_number(value, UINT32_MAX));
+      } else if (key == "cname") {
+        config.cname = value;
+      } else {
+        throw std::invalid_argument("unknown key " + key);
+      }
+    } catch (const std::logic_error &e) {
+      // std::stoull throws invalid_argument and out_of_range
+      throw std::runtime_error("line " + std::to_string(number) + ": " +
+                               e.what());
+    }
+  }
+
+  if (config.device.empty()) {
+    throw std::runtime_error("no device");
+  }
+  if (config.destinations.empty()) {
+    throw std::runtime_error("no destination");
+  }
+  for (const auto &dest : config.destinations) {
+    if (dest.family() != config.destinations.front().family()) {
+      throw std::runtime_error("destinations mix IPv4 and IPv6");
+    }
+  }
+  if (config.fps == 0 || config.mtu < 64 || config.rtcp_interval_ms == 0) {
+    throw std::runtime_error("fps, mtu or rtcp_interval_ms out of range");
+  }
+  if (config.random_ssrc) {
+    std::random_device random;
+    config.ssrc = random();
+  }
+  if (config.cname.empty()) {
+    config.cname = "elph264d@" + hostname();
+  }
+  return config;
+}
+
+Config load_config(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    throw std::runtime_error("cannot read " + path);
+  }
+  return parse_config(in);
+}
+
+} // namespace elph264d
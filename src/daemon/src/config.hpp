@@ -0,0 +1,100 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ELPH264D_CONFIG_HPP__
+#define ELPH264D_CONFIG_HPP__
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+#include <h264camera/thread_policy.hpp>
+#include <h264camera/types.hpp>
+#include <h264camera/v4l2_device.hpp>
+
+namespace elph264d {
+
+/// Where the RTP packets go.  RTCP goes to the next port.
+struct Destination {
+  sockaddr_storage addr;
+  socklen_t len;
+  /// As given in the configuration, for messages
+  std::string text;
+
+  int family() const { return addr.ss_family; }
+  uint16_t port() const;
+  bool isMulticast() const;
+  /// The same host with the port incremented for RTCP
+  Destination rtcp() const;
+};
+
+/// Parse "<ipv4>:<port>" or "[<ipv6>]:<port>".  Throws
+/// std::invalid_argument.
+Destination parse_destination(const std::string &text);
+
+/// Settings of the daemon.  The file has one "key = value" per line,
+/// "#" starts a comment:
+///
+///     device = /dev/elp-h264      camera or replay:<file>
+///     size = 1280x720
+///     fps = 30
+///     bitrate = 2000000           encoder bitrate of ELP cameras
+///     mode = cbr                  or vbr, encoder mode of ELP cameras
+///     capture_policy = fifo:50 cpus:2 mlock  see h264camera::ThreadPolicy
+///     destination = 239.1.1.1:5004  repeated for every receiver
+///     port = 5004                 local RTP port, RTCP on port + 1
+///     payload_type = 96
+///     ssrc = 0x1234abcd           random by default
+///     mtu = 1400                  largest RTP packet
+///     ttl = 1                     of multicast packets
+///     iframe_interval_ms = 500    least time between camera I-frames
+///     rtcp_interval_ms = 5000     time between sender reports
+///     cname = camera@host         RTCP CNAME, hostname by default
+struct Config {
+  std::string device;
+  h264camera::VideoSize vsize{h264camera::VIDEO_SIZE_720P};
+  uint32_t fps{30};
+  double bitrate{0};
+  h264camera::Mode mode{h264camera::Mode::CBR};
+  bool set_mode{false};
+  h264camera::ThreadPolicy capture_policy;
+
+  std::vector<Destination> destinations;
+  /// 0 takes any free port
+  uint16_t port{0};
+  uint8_t payload_type{96};
+  uint32_t ssrc{0};
+  bool random_ssrc{true};
+  std::size_t mtu{1400};
+  int ttl{1};
+  uint32_t iframe_interval_ms{500};
+  uint32_t rtcp_interval_ms{5000};
+  std::string cname;
+};
+
+/// Read the configuration.  Throws std::runtime_error naming the line of
+/// the first error.
+Config parse_config(std::istream &in);
+/// Read the configuration file *path*
+Config load_config(const std::string &path);
+
+} // namespace elph264d
+
+#endif // ELPH264D_CONFIG_HPP__
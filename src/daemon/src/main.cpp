@@ -0,0 +1,88 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Stream a camera over RTP without mediastreamer.
+//
+// Usage: elph264d <config file>
+//
+// See Config for the settings.  The daemon runs until SIGINT or SIGTERM and
+// prints its counters on exit.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "config.hpp"
+#include "streamer.hpp"
+
+using namespace elph264d;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::atomic<bool> sInterrupted{false};
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <config file>\n";
+    return EXIT_FAILURE;
+  }
+  std::signal(SIGINT, [](int) { sInterrupted = true; });
+  std::signal(SIGTERM, [](int) { sInterrupted = true; });
+
+  try {
+    const auto config = load_config(argv[1]);
+    Streamer streamer(config);
+    std::cerr << "Streaming " << config.device << " as SSRC " << std::hex
+              << streamer.ssrc() << std::dec << " from port "
+              << streamer.rtpPort() << (streamer.gso() ? " with" : " without")
+              << " UDP GSO to";
+    for (const auto &dest : config.destinations) {
+      std::cerr << " " << dest.text;
+    }
+    std::cerr << "\n";
+
+    streamer.start();
+    while (!sInterrupted && !streamer.failed()) {
+      std::this_thread::sleep_for(100ms);
+    }
+    streamer.stop();
+
+    const auto stats = streamer.stats();
+    const auto &sent = streamer.senderStats();
+    std::cerr << "frames " << stats.frames << ", packets " << stats.packets
+              << ", payload bytes " << stats.octets << ", skipped "
+              << stats.skipped << ", errors " << stats.errors
+              << ", timeouts " << stats.timeouts << "\n"
+              << "I-frame requests " << stats.iframe_requests
+              << ", passed to the camera " << stats.iframes
+              << ", sender reports " << stats.sender_reports << "\n"
+              << "datagrams " << sent.packets << " in " << sent.messages
+              << " messages and " << sent.syscalls << " system calls, "
+              << sent.errors << " failed\n";
+    return streamer.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+}
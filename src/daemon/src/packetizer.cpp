@@ -0,0 +1,125 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "packetizer.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <h264camera/annexb.hpp>
+
+namespace elph264d {
+
+using h264camera::find_start_code;
+
+namespace {
+
+constexpr uint8_t NALU_FU_A{28};
+constexpr std::size_t FU_HEADER_SIZE{2};
+
+} // namespace
+
+Packetizer::Packetizer(uint32_t ssrc, uint8_t payload_type,
+                       std::size_t max_packet_size, uint16_t first_sequence)
+    : mSsrc(ssrc), mPayloadType(payload_type & 0x7F),
+      mMaxPacketSize(max_packet_size), mSequence(first_sequence) {
+  if (max_packet_size <= RTP_HEADER_SIZE + FU_HEADER_SIZE) {
+    throw std::invalid_argument("RTP packet size too small");
+  }
+}
+
+std::size_t Packetizer::packetize(const uint8_t *data, std::size_t size,
+                                  uint32_t timestamp,
+                                  std::vector<RtpPacket> &out) {
+  const auto first = out.size();
+  const auto end = data + size;
+  std::size_t count = 0;
+  auto start_code = find_start_code(data, end);
+  while (start_code != end) {
+    auto begin = start_code + 1;
+    start_code = find_start_code(begin, end);
+    // Zero bytes in front of a start code are not part of the NALU
+    auto nalu_end = (start_code == end) ? end : start_code - 2;
+    while (nalu_end != begin && nalu_end[-1] == 0) {
+      --nalu_end;
+    }
+    if (nalu_end != begin) {
+      addNalu(begin, static_cast<std::size_t>(nalu_end - begin), timestamp,
+              out);
+      ++count;
+    }
+  }
+  if (out.size() > first) {
+    out.back().header[1] |= 0x80;
+  }
+  return count;
+}
+
+RtpPacket Packetizer::makePacket(uint32_t timestamp) {
+  RtpPacket packet;
+  auto &h = packet.header;
+  h[0] = 0x80;
+  h[1] = mPayloadType;
+  h[2] = static_cast<uint8_t>(mSequence >> 8);
+  h[3] = static_cast<uint8_t>(mSequence);
+  for (int idx = 0; idx < 4; ++idx) {
+    h[4 + idx] = static_cast<uint8_t>(timestamp >> (24 - 8 * idx));
+    h[8 + idx] = static_cast<uint8_t>(mSsrc >> (24 - 8 * idx));
+  }
+  packet.header_size = RTP_HEADER_SIZE;
+  packet.payload = nullptr;
+  packet.payload_size = 0;
+  ++mSequence;
+  return packet;
+}
+
+void Packetizer::addNalu(const uint8_t *nalu, std::size_t size,
+                         uint32_t timestamp, std::vector<RtpPacket> &out) {
+  if (RTP_HEADER_SIZE + size <= mMaxPacketSize) {
+    auto packet = makePacket(timestamp);
+    packet.payload = nalu;
+    packet.payload_size = size;
+    out.push_back(packet);
+    return;
+  }
+
+  // The NALU header moves into the FU indicator and FU header.  Spread the
+  // rest evenly, so all fragments but the last have the same size.
+  const uint8_t header = nalu[0];
+  const auto *payload = nalu + 1;
+  std::size_t remaining = size - 1;
+  const auto max_chunk = mMaxPacketSize - RTP_HEADER_SIZE - FU_HEADER_SIZE;
+  const auto fragments = (remaining + max_chunk - 1) / max_chunk;
+  const auto chunk = (remaining + fragments - 1) / fragments;
+  for (std::size_t idx = 0; idx < fragments; ++idx) {
+    auto packet = makePacket(timestamp);
+    packet.header[RTP_HEADER_SIZE] = (header & 0xE0) | NALU_FU_A;
+    packet.header[RTP_HEADER_SIZE + 1] =
+        static_cast<uint8_t>((idx == 0 ? 0x80 : 0) |
+                             (idx + 1 == fragments ? 0x40 : 0) |
+                             (header & 0x1F));
+    packet.header_size = RTP_HEADER_SIZE + FU_HEADER_SIZE;
+    packet.payload = payload;
+    packet.payload_size = std::min(chunk, remaining);
+    payload += packet.payload_size;
+    remaining -= packet.payload_size;
+    out.push_back(packet);
+  }
+}
+
+} // namespace elph264d
@@ -0,0 +1,80 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ELPH264D_PACKETIZER_HPP__
+#define ELPH264D_PACKETIZER_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace elph264d {
+
+constexpr std::size_t RTP_HEADER_SIZE{12};
+
+/// An RTP packet whose payload stays in the captured frame.  The header
+/// includes the FU indicator and FU header of fragments.
+struct RtpPacket {
+  std::array<uint8_t, RTP_HEADER_SIZE + 2> header;
+  uint8_t header_size;
+  const uint8_t *payload;
+  std::size_t payload_size;
+
+  std::size_t size() const { return header_size + payload_size; }
+  uint16_t sequence() const {
+    return static_cast<uint16_t>(header[2] << 8 | header[3]);
+  }
+  bool marker() const { return (header[1] & 0x80) != 0; }
+};
+
+/// RTP packetization of H.264 (RFC 6184) in non-interleaved mode.  NALUs
+/// fitting into a packet are sent as they are, larger ones as FU-A
+/// fragments.  The fragments of a NALU have the same size except for the
+/// last one, so they can go out as one UDP GSO send.
+class Packetizer {
+public:
+  /// Packets will not exceed *max_packet_size* bytes including the RTP
+  /// header.
+  Packetizer(uint32_t ssrc, uint8_t payload_type,
+             std::size_t max_packet_size, uint16_t first_sequence = 0);
+
+  /// Append the packets of the access unit in the Annex-B byte stream
+  /// [*data*, *data* + *size*) to *out*.  They refer to *data*, which has
+  /// to stay valid until they are sent.  The last packet has the marker
+  /// bit set.  Returns the count of NALUs.
+  std::size_t packetize(const uint8_t *data, std::size_t size,
+                        uint32_t timestamp, std::vector<RtpPacket> &out);
+
+  uint32_t ssrc() const { return mSsrc; }
+  uint16_t nextSequence() const { return mSequence; }
+
+private:
+  void addNalu(const uint8_t *nalu, std::size_t size, uint32_t timestamp,
+               std::vector<RtpPacket> &out);
+  RtpPacket makePacket(uint32_t timestamp);
+
+  const uint32_t mSsrc;
+  const uint8_t mPayloadType;
+  const std::size_t mMaxPacketSize;
+  uint16_t mSequence;
+};
+
+} // namespace elph264d
+
+#endif // ELPH264D_PACKETIZER_HPP__
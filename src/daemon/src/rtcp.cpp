@@ -0,0 +1,153 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "rtcp.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace elph264d {
+
+namespace {
+
+constexpr uint8_t RTCP_RR{201};
+constexpr uint8_t PSFB_PLI{1};
+constexpr uint8_t PSFB_FIR{4};
+constexpr uint8_t SDES_CNAME{1};
+/// Seconds between 1900 (NTP) and 1970 (Unix)
+constexpr uint64_t NTP_UNIX_OFFSET{2208988800};
+
+uint32_t read32(const uint8_t *data) {
+  return static_cast<uint32_t>(data[0]) << 24 |
+         static_cast<uint32_t>(data[1]) << 16 |
+         static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+void write32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+/// Common header, the length is patched by finish()
+std::size_t begin_packet(std::vector<uint8_t> &out, uint8_t count,
+                         uint8_t type) {
+  const auto start = out.size();
+  out.push_back(0x80 | (count & 0x1F));
+  out.push_back(type);
+  out.push_back(0);
+  out.push_back(0);
+  return start;
+}
+
+/// Pad to 32 bits and set the length in words minus one
+void finish(std::vector<uint8_t> &out, std::size_t start) {
+  while (out.size() % 4) {
+    out.push_back(0);
+  }
+  const auto words = (out.size() - start) / 4 - 1;
+  out[start + 2] = static_cast<uint8_t>(words >> 8);
+  out[start + 3] = static_cast<uint8_t>(words);
+}
+
+} // namespace
+
+bool parse_rtcp(const uint8_t *data, std::size_t size, uint32_t ssrc,
+                std::vector<IFrameRequest> &out) {
+  std::size_t pos = 0;
+  while (pos + 4 <= size) {
+    const auto packet = data + pos;
+    if ((packet[0] >> 6) != 2) {
+      return false;
+    }
+    const uint8_t fmt = packet[0] & 0x1F;
+    const uint8_t type = packet[1];
+    const std::size_t length =
+        (static_cast<std::size_t>(packet[2] << 8 | packet[3]) + 1) * 4;
+    if (pos + length > size) {
+      return false;
+    }
+    pos += length;
+    if (type != RTCP_PSFB || length < 12) {
+      continue;
+    }
+
+    // Sender SSRC, media source SSRC and the feedback control information
+    const uint32_t sender = read32(packet + 4);
+    if (fmt == PSFB_PLI && read32(packet + 8) == ssrc) {
+      out.push_back({IFrameRequest::Kind::PLI, sender, 0});
+    } else if (fmt == PSFB_FIR) {
+      // The media source SSRC is unused, the FCI entries name the sources
+      for (std::size_t fci = 12; fci + 8 <= length; fci += 8) {
+        if (read32(packet + fci) == ssrc) {
+          out.push_back({IFrameRequest::Kind::FIR, sender, packet[fci + 4]});
+        }
+      }
+    }
+  }
+  return pos == size;
+}
+
+std::vector<uint8_t> make_sender_report(const SenderInfo &info,
+                                        const std::string &cname) {
+  std::vector<uint8_t> out;
+  auto start = begin_packet(out, 0, RTCP_SR);
+  write32(out, info.ssrc);
+  write32(out, static_cast<uint32_t>(info.ntp >> 32));
+  write32(out, static_cast<uint32_t>(info.ntp));
+  write32(out, info.rtp_timestamp);
+  write32(out, info.packets);
+  write32(out, info.octets);
+  finish(out, start);
+
+  // One chunk with the CNAME, terminated by at least one zero byte
+  start = begin_packet(out, 1, RTCP_SDES);
+  write32(out, info.ssrc);
+  const auto length = std::min<std::size_t>(cname.size(), 255);
+  out.push_back(SDES_CNAME);
+  out.push_back(static_cast<uint8_t>(length));
+  out.insert(out.end(), cname.begin(), cname.begin() + length);
+  out.push_back(0);
+  finish(out, start);
+  return out;
+}
+
+std::vector<uint8_t> make_bye(uint32_t ssrc) {
+  std::vector<uint8_t> out;
+  auto start = begin_packet(out, 0, RTCP_RR);
+  write32(out, ssrc);
+  finish(out, start);
+  start = begin_packet(out, 1, RTCP_BYE);
+  write32(out, ssrc);
+  finish(out, start);
+  return out;
+}
+
+uint64_t ntp_now() {
+  const auto since_epoch =
+      std::chrono::system_clock::now().time_since_epoch();
+  const auto us =
+      std::chrono::duration_cast<std::chrono::microseconds>(since_epoch)
+          .count();
+  const auto seconds = static_cast<uint64_t>(us / 1000000) + NTP_UNIX_OFFSET;
+  const auto fraction =
+      (static_cast<uint64_t>(us % 1000000) << 32) / 1000000;
+  return seconds << 32 | fraction;
+}
+
+} // namespace elph264d
@@ -0,0 +1,75 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ELPH264D_RTCP_HPP__
+#define ELPH264D_RTCP_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace elph264d {
+
+constexpr uint8_t RTCP_SR{200};
+constexpr uint8_t RTCP_SDES{202};
+constexpr uint8_t RTCP_BYE{203};
+constexpr uint8_t RTCP_PSFB{206};
+
+/// Payload-specific feedback asking the sender for an I-frame (RFC 4585,
+/// RFC 5104)
+struct IFrameRequest {
+  enum class Kind { PLI, FIR };
+  Kind kind;
+  /// SSRC of the receiver sending the request
+  uint32_t sender;
+  /// Command sequence number of a FIR, repeated FIRs have the same one
+  uint8_t fir_sequence;
+};
+
+/// Append the I-frame requests for the media source *ssrc* in the compound
+/// RTCP packet [*data*, *data* + *size*) to *out*.  Other packets are
+/// skipped.  Returns false, if the packet is malformed, requests before
+/// the error are appended anyway.
+bool parse_rtcp(const uint8_t *data, std::size_t size, uint32_t ssrc,
+                std::vector<IFrameRequest> &out);
+
+/// What a sender report tells about the stream
+struct SenderInfo {
+  uint32_t ssrc;
+  /// Wall clock as NTP timestamp, see ntp_now()
+  uint64_t ntp;
+  /// RTP timestamp of the same instant
+  uint32_t rtp_timestamp;
+  uint32_t packets;
+  /// Payload bytes without RTP headers
+  uint32_t octets;
+};
+
+/// Compound packet of a sender report and a SDES with the *cname*
+std::vector<uint8_t> make_sender_report(const SenderInfo &info,
+                                        const std::string &cname);
+/// Compound packet of an empty receiver report and a BYE for *ssrc*
+std::vector<uint8_t> make_bye(uint32_t ssrc);
+
+/// The wall clock as 32.32 fixed point seconds since 1900
+uint64_t ntp_now();
+
+} // namespace elph264d
+
+#endif // ELPH264D_RTCP_HPP__
@@ -0,0 +1,246 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "sender.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <system_error>
+#include <unistd.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+namespace elph264d {
+
+namespace {
+
+/// Limits of the kernel for one GSO send
+constexpr std::size_t GSO_MAX_SEGMENTS{64};
+constexpr std::size_t GSO_MAX_BYTES{65000};
+constexpr std::size_t CONTROL_WORDS{(CMSG_SPACE(sizeof(uint16_t)) + 7) / 8};
+/// Messages per sendmmsg() call, UIO_MAXIOV
+constexpr std::size_t MAX_BATCH{1024};
+
+int open_socket(int family, uint16_t port, int ttl) {
+  int fd = ::socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(), "UDP socket");
+  }
+  sockaddr_storage addr;
+  std::memset(&addr, 0, sizeof addr);
+  socklen_t len;
+  if (family == AF_INET) {
+    auto v4 = reinterpret_cast<sockaddr_in *>(&addr);
+    v4->sin_family = AF_INET;
+    v4->sin_addr.s_addr = htonl(INADDR_ANY);
+    v4->sin_port = htons(port);
+    len = sizeof(sockaddr_in);
+  } else {
+    auto v6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+    v6->sin6_family = AF_INET6;
+    v6->sin6_addr = in6addr_any;
+    v6->sin6_port = htons(port);
+    len = sizeof(sockaddr_in6);
+  }
+  if (::bind(fd, reinterpret_cast<const sockaddr *>(&addr), len) < 0) {
+    const int error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::system_category(),
+                            "bind UDP port " + std::to_string(port));
+  }
+
+  // Multicast receivers on the same host should see the stream, too
+  const int loop = 1;
+  const int buffer = 1 << 20;
+  if (family == AF_INET) {
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof ttl);
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof loop);
+  } else {
+    setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof ttl);
+    setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &loop, sizeof loop);
+  }
+  // I-frames come in bursts, a larger buffer keeps them from being dropped
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof buffer);
+  return fd;
+}
+
+uint16_t bound_port(int fd) {
+  sockaddr_storage addr;
+  socklen_t len = sizeof addr;
+  if (getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) < 0) {
+    return 0;
+  }
+  if (addr.ss_family == AF_INET) {
+    return ntohs(reinterpret_cast<const sockaddr_in *>(&addr)->sin_port);
+  }
+  return ntohs(reinterpret_cast<const sockaddr_in6 *>(&addr)->sin6_port);
+}
+
+} // namespace
+
+RtpSender::RtpSender(const Config &config)
+    : mDestinations(config.destinations) {
+  if (mDestinations.empty()) {
+    throw std::invalid_argument("no destination");
+  }
+  for (const auto &dest : mDestinations) {
+    mRtcpDestinations.push_back(dest.rtcp());
+  }
+  const int family = mDestinations.front().family();
+  mRtpSocket = open_socket(family, config.port, config.ttl);
+  try {
+    // Without a fixed port the RTCP port is any free one, too
+    mRtcpSocket = open_socket(
+        family, config.port ? static_cast<uint16_t>(config.port + 1) : 0,
+        config.ttl);
+  } catch (...) {
+    ::close(mRtpSocket);
+    throw;
+  }
+  mRtpPort = bound_port(mRtpSocket);
+  mRtcpPort = bound_port(mRtcpSocket);
+
+  // Linux 4.18 and later know the option
+  int segment = 0;
+  socklen_t len = sizeof segment;
+  mGso = getsockopt(mRtpSocket, SOL_UDP, UDP_SEGMENT, &segment, &len) == 0;
+}
+
+RtpSender::~RtpSender() {
+  ::close(mRtpSocket);
+  ::close(mRtcpSocket);
+}
+
+void RtpSender::send(const std::vector<RtpPacket> &packets) {
+  if (packets.empty()) {
+    return;
+  }
+  mIovecs.clear();
+  for (const auto &packet : packets) {
+    mIovecs.push_back({const_cast<uint8_t *>(packet.header.data()),
+                       packet.header_size});
+    mIovecs.push_back(
+        {const_cast<uint8_t *>(packet.payload), packet.payload_size});
+  }
+  mMessages.clear();
+  mControl.clear();
+
+  std::size_t pos = 0;
+  while (pos < packets.size()) {
+    // A run of packets of the same size, which a smaller one may end
+    std::size_t count = 1;
+    const auto segment = packets[pos].size();
+    if (mGso) {
+      const auto max = std::min(GSO_MAX_SEGMENTS, GSO_MAX_BYTES / segment);
+      while (pos + count < packets.size() && count < max &&
+             packets[pos + count].size() == segment) {
+        ++count;
+      }
+      if (pos + count < packets.size() && count < max &&
+          packets[pos + count].size() < segment) {
+        ++count;
+      }
+    }
+    addMessages(pos, count, count > 1 ? static_cast<uint16_t>(segment) : 0);
+    pos += count;
+  }
+
+  // The control buffers are complete now, point the messages to them
+  for (std::size_t idx = 0; idx < mMessages.size(); ++idx) {
+    auto &msg = mMessages[idx].msg_hdr;
+    if (msg.msg_controllen) {
+      msg.msg_control = &mControl[idx * CONTROL_WORDS];
+    }
+  }
+  for (const auto &packet : packets) {
+    mStats.bytes += packet.size() * mDestinations.size();
+  }
+  mStats.packets += packets.size() * mDestinations.size();
+  flush();
+}
+
+void RtpSender::addMessages(std::size_t first, std::size_t count,
+                            uint16_t segment) {
+  for (const auto &dest : mDestinations) {
+    mmsghdr message;
+    std::memset(&message, 0, sizeof message);
+    auto &msg = message.msg_hdr;
+    msg.msg_name = const_cast<sockaddr_storage *>(&dest.addr);
+    msg.msg_namelen = dest.len;
+    msg.msg_iov = &mIovecs[first * 2];
+    msg.msg_iovlen = count * 2;
+
+    const auto control = mControl.size();
+    mControl.resize(control + CONTROL_WORDS, 0);
+    if (segment) {
+      auto cmsg = reinterpret_cast<cmsghdr *>(&mControl[control]);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      std::memcpy(CMSG_DATA(cmsg), &segment, sizeof segment);
+      msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+    }
+    mMessages.push_back(message);
+  }
+}
+
+void RtpSender::flush() {
+  std::size_t sent = 0;
+  while (sent < mMessages.size()) {
+    const auto batch =
+        static_cast<unsigned int>(std::min(MAX_BATCH, mMessages.size() - sent));
+    ++mStats.syscalls;
+    const int result = sendmmsg(mRtpSocket, &mMessages[sent], batch, 0);
+    if (result > 0) {
+      sent += static_cast<std::size_t>(result);
+      mStats.messages += static_cast<uint64_t>(result);
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    // The message failed, e.g., an unreachable destination.  Skip it.
+    ++mStats.errors;
+    const bool gso = mMessages[sent].msg_hdr.msg_controllen != 0;
+    if (gso && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP)) {
+      std::cerr << "UDP GSO failed, disabled: " << std::strerror(errno)
+                << "\n";
+      mGso = false;
+    }
+    ++sent;
+  }
+}
+
+bool RtpSender::sendRtcp(const std::vector<uint8_t> &packet) {
+  bool ok = true;
+  for (const auto &dest : mRtcpDestinations) {
+    ok = ::sendto(mRtcpSocket, packet.data(), packet.size(), 0,
+                  reinterpret_cast<const sockaddr *>(&dest.addr),
+                  dest.len) >= 0 &&
+         ok;
+  }
+  return ok;
+}
+
+} // namespace elph264d
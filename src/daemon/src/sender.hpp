@@ -0,0 +1,96 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ELPH264D_SENDER_HPP__
+#define ELPH264D_SENDER_HPP__
+
+#include <cstdint>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "config.hpp"
+#include "packetizer.hpp"
+
+namespace elph264d {
+
+/// Sends RTP and RTCP to all destinations of the configuration.
+///
+/// The packets of a frame go out with as few system calls as possible:
+/// sendmmsg() sends them to all destinations at once and, where the kernel
+/// supports UDP GSO, a run of equally sized packets is a single message
+/// which the kernel or the NIC cuts into datagrams.
+class RtpSender {
+public:
+  struct Stats {
+    uint64_t packets{0};
+    uint64_t bytes{0};
+    /// Messages handed to sendmmsg(), fewer than packets with GSO
+    uint64_t messages{0};
+    uint64_t syscalls{0};
+    uint64_t errors{0};
+  };
+
+  /// Bind the RTP socket to the port of the configuration and the RTCP
+  /// socket to the next one.  Throws std::system_error.
+  explicit RtpSender(const Config &config);
+  ~RtpSender();
+  RtpSender(const RtpSender &) = delete;
+  RtpSender &operator=(const RtpSender &) = delete;
+
+  /// Send *packets* to every destination
+  void send(const std::vector<RtpPacket> &packets);
+  /// Send the RTCP packet to the RTCP port of every destination.  Returns
+  /// false, if it failed for any of them.  May be called by another thread
+  /// than send().
+  bool sendRtcp(const std::vector<uint8_t> &packet);
+
+  /// Socket receiving the RTCP feedback of the receivers
+  int rtcpSocket() const { return mRtcpSocket; }
+  uint16_t rtpPort() const { return mRtpPort; }
+  uint16_t rtcpPort() const { return mRtcpPort; }
+  /// UDP GSO is used
+  bool gso() const { return mGso; }
+  /// Counters of RTP, used by the sending thread only
+  const Stats &stats() const { return mStats; }
+
+private:
+  /// Add messages for the packets [*first*, *first* + *count*) to every
+  /// destination.  *segment* is the GSO segment size or 0.
+  void addMessages(std::size_t first, std::size_t count, uint16_t segment);
+  void flush();
+
+  std::vector<Destination> mDestinations;
+  std::vector<Destination> mRtcpDestinations;
+  int mRtpSocket{-1};
+  int mRtcpSocket{-1};
+  uint16_t mRtpPort{0};
+  uint16_t mRtcpPort{0};
+  bool mGso{false};
+  Stats mStats;
+
+  // Kept to save allocations per frame
+  std::vector<iovec> mIovecs;
+  std::vector<mmsghdr> mMessages;
+  /// Holds a cmsghdr with a uint16_t per message
+  std::vector<uint64_t> mControl;
+};
+
+} // namespace elph264d
+
+#endif // ELPH264D_SENDER_HPP__
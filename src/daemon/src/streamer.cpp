@@ -0,0 +1,249 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "streamer.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <poll.h>
+#include <random>
+#include <sys/socket.h>
+#include <system_error>
+
+#include <h264camera/annexb.hpp>
+#include <h264camera/camera_source.hpp>
+
+namespace elph264d {
+
+using namespace std::chrono_literals;
+using h264camera::CameraSource;
+using h264camera::is_keyframe;
+
+namespace {
+
+/// 90 kHz clock of H.264 (RFC 6184)
+uint32_t to_rtp(uint64_t us) { return static_cast<uint32_t>(us * 9 / 100); }
+
+uint64_t capture_us(const v4l2_buffer &buf) {
+  const auto us = static_cast<uint64_t>(buf.timestamp.tv_sec) * 1000000 +
+                  static_cast<uint64_t>(buf.timestamp.tv_usec);
+  if (us != 0) {
+    return us;
+  }
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+} // namespace
+
+Streamer::Streamer(const Config &config,
+                   std::unique_ptr<h264camera::FrameSource> source)
+    : mConfig(config), mSource(std::move(source)), mSender(config),
+      mPacketizer(config.ssrc, config.payload_type, config.mtu,
+                  static_cast<uint16_t>(std::random_device{}())),
+      mTimestampBase(std::random_device{}()) {}
+
+Streamer::Streamer(const Config &config)
+    : Streamer(config, h264camera::make_frame_source(config.device)) {}
+
+Streamer::~Streamer() { stop(); }
+
+void Streamer::start() {
+  if (mRunning) {
+    return;
+  }
+  mRunning = true;
+  mFailed = false;
+  mCaptureThread = std::thread(&Streamer::captureLoop, this);
+  mRtcpThread = std::thread(&Streamer::rtcpLoop, this);
+}
+
+void Streamer::stop() {
+  mRunning = false;
+  if (mCaptureThread.joinable()) {
+    mCaptureThread.join();
+  }
+  if (mRtcpThread.joinable()) {
+    mRtcpThread.join();
+  }
+}
+
+Streamer::Stats Streamer::stats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+void Streamer::captureLoop() {
+  if (!mConfig.capture_policy.isDefault()) {
+    for (const auto &error :
+         h264camera::apply_thread_policy(mConfig.capture_policy)) {
+      std::cerr << mConfig.device << ": " << error << "\n";
+    }
+  }
+  try {
+    mSource->reopen();
+    mSource->configure(mConfig.vsize, mConfig.fps);
+    if (auto camera = dynamic_cast<CameraSource *>(mSource.get())) {
+      if (mConfig.bitrate > 0) {
+        camera->device().xuSetBitrate(mConfig.bitrate);
+      }
+      if (mConfig.set_mode) {
+        camera->device().xuSetMode(mConfig.mode);
+      }
+    }
+    mSource->start();
+    if (mConfig.capture_policy.lock_memory) {
+      try {
+        mSource->lockMemory();
+      } catch (const std::system_error &e) {
+        std::cerr << mConfig.device << ": " << e.what() << "\n";
+      }
+    }
+
+    // Receivers need the parameter sets of an IDR frame first
+    bool skip_to_idr{true};
+    std::vector<RtpPacket> packets;
+    while (mRunning) {
+      if (mRequestIFrame.exchange(false)) {
+        mSource->requestIFrame();
+      }
+      auto mem = mSource->dequeue(200ms);
+      if (!mem) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStats.timeouts;
+        continue;
+      }
+      const auto &buf = mem->video_buffer;
+      const auto data = static_cast<const uint8_t *>(mem->ptr);
+      const auto size = mem->used();
+      if (mem->hasError() || mem->truncated()) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStats.errors;
+        if (!skip_to_idr) {
+          skip_to_idr = true;
+          mSource->requestIFrame();
+        }
+      } else if (skip_to_idr && !is_keyframe(data, size, buf.flags)) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStats.skipped;
+      } else {
+        skip_to_idr = false;
+        const auto timestamp = mTimestampBase + to_rtp(capture_us(buf));
+        packets.clear();
+        mPacketizer.packetize(data, size, timestamp, packets);
+        mSender.send(packets);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStats.frames;
+        mStats.packets += packets.size();
+        for (const auto &packet : packets) {
+          mStats.octets += packet.size() - RTP_HEADER_SIZE;
+        }
+        mLastTimestamp = timestamp;
+        mLastSent = std::chrono::steady_clock::now();
+        mSending = true;
+      }
+      mem->done();
+      mSource->queue(mem->index);
+    }
+    mSource->stop();
+    mSource->close();
+  } catch (const std::exception &e) {
+    std::cerr << mConfig.device << ": " << e.what() << "\n";
+    mFailed = true;
+  }
+}
+
+void Streamer::rtcpLoop() {
+  const auto interval = std::chrono::milliseconds(mConfig.rtcp_interval_ms);
+  auto next_report = std::chrono::steady_clock::now();
+  std::vector<uint8_t> buffer(2048);
+  while (mRunning && !mFailed) {
+    // Wake up regularly to notice stop()
+    const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        next_report - std::chrono::steady_clock::now());
+    const auto timeout = std::max(0ms, std::min(100ms, wait));
+    pollfd fd{mSender.rtcpSocket(), POLLIN, 0};
+    if (::poll(&fd, 1, static_cast<int>(timeout.count())) > 0) {
+      const auto size =
+          ::recv(mSender.rtcpSocket(), buffer.data(), buffer.size(),
+                 MSG_DONTWAIT);
+      if (size > 0) {
+        handleFeedback(buffer.data(), static_cast<std::size_t>(size));
+      }
+    }
+    if (std::chrono::steady_clock::now() >= next_report) {
+      sendReport();
+      next_report += interval;
+    }
+  }
+  mSender.sendRtcp(make_bye(mPacketizer.ssrc()));
+}
+
+void Streamer::handleFeedback(const uint8_t *data, std::size_t size) {
+  std::vector<IFrameRequest> requests;
+  parse_rtcp(data, size, mPacketizer.ssrc(), requests);
+  for (const auto &request : requests) {
+    if (request.kind == IFrameRequest::Kind::FIR) {
+      // A FIR is repeated with the same sequence number until the I-frame
+      // arrives, only a new one is a new request
+      auto known = mFirSequences.find(request.sender);
+      if (known != mFirSequences.end() &&
+          known->second == request.fir_sequence) {
+        continue;
+      }
+      mFirSequences[request.sender] = request.fir_sequence;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mStats.iframe_requests;
+    if (mStats.iframes == 0 ||
+        now - mLastIFrame >=
+            std::chrono::milliseconds(mConfig.iframe_interval_ms)) {
+      ++mStats.iframes;
+      mLastIFrame = now;
+      mRequestIFrame = true;
+    }
+  }
+}
+
+void Streamer::sendReport() {
+  SenderInfo info;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mSending) {
+      return;
+    }
+    const auto since = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - mLastSent);
+    info.ssrc = mPacketizer.ssrc();
+    info.ntp = ntp_now();
+    info.rtp_timestamp =
+        mLastTimestamp + to_rtp(static_cast<uint64_t>(since.count()));
+    info.packets = static_cast<uint32_t>(mStats.packets);
+    info.octets = static_cast<uint32_t>(mStats.octets);
+  }
+  if (mSender.sendRtcp(make_sender_report(info, mConfig.cname))) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mStats.sender_reports;
+  }
+}
+
+} // namespace elph264d
@@ -0,0 +1,119 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ELPH264D_STREAMER_HPP__
+#define ELPH264D_STREAMER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <h264camera/frame_source.hpp>
+
+#include "config.hpp"
+#include "packetizer.hpp"
+#include "rtcp.hpp"
+#include "sender.hpp"
+
+namespace elph264d {
+
+/// Streams a camera to the destinations of the configuration.
+///
+/// The capture thread packetizes every frame straight out of the v4l2
+/// buffer and sends it before giving the buffer back.  The RTCP thread
+/// sends sender reports and turns PLI and FIR of the receivers into
+/// I-frame requests of the camera, at most one per iframe_interval_ms.
+class Streamer {
+public:
+  struct Stats {
+    uint64_t frames{0};
+    uint64_t packets{0};
+    /// RTP payload bytes
+    uint64_t octets{0};
+    /// Frames not sent while waiting for an IDR
+    uint64_t skipped{0};
+    /// Broken frames from the camera
+    uint64_t errors{0};
+    uint64_t timeouts{0};
+    /// PLI and new FIR received
+    uint64_t iframe_requests{0};
+    /// I-frame requests passed on to the camera
+    uint64_t iframes{0};
+    uint64_t sender_reports{0};
+  };
+
+  /// Stream *source* instead of the device of the configuration
+  Streamer(const Config &config,
+           std::unique_ptr<h264camera::FrameSource> source);
+  explicit Streamer(const Config &config);
+  ~Streamer();
+  Streamer(const Streamer &) = delete;
+  Streamer &operator=(const Streamer &) = delete;
+
+  void start();
+  void stop();
+  /// The capture failed, the streamer stopped sending
+  bool failed() const { return mFailed; }
+
+  Stats stats() const;
+  uint16_t rtpPort() const { return mSender.rtpPort(); }
+  uint16_t rtcpPort() const { return mSender.rtcpPort(); }
+  uint32_t ssrc() const { return mPacketizer.ssrc(); }
+  bool gso() const { return mSender.gso(); }
+  /// Counters of the socket, valid after stop()
+  const RtpSender::Stats &senderStats() const { return mSender.stats(); }
+
+private:
+  void captureLoop();
+  void rtcpLoop();
+  void handleFeedback(const uint8_t *data, std::size_t size);
+  void sendReport();
+
+  const Config mConfig;
+  std::unique_ptr<h264camera::FrameSource> mSource;
+  RtpSender mSender;
+  Packetizer mPacketizer;
+  /// Random offset of the RTP timestamps (RFC 3550)
+  uint32_t mTimestampBase;
+
+  std::atomic<bool> mRunning{false};
+  std::atomic<bool> mFailed{false};
+  std::atomic<bool> mRequestIFrame{false};
+  std::thread mCaptureThread;
+  std::thread mRtcpThread;
+
+  mutable std::mutex mMutex;
+  Stats mStats;
+  /// RTP timestamp of the last frame and when it was sent, for the sender
+  /// reports
+  uint32_t mLastTimestamp{0};
+  std::chrono::steady_clock::time_point mLastSent;
+  bool mSending{false};
+
+  // Used by the RTCP thread only
+  std::map<uint32_t, uint8_t> mFirSequences;
+  std::chrono::steady_clock::time_point mLastIFrame;
+};
+
+} // namespace elph264d
+
+#endif // ELPH264D_STREAMER_HPP__
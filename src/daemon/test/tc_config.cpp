@@ -0,0 +1,92 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "config.hpp"
+
+#include <sstream>
+
+#include <catch.hpp>
+
+using namespace elph264d;
+
+namespace {
+
+Config parse(const std::string &text) {
+  std::istringstream in(text);
+  return parse_config(in);
+}
+
+} // namespace
+
+TEST_CASE("Daemon configuration", "[daemon]") {
+  const auto config = parse("# camera\n"
+                            "device = replay:test.h264\n"
+                            "size = 800x600   # SVGA\n"
+                            "fps = 15\n"
+                            "mode = vbr\n"
+                            "capture_policy = rr:20 cpus:1\n"
+                            "destination = 127.0.0.1:5004\n"
+                            "destination = 239.1.2.3:6000\n"
+                            "port = 7000\n"
+                            "ssrc = 0x1234abcd\n"
+                            "mtu = 1200\n");
+  CHECK(config.device == "replay:test.h264");
+  CHECK(config.vsize == h264camera::VIDEO_SIZE_SVGA);
+  CHECK(config.fps == 15);
+  CHECK(config.set_mode);
+  CHECK(config.mode == h264camera::Mode::VBR);
+  CHECK(config.capture_policy.scheduler ==
+        h264camera::ThreadPolicy::Scheduler::RR);
+  CHECK(config.capture_policy.cpus == std::vector<int>{1});
+  REQUIRE(config.destinations.size() == 2);
+  CHECK(config.destinations[0].port() == 5004);
+  CHECK_FALSE(config.destinations[0].isMulticast());
+  CHECK(config.destinations[1].isMulticast());
+  CHECK(config.destinations[1].rtcp().port() == 6001);
+  CHECK(config.port == 7000);
+  CHECK(config.ssrc == 0x1234abcd);
+  CHECK(config.mtu == 1200);
+  CHECK(config.payload_type == 96);
+  CHECK_FALSE(config.cname.empty());
+}
+
+TEST_CASE("Daemon destinations", "[daemon]") {
+  const auto v6 = parse_destination("[::1]:5004");
+  CHECK(v6.family() == AF_INET6);
+  CHECK(v6.port() == 5004);
+  CHECK(parse_destination("[ff02::1]:5004").isMulticast());
+  CHECK_THROWS(parse_destination("127.0.0.1"));
+  CHECK_THROWS(parse_destination("127.0.0.1:0"));
+  CHECK_THROWS(parse_destination("localhost:5004"));
+}
+
+TEST_CASE("Daemon configuration errors", "[daemon]") {
+  const std::string base = "device = /dev/video0\n"
+                           "destination = 127.0.0.1:5004\n";
+  CHECK_NOTHROW(parse(base));
+  CHECK_THROWS_WITH(parse(base + "colour = red\n"),
+                    Catch::Contains("line 3"));
+  CHECK_THROWS_WITH(parse(base + "fps = many\n"), Catch::Contains("line 3"));
+  CHECK_THROWS_WITH(parse(base + "payload_type = 128\n"),
+                    Catch::Contains("line 3"));
+  CHECK_THROWS_WITH(parse(base + "destination = [::1]:5004\n"),
+                    Catch::Contains("IPv6"));
+  CHECK_THROWS_WITH(parse("device = /dev/video0\n"),
+                    Catch::Contains("destination"));
+  CHECK_THROWS(load_config("no_such_file.conf"));
+}
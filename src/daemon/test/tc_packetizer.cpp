@@ -0,0 +1,125 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "packetizer.hpp"
+
+#include <numeric>
+
+#include <catch.hpp>
+
+using namespace elph264d;
+
+namespace {
+
+/// Annex-B access unit of NALUs with the given header and size
+std::vector<uint8_t> make_access_unit(
+    const std::vector<std::pair<uint8_t, std::size_t>> &nalus) {
+  std::vector<uint8_t> data;
+  for (const auto &nalu : nalus) {
+    data.insert(data.end(), {0, 0, 0, 1, nalu.first});
+    for (std::size_t idx = 1; idx < nalu.second; ++idx) {
+      data.push_back(static_cast<uint8_t>(0x80 | (idx & 0x7F)));
+    }
+  }
+  return data;
+}
+
+/// Undo the packetization, returns the NALUs
+std::vector<std::vector<uint8_t>>
+depacketize(const std::vector<RtpPacket> &packets) {
+  std::vector<std::vector<uint8_t>> nalus;
+  for (const auto &packet : packets) {
+    if (packet.header_size == RTP_HEADER_SIZE) {
+      nalus.emplace_back(packet.payload, packet.payload + packet.payload_size);
+      continue;
+    }
+    const uint8_t indicator = packet.header[RTP_HEADER_SIZE];
+    const uint8_t fu = packet.header[RTP_HEADER_SIZE + 1];
+    REQUIRE((indicator & 0x1F) == 28);
+    if (fu & 0x80) {
+      nalus.push_back({static_cast<uint8_t>((indicator & 0xE0) | (fu & 0x1F))});
+    }
+    REQUIRE_FALSE(nalus.empty());
+    nalus.back().insert(nalus.back().end(), packet.payload,
+                        packet.payload + packet.payload_size);
+  }
+  return nalus;
+}
+
+} // namespace
+
+TEST_CASE("RTP packetization", "[daemon]") {
+  Packetizer packetizer(0x11223344, 96, 1200, 65534);
+  std::vector<RtpPacket> packets;
+
+  SECTION("Small NALUs are single packets") {
+    const auto data = make_access_unit({{0x67, 10}, {0x68, 4}, {0x65, 500}});
+    CHECK(3 == packetizer.packetize(data.data(), data.size(), 9000, packets));
+    REQUIRE(3 == packets.size());
+    CHECK(0x80 == packets[0].header[0]);
+    CHECK(96 == packets[0].header[1]);
+    CHECK(65534 == packets[0].sequence());
+    CHECK(65535 == packets[1].sequence());
+    CHECK(0 == packets[2].sequence());
+    CHECK(1 == packetizer.nextSequence());
+    CHECK_FALSE(packets[1].marker());
+    CHECK(packets[2].marker());
+    CHECK(0x23 == packets[0].header[6]);
+    CHECK(0x28 == packets[0].header[7]);
+    CHECK(0x44 == packets[0].header[11]);
+    CHECK(0x67 == packets[0].payload[0]);
+    CHECK(10 == packets[0].payload_size);
+  }
+
+  SECTION("Large NALUs are split evenly") {
+    const auto data = make_access_unit({{0x65, 5000}, {0x41, 1188}});
+    packetizer.packetize(data.data(), data.size(), 0, packets);
+    // 4999 bytes after the NALU header in fragments of up to 1186 bytes,
+    // the second NALU just fits
+    REQUIRE(6 == packets.size());
+    for (std::size_t idx = 0; idx < 4; ++idx) {
+      CHECK(packets[idx].size() == packets[0].size());
+      CHECK(packets[idx].size() <= 1200);
+    }
+    CHECK(packets[4].size() <= packets[0].size());
+    CHECK(1200 == packets[5].size());
+    CHECK(packets[5].marker());
+    CHECK(0x85 == packets[0].header[RTP_HEADER_SIZE + 1]);
+    CHECK(0x45 == packets[4].header[RTP_HEADER_SIZE + 1]);
+
+    const auto nalus = depacketize(packets);
+    REQUIRE(2 == nalus.size());
+    CHECK(std::equal(nalus[0].begin(), nalus[0].end(), data.begin() + 4));
+    CHECK(std::equal(nalus[1].begin(), nalus[1].end(),
+                     data.begin() + 4 + 5000 + 4));
+  }
+
+  SECTION("Trailing zeros are dropped") {
+    auto data = make_access_unit({{0x41, 20}});
+    data.insert(data.end(), {0, 0});
+    packetizer.packetize(data.data(), data.size(), 0, packets);
+    REQUIRE(1 == packets.size());
+    CHECK(20 == packets[0].payload_size);
+  }
+
+  SECTION("No NALU") {
+    const std::vector<uint8_t> data{0, 0, 0, 1};
+    CHECK(0 == packetizer.packetize(data.data(), data.size(), 0, packets));
+    CHECK(packets.empty());
+  }
+}
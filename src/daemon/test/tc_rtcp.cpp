@@ -0,0 +1,138 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "rtcp.hpp"
+
+#include <catch.hpp>
+
+using namespace elph264d;
+
+namespace {
+
+void put32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+uint32_t get32(const std::vector<uint8_t> &data, std::size_t pos) {
+  return static_cast<uint32_t>(data[pos]) << 24 |
+         static_cast<uint32_t>(data[pos + 1]) << 16 |
+         static_cast<uint32_t>(data[pos + 2]) << 8 | data[pos + 3];
+}
+
+/// Empty receiver report as the first packet of a compound packet
+std::vector<uint8_t> make_rr(uint32_t sender) {
+  std::vector<uint8_t> out{0x80, 201, 0, 1};
+  put32(out, sender);
+  return out;
+}
+
+void add_pli(std::vector<uint8_t> &out, uint32_t sender, uint32_t media) {
+  out.insert(out.end(), {0x81, 206, 0, 2});
+  put32(out, sender);
+  put32(out, media);
+}
+
+void add_fir(std::vector<uint8_t> &out, uint32_t sender,
+             const std::vector<std::pair<uint32_t, uint8_t>> &entries) {
+  out.insert(out.end(),
+             {0x84, 206, 0, static_cast<uint8_t>(2 + 2 * entries.size())});
+  put32(out, sender);
+  put32(out, 0);
+  for (const auto &entry : entries) {
+    put32(out, entry.first);
+    out.insert(out.end(), {entry.second, 0, 0, 0});
+  }
+}
+
+} // namespace
+
+TEST_CASE("RTCP feedback", "[daemon]") {
+  constexpr uint32_t ssrc{0xCAFE};
+  std::vector<IFrameRequest> requests;
+
+  SECTION("PLI") {
+    auto packet = make_rr(7);
+    add_pli(packet, 7, ssrc);
+    add_pli(packet, 7, 0xBEEF);
+    CHECK(parse_rtcp(packet.data(), packet.size(), ssrc, requests));
+    REQUIRE(1 == requests.size());
+    CHECK(IFrameRequest::Kind::PLI == requests[0].kind);
+    CHECK(7 == requests[0].sender);
+  }
+
+  SECTION("FIR") {
+    auto packet = make_rr(8);
+    add_fir(packet, 8, {{0xBEEF, 1}, {ssrc, 42}});
+    CHECK(parse_rtcp(packet.data(), packet.size(), ssrc, requests));
+    REQUIRE(1 == requests.size());
+    CHECK(IFrameRequest::Kind::FIR == requests[0].kind);
+    CHECK(8 == requests[0].sender);
+    CHECK(42 == requests[0].fir_sequence);
+  }
+
+  SECTION("Malformed") {
+    auto packet = make_rr(7);
+    add_pli(packet, 7, ssrc);
+    // Length beyond the end
+    auto truncated = packet;
+    truncated.resize(truncated.size() - 2);
+    CHECK_FALSE(parse_rtcp(truncated.data(), truncated.size(), ssrc,
+                           requests));
+    CHECK(requests.empty());
+    // Wrong version after a valid PLI
+    packet.insert(packet.end(), {0x40, 206, 0, 0});
+    CHECK_FALSE(parse_rtcp(packet.data(), packet.size(), ssrc, requests));
+    CHECK(1 == requests.size());
+  }
+}
+
+TEST_CASE("RTCP sender report", "[daemon]") {
+  SenderInfo info{0xCAFE, 0x0102030405060708, 90000, 10, 12345};
+  const auto packet = make_sender_report(info, "cam@host");
+  REQUIRE(packet.size() % 4 == 0);
+  CHECK(0x80 == packet[0]);
+  CHECK(200 == packet[1]);
+  REQUIRE(28 == (packet[3] + 1) * 4);
+  CHECK(0xCAFE == get32(packet, 4));
+  CHECK(0x01020304 == get32(packet, 8));
+  CHECK(0x05060708 == get32(packet, 12));
+  CHECK(90000 == get32(packet, 16));
+  CHECK(10 == get32(packet, 20));
+  CHECK(12345 == get32(packet, 24));
+
+  // SDES with the CNAME
+  CHECK(0x81 == packet[28]);
+  CHECK(202 == packet[29]);
+  CHECK(packet.size() == 28 + (packet[31] + 1) * 4u);
+  CHECK(0xCAFE == get32(packet, 32));
+  CHECK(1 == packet[36]);
+  REQUIRE(8 == packet[37]);
+  CHECK("cam@host" == std::string(packet.begin() + 38, packet.begin() + 46));
+
+  std::vector<IFrameRequest> requests;
+  CHECK(parse_rtcp(packet.data(), packet.size(), 0xCAFE, requests));
+  const auto bye = make_bye(0xCAFE);
+  CHECK(parse_rtcp(bye.data(), bye.size(), 0xCAFE, requests));
+  CHECK(203 == bye[9]);
+  CHECK(requests.empty());
+
+  // Seconds since 1900
+  CHECK((ntp_now() >> 32) > 3900000000u);
+}
@@ -0,0 +1,227 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "streamer.hpp"
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <catch.hpp>
+
+using namespace elph264d;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr std::size_t IDR_SIZE{5000};
+constexpr int GOP{50};
+
+/// Write a recording of GOPs with a large IDR frame, so it is sent as FU-A
+std::string write_recording() {
+  const std::vector<uint8_t> parameter_sets{0, 0, 0, 1, 0x67, 0x42, 0xC0,
+                                            0x1F, 0, 0, 0, 1, 0x68, 0xCE,
+                                            0x3C, 0x80};
+  std::vector<uint8_t> idr{0, 0, 0, 1, 0x65};
+  idr.resize(idr.size() + IDR_SIZE - 1, 0xAB);
+  std::vector<uint8_t> p_frame{0, 0, 0, 1, 0x41};
+  p_frame.resize(p_frame.size() + 299, 0xCD);
+
+  const std::string fname = "elph264d_test.h264";
+  auto stream = std::fopen(fname.c_str(), "wb");
+  REQUIRE(stream);
+  for (int gop = 0; gop < 2; ++gop) {
+    std::fwrite(parameter_sets.data(), parameter_sets.size(), 1, stream);
+    std::fwrite(idr.data(), idr.size(), 1, stream);
+    for (int idx = 1; idx < GOP; ++idx) {
+      std::fwrite(p_frame.data(), p_frame.size(), 1, stream);
+    }
+  }
+  std::fclose(stream);
+  return fname;
+}
+
+/// UDP socket on 127.0.0.1, *port* 0 takes any
+int bind_udp(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (fd >= 0 &&
+      bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof addr) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+uint16_t local_port(int fd) {
+  sockaddr_in addr;
+  socklen_t len = sizeof addr;
+  getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+  return ntohs(addr.sin_port);
+}
+
+/// A receiver on loopback with RTP on an even port and RTCP on the next
+struct Receiver {
+  Receiver() {
+    for (int attempt = 0; attempt < 20 && rtcp < 0; ++attempt) {
+      if (rtp >= 0) {
+        close(rtp);
+      }
+      rtp = bind_udp(0);
+      rtcp = bind_udp(static_cast<uint16_t>(local_port(rtp) + 1));
+    }
+    REQUIRE(rtcp >= 0);
+  }
+  ~Receiver() {
+    close(rtp);
+    close(rtcp);
+  }
+
+  /// Receive a datagram within *timeout*
+  std::vector<uint8_t> receive(int fd, std::chrono::milliseconds timeout) {
+    pollfd pfd{fd, POLLIN, 0};
+    if (poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0) {
+      return {};
+    }
+    std::vector<uint8_t> data(2048);
+    const auto size = recv(fd, data.data(), data.size(), 0);
+    data.resize(size > 0 ? static_cast<std::size_t>(size) : 0);
+    return data;
+  }
+
+  /// Receive RTP packets up to the next marker bit and reassemble the NAL
+  /// unit types of the frame
+  std::vector<uint8_t> frame(uint32_t &timestamp) {
+    std::vector<uint8_t> types;
+    while (true) {
+      const auto packet = receive(rtp, 1s);
+      REQUIRE(packet.size() > RTP_HEADER_SIZE);
+      CHECK(packet.size() <= 1200);
+      timestamp = static_cast<uint32_t>(packet[4]) << 24 | packet[5] << 16 |
+                  packet[6] << 8 | packet[7];
+      const uint8_t nalu = packet[RTP_HEADER_SIZE];
+      if ((nalu & 0x1F) == 28) {
+        const uint8_t fu = packet[RTP_HEADER_SIZE + 1];
+        if (fu & 0x80) {
+          types.push_back(fu & 0x1F);
+        }
+      } else {
+        types.push_back(nalu & 0x1F);
+      }
+      if (packet[1] & 0x80) {
+        return types;
+      }
+    }
+  }
+
+  void sendPli(uint16_t port, uint32_t media) {
+    const uint8_t pli[] = {0x81,
+                           206,
+                           0,
+                           2,
+                           0,
+                           0,
+                           0,
+                           7,
+                           static_cast<uint8_t>(media >> 24),
+                           static_cast<uint8_t>(media >> 16),
+                           static_cast<uint8_t>(media >> 8),
+                           static_cast<uint8_t>(media)};
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    sendto(rtcp, pli, sizeof pli, 0, reinterpret_cast<const sockaddr *>(&addr),
+           sizeof addr);
+  }
+
+  int rtp{-1};
+  int rtcp{-1};
+};
+
+} // namespace
+
+TEST_CASE("Stream to loopback", "[daemon]") {
+  Receiver receiver;
+  Config config;
+  const auto fname = write_recording();
+  config.device = "replay:" + fname;
+  config.fps = 100;
+  config.mtu = 1200;
+  config.ssrc = 0xCAFE;
+  config.rtcp_interval_ms = 100;
+  config.iframe_interval_ms = 10000;
+  config.cname = "test";
+  const auto port = local_port(receiver.rtp);
+  config.destinations.push_back(
+      parse_destination("127.0.0.1:" + std::to_string(port)));
+
+  Streamer streamer(config);
+  streamer.start();
+
+  // Starts with the parameter sets and the IDR
+  uint32_t timestamp;
+  CHECK(std::vector<uint8_t>{7, 8, 5} == receiver.frame(timestamp));
+  uint32_t previous = timestamp;
+  CHECK(std::vector<uint8_t>{1} == receiver.frame(timestamp));
+  // About 10 ms at 90 kHz
+  CHECK(timestamp - previous > 0);
+  CHECK(timestamp - previous < 9000);
+
+  // A PLI cuts the GOP short, a second one within the interval does not
+  receiver.sendPli(streamer.rtcpPort(), 0xCAFE);
+  receiver.sendPli(streamer.rtcpPort(), 0xCAFE);
+  int frames = 2;
+  while (receiver.frame(timestamp) != std::vector<uint8_t>{7, 8, 5}) {
+    ++frames;
+    REQUIRE(frames < GOP);
+  }
+
+  // Sender reports arrive on the RTCP port
+  std::vector<uint8_t> report;
+  for (int idx = 0; idx < 10 && (report.size() < 2 || report[1] != 200);
+       ++idx) {
+    report = receiver.receive(receiver.rtcp, 200ms);
+  }
+  REQUIRE(report.size() > 8);
+  CHECK(200 == report[1]);
+
+  streamer.stop();
+  CHECK_FALSE(streamer.failed());
+  const auto stats = streamer.stats();
+  CHECK(stats.frames > 2);
+  CHECK(stats.iframe_requests == 2);
+  CHECK(stats.iframes == 1);
+  CHECK(stats.sender_reports > 0);
+  const auto &sent = streamer.senderStats();
+  CHECK(sent.packets == stats.packets);
+  CHECK(sent.errors == 0);
+  if (streamer.gso()) {
+    // The fragments of an IDR go out as one message
+    CHECK(sent.messages < sent.packets);
+  }
+  std::remove(fname.c_str());
+}
@@ -0,0 +1,133 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "bitstream.hpp"
+
+using namespace std;
+
+namespace mselph264 {
+
+vector<uint8_t> unescape_rbsp(const uint8_t *data, size_t size) {
+  vector<uint8_t> rbsp;
+  rbsp.reserve(size);
+  size_t zero_cnt{0};
+  for (size_t idx = 0; idx < size; ++idx) {
+    if (zero_cnt >= 2 && data[idx] == 0x03) {
+      zero_cnt = 0;
+      continue;
+    }
+    rbsp.push_back(data[idx]);
+    zero_cnt = (data[idx] == 0) ? zero_cnt + 1 : 0;
+  }
+  return rbsp;
+}
+
+void escape_rbsp(const vector<uint8_t> &rbsp, vector<uint8_t> &nalu) {
+  size_t zero_cnt{0};
+  for (auto byte : rbsp) {
+    if (zero_cnt >= 2 && byte <= 0x03) {
+      nalu.push_back(0x03);
+      zero_cnt = 0;
+    }
+    nalu.push_back(byte);
+    zero_cnt = (byte == 0) ? zero_cnt + 1 : 0;
+  }
+}
+
+uint32_t BitReader::u(unsigned bits) {
+  uint32_t value{0};
+  for (unsigned idx = 0; idx < bits; ++idx) {
+    uint32_t bit{0};
+    if (mPos < mSize * 8) {
+      bit = (mData[mPos / 8] >> (7 - mPos % 8)) & 1;
+    } else {
+      mOk = false;
+    }
+    value = (value << 1) | bit;
+    ++mPos;
+  }
+  return value;
+}
+
+uint32_t BitReader::ue() {
+  unsigned leading_zeros{0};
+  while (!flag()) {
+    if (!mOk || ++leading_zeros > 31) {
+      mOk = false;
+      return 0;
+    }
+  }
+  if (leading_zeros == 0) {
+    return 0;
+  }
+  return static_cast<uint32_t>((uint64_t{1} << leading_zeros) - 1 +
+                               u(leading_zeros));
+}
+
+int32_t BitReader::se() {
+  const uint32_t code = ue();
+  const auto magnitude = static_cast<int32_t>((code + 1) / 2);
+  return (code & 1) ? magnitude : -magnitude;
+}
+
+void BitWriter::u(unsigned bits, uint32_t value) {
+  for (unsigned idx = bits; idx > 0; --idx) {
+    if (mPos % 8 == 0) {
+      mData.push_back(0);
+    }
+    if ((value >> (idx - 1)) & 1) {
+      mData.back() |= static_cast<uint8_t>(0x80 >> (mPos % 8));
+    }
+    ++mPos;
+  }
+}
+
+void BitWriter::ue(uint32_t value) {
+  const uint64_t code = uint64_t{value} + 1;
+  unsigned bits{0};
+  while ((code >> bits) > 1) {
+    ++bits;
+  }
+  u(bits, 0);
+  // The code has bits + 1 significant bits, the leading one included
+  u(1, 1);
+  u(bits, static_cast<uint32_t>(code));
+}
+
+void BitWriter::se(int32_t value) {
+  if (value > 0) {
+    ue(static_cast<uint32_t>(value) * 2 - 1);
+  } else {
+    ue(static_cast<uint32_t>(-static_cast<int64_t>(value)) * 2);
+  }
+}
+
+void BitWriter::copy(const uint8_t *data, size_t begin, size_t end) {
+  for (size_t pos = begin; pos < end; ++pos) {
+    u(1, (data[pos / 8] >> (7 - pos % 8)) & 1);
+  }
+}
+
+void BitWriter::trailingBits() {
+  u(1, 1);
+  while (mPos % 8 != 0) {
+    u(1, 0);
+  }
+}
+
+} // namespace mselph264
@@ -0,0 +1,88 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_BITSTREAM_HPP__
+#define PLUGIN_BITSTREAM_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mselph264 {
+
+/// Remove the emulation prevention bytes of a NALU payload
+std::vector<uint8_t> unescape_rbsp(const uint8_t *data, std::size_t size);
+
+/// Append the RBSP *rbsp* to *nalu* inserting emulation prevention bytes
+void escape_rbsp(const std::vector<uint8_t> &rbsp, std::vector<uint8_t> &nalu);
+
+/// Read bits and Exp-Golomb codes from an RBSP.  Reading beyond the end
+/// yields zeros and clears ok(), so a parser can check once at the end.
+class BitReader {
+public:
+  BitReader(const uint8_t *data, std::size_t size)
+      : mData(data), mSize(size) {}
+
+  /// Read *bits* bits, at most 32, most significant first
+  uint32_t u(unsigned bits);
+  bool flag() { return u(1) != 0; }
+  /// Unsigned Exp-Golomb code ue(v)
+  uint32_t ue();
+  /// Signed Exp-Golomb code se(v)
+  int32_t se();
+
+  /// Count of bits read so far
+  std::size_t position() const { return mPos; }
+  /// No read went beyond the end of the data
+  bool ok() const { return mOk; }
+
+private:
+  const uint8_t *mData;
+  std::size_t mSize;
+  std::size_t mPos{0};
+  bool mOk{true};
+};
+
+/// Write bits and Exp-Golomb codes into an RBSP
+class BitWriter {
+public:
+  /// Write the lowest *bits* bits of *value*, at most 32
+  void u(unsigned bits, uint32_t value);
+  void flag(bool value) { u(1, value ? 1 : 0); }
+  /// Unsigned Exp-Golomb code ue(v)
+  void ue(uint32_t value);
+  /// Signed Exp-Golomb code se(v)
+  void se(int32_t value);
+  /// Copy the bits [*begin*, *end*) of *data*
+  void copy(const uint8_t *data, std::size_t begin, std::size_t end);
+  /// rbsp_trailing_bits: a one bit followed by zeros up to the byte boundary
+  void trailingBits();
+
+  /// Count of bits written so far
+  std::size_t position() const { return mPos; }
+  /// The written bytes, the last one is padded with zero bits
+  const std::vector<uint8_t> &data() const { return mData; }
+
+private:
+  std::vector<uint8_t> mData;
+  std::size_t mPos{0};
+};
+
+} // namespace mselph264
+
+#endif
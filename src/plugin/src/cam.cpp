@@ -18,23 +18,30 @@
 #include <mediastreamer2/mswebcam.h>
 
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
+#include <sstream>
+#include <string>
 #include <sys/ioctl.h>
 
 #include <h264camera/elp_usb100w04h.hpp>
+#include <h264camera/preview_source.hpp>
 #include <libv4l2.h>
 #include <linux/videodev2.h>
 
 #include "filter.hpp"
+#include "preview.hpp"
 
 using namespace std::chrono_literals;
 
 namespace mselph264 {
 
 extern MSFilterDesc filter_description;
+extern MSFilterDesc preview_filter_description;
 
 static void detect_camera(MSWebCamManager *obj);
+static void detect_preview(MSWebCamManager *obj);
 
 // Create the capture filter using the camera device as source.
 static MSFilter *create_reader(MSWebCam *cam) {
@@ -59,26 +66,87 @@ MSWebCamDesc camera_description = {"ELP-USB100W04H" /*driver_type*/,
                                    nullptr /* uninit */,
                                    encode_to_mime_type};
 
+// Create the preview filter using the secondary video node as source.
+static MSFilter *create_preview_reader(MSWebCam *cam) {
+  MSFactory *factory = ms_web_cam_get_factory(cam);
+  MSFilter *f =
+      ms_factory_create_filter_from_desc(factory, &preview_filter_description);
+  PreviewState::from(f)->setDevice(cam->name);
+  return f;
+}
+
+// The preview delivers MJPEG or YUYV, which is not encoded for sending.
+MSWebCamDesc preview_camera_description = {"ELP-USB100W04H-Preview",
+                                           detect_preview,
+                                           nullptr /* init */,
+                                           create_preview_reader,
+                                           nullptr /* uninit */,
+                                           nullptr};
+
+static void add_camera(MSWebCamManager *obj, const std::string &name,
+                       MSWebCamDesc *desc = &camera_description) {
+  MSWebCam *cam = ms_web_cam_new(desc);
+  cam->name = ms_strdup(name.c_str());
+  ms_web_cam_manager_add_cam(obj, cam);
+}
+
 // Detect suitable candidates for this plugin.
+//
+// Besides the camera, replay sources listed in the environment variable
+// ELPH264_REPLAY are added.  It holds camera names separated by ';', e.g.,
+// "replay:/tmp/a.h264;replay-max:/tmp/b.h264".  A plain file name is
+// replayed in real time.
 static void detect_camera(MSWebCamManager *obj) {
-  // See udev rules (elp-camera.rules)
-  h264camera::Usb100W04H device("/dev/elp-h264");
-  device.open();
-  device.addXuCtrl();
-  device.setFormat(MS_VIDEO_SIZE_720P_W, MS_VIDEO_SIZE_720P_H,
-                   V4L2_PIX_FMT_H264);
-  device.setFramerate(30);
-  device.xuResetIFrame();
-  device.mmap();
-  device.streamOn();
-  if (nullptr == device.dequeue(500ms)) {
-    bctbx_warning("Unable to retrieve image in camera detection");
+  try {
+    // See udev rules (elp-camera.rules)
+    h264camera::Usb100W04H device("/dev/elp-h264");
+    device.open();
+    device.addXuCtrl();
+    device.setFormat(MS_VIDEO_SIZE_720P_W, MS_VIDEO_SIZE_720P_H,
+                     V4L2_PIX_FMT_H264);
+    device.setFramerate(30);
+    device.xuResetIFrame();
+    device.mmap();
+    device.streamOn();
+    if (nullptr == device.dequeue(500ms)) {
+      bctbx_warning("Unable to retrieve image in camera detection");
+    }
+    device.streamOff();
+    device.close();
+    add_camera(obj, device.path());
+  } catch (const std::exception &e) {
+    bctbx_warning("No ELP camera detected: %s", e.what());
+  }
+
+  if (const char *replay = std::getenv("ELPH264_REPLAY")) {
+    std::stringstream ss(replay);
+    std::string name;
+    while (std::getline(ss, name, ';')) {
+      if (name.empty()) {
+        continue;
+      }
+      if (name.compare(0, 7, "replay:") != 0 &&
+          name.compare(0, 11, "replay-max:") != 0) {
+        name = "replay:" + name;
+      }
+      bctbx_message("Add replay source %s", name.c_str());
+      add_camera(obj, name);
+    }
+  }
+}
+
+// Detect the secondary video node of the camera, which may stream next to
+// the H.264 node.
+static void detect_preview(MSWebCamManager *obj) {
+  try {
+    // See udev rules (elp-camera.rules)
+    h264camera::PreviewSource source("/dev/elp-mjpeg");
+    source.reopen();
+    source.close();
+    add_camera(obj, source.name(), &preview_camera_description);
+  } catch (const std::exception &e) {
+    bctbx_warning("No ELP preview node detected: %s", e.what());
   }
-  device.streamOff();
-  device.close();
-  MSWebCam *cam = ms_web_cam_new(&camera_description);
-  cam->name = ms_strdup(device.path().c_str());
-  ms_web_cam_manager_add_cam(obj, cam);
 }
 
 } // namespace mselph264
@@ -0,0 +1,543 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "capture_session.hpp"
+
+#include <algorithm>
+#include <bctoolbox/logging.h>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+
+#include "h264camera/frame_source.hpp"
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+namespace mselph264 {
+
+bool Subscription::push(const SharedFrame &frame) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const bool idr = frame->info.has(FrameInfo::HAS_IDR);
+  if (mWaitingForIdr && !idr) {
+    ++mStats.dropped;
+    return false;
+  }
+  mWaitingForIdr = false;
+  if (mFrames.size() < mCapacity) {
+    mFrames.push_back(frame);
+    mQueued.notify_one();
+    return false;
+  }
+
+  ++mStats.overflows;
+  mStats.dropped += mFrames.size();
+  mFrames.clear();
+  if (idr) {
+    // A fresh start anyway
+    mFrames.push_back(frame);
+    mQueued.notify_one();
+    return false;
+  }
+  ++mStats.dropped;
+  mWaitingForIdr = true;
+  return mOverflow == Overflow::REQUEST_IDR;
+}
+
+SharedFrame Subscription::pop() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mFrames.empty()) {
+    return nullptr;
+  }
+  auto frame = std::move(mFrames.front());
+  mFrames.pop_front();
+  ++mStats.delivered;
+  return frame;
+}
+
+SharedFrame Subscription::pop(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (!mQueued.wait_for(lock, timeout, [this] { return !mFrames.empty(); })) {
+    return nullptr;
+  }
+  auto frame = std::move(mFrames.front());
+  mFrames.pop_front();
+  ++mStats.delivered;
+  return frame;
+}
+
+bool Subscription::wait(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  return mQueued.wait_for(lock, timeout, [this] { return !mFrames.empty(); });
+}
+
+Subscription::Stats Subscription::stats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+class CaptureSession::FramePool {
+public:
+  ~FramePool() {
+    for (auto frame : mFrames) {
+      delete frame;
+    }
+  }
+
+  /// A frame for the capture thread, which the last owner gives back
+  static std::shared_ptr<Frame> get(const std::shared_ptr<FramePool> &pool) {
+    Frame *frame{nullptr};
+    {
+      std::lock_guard<std::mutex> lock(pool->mMutex);
+      if (!pool->mFrames.empty()) {
+        frame = pool->mFrames.back();
+        pool->mFrames.pop_back();
+      }
+    }
+    if (!frame) {
+      frame = new Frame();
+    }
+    return std::shared_ptr<Frame>(frame, [pool](Frame *frame) {
+      ms_queue_flush(&frame->nalus);
+      std::lock_guard<std::mutex> lock(pool->mMutex);
+      pool->mFrames.push_back(frame);
+    });
+  }
+
+private:
+  std::mutex mMutex;
+  std::vector<Frame *> mFrames;
+};
+
+std::shared_ptr<CaptureSession> CaptureSession::get(const std::string &name) {
+  static std::mutex sMutex;
+  static std::map<std::string, std::weak_ptr<CaptureSession>> sSessions;
+
+  std::lock_guard<std::mutex> lock(sMutex);
+  // Forget ended sessions, e.g., of replays or unplugged cameras
+  for (auto it = sSessions.begin(); it != sSessions.end();) {
+    it = it->second.expired() ? sSessions.erase(it) : std::next(it);
+  }
+  auto session = sSessions[name].lock();
+  if (!session) {
+    bctbx_message("New capture session for %s", name.c_str());
+    session.reset(new CaptureSession(name, make_frame_source(name)));
+    sSessions[name] = session;
+  }
+  return session;
+}
+
+CaptureSession::CaptureSession(const std::string &name,
+                               std::unique_ptr<FrameSource> source)
+    : mName(name), mDevice(std::move(source)),
+      mPool(std::make_shared<FramePool>()) {
+  if (const char *policy = std::getenv("ELPH264_CAPTURE_POLICY")) {
+    try {
+      mThreadPolicy = parse_thread_policy(policy);
+    } catch (const std::invalid_argument &e) {
+      bctbx_warning("Ignoring ELPH264_CAPTURE_POLICY: %s", e.what());
+    }
+  }
+}
+
+CaptureSession::~CaptureSession() {
+  std::lock_guard<std::mutex> lock(mLifecycleMutex);
+  stop();
+}
+
+std::shared_ptr<Subscription>
+CaptureSession::subscribe(std::size_t capacity,
+                          Subscription::Overflow overflow) {
+  auto subscription = std::make_shared<Subscription>(capacity, overflow);
+  std::lock_guard<std::mutex> lock(mLifecycleMutex);
+  if (mCaptureThread.joinable() && mLoopExited) {
+    // The source failed for good, the new reader gets another attempt
+    mCaptureThread.join();
+  }
+  const bool running = mCaptureThread.joinable();
+  bool primed{false};
+  {
+    std::lock_guard<std::mutex> subscriptions_lock(mSubscriptionMutex);
+    std::vector<SharedFrame> gop;
+    if (running && mGopCache.get(capacity, gop)) {
+      for (const auto &frame : gop) {
+        subscription->push(frame);
+      }
+      primed = true;
+    }
+    mSubscriptions.push_back(subscription);
+  }
+  if (!running) {
+    start();
+  } else if (!primed) {
+    // Joining a running capture, the others already had their IDR
+    mIFrameArbiter.requestRecovery();
+  }
+  return subscription;
+}
+
+void CaptureSession::unsubscribe(
+    const std::shared_ptr<Subscription> &subscription) {
+  std::lock_guard<std::mutex> lock(mLifecycleMutex);
+  bool last{false};
+  {
+    std::lock_guard<std::mutex> subscriptions_lock(mSubscriptionMutex);
+    mSubscriptions.erase(std::remove(mSubscriptions.begin(),
+                                     mSubscriptions.end(), subscription),
+                         mSubscriptions.end());
+    last = mSubscriptions.empty();
+  }
+  if (last) {
+    stop();
+  }
+}
+
+std::size_t CaptureSession::subscriptions() const {
+  std::lock_guard<std::mutex> lock(mSubscriptionMutex);
+  return mSubscriptions.size();
+}
+
+void CaptureSession::setVideoConf(const MSVideoConfiguration &conf) {
+  bool restart{false};
+  mVideoConf.update([&](VideoSettings &settings) {
+    restart = conf.vsize.width != settings.conf.vsize.width ||
+              conf.vsize.height != settings.conf.vsize.height ||
+              conf.fps != settings.conf.fps;
+    settings.conf = conf;
+    settings.configured = true;
+  });
+  // Only after publishing: the capture thread clears the flags before it
+  // reads the configuration, so it either sees the new one or restarts
+  // again.
+  if (restart) {
+    mReconfigure = true;
+    mRunning = false;
+  }
+}
+
+void CaptureSession::initVideoConf(const MSVideoConfiguration &conf) {
+  mVideoConf.update([&](VideoSettings &settings) {
+    if (!settings.configured) {
+      settings.conf = conf;
+      settings.configured = true;
+    }
+  });
+}
+
+void CaptureSession::requestIFrame(uint32_t receiver) {
+  mIFrameArbiter.request(receiver, now());
+}
+
+bool CaptureSession::exportFrames(const std::string &ring) {
+  std::shared_ptr<h264camera::ShmPublisher> publisher;
+  if (!ring.empty()) {
+    try {
+      publisher = std::make_shared<h264camera::ShmPublisher>(ring);
+    } catch (const std::exception &e) {
+      bctbx_error("Cannot export %s to ring %s: %s", mName.c_str(),
+                  ring.c_str(), e.what());
+      return false;
+    }
+  }
+  // The capture thread may still use the old ring until its next frame
+  std::lock_guard<std::mutex> lock(mExportMutex);
+  mExport = std::move(publisher);
+  return true;
+}
+
+ThreadPolicy CaptureSession::threadPolicy() const {
+  std::lock_guard<std::mutex> lock(mPolicyMutex);
+  return mThreadPolicy;
+}
+
+void CaptureSession::setThreadPolicy(const ThreadPolicy &policy) {
+  std::lock_guard<std::mutex> lock(mPolicyMutex);
+  mThreadPolicy = policy;
+  mThreadPolicyChanged = true;
+}
+
+CaptureSession::Recovery CaptureSession::recovery() const {
+  std::lock_guard<std::mutex> lock(mRecoveryMutex);
+  return mRecovery;
+}
+
+void CaptureSession::start() {
+  assert(mDevice);
+  mStopped = false;
+  mLoopExited = false;
+  mReconfigure = true;
+  mCaptureThread = std::thread(&CaptureSession::captureLoop, this);
+}
+
+void CaptureSession::stop() {
+  if (!mCaptureThread.joinable()) {
+    return;
+  }
+  mStopped = true;
+  mRunning = false;
+  mCaptureThread.join();
+}
+
+uint64_t CaptureSession::now() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+void CaptureSession::publish(const SharedFrame &frame) {
+  bool request{false};
+  {
+    std::lock_guard<std::mutex> lock(mSubscriptionMutex);
+    mGopCache.add(frame);
+    for (const auto &subscription : mSubscriptions) {
+      request |= subscription->push(frame);
+    }
+  }
+  if (request) {
+    mIFrameArbiter.requestRecovery();
+  }
+}
+
+void CaptureSession::captureLoop() {
+  ms_message("Start capture loop of %s", mName.c_str());
+  mLost = false;
+  // Every capture runs in a new thread
+  if (mThreadPolicyChanged || !threadPolicy().isDefault()) {
+    applyThreadPolicy();
+  }
+  while (!mStopped) {
+    try {
+      capture();
+      break;
+    } catch (const std::exception &e) {
+      ms_error("Something went wrong in the capture loop %s", e.what());
+      if (!reattach(e)) {
+        break;
+      }
+    }
+  }
+  ms_message("Stop capture loop of %s", mName.c_str());
+  mLoopExited = true;
+}
+
+bool CaptureSession::reattach(const std::exception &error) {
+  mGopCache.reset();
+  try {
+    mDevice->close();
+  } catch (const std::exception &e) {
+    bctbx_warning("Closing %s failed: %s", mName.c_str(), e.what());
+  }
+  if (!mDevice->reattachable()) {
+    return false;
+  }
+  if (!mLost) {
+    mLost = true;
+    mLostAt = now();
+    std::lock_guard<std::mutex> lock(mRecoveryMutex);
+    ++mRecovery.losses;
+    bctbx_warning("Lost %s (%s), waiting for it to come back", mName.c_str(),
+                  error.what());
+  }
+  try {
+    while (!mStopped && !mDevice->waitUntilAvailable(200ms)) {
+    }
+  } catch (const std::exception &e) {
+    bctbx_error("Cannot wait for %s: %s", mName.c_str(), e.what());
+    return false;
+  }
+  // The node of a vanishing device may still be there or a new one may not
+  // be usable yet, so every further attempt is delayed a bit
+  for (int ms = 0; ms < 250 && !mStopped; ms += 10) {
+    std::this_thread::sleep_for(10ms);
+  }
+  mReconfigure = true;
+  return !mStopped;
+}
+
+void CaptureSession::applyThreadPolicy() {
+  ThreadPolicy policy;
+  {
+    std::lock_guard<std::mutex> lock(mPolicyMutex);
+    policy = mThreadPolicy;
+    mThreadPolicyChanged = false;
+  }
+  // Missing privileges leave the thread as it is
+  for (const auto &error : apply_thread_policy(policy)) {
+    bctbx_warning("Capture thread of %s: %s", mName.c_str(), error.c_str());
+  }
+  bctbx_message("Capture thread of %s uses %s", mName.c_str(),
+                to_string(policy).c_str());
+  if (mDevice->isOpen()) {
+    lockMemory();
+  }
+}
+
+void CaptureSession::lockMemory() {
+  if (!threadPolicy().lock_memory) {
+    return;
+  }
+  try {
+    mDevice->lockMemory();
+  } catch (const std::exception &e) {
+    bctbx_warning("Cannot lock the buffers of %s: %s", mName.c_str(),
+                  e.what());
+  }
+}
+
+void CaptureSession::recoverStall(StallWatchdog::Action action) {
+  if (action == StallWatchdog::Action::NONE) {
+    return;
+  }
+  bctbx_warning("No frame from %s for %llu ms, trying %s", mName.c_str(),
+                static_cast<unsigned long long>(mStallWatchdog.idle(now())),
+                StallWatchdog::name(action));
+  // Whatever comes next, the readers missed frames
+  mFrameGuard.lost();
+  mGopCache.reset();
+  mIFrameArbiter.requestRecovery();
+  switch (action) {
+  case StallWatchdog::Action::NONE:
+    break;
+  case StallWatchdog::Action::REQUEUE:
+    mDevice->requeue();
+    break;
+  case StallWatchdog::Action::RESTART_STREAM:
+    mDevice->restartStream();
+    break;
+  case StallWatchdog::Action::REOPEN:
+    // Done by the reconfiguration
+    mReconfigure = true;
+    mRunning = false;
+    break;
+  }
+}
+
+void CaptureSession::capture() {
+  while (mReconfigure && !mStopped) {
+    // Configure camera berfore opening the stream
+    // Cleared before reading, see setVideoConf()
+    mReconfigure = false;
+    mRunning = true;
+    const MSVideoConfiguration vconf = videoConf();
+    bctbx_message(
+        "Reconfigure %dbit/s %dbit/s %dx%d %ffps mincpu: %d extra: %p",
+        vconf.required_bitrate, vconf.bitrate_limit, vconf.vsize.width,
+        vconf.vsize.height, vconf.fps, vconf.mincpu, vconf.extra);
+    mParameterSets.clear(vconf.fps);
+    mIFrameArbiter.reset();
+    if (mLost || mStallWatchdog.stalled()) {
+      mFrameGuard.lost();
+      mIFrameArbiter.requestRecovery();
+    } else {
+      mFrameGuard.reset();
+    }
+    mGopCache.reset();
+    mDevice->reopen();
+    mDevice->configure({static_cast<unsigned int>(vconf.vsize.width),
+                        static_cast<unsigned int>(vconf.vsize.height)},
+                       static_cast<uint32_t>(vconf.fps));
+    mDevice->start();
+    lockMemory();
+    mStallWatchdog.start(now());
+
+    while (mRunning && !mStopped) {
+      if (mThreadPolicyChanged) {
+        applyThreadPolicy();
+      }
+      if (mIFrameArbiter.takeRequest(now())) {
+        mDevice->requestIFrame();
+      }
+      recoverStall(mStallWatchdog.check(now()));
+      if (!mRunning) {
+        continue;
+      }
+
+      auto mem = mDevice->dequeue(200ms);
+      if (!mem) {
+        if (!mStallWatchdog.stalled()) {
+          bctbx_warning("Timeout when waiting for a new frame");
+        }
+        continue;
+      }
+      if (mStallWatchdog.frame(mem->video_buffer.sequence, now())) {
+        const auto stats = mStallWatchdog.stats();
+        bctbx_message("%s delivers again after %s in %llu ms", mName.c_str(),
+                      StallWatchdog::name(stats.last_step),
+                      static_cast<unsigned long long>(stats.last_recovery));
+      }
+      if (mFrameGuard.checkBuffer(*mem) != FrameGuard::Verdict::FORWARD) {
+        bctbx_warning("Dropping broken frame %u (flags 0x%x, %u/%u bytes)",
+                      mem->video_buffer.sequence, mem->video_buffer.flags,
+                      mem->used(), mem->len);
+        mem->done();
+        mDevice->queue(mem->index);
+        mGopCache.reset();
+        mIFrameArbiter.requestRecovery();
+        continue;
+      }
+      std::shared_ptr<h264camera::ShmPublisher> ring;
+      {
+        std::lock_guard<std::mutex> lock(mExportMutex);
+        ring = mExport;
+      }
+      if (ring && !ring->publish(*mem)) {
+        bctbx_warning("Frame %u too large for ring %s",
+                      mem->video_buffer.sequence, ring->name().c_str());
+      }
+      auto frame = FramePool::get(mPool);
+      separate_h264_nalus(mem, &frame->nalus, frame->info);
+      mDevice->queue(mem->index);
+      switch (mFrameGuard.checkFrame(frame->info)) {
+      case FrameGuard::Verdict::FORWARD:
+        if (frame->info.has(FrameInfo::HAS_IDR)) {
+          mIFrameArbiter.idrCaptured(now());
+        }
+        mParameterSets.process(&frame->nalus, frame->info);
+        if (!ms_queue_empty(&frame->nalus)) {
+          publish(frame);
+          if (mLost) {
+            mLost = false;
+            const auto elapsed = now() - mLostAt;
+            std::lock_guard<std::mutex> lock(mRecoveryMutex);
+            ++mRecovery.recoveries;
+            mRecovery.last_ms = elapsed;
+            mRecovery.max_ms = std::max(mRecovery.max_ms, elapsed);
+            bctbx_message("Recovered %s after %llu ms", mName.c_str(),
+                          static_cast<unsigned long long>(elapsed));
+          }
+        }
+        break;
+      case FrameGuard::Verdict::BAD:
+        bctbx_warning("Dropping malformed frame %u", frame->info.sequence);
+        mGopCache.reset();
+        mIFrameArbiter.requestRecovery();
+        break;
+      case FrameGuard::Verdict::DEPENDENT:
+        break;
+      }
+    }
+    mDevice->stop();
+  }
+  mDevice->close();
+  mGopCache.reset();
+}
+
+} // namespace mselph264
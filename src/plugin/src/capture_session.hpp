@@ -0,0 +1,271 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLUGIN_CAPTURE_SESSION_HPP__
+#define PLUGIN_CAPTURE_SESSION_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <mediastreamer2/msqueue.h>
+#include <mediastreamer2/msvideo.h>
+#include <h264camera/shm_ring.hpp>
+#include <h264camera/thread_policy.hpp>
+
+#include "frame_guard.hpp"
+#include "gop_cache.hpp"
+#include "h264helper.hpp"
+#include "iframe_arbiter.hpp"
+#include "parameter_sets.hpp"
+#include "seqlock.hpp"
+#include "stall_watchdog.hpp"
+
+namespace h264camera {
+class FrameSource;
+}
+
+namespace mselph264 {
+
+/// The frames of a camera for one reader, a bounded queue filled by the
+/// capture thread and emptied by the reader.
+///
+/// A reader cannot decode anything after a dropped frame up to the next
+/// IDR.  So on overflow the queue is emptied and frames are skipped until
+/// an IDR arrives.  A new subscription starts waiting for an IDR as well,
+/// unless the session fills it from its GopCache.
+class Subscription {
+public:
+  /// What to do on overflow besides skipping to the next IDR
+  enum class Overflow {
+    /// Ask the camera for an IDR, e.g., for a live stream
+    REQUEST_IDR,
+    /// Wait for the next IDR of the GOP, e.g., for a recording, so the
+    /// other readers do not pay for a slow one
+    WAIT_FOR_IDR,
+  };
+
+  struct Stats {
+    /// Frames taken by the reader
+    uint64_t delivered{0};
+    /// Frames dropped due to overflows or while waiting for an IDR
+    uint64_t dropped{0};
+    uint64_t overflows{0};
+  };
+
+  Subscription(std::size_t capacity, Overflow overflow)
+      : mCapacity(capacity), mOverflow(overflow) {}
+
+  /// Queue a frame, called by the capture thread.  Returns true, if the
+  /// reader needs an IDR from the camera.
+  bool push(const SharedFrame &frame);
+  /// Next frame or nullptr, called by the reader
+  SharedFrame pop();
+  /// Next frame, waiting up to *timeout* for one.  For readers with their
+  /// own thread.
+  SharedFrame pop(std::chrono::milliseconds timeout);
+  /// Wait up to *timeout* for a frame without taking it.  Returns true, if
+  /// one is queued.
+  bool wait(std::chrono::milliseconds timeout);
+
+  Stats stats() const;
+
+private:
+  mutable std::mutex mMutex;
+  std::condition_variable mQueued;
+  std::deque<SharedFrame> mFrames;
+  const std::size_t mCapacity;
+  const Overflow mOverflow;
+  bool mWaitingForIdr{true};
+  Stats mStats;
+};
+
+/// One capture of a camera shared by all its reader filters.
+///
+/// The session owns the frame source, the capture thread and the buffers.
+/// Every frame is parsed and fixed up once and then handed to all
+/// subscriptions by reference, so the cost of the capture does not depend
+/// on the count of readers.  The capture runs while there is at least one
+/// subscription.  A reader joining a running capture starts with the
+/// current GOP from the GopCache, if it fits into its queue.
+///
+/// The frames keep the SEI of the camera.  Dropping SEI, adding the
+/// timestamp SEI or stripping parameter sets is up to every reader, see
+/// ReaderPolicy.  The SPS rewrite and the video configuration apply to all
+/// readers, the last configuration set wins.  I-frame requests of all
+/// readers meet in one IFrameArbiter.  The configuration is published as a
+/// Seqlock, so the capture thread and the readers never wait for a reader
+/// setting it.
+///
+/// A capture failing with an exception, e.g., because the camera was
+/// unplugged, waits for the source to come back if it is reattachable and
+/// restarts with the last configuration.  The readers resume with an IDR.
+/// A capture running without frames is handled by the StallWatchdog.
+///
+/// The capture thread runs with the h264camera::ThreadPolicy set by a
+/// reader or, before, the one of the environment variable
+/// ELPH264_CAPTURE_POLICY, e.g., "fifo:50 cpus:2 mlock".
+class CaptureSession {
+public:
+  /// Failures of the capture and the time to the first frame after each
+  struct Recovery {
+    uint64_t losses{0};
+    uint64_t recoveries{0};
+    /// Milliseconds from the failure to the first frame
+    uint64_t last_ms{0};
+    uint64_t max_ms{0};
+  };
+
+  /// The session of camera *name* (see h264camera::make_frame_source).  It
+  /// is created by the first call and lives as long as someone holds it.
+  static std::shared_ptr<CaptureSession> get(const std::string &name);
+
+  ~CaptureSession();
+  CaptureSession(const CaptureSession &) = delete;
+  CaptureSession &operator=(const CaptureSession &) = delete;
+
+  const std::string &name() const { return mName; }
+
+  /// Start receiving frames, the first subscription starts the capture.
+  /// Later ones get the cached GOP or an IDR is requested for them.
+  std::shared_ptr<Subscription>
+  subscribe(std::size_t capacity = 8,
+            Subscription::Overflow overflow =
+                Subscription::Overflow::REQUEST_IDR);
+  /// Stop receiving frames, the last one stops the capture
+  void unsubscribe(const std::shared_ptr<Subscription> &subscription);
+  std::size_t subscriptions() const;
+  /// The capture loop runs.  It ends without a stop, if the source fails
+  /// and cannot be reattached.  The next subscription starts it again.
+  bool capturing() const { return !mStopped && !mLoopExited; }
+
+  MSVideoConfiguration videoConf() const { return mVideoConf.load().conf; }
+  /// Set the configuration, the capture restarts if size or frame rate
+  /// change
+  void setVideoConf(const MSVideoConfiguration &conf);
+  /// Set the configuration, unless a reader did before
+  void initVideoConf(const MSVideoConfiguration &conf);
+
+  /// I-frame request of a reader or a receiver, see IFrameArbiter
+  void requestIFrame(uint32_t receiver);
+  IFrameArbiter &iframeArbiter() { return mIFrameArbiter; }
+  /// SPS and PPS of the running configuration
+  ParameterSets &parameterSets() { return mParameterSets; }
+  /// Drops broken frames and the frames depending on them
+  const FrameGuard &frameGuard() const { return mFrameGuard; }
+  /// Primes readers joining a running capture
+  GopCache &gopCache() { return mGopCache; }
+  /// Restarts a capture delivering nothing
+  StallWatchdog &stallWatchdog() { return mStallWatchdog; }
+
+  h264camera::ThreadPolicy threadPolicy() const;
+  /// Set scheduling and memory locking of the capture thread, which
+  /// applies it with its next frame
+  void setThreadPolicy(const h264camera::ThreadPolicy &policy);
+
+  /// Publish the frames of the camera as they come from the device to the
+  /// shared memory ring *ring*, see h264camera::ShmPublisher.  An empty name
+  /// ends the export.  Returns false, if the ring cannot be created.
+  bool exportFrames(const std::string &ring);
+
+  Recovery recovery() const;
+
+private:
+  /// Recycles frames when the last reader is done with them
+  class FramePool;
+
+  CaptureSession(const std::string &name,
+                 std::unique_ptr<h264camera::FrameSource> source);
+
+  void start();
+  void stop();
+  void captureLoop();
+  /// Capture until stopped, throws if the source fails
+  void capture();
+  /// Wait for the source to come back after *error*.  Returns false, if
+  /// the capture cannot continue.
+  bool reattach(const std::exception &error);
+  /// Apply the ThreadPolicy in the capture thread
+  void applyThreadPolicy();
+  /// Lock the buffers of the started source, if the policy asks for it
+  void lockMemory();
+  /// Take the recovery step of the StallWatchdog
+  void recoverStall(StallWatchdog::Action action);
+  void publish(const SharedFrame &frame);
+  /// Milliseconds of a monotonic clock for the IFrameArbiter
+  static uint64_t now();
+
+  const std::string mName;
+  std::unique_ptr<h264camera::FrameSource> mDevice;
+  std::shared_ptr<FramePool> mPool;
+
+  /// Serializes start() and stop()
+  std::mutex mLifecycleMutex;
+  std::thread mCaptureThread;
+  // The capture loop will stop, if this is false.
+  std::atomic<bool> mRunning{false};
+  // The capture loop will restart after exit, if this is true.
+  std::atomic<bool> mReconfigure{false};
+  // Ends the capture loop for good, a reconfiguration cannot restart it
+  std::atomic<bool> mStopped{true};
+  // The capture loop ended, mCaptureThread waits to be joined
+  std::atomic<bool> mLoopExited{false};
+
+  struct VideoSettings {
+    MSVideoConfiguration conf;
+    /// A reader set the configuration
+    bool configured;
+  };
+  Seqlock<VideoSettings> mVideoConf;
+
+  mutable std::mutex mPolicyMutex;
+  h264camera::ThreadPolicy mThreadPolicy;
+  // The capture thread applies mThreadPolicy, if this is true.
+  std::atomic<bool> mThreadPolicyChanged{false};
+
+  mutable std::mutex mSubscriptionMutex;
+  std::vector<std::shared_ptr<Subscription>> mSubscriptions;
+
+  mutable std::mutex mRecoveryMutex;
+  Recovery mRecovery;
+  // Used by the capture thread only: the capture failed at mLostAt and no
+  // frame was published since, if this is true.
+  bool mLost{false};
+  uint64_t mLostAt{0};
+
+  std::mutex mExportMutex;
+  std::shared_ptr<h264camera::ShmPublisher> mExport;
+
+  // Used by the capture thread only, besides the thread safe accessors
+  ParameterSets mParameterSets;
+  FrameGuard mFrameGuard;
+  IFrameArbiter mIFrameArbiter;
+  StallWatchdog mStallWatchdog;
+  // Filled by the capture thread under mSubscriptionMutex, so a new
+  // subscription continues exactly where the cached GOP ends
+  GopCache mGopCache;
+};
+
+} // namespace mselph264
+
+#endif
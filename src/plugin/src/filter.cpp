@@ -17,41 +17,64 @@
 
 #include "filter.hpp"
 
+#include <algorithm>
 #include <bctoolbox/logging.h>
 #include <cassert>
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <mediastreamer2/msfilter.h>
 #include <mediastreamer2/msticker.h>
 #include <mediastreamer2/msvideo.h>
+#include <stdexcept>
+#include <utility>
 
-#include "h264camera/elp_usb100w04h.hpp"
+#include "h264camera/frame_source.hpp"
 #include "h264helper.hpp"
+#include "methods.hpp"
+#include "ticker_wakeup.hpp"
 #include "utils.hpp"
 
-
 using namespace h264camera;
 using namespace std::chrono_literals;
 
 namespace mselph264 {
 
-/// MSFilter is locked during lifetime of FilterLock
-struct FilterLock {
-  FilterLock(MSFilter *f) : filter(f) { ms_filter_lock(filter); }
-  ~FilterLock() { ms_filter_unlock(filter); }
-  MSFilter *filter{nullptr};
-};
+namespace {
+
+VideoSize to_video_size(MSVideoSize vsize) {
+  return {static_cast<unsigned int>(vsize.width),
+          static_cast<unsigned int>(vsize.height)};
+}
+
+/// Sizes of all configurations, each gets a placeholder stream
+std::vector<VideoSize> video_sizes() {
+  std::vector<VideoSize> sizes;
+  for (const auto &vconf : State::sVideoConfList) {
+    sizes.push_back(to_video_size(vconf.vsize));
+  }
+  return sizes;
+}
+
+} // namespace
 
 State::State(MSFilter *filter)
     : mFilter(filter), mVideoConf(ms_video_find_best_configuration_for_size(
-                           sVideoConfList.data(), MS_VIDEO_SIZE_720P, 1)) {
+                           sVideoConfList.data(), MS_VIDEO_SIZE_720P, 1)),
+      mKeepAlive(video_sizes()) {
+  const auto vconf = mVideoConf.load();
   bctbx_debug("Start vconf: %dbit/s %dbit/s %dx%d %ffps mincpu: %d extra: %p",
-              mVideoConf.required_bitrate, mVideoConf.bitrate_limit,
-              mVideoConf.vsize.width, mVideoConf.vsize.height, mVideoConf.fps,
-              mVideoConf.mincpu, mVideoConf.extra);
+              vconf.required_bitrate, vconf.bitrate_limit, vconf.vsize.width,
+              vconf.vsize.height, vconf.fps, vconf.mincpu, vconf.extra);
+  // For applications not calling MS_ELPH264_SET_FRAME_WAKEUP
+  if (const char *wakeup = std::getenv("ELPH264_FRAME_WAKEUP")) {
+    mFrameWakeup = std::strcmp(wakeup, "0") != 0;
+  }
 }
 
+State::~State() { stopRecording(); }
+
 State *State::from(MSFilter *filter) {
   assert(filter);
   assert(filter->data);
@@ -60,187 +83,178 @@ State *State::from(MSFilter *filter) {
 
 void State::setDevice(const std::string &path) {
   bctbx_message("Set camera device %s", path.c_str());
-  mDevice = std::make_unique<h264camera::Usb100W04H>(path);
-}
-
-void State::captureLoop() {
-  assert(mDevice);
-  ms_message("Start capture loop");
-  try {
-    while (mReconfigure) {
-      // Configure camera berfore opening the stream
-      MSVideoConfiguration vconf;
-      {
-        FilterLock lock(mFilter);
-        vconf = mVideoConf;
-        mReconfigure = false;
-        mRunning = true;
-      }
-      bctbx_message(
-          "Reconfigure %dbit/s %dbit/s %dx%d %ffps mincpu: %d extra: %p",
-          vconf.required_bitrate, vconf.bitrate_limit, vconf.vsize.width,
-          vconf.vsize.height, vconf.fps, vconf.mincpu, vconf.extra);
-      mDevice->reopen();
-      mDevice->xuEnableSeiHeader(true);
-      mDevice->setFormat(vconf.vsize.width, vconf.vsize.height,
-                         V4L2_PIX_FMT_H264);
-      mDevice->setFramerate(vconf.fps);
-      mDevice->mmap();
-
-      ms_video_starter_first_frame(&mVideoStarter, mFilter->ticker->time);
-      mDevice->streamOn();
-
-      // The camera is mounted upside down in SmartConnect door, so flip it
-      // before sending images.
-      //
-      // Toggle flip option between frames to take effect
-      if (auto frame = mDevice->dequeue(500ms)) {
-        frame->done();
-        mDevice->queue(frame->index);
-      }
-      mDevice->xuSetFlip(false);
-      if (auto frame = mDevice->dequeue(500ms)) {
-        frame->done();
-        mDevice->queue(frame->index);
-      }
-      mDevice->xuSetFlip(true);
-      if (auto frame = mDevice->dequeue(500ms)) {
-        frame->done();
-        mDevice->queue(frame->index);
-      }
-      mDevice->xuResetIFrame();
-
-      while (mRunning) {
-        if (ms_video_starter_need_i_frame(&mVideoStarter,
-					  mFilter->ticker->time) ||
-           ms_iframe_requests_limiter_iframe_requested(
-						       &mIFrameLimiter,
-						       mFilter->ticker->time)) {
-	   mDevice->xuResetIFrame();
-	   ms_iframe_requests_limiter_notify_iframe_sent(&mIFrameLimiter,
-							mFilter->ticker->time);
-        }
-
-        if (auto frame = mDevice->dequeue(200ms)) {
-	  MSQueue *nalus = getMSQueue();
-	  separate_h264_nalus(frame, nalus);
-
-	  mCaptureMutex.lock();
-	  if (!ms_queue_empty(nalus)) {
-	    mNalusQueue.push(nalus);
-	  } else {
-	    mAvailableNalus.push(nalus);
-	  }
-	  mCaptureMutex.unlock();
-	  mDevice->queue(frame->index);
-        } else {
-          bctbx_warning("Timeout when waiting for a new frame");
-        }
-      }
-      mDevice->streamOff();
-    }
-    mDevice->close();
-  } catch (const std::exception &e) {
-    ms_error("Something went wrong in the capture loop %s", e.what());
-  }
-  ms_message("Stop capture loop");
+  mSession = CaptureSession::get(path);
+  mSession->initVideoConf(mVideoConf.load());
 }
 
 void State::preprocess() {
-  assert(mDevice);
+  assert(mSession);
 
   mPacker = rfc3984_new_with_factory(mFilter->factory);
   rfc3984_set_mode(mPacker, 1);
   ms_video_starter_init(&mVideoStarter);
-  ms_iframe_requests_limiter_init(&mIFrameLimiter, 1000);
-
-  mCaptureThread = std::thread(&State::captureLoop, this);
+  mStopStarter = false;
+  ms_video_starter_first_frame(&mVideoStarter, mFilter->ticker->time);
+  mKeepAlive.start(mFilter->ticker->time);
+  mRtpClock.reset();
+
+  mSubscription = mSession->subscribe(mQueueCapacity, mOverflow);
+  if (mFrameWakeup) {
+    mDrivesTicker = drive_ticker(mFilter->ticker, mSubscription);
+    if (!mDrivesTicker) {
+      bctbx_warning("Ticker is driven by another filter already");
+    }
+  }
 }
 
 void State::process() {
-  // rtp uses a 90 kHz clockrate for video
-  auto timestamp = mFilter->ticker->time * 90;
-
-  if (mCaptureMutex.try_lock()) {
-    while (!mNalusQueue.empty()) {
-      MSQueue *nalus = mNalusQueue.front();
-      if (!ms_queue_empty(nalus)) {
-        rfc3984_pack(mPacker, nalus, mFilter->outputs[0], timestamp);
-      }
-      mNalusQueue.pop();
-      ms_queue_flush(nalus);
-      mAvailableNalus.push(nalus);
+  const uint64_t now = mFilter->ticker->time;
+  // rtp uses a 90 kHz clockrate for video, frames are at least one nominal
+  // frame interval apart unless their capture times tell otherwise
+  const uint64_t interval =
+      static_cast<uint64_t>(90000 / std::max(fps(), 1.f));
+
+  if (mStopStarter.exchange(false)) {
+    ms_video_starter_deactivate(&mVideoStarter);
+  }
+  if (ms_video_starter_need_i_frame(&mVideoStarter, now)) {
+    mSession->requestIFrame(IFrameArbiter::LOCAL);
+  }
+
+  bool sent{false};
+  MSQueue nalus;
+  ms_queue_init(&nalus);
+  while (auto frame = mSubscription->pop()) {
+    if (!mKeepAlive.frame(frame->info, now)) {
+      // Receivers decode the placeholders until the camera sends an IDR
+      mSession->iframeArbiter().requestRecovery();
+      continue;
     }
-    mCaptureMutex.unlock();
+    mReaderPolicy.copy(*frame, &nalus);
+    const uint64_t timestamp =
+        mRtpClock.stamp(now, frame->info.timestamp_us, interval);
+    rfc3984_pack(mPacker, &nalus, mFilter->outputs[0], timestamp);
+    ms_queue_flush(&nalus);
+    sent = true;
+  }
+
+  if (!sent && mKeepAlive.idle(to_video_size(vsize()), now, &nalus)) {
+    rfc3984_pack(mPacker, &nalus, mFilter->outputs[0],
+                 mRtpClock.stamp(now, 0, interval));
+    ms_queue_flush(&nalus);
   }
 }
 
 void State::postprocess() {
-  mReconfigure = false;
-  mRunning = false;
-  mCaptureThread.join();
-
+  if (mDrivesTicker) {
+    release_ticker(mFilter->ticker);
+    mDrivesTicker = false;
+  }
+  // A recording keeps running, see startRecording()
+  mSession->unsubscribe(mSubscription);
+  mSubscription.reset();
   rfc3984_destroy(mPacker);
+}
 
-  while (!mNalusQueue.empty()) {
-    MSQueue *nalus = mNalusQueue.front();
-    ms_queue_flush(nalus);
-    delete nalus;
-    mNalusQueue.pop();
+Subscription::Stats State::queueStats() const {
+  return mSubscription ? mSubscription->stats() : Subscription::Stats{};
+}
+
+bool State::startRecording(const std::string &prefix) {
+  if (!mSession || prefix.empty()) {
+    return false;
+  }
+  stopRecording();
+  // A recording must not cost the live readers extra IDRs
+  auto recording =
+      mSession->subscribe(64, Subscription::Overflow::WAIT_FOR_IDR);
+  std::shared_ptr<Recorder> recorder;
+  std::shared_ptr<Subscription> previous;
+  {
+    std::lock_guard<std::mutex> lock(mRecorderMutex);
+    auto config = mRecorderConfig;
+    config.prefix = prefix;
+    recorder = std::make_shared<Recorder>(config);
+    recorder->start(recording);
+    // Another thread started a recording meanwhile, the last one wins
+    std::swap(mRecorder, recorder);
+    previous = std::exchange(mRecording, recording);
   }
-  while (!mAvailableNalus.empty()) {
-    MSQueue *nalus = mAvailableNalus.front();
-    ms_queue_flush(nalus);
-    delete nalus;
-    mAvailableNalus.pop();
+  if (previous) {
+    recorder->stop();
+    mSession->unsubscribe(previous);
   }
+  return true;
 }
 
-MSQueue *State::getMSQueue() {
-  MSQueue *queue;
+void State::stopRecording() {
+  std::shared_ptr<Recorder> recorder;
+  std::shared_ptr<Subscription> recording;
+  {
+    std::lock_guard<std::mutex> lock(mRecorderMutex);
+    recorder = mRecorder;
+    recording = std::move(mRecording);
+  }
+  if (!recording) {
+    return;
+  }
+  // Waits for the writer thread, e.g., blocked by a slow disk
+  recorder->stop();
+  mSession->unsubscribe(recording);
+}
+
+void State::setRecordingRotation(uint64_t segment_ms,
+                                 uint64_t segment_bytes) {
+  std::lock_guard<std::mutex> lock(mRecorderMutex);
+  mRecorderConfig.segment_ms = segment_ms;
+  mRecorderConfig.segment_bytes = segment_bytes;
+}
 
-  if (!mAvailableNalus.empty()) {
-    queue = mAvailableNalus.front();
-    mAvailableNalus.pop();
-  } else {
-    queue = new MSQueue();
-    ms_queue_init(queue);
+Recorder::Stats State::recordingStats() const {
+  std::shared_ptr<Recorder> recorder;
+  {
+    std::lock_guard<std::mutex> lock(mRecorderMutex);
+    recorder = mRecorder;
   }
-  return queue;
+  return recorder ? recorder->stats() : Recorder::Stats{};
 }
 
 const MSVideoConfiguration *State::videoConfList() {
   return sVideoConfList.data();
 }
 
-void State::setVideoConf(MSVideoConfiguration conf) {
+MSVideoConfiguration State::videoConf() const {
+  return mSession ? mSession->videoConf() : mVideoConf.load();
+}
+
+bool State::setVideoConf(MSVideoConfiguration conf) {
   bctbx_set_log_level("mediastreamer", BCTBX_LOG_MESSAGE);
   if ((conf.vsize.width == 1280 && conf.vsize.height == 720) ||
       (conf.vsize.width == 800 && conf.vsize.height == 600) ||
       (conf.vsize.width == 640 && conf.vsize.height == 480)) {
-    {
-      FilterLock lock(mFilter);
-      if (conf.vsize != mVideoConf.vsize || conf.fps != mVideoConf.fps) {
-        mReconfigure = true;
-        mRunning = false;
-      }
-      mVideoConf = conf;
+    mVideoConf.store(conf);
+    if (mSession) {
+      mSession->setVideoConf(conf);
     }
-  } else {
-    bctbx_error("Passing invalid resolution: %dx%d", conf.vsize.width,
-                conf.vsize.height);
+    return true;
   }
+  bctbx_error("Passing invalid resolution: %dx%d", conf.vsize.width,
+              conf.vsize.height);
+  return false;
 }
 
-void State::requestVFU() {
-  FilterLock lock(mFilter);
-  ms_video_starter_deactivate(&mVideoStarter);
-  ms_iframe_requests_limiter_request_iframe(&mIFrameLimiter);
-}
+void State::requestVFU() { requestIFrameFrom(mReceiver); }
 
 void State::notifyPLI() { requestVFU(); }
 void State::notifyFIR() { requestVFU(); }
 
+void State::requestIFrameFrom(uint32_t receiver) {
+  mStopStarter = true;
+  if (mSession) {
+    mSession->requestIFrame(receiver);
+  }
+}
+
 // Define callbacks for various filter method calls.
 // Implement methods listed in msinterfaces.h listed for
 // MSFilterVideoEncoderInterface
@@ -299,8 +313,7 @@ static MSFilterMethod filter_method_table[] = {
                    vconf->required_bitrate, vconf->bitrate_limit,
                    vconf->vsize.width, vconf->vsize.height, vconf->fps,
                    vconf->mincpu, vconf->extra);
-       state->setVideoConf(*vconf);
-       return 0;
+       return state->setVideoConf(*vconf) ? 0 : -1;
      }},
     {MS_VIDEO_ENCODER_REQ_VFU,
      [](MSFilter *f, void *) -> int {
@@ -330,6 +343,328 @@ static MSFilterMethod filter_method_table[] = {
                    *enable_avpf);
        return 0;
      }},
+    {MS_ELPH264_ENABLE_TIMESTAMP_SEI,
+     [](MSFilter *f, void *arg) -> int {
+       auto enable = static_cast<bool *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_ENABLE_TIMESTAMP_SEI %d",
+                   *enable);
+       State::from(f)->readerPolicy().enableTimestampSei(*enable);
+       return 0;
+     }},
+    {MS_ELPH264_GET_SPROP_PARAMETER_SETS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_SPROP_PARAMETER_SETS");
+       auto session = State::from(f)->session();
+       const auto sprop = session ? session->parameterSets().sprop() : "";
+       if (sprop.empty()) {
+         return -1;
+       }
+       *static_cast<char **>(arg) = ms_strdup(sprop.c_str());
+       return 0;
+     }},
+    {MS_ELPH264_STRIP_PARAMETER_SETS,
+     [](MSFilter *f, void *arg) -> int {
+       auto enable = static_cast<bool *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_STRIP_PARAMETER_SETS %d",
+                   *enable);
+       State::from(f)->readerPolicy().stripParameterSets(*enable);
+       return 0;
+     }},
+    {MS_ELPH264_SET_SPS_REWRITE,
+     [](MSFilter *f, void *arg) -> int {
+       auto mode = *static_cast<int *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_SPS_REWRITE %d", mode);
+       auto session = State::from(f)->session();
+       if (!session || mode < MS_ELPH264_SPS_UNCHANGED ||
+           mode > MS_ELPH264_SPS_ZERO_REORDER_TIMING) {
+         return -1;
+       }
+       session->parameterSets().rewriteSps(
+           mode != MS_ELPH264_SPS_UNCHANGED,
+           mode == MS_ELPH264_SPS_ZERO_REORDER_TIMING);
+       return 0;
+     }},
+    {MS_ELPH264_SET_SEI_POLICY,
+     [](MSFilter *f, void *arg) -> int {
+       auto policy = *static_cast<int *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_SEI_POLICY %d", policy);
+       auto &reader = State::from(f)->readerPolicy();
+       switch (policy) {
+       case MS_ELPH264_SEI_KEEP:
+         reader.setSeiPolicy(SeiPolicy::KEEP);
+         return 0;
+       case MS_ELPH264_SEI_DROP:
+         reader.setSeiPolicy(SeiPolicy::DROP);
+         return 0;
+       case MS_ELPH264_SEI_KEEP_ON_IDR:
+         reader.setSeiPolicy(SeiPolicy::KEEP_ON_IDR);
+         return 0;
+       default:
+         return -1;
+       }
+     }},
+    {MS_ELPH264_GET_SEI_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_SEI_STATS");
+       const auto &reader = State::from(f)->readerPolicy();
+       auto stats = static_cast<MSElph264SeiStats *>(arg);
+       stats->dropped = reader.droppedSei();
+       stats->dropped_bytes = reader.droppedSeiBytes();
+       return 0;
+     }},
+    {MS_ELPH264_REQUEST_IFRAME_FROM,
+     [](MSFilter *f, void *arg) -> int {
+       auto receiver = *static_cast<uint32_t *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_REQUEST_IFRAME_FROM %u",
+                   receiver);
+       State::from(f)->requestIFrameFrom(receiver);
+       return 0;
+     }},
+    {MS_ELPH264_SET_IFRAME_WINDOW,
+     [](MSFilter *f, void *arg) -> int {
+       auto window = *static_cast<int *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_IFRAME_WINDOW %d", window);
+       auto session = State::from(f)->session();
+       if (!session || window < 0) {
+         return -1;
+       }
+       session->iframeArbiter().setWindow(
+           static_cast<uint64_t>(window));
+       return 0;
+     }},
+    {MS_ELPH264_GET_IFRAME_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_IFRAME_STATS");
+       auto session = State::from(f)->session();
+       if (!session) {
+         return -1;
+       }
+       const auto stats = session->iframeArbiter().stats();
+       auto out = static_cast<MSElph264IFrameStats *>(arg);
+       out->requests = stats.requests;
+       out->sent = stats.sent;
+       out->suppressed = stats.suppressed;
+       out->coalesced = stats.coalesced;
+       out->idr_frames = stats.idr_frames;
+       return 0;
+     }},
+    {MS_ELPH264_GET_CAPTURE_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_CAPTURE_STATS");
+       auto session = State::from(f)->session();
+       if (!session) {
+         return -1;
+       }
+       const auto stats = session->frameGuard().stats();
+       auto out = static_cast<MSElph264CaptureStats *>(arg);
+       out->frames = stats.frames;
+       out->errored = stats.errored;
+       out->empty = stats.empty;
+       out->truncated = stats.truncated;
+       out->malformed = stats.malformed;
+       out->dependent = stats.dependent;
+       return 0;
+     }},
+    {MS_ELPH264_SET_KEEPALIVE,
+     [](MSFilter *f, void *arg) -> int {
+       auto timeout = *static_cast<int *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_KEEPALIVE %d", timeout);
+       if (timeout < 0) {
+         return -1;
+       }
+       State::from(f)->keepAlive().setTimeout(static_cast<uint64_t>(timeout));
+       return 0;
+     }},
+    {MS_ELPH264_GET_KEEPALIVE_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_KEEPALIVE_STATS");
+       const auto stats = State::from(f)->keepAlive().stats();
+       auto out = static_cast<MSElph264KeepAliveStats *>(arg);
+       out->placeholders = stats.placeholders;
+       out->dropped = stats.dropped;
+       return 0;
+     }},
+    {MS_ELPH264_SET_QUEUE,
+     [](MSFilter *f, void *arg) -> int {
+       auto queue = static_cast<const MSElph264Queue *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_QUEUE %d %d",
+                   queue->capacity, queue->overflow);
+       if (queue->capacity < 1 ||
+           (queue->overflow != MS_ELPH264_OVERFLOW_REQUEST_IDR &&
+            queue->overflow != MS_ELPH264_OVERFLOW_WAIT_FOR_IDR)) {
+         return -1;
+       }
+       FilterLock lock(f);
+       State::from(f)->setQueue(
+           static_cast<std::size_t>(queue->capacity),
+           queue->overflow == MS_ELPH264_OVERFLOW_REQUEST_IDR
+               ? Subscription::Overflow::REQUEST_IDR
+               : Subscription::Overflow::WAIT_FOR_IDR);
+       return 0;
+     }},
+    {MS_ELPH264_GET_QUEUE_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_QUEUE_STATS");
+       auto state = State::from(f);
+       const auto stats = state->queueStats();
+       auto out = static_cast<MSElph264QueueStats *>(arg);
+       out->delivered = stats.delivered;
+       out->dropped = stats.dropped;
+       out->overflows = stats.overflows;
+       const auto session = state->session();
+       out->readers =
+           session ? static_cast<int>(session->subscriptions()) : 0;
+       return 0;
+     }},
+    {MS_ELPH264_SET_GOP_CACHE,
+     [](MSFilter *f, void *arg) -> int {
+       auto cache = static_cast<const MSElph264GopCache *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_GOP_CACHE %d %d",
+                   cache->max_frames, cache->max_bytes);
+       auto session = State::from(f)->session();
+       if (!session || cache->max_frames < 0 || cache->max_bytes < 0) {
+         return -1;
+       }
+       GopCache::Limits limits;
+       limits.frames = static_cast<std::size_t>(cache->max_frames);
+       limits.bytes = static_cast<std::size_t>(cache->max_bytes);
+       session->gopCache().setLimits(limits);
+       return 0;
+     }},
+    {MS_ELPH264_GET_GOP_CACHE_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_GOP_CACHE_STATS");
+       auto session = State::from(f)->session();
+       if (!session) {
+         return -1;
+       }
+       const auto stats = session->gopCache().stats();
+       auto out = static_cast<MSElph264GopCacheStats *>(arg);
+       out->hits = stats.hits;
+       out->misses = stats.misses;
+       out->overflows = stats.overflows;
+       out->frames = stats.frames;
+       out->bytes = stats.bytes;
+       return 0;
+     }},
+    {MS_ELPH264_START_RECORDING,
+     [](MSFilter *f, void *arg) -> int {
+       auto prefix = static_cast<const char *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_START_RECORDING %s",
+                   prefix ? prefix : "(null)");
+       return (prefix && State::from(f)->startRecording(prefix)) ? 0 : -1;
+     }},
+    {MS_ELPH264_STOP_RECORDING,
+     [](MSFilter *f, void *) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_STOP_RECORDING");
+       State::from(f)->stopRecording();
+       return 0;
+     }},
+    {MS_ELPH264_SET_RECORDING_ROTATION,
+     [](MSFilter *f, void *arg) -> int {
+       auto rotation = static_cast<const MSElph264Rotation *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_RECORDING_ROTATION %d %d",
+                   rotation->max_seconds, rotation->max_megabytes);
+       if (rotation->max_seconds < 0 || rotation->max_megabytes < 0) {
+         return -1;
+       }
+       State::from(f)->setRecordingRotation(
+           static_cast<uint64_t>(rotation->max_seconds) * 1000,
+           static_cast<uint64_t>(rotation->max_megabytes) * 1024 * 1024);
+       return 0;
+     }},
+    {MS_ELPH264_GET_RECORDING_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_RECORDING_STATS");
+       const auto stats = State::from(f)->recordingStats();
+       auto out = static_cast<MSElph264RecordingStats *>(arg);
+       out->segments = stats.segments;
+       out->fragments = stats.fragments;
+       out->frames = stats.frames;
+       out->bytes = stats.bytes;
+       out->errors = stats.errors;
+       return 0;
+     }},
+    {MS_ELPH264_EXPORT_FRAMES,
+     [](MSFilter *f, void *arg) -> int {
+       auto ring = static_cast<const char *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_EXPORT_FRAMES %s",
+                   ring ? ring : "(null)");
+       auto session = State::from(f)->session();
+       if (!session || !ring) {
+         return -1;
+       }
+       return session->exportFrames(ring) ? 0 : -1;
+     }},
+    {MS_ELPH264_GET_RECOVERY_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_RECOVERY_STATS");
+       auto session = State::from(f)->session();
+       if (!session) {
+         return -1;
+       }
+       const auto stats = session->recovery();
+       auto out = static_cast<MSElph264RecoveryStats *>(arg);
+       out->losses = stats.losses;
+       out->recoveries = stats.recoveries;
+       out->last_ms = stats.last_ms;
+       out->max_ms = stats.max_ms;
+       return 0;
+     }},
+    {MS_ELPH264_SET_STALL_TIMEOUT,
+     [](MSFilter *f, void *arg) -> int {
+       const int timeout = *static_cast<int *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_STALL_TIMEOUT %d", timeout);
+       auto session = State::from(f)->session();
+       if (!session || timeout < 0) {
+         return -1;
+       }
+       session->stallWatchdog().setTimeout(static_cast<uint64_t>(timeout));
+       return 0;
+     }},
+    {MS_ELPH264_GET_STALL_STATS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Filter method: MS_ELPH264_GET_STALL_STATS");
+       auto session = State::from(f)->session();
+       if (!session) {
+         return -1;
+       }
+       const auto stats = session->stallWatchdog().stats();
+       auto out = static_cast<MSElph264StallStats *>(arg);
+       out->stalls = stats.stalls;
+       out->requeues = stats.requeues;
+       out->restarts = stats.restarts;
+       out->reopens = stats.reopens;
+       out->recoveries = stats.recoveries;
+       out->last_recovery_ms = stats.last_recovery;
+       out->max_recovery_ms = stats.max_recovery;
+       return 0;
+     }},
+    {MS_ELPH264_SET_CAPTURE_POLICY,
+     [](MSFilter *f, void *arg) -> int {
+       auto text = static_cast<const char *>(arg);
+       bctbx_debug("Filter method: MS_ELPH264_SET_CAPTURE_POLICY %s",
+                   text ? text : "(null)");
+       auto session = State::from(f)->session();
+       if (!session || !text) {
+         return -1;
+       }
+       try {
+         session->setThreadPolicy(h264camera::parse_thread_policy(text));
+       } catch (const std::invalid_argument &e) {
+         bctbx_warning("Invalid capture policy: %s", e.what());
+         return -1;
+       }
+       return 0;
+     }},
+    {MS_ELPH264_SET_FRAME_WAKEUP,
+     [](MSFilter *f, void *arg) -> int {
+       const bool enable = *static_cast<int *>(arg) != 0;
+       bctbx_debug("Filter method: MS_ELPH264_SET_FRAME_WAKEUP %d", enable);
+       FilterLock lock(f);
+       State::from(f)->setFrameWakeup(enable);
+       return 0;
+     }},
     {MS_VIDEO_ENCODER_IS_HARDWARE_ACCELERATED,
      [](MSFilter *, void *arg) -> int {
        bctbx_debug("Filter method: MS_VIDEO_ENCODER_IS_HARDWARE_ACCELERATED");
@@ -21,48 +21,97 @@
 #include <array>
 #include <atomic>
 #include <memory>
-#include <string>
-#include <queue>
 #include <mutex>
-#include <thread>
+#include <string>
 #include <mediastreamer2/mscodecutils.h>
 #include <mediastreamer2/msfilter.h>
 #include <mediastreamer2/msvideo.h>
 #include <mediastreamer2/rfc3984.h>
 
-namespace h264camera {
-	class Usb100W04H;
-}
+#include "capture_session.hpp"
+#include "placeholder.hpp"
+#include "reader_policy.hpp"
+#include "recorder.hpp"
+#include "rtp_clock.hpp"
+#include "seqlock.hpp"
 
 namespace mselph264 {
 
 /// Structure holding all relevant data during the lifetime of the
 /// filter.  It is to be created in the init method and will be
 /// destroyed on uninit.  The reference is stored int filter->data.
+///
+/// The capture itself is done by the CaptureSession of the camera, which
+/// is shared with the other filters reading the same camera.
+///
+/// Video configuration and I-frame requests come from the signalling
+/// thread without the filter lock, so they never wait for the ticker.
 class State {
 public:
   State(MSFilter *filter);
+  ~State();
 
   /// Extract the State from the userdata in a MSFilter
   static State *from(MSFilter *filter);
-  /// Set the video device string. Device will be opened during the
+  /// Set the video device string, which may also name a replay source (see
+  /// h264camera::make_frame_source).  Device will be opened during the
   /// preprocessing.
   void setDevice(const std::string &path);
+  /// The capture of the device, nullptr before setDevice()
+  CaptureSession *session() { return mSession.get(); }
 
   void preprocess();
   void process();
   void postprocess();
 
   const MSVideoConfiguration *videoConfList();
-  MSVideoConfiguration videoConf() const { return mVideoConf; }
-  void setVideoConf(MSVideoConfiguration conf);
+  MSVideoConfiguration videoConf() const;
+  /// Returns false and keeps the configuration for a size the camera does
+  /// not support, e.g., QVGA of sVideoConfList
+  bool setVideoConf(MSVideoConfiguration conf);
 
-  MSVideoSize vsize() const { return mVideoConf.vsize; }
-  float fps() const { return mVideoConf.fps; }
+  MSVideoSize vsize() const { return videoConf().vsize; }
+  float fps() const { return videoConf().fps; }
 
+  /// I-frame requests of the receiver of this filter
   void requestVFU();
   void notifyPLI();
   void notifyFIR();
+  /// I-frame request of a known receiver, e.g., identified by its SSRC
+  void requestIFrameFrom(uint32_t receiver);
+
+  /// Size and overflow handling of the frame queue of this filter.  Takes
+  /// effect with the next preprocessing.
+  void setQueue(std::size_t capacity, Subscription::Overflow overflow) {
+    mQueueCapacity = capacity;
+    mOverflow = overflow;
+  }
+  /// Counters of the frame queue, all zero while not running
+  Subscription::Stats queueStats() const;
+
+  /// Send frames as soon as they are captured instead of with the next
+  /// tick, see drive_ticker().  Takes effect with the next preprocessing.
+  void setFrameWakeup(bool enable) { mFrameWakeup = enable; }
+
+  /// Sends placeholder frames while the camera delivers none
+  KeepAlive &keepAlive() { return mKeepAlive; }
+  /// SEI and parameter set handling of the frames sent by this filter
+  ReaderPolicy &readerPolicy() { return mReaderPolicy; }
+
+  /// Record the camera to fragmented MP4 files starting with *prefix*, see
+  /// Recorder.  The recording reads the capture session like another
+  /// filter, so it also runs while the filter does not: postprocessing
+  /// keeps it and the camera open until stopRecording() or the filter is
+  /// destroyed.
+  ///
+  /// The recording methods do not need the filter lock.  Stopping waits for
+  /// the file to be written, which must not block the ticker.
+  bool startRecording(const std::string &prefix);
+  void stopRecording();
+  /// File limits of the next recording
+  void setRecordingRotation(uint64_t segment_ms, uint64_t segment_bytes);
+  /// Counters of the current or last recording
+  Recorder::Stats recordingStats() const;
 
   // Just guessuing. CPU count does not matter, since the hardware encoder does
   // all the hard work.
@@ -77,28 +126,38 @@ public:
        MS_VIDEO_CONF(0, 150000, QCIF, 10, 0)}};
 
 private:
-  void captureLoop();
-  MSQueue *getMSQueue();
-
   MSFilter *mFilter{nullptr};
-  /// The camera device.  It will be set by the create_reader call in the
-  /// MSWebCamDesc.
-  std::unique_ptr<h264camera::Usb100W04H> mDevice;
-  /// Selected configuration
-  MSVideoConfiguration mVideoConf;
-
-  std::thread mCaptureThread;
-  std::mutex mCaptureMutex;
-  // The capture loop will stop, if this is false.
-  std::atomic<bool> mRunning{false};
-  // The capture loop will restart after exit, if this is true.
-  std::atomic<bool> mReconfigure{true};
-  std::queue<MSQueue *> mNalusQueue;
-  std::queue<MSQueue *> mAvailableNalus;
+  /// Id of this filter for the IFrameArbiter of the shared session, so the
+  /// requests of one call do not limit the ones of another
+  const uint32_t mReceiver{IFrameArbiter::uniqueReceiver()};
+  std::shared_ptr<CaptureSession> mSession;
+  /// Frames of the session for this filter while running
+  std::shared_ptr<Subscription> mSubscription;
+  std::size_t mQueueCapacity{8};
+  Subscription::Overflow mOverflow{Subscription::Overflow::REQUEST_IDR};
+  bool mFrameWakeup{false};
+  /// The ticker is driven by the subscription
+  bool mDrivesTicker{false};
+  /// Configuration until a session exists
+  Seqlock<MSVideoConfiguration> mVideoConf;
 
   Rfc3984Context *mPacker{nullptr};
+  /// RTP timestamps of the packed frames
+  RtpClock mRtpClock;
   MSVideoStarter mVideoStarter;
-  MSIFrameRequestsLimiterCtx mIFrameLimiter;
+  /// A receiver asked for an I-frame, so the ticker stops mVideoStarter
+  std::atomic<bool> mStopStarter{false};
+  // Used by the ticker thread only, besides the thread safe accessors
+  KeepAlive mKeepAlive;
+  ReaderPolicy mReaderPolicy;
+
+  /// Guards the recording members, but is never held while a recording
+  /// stops
+  mutable std::mutex mRecorderMutex;
+  Recorder::Config mRecorderConfig;
+  /// The current or last recording, for its stats
+  std::shared_ptr<Recorder> mRecorder;
+  std::shared_ptr<Subscription> mRecording;
 };
 
 } // namespace mselph264
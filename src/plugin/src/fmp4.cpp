@@ -0,0 +1,291 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "fmp4.hpp"
+
+#include <algorithm>
+
+#include "h264helper.hpp"
+#include "sps_rewriter.hpp"
+
+using namespace std;
+
+namespace mselph264 {
+
+namespace {
+
+/// Appends big endian fields and boxes to a buffer
+class BoxWriter {
+public:
+  void u8(uint32_t value) { mData.push_back(static_cast<uint8_t>(value)); }
+  void u16(uint32_t value) {
+    u8(value >> 8);
+    u8(value);
+  }
+  void u32(uint32_t value) {
+    u16(value >> 16);
+    u16(value);
+  }
+  void u64(uint64_t value) {
+    u32(static_cast<uint32_t>(value >> 32));
+    u32(static_cast<uint32_t>(value));
+  }
+  void zeros(size_t count) { mData.insert(mData.end(), count, 0); }
+  void bytes(const vector<uint8_t> &data) {
+    mData.insert(mData.end(), data.begin(), data.end());
+  }
+  void fourcc(const char *type) {
+    mData.insert(mData.end(), type, type + 4);
+  }
+
+  /// Start a box, returns the position for end()
+  size_t box(const char *type) {
+    const auto pos = mData.size();
+    u32(0);
+    fourcc(type);
+    return pos;
+  }
+  size_t fullBox(const char *type, uint8_t version, uint32_t flags) {
+    const auto pos = box(type);
+    u32((static_cast<uint32_t>(version) << 24) | flags);
+    return pos;
+  }
+  /// Fill in the size of the box started at *pos*
+  void end(size_t pos) {
+    const auto size = static_cast<uint32_t>(mData.size() - pos);
+    for (int idx = 0; idx < 4; ++idx) {
+      mData[pos + idx] = static_cast<uint8_t>(size >> (24 - 8 * idx));
+    }
+  }
+
+  size_t size() const { return mData.size(); }
+  vector<uint8_t> &data() { return mData; }
+
+private:
+  vector<uint8_t> mData;
+};
+
+void unity_matrix(BoxWriter &writer) {
+  for (uint32_t value :
+       {0x00010000u, 0u, 0u, 0u, 0x00010000u, 0u, 0u, 0u, 0x40000000u}) {
+    writer.u32(value);
+  }
+}
+
+void write_avcc(BoxWriter &writer, const vector<uint8_t> &sps,
+                const vector<uint8_t> &pps, const Sps &parsed) {
+  const auto avcc = writer.box("avcC");
+  writer.u8(1); // configurationVersion
+  writer.u8(sps[1]); // AVCProfileIndication
+  writer.u8(sps[2]); // profile_compatibility
+  writer.u8(sps[3]); // AVCLevelIndication
+  writer.u8(0xFC | 3); // lengthSizeMinusOne
+  writer.u8(0xE0 | 1); // numOfSequenceParameterSets
+  writer.u16(static_cast<uint32_t>(sps.size()));
+  writer.bytes(sps);
+  writer.u8(1); // numOfPictureParameterSets
+  writer.u16(static_cast<uint32_t>(pps.size()));
+  writer.bytes(pps);
+  if (parsed.profile_idc == 100 || parsed.profile_idc == 110 ||
+      parsed.profile_idc == 122 || parsed.profile_idc == 144) {
+    writer.u8(0xFC | parsed.chroma_format_idc);
+    // The camera encodes 8 bit samples only
+    writer.u8(0xF8); // bit_depth_luma_minus8
+    writer.u8(0xF8); // bit_depth_chroma_minus8
+    writer.u8(0); // numOfSequenceParameterSetExt
+  }
+  writer.end(avcc);
+}
+
+} // namespace
+
+vector<uint8_t> fmp4_init_segment(const vector<uint8_t> &sps,
+                                  const vector<uint8_t> &pps) {
+  Sps parsed;
+  if (sps.size() < 4 || pps.empty() ||
+      !parse_sps(sps.data(), sps.size(), parsed)) {
+    return {};
+  }
+  const uint32_t width = parsed.width();
+  const uint32_t height = parsed.height();
+
+  BoxWriter writer;
+  const auto ftyp = writer.box("ftyp");
+  writer.fourcc("isom");
+  writer.u32(0x200);
+  for (auto brand : {"isom", "iso6", "avc1", "mp41"}) {
+    writer.fourcc(brand);
+  }
+  writer.end(ftyp);
+
+  const auto moov = writer.box("moov");
+  const auto mvhd = writer.fullBox("mvhd", 0, 0);
+  writer.u32(0); // creation_time
+  writer.u32(0); // modification_time
+  writer.u32(1000); // timescale
+  writer.u32(0); // duration, given by the fragments
+  writer.u32(0x00010000); // rate
+  writer.u16(0x0100); // volume
+  writer.zeros(10);
+  unity_matrix(writer);
+  writer.zeros(24); // pre_defined
+  writer.u32(2); // next_track_ID
+  writer.end(mvhd);
+
+  const auto trak = writer.box("trak");
+  const auto tkhd = writer.fullBox("tkhd", 0, 0x000003); // enabled, in movie
+  writer.u32(0); // creation_time
+  writer.u32(0); // modification_time
+  writer.u32(1); // track_ID
+  writer.u32(0);
+  writer.u32(0); // duration
+  writer.zeros(8);
+  writer.u16(0); // layer
+  writer.u16(0); // alternate_group
+  writer.u16(0); // volume
+  writer.u16(0);
+  unity_matrix(writer);
+  writer.u32(width << 16);
+  writer.u32(height << 16);
+  writer.end(tkhd);
+
+  const auto mdia = writer.box("mdia");
+  const auto mdhd = writer.fullBox("mdhd", 0, 0);
+  writer.u32(0); // creation_time
+  writer.u32(0); // modification_time
+  writer.u32(FMP4_TIMESCALE);
+  writer.u32(0); // duration
+  writer.u16(0x55C4); // language "und"
+  writer.u16(0);
+  writer.end(mdhd);
+  const auto hdlr = writer.fullBox("hdlr", 0, 0);
+  writer.u32(0); // pre_defined
+  writer.fourcc("vide");
+  writer.zeros(12);
+  writer.bytes({'V', 'i', 'd', 'e', 'o', 'H', 'a', 'n', 'd', 'l', 'e', 'r', 0});
+  writer.end(hdlr);
+
+  const auto minf = writer.box("minf");
+  const auto vmhd = writer.fullBox("vmhd", 0, 1);
+  writer.zeros(8); // graphicsmode and opcolor
+  writer.end(vmhd);
+  const auto dinf = writer.box("dinf");
+  const auto dref = writer.fullBox("dref", 0, 0);
+  writer.u32(1);
+  writer.end(writer.fullBox("url ", 0, 1)); // media in the same file
+  writer.end(dref);
+  writer.end(dinf);
+
+  const auto stbl = writer.box("stbl");
+  const auto stsd = writer.fullBox("stsd", 0, 0);
+  writer.u32(1);
+  const auto avc1 = writer.box("avc1");
+  writer.zeros(6);
+  writer.u16(1); // data_reference_index
+  writer.zeros(16);
+  writer.u16(width);
+  writer.u16(height);
+  writer.u32(0x00480000); // 72 dpi
+  writer.u32(0x00480000);
+  writer.u32(0);
+  writer.u16(1); // frame_count
+  writer.zeros(32); // compressorname
+  writer.u16(0x0018); // depth
+  writer.u16(0xFFFF); // pre_defined
+  write_avcc(writer, sps, pps, parsed);
+  writer.end(avc1);
+  writer.end(stsd);
+  // No samples outside of the fragments
+  for (auto type : {"stts", "stsc", "stco"}) {
+    const auto table = writer.fullBox(type, 0, 0);
+    writer.u32(0);
+    writer.end(table);
+  }
+  const auto stsz = writer.fullBox("stsz", 0, 0);
+  writer.u32(0);
+  writer.u32(0);
+  writer.end(stsz);
+  writer.end(stbl);
+  writer.end(minf);
+  writer.end(mdia);
+  writer.end(trak);
+
+  const auto mvex = writer.box("mvex");
+  const auto trex = writer.fullBox("trex", 0, 0);
+  writer.u32(1); // track_ID
+  writer.u32(1); // default_sample_description_index
+  writer.u32(0); // default_sample_duration
+  writer.u32(0); // default_sample_size
+  writer.u32(0); // default_sample_flags
+  writer.end(trex);
+  writer.end(mvex);
+  writer.end(moov);
+  return move(writer.data());
+}
+
+vector<uint8_t> fmp4_fragment_header(uint32_t sequence, uint64_t decode_time,
+                                     const vector<Fmp4Sample> &samples) {
+  // sample_depends_on 2 for IDR frames, 1 and sample_is_non_sync_sample
+  // for the others
+  constexpr uint32_t SYNC_FLAGS{0x02000000};
+  constexpr uint32_t NON_SYNC_FLAGS{0x01010000};
+
+  BoxWriter writer;
+  const auto moof = writer.box("moof");
+  const auto mfhd = writer.fullBox("mfhd", 0, 0);
+  writer.u32(sequence);
+  writer.end(mfhd);
+  const auto traf = writer.box("traf");
+  const auto tfhd = writer.fullBox("tfhd", 0, 0x020000); // base is moof
+  writer.u32(1); // track_ID
+  writer.end(tfhd);
+  const auto tfdt = writer.fullBox("tfdt", 1, 0);
+  writer.u64(decode_time);
+  writer.end(tfdt);
+  // data_offset, sample_duration, sample_size and sample_flags present
+  const auto trun = writer.fullBox("trun", 0, 0x000701);
+  writer.u32(static_cast<uint32_t>(samples.size()));
+  const auto data_offset = writer.size();
+  writer.u32(0);
+  uint64_t payload{0};
+  for (const auto &sample : samples) {
+    writer.u32(sample.duration);
+    writer.u32(sample.size);
+    writer.u32(sample.sync ? SYNC_FLAGS : NON_SYNC_FLAGS);
+    payload += sample.size;
+  }
+  writer.end(trun);
+  writer.end(traf);
+  writer.end(moof);
+
+  // The samples start right after the mdat header
+  const auto offset = static_cast<uint32_t>(writer.size() - moof + 8);
+  for (int idx = 0; idx < 4; ++idx) {
+    writer.data()[data_offset + idx] =
+        static_cast<uint8_t>(offset >> (24 - 8 * idx));
+  }
+  writer.u32(static_cast<uint32_t>(payload + 8));
+  writer.fourcc("mdat");
+  return move(writer.data());
+}
+
+bool fmp4_sample_nalu(uint8_t type) {
+  return type != NALU_SPS && type != NALU_PPS && type != NALU_AUD;
+}
+
+} // namespace mselph264
@@ -0,0 +1,64 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_FMP4_HPP__
+#define PLUGIN_FMP4_HPP__
+
+#include <cstdint>
+#include <vector>
+
+namespace mselph264 {
+
+// Boxes of fragmented MP4 files with a single H.264 track (ISO/IEC 14496-12
+// and 14496-15).  A file is the init segment (ftyp and moov without
+// samples) followed by fragments, each a moof box and the mdat box with the
+// samples.  Every complete fragment can be played, so files are readable
+// while they are being written.
+
+/// Clock rate of the track, the one of RTP video
+constexpr uint32_t FMP4_TIMESCALE{90000};
+
+/// Sample of a fragment, i.e., one frame
+struct Fmp4Sample {
+  /// In FMP4_TIMESCALE units
+  uint32_t duration;
+  /// Bytes in the mdat box
+  uint32_t size;
+  /// IDR frame
+  bool sync;
+};
+
+/// The ftyp and moov boxes for a stream with SPS and PPS NALUs *sps* and
+/// *pps* (without start codes).  Returns nothing, if the SPS is malformed.
+std::vector<uint8_t> fmp4_init_segment(const std::vector<uint8_t> &sps,
+                                       const std::vector<uint8_t> &pps);
+
+/// The moof box of fragment *sequence* with *samples* starting at
+/// *decode_time* and the header of the mdat box.  The sample data has to
+/// follow directly.
+std::vector<uint8_t>
+fmp4_fragment_header(uint32_t sequence, uint64_t decode_time,
+                     const std::vector<Fmp4Sample> &samples);
+
+/// Whether a NALU of *type* goes into the samples.  Parameter sets are in
+/// the init segment and access unit delimiters are not allowed.
+bool fmp4_sample_nalu(uint8_t type);
+
+} // namespace mselph264
+
+#endif
@@ -0,0 +1,81 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "frame_guard.hpp"
+
+using namespace std;
+
+namespace mselph264 {
+
+FrameGuard::Verdict FrameGuard::checkBuffer(const Device::Mem &mem) {
+  lock_guard<mutex> lock(mMutex);
+  ++mStats.frames;
+  if (mem.hasError()) {
+    return bad(&Stats::errored);
+  }
+  if (mem.used() == 0) {
+    return bad(&Stats::empty);
+  }
+  if (mem.truncated()) {
+    return bad(&Stats::truncated);
+  }
+  return Verdict::FORWARD;
+}
+
+FrameGuard::Verdict FrameGuard::checkFrame(const FrameInfo &info) {
+  lock_guard<mutex> lock(mMutex);
+  if (info.has(FrameInfo::MALFORMED) || info.nalus.empty()) {
+    return bad(&Stats::malformed);
+  }
+  if (info.has(FrameInfo::HAS_IDR)) {
+    mRecovering = false;
+  }
+  // Parameter sets sent on their own do not depend on anything
+  if (mRecovering && info.firstVcl() != info.nalus.size()) {
+    ++mStats.dependent;
+    return Verdict::DEPENDENT;
+  }
+  return Verdict::FORWARD;
+}
+
+void FrameGuard::reset() {
+  lock_guard<mutex> lock(mMutex);
+  mRecovering = false;
+}
+
+void FrameGuard::lost() {
+  lock_guard<mutex> lock(mMutex);
+  mRecovering = true;
+}
+
+bool FrameGuard::recovering() const {
+  lock_guard<mutex> lock(mMutex);
+  return mRecovering;
+}
+
+FrameGuard::Stats FrameGuard::stats() const {
+  lock_guard<mutex> lock(mMutex);
+  return mStats;
+}
+
+FrameGuard::Verdict FrameGuard::bad(uint64_t Stats::*counter) {
+  ++(mStats.*counter);
+  mRecovering = true;
+  return Verdict::BAD;
+}
+
+} // namespace mselph264
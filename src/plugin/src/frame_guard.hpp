@@ -0,0 +1,93 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLUGIN_FRAME_GUARD_HPP__
+#define PLUGIN_FRAME_GUARD_HPP__
+
+#include <cstdint>
+#include <mutex>
+
+#include "h264helper.hpp"
+
+namespace mselph264 {
+
+/// Keep broken frames out of the stream.
+///
+/// A busy USB bus loses or corrupts payload.  The driver flags such
+/// buffers with V4L2_BUF_FLAG_ERROR, but returns them like any other, and
+/// cut off or empty buffers are not flagged at all.  Sending them produces
+/// undecodable RTP, which the receivers answer with a storm of PLIs.
+///
+/// Every following frame refers to the broken one, so the guard drops all
+/// frames until the next IDR.  The caller is expected to ask the camera
+/// for that IDR as soon as a frame was found broken.
+///
+/// The capture thread calls the checks, stats() may be called from any
+/// thread.
+class FrameGuard {
+public:
+  enum class Verdict {
+    FORWARD,
+    /// The frame is broken, the stream needs an IDR to recover
+    BAD,
+    /// The frame depends on a dropped frame
+    DEPENDENT,
+  };
+
+  struct Stats {
+    /// Frames checked
+    uint64_t frames{0};
+    /// Buffers flagged with V4L2_BUF_FLAG_ERROR
+    uint64_t errored{0};
+    /// Buffers without data
+    uint64_t empty{0};
+    /// Buffers cut off by the driver
+    uint64_t truncated{0};
+    /// Frames with an invalid NALU header or without any start code
+    uint64_t malformed{0};
+    /// Intact frames with slices dropped while waiting for an IDR
+    uint64_t dependent{0};
+  };
+
+  /// Check the v4l2 buffer before it is parsed.  Broken buffers need not
+  /// be parsed at all.
+  Verdict checkBuffer(const Device::Mem &mem);
+  /// Check the descriptor of a frame whose buffer passed checkBuffer().  A
+  /// frame is malformed, if it has FrameInfo::MALFORMED or no NALU at all.
+  Verdict checkFrame(const FrameInfo &info);
+  /// The capture restarts, which begins with an IDR
+  void reset();
+  /// The capture restarts after the stream broke off, e.g., the camera was
+  /// unplugged.  The readers are left somewhere in the old GOP, so frames
+  /// are dropped until the next IDR.
+  void lost();
+  /// Frames are dropped until the next IDR
+  bool recovering() const;
+
+  Stats stats() const;
+
+private:
+  Verdict bad(uint64_t Stats::*counter);
+
+  mutable std::mutex mMutex;
+  Stats mStats;
+  bool mRecovering{false};
+};
+
+} // namespace mselph264
+
+#endif
@@ -0,0 +1,85 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "gop_cache.hpp"
+
+namespace mselph264 {
+
+void GopCache::setLimits(const Limits &limits) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mLimits = limits;
+  if (mFrames.size() > mLimits.frames || mBytes > mLimits.bytes) {
+    clear();
+  }
+}
+
+GopCache::Limits GopCache::limits() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mLimits;
+}
+
+void GopCache::add(const SharedFrame &frame) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (frame->info.has(FrameInfo::HAS_IDR)) {
+    clear();
+  } else if (mFrames.empty()) {
+    // No IDR since the start or the last overflow
+    return;
+  }
+  if (mFrames.size() + 1 > mLimits.frames ||
+      mBytes + frame->info.bytes > mLimits.bytes) {
+    if (mLimits.frames > 0) {
+      ++mStats.overflows;
+    }
+    clear();
+    return;
+  }
+  mFrames.push_back(frame);
+  mBytes += frame->info.bytes;
+}
+
+bool GopCache::get(std::size_t max_frames, std::vector<SharedFrame> &frames) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mFrames.empty() || mFrames.size() > max_frames) {
+    ++mStats.misses;
+    return false;
+  }
+  ++mStats.hits;
+  frames = mFrames;
+  return true;
+}
+
+void GopCache::reset() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  clear();
+}
+
+GopCache::Stats GopCache::stats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto stats = mStats;
+  stats.frames = mFrames.size();
+  stats.bytes = mBytes;
+  return stats;
+}
+
+void GopCache::clear() {
+  mFrames.clear();
+  mBytes = 0;
+}
+
+} // namespace mselph264
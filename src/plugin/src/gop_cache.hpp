@@ -0,0 +1,86 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_GOP_CACHE_HPP__
+#define PLUGIN_GOP_CACHE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "h264helper.hpp"
+
+namespace mselph264 {
+
+/// The frames from the last IDR up to now.
+///
+/// A reader joining a running capture is fed from the cache and decodes
+/// immediately, instead of asking the camera for an IDR, which every other
+/// reader would have to receive as well.  The frames are shared with the
+/// readers, so the cache only holds references.
+///
+/// If the GOP grows beyond the limits, the cache is emptied and stays
+/// empty up to the next IDR.
+class GopCache {
+public:
+  struct Limits {
+    /// 0 disables the cache
+    std::size_t frames{300};
+    /// Sum of FrameInfo::bytes
+    std::size_t bytes{4 * 1024 * 1024};
+  };
+
+  struct Stats {
+    /// Readers started from the cache
+    uint64_t hits{0};
+    /// Readers which had to wait for an IDR
+    uint64_t misses{0};
+    /// GOPs which exceeded the limits
+    uint64_t overflows{0};
+    /// Current content
+    std::size_t frames{0};
+    std::size_t bytes{0};
+  };
+
+  void setLimits(const Limits &limits);
+  Limits limits() const;
+
+  /// Add the next frame of the capture
+  void add(const SharedFrame &frame);
+  /// Copy the cached GOP to *frames* for a new reader accepting up to
+  /// *max_frames*.  Returns false and leaves *frames* alone on a miss.
+  bool get(std::size_t max_frames, std::vector<SharedFrame> &frames);
+  /// Forget the GOP, e.g., when the capture restarts
+  void reset();
+
+  Stats stats() const;
+
+private:
+  void clear();
+
+  mutable std::mutex mMutex;
+  Limits mLimits;
+  std::vector<SharedFrame> mFrames;
+  std::size_t mBytes{0};
+  Stats mStats;
+};
+
+} // namespace mselph264
+
+#endif
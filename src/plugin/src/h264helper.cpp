@@ -18,9 +18,14 @@
 #include "h264helper.hpp"
 
 #include <algorithm>
+#include <cstring>
 #include <iterator>
 
+#include "h264camera/annexb.hpp"
+#include "timestamp_sei.hpp"
+
 using namespace std;
+using h264camera::find_start_code;
 
 namespace mselph264 {
 
@@ -35,37 +40,155 @@ namespace mselph264 {
 // static_assert(sizeof(nal_unit_t) == 1, "Bit field is not packed");
 
 void push_nalu(const uint8_t *begin, const uint8_t *end, MSQueue *nalus) {
-  mblk_t *m = allocb(distance(begin, end), 0);
-  while (begin != end) {
-    *m->b_wptr = *begin;
-    ++begin;
-    ++m->b_wptr;
-  }
+  const auto size = static_cast<size_t>(distance(begin, end));
+  mblk_t *m = allocb(size, 0);
+  memcpy(m->b_wptr, begin, size);
+  m->b_wptr += size;
   ms_queue_put(nalus, m);
 }
 
-void separate_h264_nalus(Device::Mem *mem, MSQueue *nalus) {
-  size_t zero_cnt{0};
-
-  const uint8_t *unit_begin = nullptr;
-  auto cur = static_cast<const uint8_t *>(mem->ptr);
-  for (size_t idx = 0; idx < mem->used(); ++idx) {
-    if (*cur == 0) {
-      ++zero_cnt;
-    } else if (zero_cnt >= 3 && *cur == 1) {
-      if (unit_begin) {
-        push_nalu(unit_begin, cur, nalus);
-      }
-      unit_begin = cur + 1;
-    } else {
-      zero_cnt = 0;
-    }
-    ++cur;
+std::size_t FrameInfo::firstVcl() const {
+  auto vcl = find_if(nalus.begin(), nalus.end(),
+                     [](const NaluInfo &nalu) { return nalu.isVcl(); });
+  return static_cast<size_t>(distance(nalus.begin(), vcl));
+}
+
+void FrameInfo::clear() {
+  nalus.clear();
+  flags = 0;
+  bytes = 0;
+  timestamp_us = 0;
+  sequence = 0;
+}
+
+namespace {
+
+uint32_t type_flag(uint8_t type) {
+  switch (type) {
+  case NALU_IDR:
+    return FrameInfo::HAS_IDR;
+  case NALU_SEI:
+    return FrameInfo::HAS_SEI;
+  case NALU_SPS:
+    return FrameInfo::HAS_SPS;
+  case NALU_PPS:
+    return FrameInfo::HAS_PPS;
+  default:
+    return 0;
   }
-  if (unit_begin) {
-    push_nalu(unit_begin, cur, nalus);
+}
+
+NaluInfo make_nalu_info(uint32_t offset, const uint8_t *begin,
+                        const uint8_t *end) {
+  NaluInfo nalu;
+  nalu.offset = offset;
+  nalu.size = static_cast<uint32_t>(distance(begin, end));
+  nalu.type = *begin & 0x1F;
+  nalu.ref_idc = (*begin >> 5) & 0x03;
+  nalu.redundant = false;
+  return nalu;
+}
+
+void add_nalu(const uint8_t *buffer, const uint8_t *begin, const uint8_t *end,
+              FrameInfo &info) {
+  auto nalu = make_nalu_info(static_cast<uint32_t>(distance(buffer, begin)),
+                             begin, end);
+  info.nalus.push_back(nalu);
+  info.bytes += nalu.size;
+  info.flags |= type_flag(nalu.type);
+  if ((*begin & 0x80) || nalu.type == 0 || nalu.type >= 24) {
+    info.flags |= FrameInfo::MALFORMED;
+  }
+}
+
+} // namespace
+
+void FrameInfo::updateFlags() {
+  flags &= KEYFRAME | MALFORMED;
+  for (const auto &nalu : nalus) {
+    flags |= type_flag(nalu.type);
+  }
+}
+
+void Frame::duplicate(MSQueue *out) const {
+  // The queue is only read, ms_queue_* just lack const overloads
+  auto queue = const_cast<MSQueue *>(&nalus);
+  for (mblk_t *m = ms_queue_peek_first(queue); !ms_queue_end(queue, m);
+       m = ms_queue_next(queue, m)) {
+    ms_queue_put(out, dupb(m));
+  }
+}
+
+void separate_h264_nalus(Device::Mem *mem, MSQueue *nalus, FrameInfo &info) {
+  auto begin = static_cast<const uint8_t *>(mem->ptr);
+  auto end = begin + mem->used();
+
+  info.clear();
+  const auto &buf = mem->video_buffer;
+  info.timestamp_us = static_cast<uint64_t>(buf.timestamp.tv_sec) * 1000000 +
+                      static_cast<uint64_t>(buf.timestamp.tv_usec);
+  info.sequence = buf.sequence;
+  if (buf.flags & V4L2_BUF_FLAG_KEYFRAME) {
+    info.flags |= FrameInfo::KEYFRAME;
+  }
+
+  auto start_code = find_start_code(begin, end);
+  while (start_code != end) {
+    auto unit_begin = start_code + 1;
+    start_code = find_start_code(unit_begin, end);
+    // Zero bytes in front of a start code belong to a 4-byte start code or
+    // are trailing_zero_8bits, never to the NALU.
+    auto unit_end = (start_code == end) ? end : start_code - 2;
+    while (unit_end != unit_begin && unit_end[-1] == 0) {
+      --unit_end;
+    }
+    if (unit_end == unit_begin) {
+      continue;
+    }
+    push_nalu(unit_begin, unit_end, nalus);
+    add_nalu(begin, unit_begin, unit_end, info);
   }
   mem->done();
 }
 
+mblk_t *nalu_at(MSQueue *nalus, size_t pos) {
+  mblk_t *cur = ms_queue_peek_first(nalus);
+  for (; pos > 0 && !ms_queue_end(nalus, cur); --pos) {
+    cur = ms_queue_next(nalus, cur);
+  }
+  return cur;
+}
+
+void insert_nalu(MSQueue *nalus, FrameInfo &info, size_t pos, mblk_t *m) {
+  pos = min(pos, info.nalus.size());
+  const auto nalu = make_nalu_info(NaluInfo::INSERTED, m->b_rptr, m->b_wptr);
+  ms_queue_insert(nalus, nalu_at(nalus, pos), m);
+  info.nalus.insert(info.nalus.begin() + pos, nalu);
+  info.bytes += nalu.size;
+  info.flags |= type_flag(nalu.type);
+}
+
+void remove_nalu(MSQueue *nalus, FrameInfo &info, size_t pos) {
+  mblk_t *m = nalu_at(nalus, pos);
+  ms_queue_remove(nalus, m);
+  freemsg(m);
+  info.bytes -= info.nalus[pos].size;
+  info.nalus.erase(info.nalus.begin() + pos);
+  info.updateFlags();
+}
+
+void insert_timestamp_sei(FrameInfo &info, MSQueue *nalus) {
+  TimestampSei sei;
+  sei.capture_us = info.timestamp_us;
+  sei.sequence = info.sequence;
+  const auto data = make_timestamp_sei(sei);
+  mblk_t *m = allocb(data.size(), 0);
+  copy(data.begin(), data.end(), m->b_wptr);
+  m->b_wptr += data.size();
+
+  // SEI has to precede the first VCL NALU of the access unit.  The
+  // descriptor tells where it is, so no payload has to be read.
+  insert_nalu(nalus, info, info.firstVcl(), m);
+}
+
 } // namespace mselph264
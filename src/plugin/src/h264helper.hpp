@@ -18,6 +18,9 @@
 #ifndef PLUGIN_H264_HELPER_HPP__
 #define PLUGIN_H264_HELPER_HPP__
 
+#include <cstdint>
+#include <memory>
+#include <vector>
 #include <mediastreamer2/msqueue.h>
 #include <h264camera/v4l2_device.hpp>
 
@@ -25,8 +28,106 @@ namespace mselph264 {
 
 using h264camera::Device;
 
-/// Split raw h264 data into nalus and store into a queue of mblk_t.
-void separate_h264_nalus(Device::Mem *mem, MSQueue *nalus);
+/// nal_unit_type values used by the plugin
+enum NaluType : uint8_t {
+  NALU_SLICE = 1,
+  NALU_IDR = 5,
+  NALU_SEI = 6,
+  NALU_SPS = 7,
+  NALU_PPS = 8,
+  NALU_AUD = 9,
+};
+
+/// Position and header of a NALU within a captured frame
+struct NaluInfo {
+  /// Offset of NALUs added by the plugin, which are not in the v4l2 buffer
+  static constexpr uint32_t INSERTED{UINT32_MAX};
+
+  /// Offset of the first byte after the start code within the v4l2 buffer
+  uint32_t offset;
+  uint32_t size;
+  /// nal_unit_type
+  uint8_t type;
+  /// nal_ref_idc
+  uint8_t ref_idc;
+  /// SPS or PPS equal to the cached one in front of a non-IDR frame, set by
+  /// ParameterSets
+  bool redundant;
+
+  /// Slice data (nal_unit_type 1 to 5)
+  bool isVcl() const { return type >= 1 && type <= 5; }
+};
+
+/// Descriptor of a captured frame computed once by separate_h264_nalus().
+/// It lists the NALUs in the order of the MSQueue, so later stages decide
+/// about the frame without looking at the payload again.  Stages changing
+/// the queue use insert_nalu() and remove_nalu() to keep both in sync.
+struct FrameInfo {
+  enum Flags : uint32_t {
+    HAS_IDR = 1 << 0,
+    HAS_SPS = 1 << 1,
+    HAS_PPS = 1 << 2,
+    HAS_SEI = 1 << 3,
+    /// V4L2_BUF_FLAG_KEYFRAME was set by the driver
+    KEYFRAME = 1 << 4,
+    /// A NALU header is invalid: forbidden_zero_bit is set or the
+    /// nal_unit_type is 0 or one never found in a byte stream (24 to 31)
+    MALFORMED = 1 << 5,
+  };
+
+  std::vector<NaluInfo> nalus;
+  uint32_t flags{0};
+  /// Sum of the NALU sizes without start codes
+  std::size_t bytes{0};
+  /// Capture time from v4l2_buffer::timestamp
+  uint64_t timestamp_us{0};
+  /// v4l2_buffer::sequence
+  uint32_t sequence{0};
+
+  bool has(Flags flag) const { return (flags & flag) != 0; }
+  /// Index of the first slice or the NALU count if there is none
+  std::size_t firstVcl() const;
+  /// Forget everything but keep the capacity for the next frame
+  void clear();
+  /// Recompute the content flags from the NALU list
+  void updateFlags();
+};
+
+/// A captured frame.  Once published it is shared by all readers of the
+/// camera and must not change anymore.
+struct Frame {
+  Frame() { ms_queue_init(&nalus); }
+  ~Frame() { ms_queue_flush(&nalus); }
+  Frame(const Frame &) = delete;
+  Frame &operator=(const Frame &) = delete;
+
+  /// Append duplicates of the NALUs to *out*.  They share the data with
+  /// the frame (see dupb), so packing them leaves the frame intact.
+  void duplicate(MSQueue *out) const;
+
+  MSQueue nalus;
+  FrameInfo info;
+};
+
+using SharedFrame = std::shared_ptr<const Frame>;
+
+/// Split raw h264 data into nalus and store into a queue of mblk_t.  *info*
+/// is overwritten with the descriptor of the frame.
+void separate_h264_nalus(Device::Mem *mem, MSQueue *nalus, FrameInfo &info);
+
+/// Queue entry of the NALU at index *pos* of the descriptor
+mblk_t *nalu_at(MSQueue *nalus, std::size_t pos);
+
+/// Insert the NALU *m* in front of the NALU at index *pos* and add it to
+/// *info*.  If *pos* is the NALU count, *m* is appended.
+void insert_nalu(MSQueue *nalus, FrameInfo &info, std::size_t pos, mblk_t *m);
+
+/// Remove and free the NALU at index *pos* of the descriptor
+void remove_nalu(MSQueue *nalus, FrameInfo &info, std::size_t pos);
+
+/// Insert a SEI NALU carrying the capture timestamp and sequence number of
+/// the frame described by *info* in front of the first slice in *nalus*.
+void insert_timestamp_sei(FrameInfo &info, MSQueue *nalus);
 
 } // namespace mselph264
 
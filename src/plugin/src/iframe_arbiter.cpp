@@ -0,0 +1,123 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "iframe_arbiter.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+namespace mselph264 {
+
+uint32_t IFrameArbiter::uniqueReceiver() {
+  static atomic<uint32_t> sLast{LOCAL};
+  return --sLast;
+}
+
+void IFrameArbiter::request(uint32_t receiver, uint64_t now) {
+  lock_guard<mutex> lock(mMutex);
+  ++mStats.requests;
+
+  auto &rcv = mReceivers[receiver];
+  if (rcv.interval == 0) {
+    rcv.interval = mConfig.min_interval;
+  } else if (now - rcv.last_request > 4 * rcv.interval) {
+    rcv.interval = max(mConfig.min_interval, rcv.interval / 2);
+  }
+  rcv.last_request = now;
+
+  if (rcv.accepted && now - rcv.last_accepted < rcv.interval) {
+    // The receiver asks again before the last I-frame could arrive
+    rcv.interval = min(mConfig.max_interval, rcv.interval * 2);
+    ++mStats.coalesced;
+    return;
+  }
+  rcv.accepted = true;
+  rcv.last_accepted = now;
+
+  if (mIdrCaptured && now - mLastIdr < mConfig.window) {
+    ++mStats.suppressed;
+  } else if (mPending || mInFlight) {
+    ++mStats.coalesced;
+  } else {
+    mPending = true;
+  }
+}
+
+void IFrameArbiter::requestRecovery() {
+  lock_guard<mutex> lock(mMutex);
+  ++mStats.requests;
+  if (mPending || mInFlight) {
+    ++mStats.coalesced;
+  } else {
+    mPending = true;
+  }
+}
+
+bool IFrameArbiter::takeRequest(uint64_t now) {
+  lock_guard<mutex> lock(mMutex);
+  if (mInFlight && now - mSentAt >= mConfig.timeout) {
+    // The camera did not deliver, ask again
+    mInFlight = false;
+    mPending = true;
+  }
+  if (!mPending) {
+    return false;
+  }
+  mPending = false;
+  mInFlight = true;
+  mSentAt = now;
+  ++mStats.sent;
+  return true;
+}
+
+void IFrameArbiter::idrCaptured(uint64_t now) {
+  lock_guard<mutex> lock(mMutex);
+  ++mStats.idr_frames;
+  mIdrCaptured = true;
+  mLastIdr = now;
+  mInFlight = false;
+  // A natural IDR satisfies a request not sent yet
+  mPending = false;
+}
+
+void IFrameArbiter::reset() {
+  lock_guard<mutex> lock(mMutex);
+  mReceivers.clear();
+  mPending = false;
+  mInFlight = false;
+  mIdrCaptured = false;
+}
+
+void IFrameArbiter::setWindow(uint64_t window) {
+  lock_guard<mutex> lock(mMutex);
+  mConfig.window = window;
+}
+
+IFrameArbiter::Config IFrameArbiter::config() const {
+  lock_guard<mutex> lock(mMutex);
+  return mConfig;
+}
+
+IFrameArbiter::Stats IFrameArbiter::stats() const {
+  lock_guard<mutex> lock(mMutex);
+  return mStats;
+}
+
+} // namespace mselph264
@@ -0,0 +1,116 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_IFRAME_ARBITER_HPP__
+#define PLUGIN_IFRAME_ARBITER_HPP__
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace mselph264 {
+
+/// Decide which I-frame requests reach the camera.
+///
+/// Every IDR costs a multiple of a P frame, so requests are coalesced:
+/// - a request is suppressed, if an IDR was captured within the window
+/// - a request is coalesced with one already sent to the camera, until
+///   its IDR is captured or the request timed out
+/// - every receiver has its own minimal interval between requests.  It
+///   doubles while the receiver keeps asking within the interval, e.g.,
+///   due to heavy loss, and halves again after a quiet period.
+///
+/// Requests come from any thread, the capture thread calls takeRequest()
+/// and idrCaptured().  All times are in milliseconds.
+class IFrameArbiter {
+public:
+  /// Receiver id for requests without a known sender
+  static constexpr uint32_t ANY_RECEIVER{0};
+  /// Receiver id for requests of the plugin itself, e.g., at start up
+  static constexpr uint32_t LOCAL{UINT32_MAX};
+  /// A new receiver id, e.g., for the requests of one filter.  Ids count
+  /// down from LOCAL, away from the ones applications pick.
+  static uint32_t uniqueReceiver();
+
+  struct Config {
+    /// Requests are suppressed, if an IDR was captured this long ago
+    uint64_t window{300};
+    /// Bounds of the adaptive interval per receiver
+    uint64_t min_interval{250};
+    uint64_t max_interval{4000};
+    /// A request sent to the camera is repeated, if no IDR follows
+    uint64_t timeout{1000};
+  };
+
+  struct Stats {
+    uint64_t requests{0};
+    /// Requests passed on to the camera
+    uint64_t sent{0};
+    /// Requests suppressed by a recently captured IDR
+    uint64_t suppressed{0};
+    /// Requests merged with a pending one or limited per receiver
+    uint64_t coalesced{0};
+    /// IDR frames seen in the captured stream
+    uint64_t idr_frames{0};
+  };
+
+  IFrameArbiter() = default;
+  explicit IFrameArbiter(const Config &config) : mConfig(config) {}
+
+  /// An I-frame was requested by *receiver*
+  void request(uint32_t receiver, uint64_t now);
+  /// The plugin dropped frames and the stream cannot be decoded until the
+  /// next IDR.  Neither the window nor the receiver interval apply, but the
+  /// request is still coalesced with a pending one.
+  void requestRecovery();
+  /// Check if the camera has to be asked for an I-frame now.  A true
+  /// result marks the request as sent.
+  bool takeRequest(uint64_t now);
+  /// An IDR was found in the captured stream
+  void idrCaptured(uint64_t now);
+  /// Forget everything, e.g., when the capture restarts
+  void reset();
+
+  void setWindow(uint64_t window);
+  Config config() const;
+  Stats stats() const;
+
+private:
+  struct Receiver {
+    uint64_t interval{0};
+    uint64_t last_request{0};
+    uint64_t last_accepted{0};
+    bool accepted{false};
+  };
+
+  mutable std::mutex mMutex;
+  Config mConfig;
+  Stats mStats;
+  std::unordered_map<uint32_t, Receiver> mReceivers;
+  /// A request waits for takeRequest()
+  bool mPending{false};
+  /// A request was sent to the camera and no IDR was captured since
+  bool mInFlight{false};
+  uint64_t mSentAt{0};
+  bool mIdrCaptured{false};
+  uint64_t mLastIdr{0};
+};
+
+} // namespace mselph264
+
+#endif
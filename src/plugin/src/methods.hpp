@@ -0,0 +1,322 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLUGIN_METHODS_HPP__
+#define PLUGIN_METHODS_HPP__
+
+#include <cstdint>
+#include <mediastreamer2/msfilter.h>
+
+// Filter methods specific to the h264camera filter.  They are called with
+// ms_filter_call_method on the capture filter.
+
+/// Insert a SEI with the capture timestamp in front of every frame (bool).
+/// Like the SEI policy and the stripping of parameter sets, it only applies
+/// to the frames of this filter, not to other readers of the camera.
+#define MS_ELPH264_ENABLE_TIMESTAMP_SEI                                        \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 0, bool)
+
+/// Get the sprop-parameter-sets of the running configuration (char *).  The
+/// string is allocated and has to be released with ms_free.  The method
+/// fails until the camera delivered SPS and PPS.
+#define MS_ELPH264_GET_SPROP_PARAMETER_SETS                                    \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 1, char *)
+
+/// Remove SPS and PPS repeated in front of non-IDR frames (bool).  They are
+/// still guaranteed in front of every IDR frame.
+#define MS_ELPH264_STRIP_PARAMETER_SETS                                        \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 2, bool)
+
+/// Values for MS_ELPH264_SET_SPS_REWRITE
+enum MSElph264SpsRewrite {
+  /// Send the SPS of the camera unchanged
+  MS_ELPH264_SPS_UNCHANGED = 0,
+  /// Add bitstream_restriction with max_num_reorder_frames=0, so decoders
+  /// output each frame immediately
+  MS_ELPH264_SPS_ZERO_REORDER = 1,
+  /// As above and add timing info matching the configured frame rate
+  MS_ELPH264_SPS_ZERO_REORDER_TIMING = 2,
+};
+
+/// Rewrite the VUI of the SPS for low latency decoding (int, see
+/// MSElph264SpsRewrite)
+#define MS_ELPH264_SET_SPS_REWRITE                                             \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 3, int)
+
+/// Values for MS_ELPH264_SET_SEI_POLICY
+enum MSElph264SeiPolicy {
+  MS_ELPH264_SEI_KEEP = 0,
+  MS_ELPH264_SEI_DROP = 1,
+  /// Keep the SEI of IDR frames only
+  MS_ELPH264_SEI_KEEP_ON_IDR = 2,
+};
+
+/// Select what happens to the SEI NALUs sent by the camera (int, see
+/// MSElph264SeiPolicy).  The timestamp SEI is not affected.
+#define MS_ELPH264_SET_SEI_POLICY                                              \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 4, int)
+
+/// Result of MS_ELPH264_GET_SEI_STATS
+struct MSElph264SeiStats {
+  /// Count of SEI NALUs dropped due to the policy
+  uint64_t dropped;
+  /// Their size without start codes and packetization overhead
+  uint64_t dropped_bytes;
+};
+
+/// Get the counters of dropped SEI NALUs (MSElph264SeiStats)
+#define MS_ELPH264_GET_SEI_STATS                                               \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 5, MSElph264SeiStats)
+
+/// Request an I-frame on behalf of a receiver identified by a number, e.g.,
+/// the SSRC of a RTCP PLI (uint32_t).  Requests are limited per receiver,
+/// MS_VIDEO_ENCODER_REQ_VFU and friends count as one anonymous receiver.
+#define MS_ELPH264_REQUEST_IFRAME_FROM                                         \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 6, uint32_t)
+
+/// Suppress I-frame requests for this many ms after an IDR was captured
+/// (int, default 300)
+#define MS_ELPH264_SET_IFRAME_WINDOW                                           \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 7, int)
+
+/// Result of MS_ELPH264_GET_IFRAME_STATS
+struct MSElph264IFrameStats {
+  /// I-frame requests received
+  uint64_t requests;
+  /// Requests passed on to the camera
+  uint64_t sent;
+  /// Requests suppressed due to a recently captured IDR
+  uint64_t suppressed;
+  /// Requests merged with another or limited per receiver
+  uint64_t coalesced;
+  /// IDR frames captured
+  uint64_t idr_frames;
+};
+
+/// Get the I-frame request counters (MSElph264IFrameStats)
+#define MS_ELPH264_GET_IFRAME_STATS                                            \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 8, MSElph264IFrameStats)
+
+/// Result of MS_ELPH264_GET_CAPTURE_STATS
+struct MSElph264CaptureStats {
+  /// Frames dequeued from the camera
+  uint64_t frames;
+  /// Frames dropped, because the driver flagged an error
+  uint64_t errored;
+  /// Frames dropped, because the buffer was empty
+  uint64_t empty;
+  /// Frames dropped, because the buffer was cut off
+  uint64_t truncated;
+  /// Frames dropped due to invalid NALU headers
+  uint64_t malformed;
+  /// Intact frames dropped until the next IDR after a broken frame
+  uint64_t dependent;
+};
+
+/// Get the counters of dropped frames (MSElph264CaptureStats)
+#define MS_ELPH264_GET_CAPTURE_STATS                                           \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 9, MSElph264CaptureStats)
+
+/// Send a pre-encoded grey picture, if the camera delivered no frame for
+/// the given milliseconds (int), e.g., during a reconfiguration.  0 disables
+/// it, which is the default.
+#define MS_ELPH264_SET_KEEPALIVE                                               \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 10, int)
+
+/// Result of MS_ELPH264_GET_KEEPALIVE_STATS
+struct MSElph264KeepAliveStats {
+  /// Placeholder frames sent
+  uint64_t placeholders;
+  /// Camera frames dropped after the placeholders until the next IDR
+  uint64_t dropped;
+};
+
+/// Get the keep-alive counters (MSElph264KeepAliveStats)
+#define MS_ELPH264_GET_KEEPALIVE_STATS                                         \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 11, MSElph264KeepAliveStats)
+
+/// Overflow handling of MSElph264Queue
+enum MSElph264Overflow {
+  /// Empty the queue and ask the camera for an IDR
+  MS_ELPH264_OVERFLOW_REQUEST_IDR = 0,
+  /// Empty the queue and wait for the next IDR of the camera
+  MS_ELPH264_OVERFLOW_WAIT_FOR_IDR = 1,
+};
+
+/// Frame queue of one filter reading a camera shared with others
+struct MSElph264Queue {
+  /// Count of frames, at least 1
+  int capacity;
+  /// MSElph264Overflow
+  int overflow;
+};
+
+/// Configure the frame queue (MSElph264Queue).  It takes effect with the
+/// next preprocessing.
+#define MS_ELPH264_SET_QUEUE                                                   \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 12, MSElph264Queue)
+
+/// Result of MS_ELPH264_GET_QUEUE_STATS
+struct MSElph264QueueStats {
+  /// Frames taken from the queue
+  uint64_t delivered;
+  /// Frames dropped due to overflows or while waiting for an IDR
+  uint64_t dropped;
+  uint64_t overflows;
+  /// Filters reading the same camera right now
+  int readers;
+};
+
+/// Get the counters of the frame queue (MSElph264QueueStats)
+#define MS_ELPH264_GET_QUEUE_STATS                                             \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 13, MSElph264QueueStats)
+
+/// Limits of the GOP cache, see MS_ELPH264_SET_GOP_CACHE
+struct MSElph264GopCache {
+  /// Most frames kept, 0 disables the cache
+  int max_frames;
+  /// Most bytes kept
+  int max_bytes;
+};
+
+/// Set the limits of the cache of the current GOP (MSElph264GopCache),
+/// which lets further filters reading the same camera start without an
+/// IDR.  It is enabled by default with 300 frames and 4 MiB.
+#define MS_ELPH264_SET_GOP_CACHE                                               \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 14, MSElph264GopCache)
+
+/// Result of MS_ELPH264_GET_GOP_CACHE_STATS
+struct MSElph264GopCacheStats {
+  /// Filters started from the cache
+  uint64_t hits;
+  /// Filters that had to wait for an IDR
+  uint64_t misses;
+  /// GOPs exceeding the limits
+  uint64_t overflows;
+  /// Frames and bytes cached right now
+  uint64_t frames;
+  uint64_t bytes;
+};
+
+/// Get the counters of the GOP cache (MSElph264GopCacheStats)
+#define MS_ELPH264_GET_GOP_CACHE_STATS                                         \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 15, MSElph264GopCacheStats)
+
+/// Record the camera to fragmented MP4 files, the argument is the path
+/// prefix of the files (const char).  The files are named
+/// <prefix>-00001.mp4 and so on.  A running recording is stopped first.
+/// The recording keeps the camera open when the filter stops running,
+/// until MS_ELPH264_STOP_RECORDING or the filter is destroyed.
+#define MS_ELPH264_START_RECORDING                                             \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 16, const char)
+
+/// Write the pending frames and close the file
+#define MS_ELPH264_STOP_RECORDING                                              \
+  MS_FILTER_METHOD_NO_ARG(MS_FILTER_PLUGIN_ID, 17)
+
+/// File limits of a recording, 0 for none.  A new file starts with the
+/// first IDR beyond a limit.
+struct MSElph264Rotation {
+  int max_seconds;
+  int max_megabytes;
+};
+
+/// Set the file limits of the next recording (MSElph264Rotation)
+#define MS_ELPH264_SET_RECORDING_ROTATION                                      \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 18, MSElph264Rotation)
+
+/// Result of MS_ELPH264_GET_RECORDING_STATS
+struct MSElph264RecordingStats {
+  /// Files started
+  uint64_t segments;
+  uint64_t fragments;
+  uint64_t frames;
+  /// Bytes written to all files
+  uint64_t bytes;
+  /// Failed opens and writes
+  uint64_t errors;
+};
+
+/// Get the counters of the current or last recording
+/// (MSElph264RecordingStats)
+#define MS_ELPH264_GET_RECORDING_STATS                                         \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 19, MSElph264RecordingStats)
+
+/// Publish the frames of the camera to the shared memory ring of the given
+/// name, so other processes can read them with h264camera::ShmSubscriber.
+/// An empty name ends the export.
+#define MS_ELPH264_EXPORT_FRAMES                                               \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 20, const char)
+
+/// Result of MS_ELPH264_GET_RECOVERY_STATS
+struct MSElph264RecoveryStats {
+  /// Capture failures, e.g., the camera was unplugged
+  uint64_t losses;
+  /// Failures followed by a frame again
+  uint64_t recoveries;
+  /// Milliseconds from the failure to the first frame, of the last and the
+  /// slowest recovery
+  uint64_t last_ms;
+  uint64_t max_ms;
+};
+
+/// Get the counters of the camera recovery (MSElph264RecoveryStats)
+#define MS_ELPH264_GET_RECOVERY_STATS                                          \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 21, MSElph264RecoveryStats)
+
+/// Time without a new frame after which the capture is restarted step by
+/// step (int, milliseconds): requeue the buffers, restart the stream,
+/// reopen the camera.  0 disables the watchdog, the default is 500.
+#define MS_ELPH264_SET_STALL_TIMEOUT                                           \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 22, int)
+
+/// Result of MS_ELPH264_GET_STALL_STATS
+struct MSElph264StallStats {
+  uint64_t stalls;
+  /// Recovery steps taken
+  uint64_t requeues;
+  uint64_t restarts;
+  uint64_t reopens;
+  /// Stalls ended by a frame
+  uint64_t recoveries;
+  /// Milliseconds from the detection to the next frame, of the last and
+  /// the slowest recovery
+  uint64_t last_recovery_ms;
+  uint64_t max_recovery_ms;
+};
+
+/// Get the counters of the stall watchdog (MSElph264StallStats)
+#define MS_ELPH264_GET_STALL_STATS                                             \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 23, MSElph264StallStats)
+
+/// Scheduling and memory locking of the capture thread of the camera
+/// (const char), e.g., "fifo:50 cpus:2-3 mlock", see
+/// h264camera::ThreadPolicy.  Applies to all readers of the camera and
+/// overrides the environment variable ELPH264_CAPTURE_POLICY.  Missing
+/// privileges are logged and leave the thread as it is.
+#define MS_ELPH264_SET_CAPTURE_POLICY                                          \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 24, const char)
+
+/// Send every frame as soon as it is captured instead of with the next tick
+/// of the ticker (int, 0 or 1).  The filter then wakes its ticker, which
+/// saves 5 ms per frame on average with the default interval of 10 ms.  One
+/// filter per ticker at most, takes effect with the next start.  The
+/// environment variable ELPH264_FRAME_WAKEUP=1 enables it by default.
+#define MS_ELPH264_SET_FRAME_WAKEUP                                            \
+  MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 25, int)
+
+#endif
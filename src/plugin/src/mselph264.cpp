@@ -22,7 +22,9 @@
 
 namespace mselph264 {
 extern MSFilterDesc filter_description;
+extern MSFilterDesc preview_filter_description;
 extern MSWebCamDesc camera_description;
+extern MSWebCamDesc preview_camera_description;
 } // namespace mselph264
 
 // This function is automatically called by Mediastreamer2.  The
@@ -33,8 +35,11 @@ extern "C" void libmselph264_init(MSFactory *factory) {
   // bctbx_set_log_level(BCTBX_LOG_DOMAIN, BCTBX_LOG_DEBUG);
   assert(factory);
   ms_factory_register_filter(factory, &mselph264::filter_description);
+  ms_factory_register_filter(factory, &mselph264::preview_filter_description);
   auto cam_manager = ms_factory_get_web_cam_manager(factory);
   assert(cam_manager);
   ms_web_cam_manager_register_desc(cam_manager, &mselph264::camera_description);
+  ms_web_cam_manager_register_desc(cam_manager,
+                                   &mselph264::preview_camera_description);
   ms_message("elph264 plugin registered");
 }
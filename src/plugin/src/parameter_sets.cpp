@@ -0,0 +1,166 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "parameter_sets.hpp"
+
+#include <algorithm>
+#include <bctoolbox/logging.h>
+
+using namespace std;
+
+namespace mselph264 {
+
+namespace {
+
+bool equals(const vector<uint8_t> &cache, const mblk_t *m) {
+  return cache.size() == static_cast<size_t>(m->b_wptr - m->b_rptr) &&
+         equal(cache.begin(), cache.end(), m->b_rptr);
+}
+
+mblk_t *make_nalu(const vector<uint8_t> &data) {
+  mblk_t *m = allocb(data.size(), 0);
+  copy(data.begin(), data.end(), m->b_wptr);
+  m->b_wptr += data.size();
+  return m;
+}
+
+} // namespace
+
+void ParameterSets::process(MSQueue *nalus, FrameInfo &info) {
+  if (!info.has(FrameInfo::HAS_SPS) && !info.has(FrameInfo::HAS_PPS) &&
+      !info.has(FrameInfo::HAS_IDR)) {
+    // Most frames, nothing to do
+    return;
+  }
+
+  SpsRewriteOptions options;
+  options.zero_reorder = mZeroReorder;
+  options.fps = mTimingInfo ? mFps : 0;
+
+  const bool idr = info.has(FrameInfo::HAS_IDR);
+  bool changed{false};
+  bool has_sps{false};
+  bool has_pps{false};
+  mblk_t *m = ms_queue_peek_first(nalus);
+  for (size_t pos = 0; pos < info.nalus.size();) {
+    mblk_t *next = ms_queue_next(nalus, m);
+    const auto type = info.nalus[pos].type;
+    if (type == NALU_SPS) {
+      bool redundant{false};
+      if (!equals(mSps, m) || options != mSpsOptions) {
+        mSps.assign(m->b_rptr, m->b_wptr);
+        rewrite(options);
+        changed = true;
+      } else {
+        redundant = !idr;
+      }
+      if (mSpsOut != mSps) {
+        remove_nalu(nalus, info, pos);
+        insert_nalu(nalus, info, pos, make_nalu(mSpsOut));
+      }
+      info.nalus[pos].redundant = redundant;
+      has_sps = true;
+    } else if (type == NALU_PPS) {
+      if (!equals(mPps, m)) {
+        mPps.assign(m->b_rptr, m->b_wptr);
+        changed = true;
+      } else {
+        info.nalus[pos].redundant = !idr;
+      }
+      has_pps = true;
+    }
+    m = next;
+    ++pos;
+  }
+
+  if (changed) {
+    bctbx_message("New parameter sets: SPS %zu bytes, PPS %zu bytes",
+                  mSpsOut.size(), mPps.size());
+    updateSprop();
+  }
+
+  if (idr) {
+    // Parameter sets go first, only an access unit delimiter precedes them
+    size_t pos =
+        (!info.nalus.empty() && info.nalus[0].type == NALU_AUD) ? 1 : 0;
+    if (!has_sps && !mSpsOut.empty()) {
+      insert_nalu(nalus, info, pos++, make_nalu(mSpsOut));
+      ++mInserted;
+    }
+    if (!has_pps && !mPps.empty()) {
+      insert_nalu(nalus, info, pos, make_nalu(mPps));
+      ++mInserted;
+    }
+  }
+}
+
+void ParameterSets::rewrite(const SpsRewriteOptions &options) {
+  mSpsOptions = options;
+  if (!options.zero_reorder && options.fps <= 0) {
+    mSpsOut = mSps;
+  } else if (!rewrite_sps(mSps.data(), mSps.size(), options, mSpsOut)) {
+    bctbx_warning("Failed to parse the SPS, send it unchanged");
+    mSpsOut = mSps;
+  }
+}
+
+void ParameterSets::clear(float fps) {
+  mSps.clear();
+  mSpsOut.clear();
+  mPps.clear();
+  mFps = fps;
+  updateSprop();
+}
+
+string ParameterSets::sprop() const {
+  lock_guard<mutex> lock(mMutex);
+  return mSprop;
+}
+
+void ParameterSets::updateSprop() {
+  string sprop;
+  if (!mSpsOut.empty() && !mPps.empty()) {
+    sprop = base64_encode(mSpsOut.data(), mSpsOut.size()) + "," +
+            base64_encode(mPps.data(), mPps.size());
+  }
+  lock_guard<mutex> lock(mMutex);
+  mSprop = move(sprop);
+}
+
+string base64_encode(const uint8_t *data, size_t size) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  string result;
+  result.reserve((size + 2) / 3 * 4);
+  for (size_t idx = 0; idx < size; idx += 3) {
+    uint32_t triple = static_cast<uint32_t>(data[idx]) << 16;
+    if (idx + 1 < size) {
+      triple |= static_cast<uint32_t>(data[idx + 1]) << 8;
+    }
+    if (idx + 2 < size) {
+      triple |= data[idx + 2];
+    }
+    result += alphabet[(triple >> 18) & 0x3F];
+    result += alphabet[(triple >> 12) & 0x3F];
+    result += (idx + 1 < size) ? alphabet[(triple >> 6) & 0x3F] : '=';
+    result += (idx + 2 < size) ? alphabet[triple & 0x3F] : '=';
+  }
+  return result;
+}
+
+} // namespace mselph264
@@ -0,0 +1,94 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_PARAMETER_SETS_HPP__
+#define PLUGIN_PARAMETER_SETS_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <mediastreamer2/msqueue.h>
+
+#include "h264helper.hpp"
+#include "sps_rewriter.hpp"
+
+namespace mselph264 {
+
+/// Cache of the latest SPS and PPS of the running configuration.
+///
+/// The camera repeats both in-band.  Every frame passes process() on the
+/// capture thread, which keeps the cache up to date, makes sure each IDR
+/// frame carries SPS and PPS and marks unchanged copies in front of other
+/// frames as redundant (see NaluInfo), so readers may strip them.  The
+/// cache has to be cleared, when the camera is reconfigured.
+///
+/// If enabled, the VUI of the SPS is rewritten for low latency decoding.
+/// This is done once per SPS of the camera, all frames get the cached
+/// result.
+class ParameterSets {
+public:
+  /// Update the cache from the frame and fix up its parameter sets
+  void process(MSQueue *nalus, FrameInfo &info);
+  /// Forget SPS and PPS, e.g., after changing the resolution.  *fps* is the
+  /// frame rate of the new configuration for the SPS timing info.
+  void clear(float fps = 0);
+
+  /// Rewrite the SPS to disable frame reordering in the decoder and
+  /// optionally add timing info.  Takes effect with the next SPS.
+  void rewriteSps(bool zero_reorder, bool timing_info) {
+    mZeroReorder = zero_reorder;
+    mTimingInfo = timing_info;
+  }
+
+  /// Base64 encoded SPS and PPS separated by a comma, as used for the
+  /// sprop-parameter-sets SDP parameter.  Empty until both were seen.
+  std::string sprop() const;
+
+  /// Count of parameter sets inserted in front of IDR frames
+  std::size_t inserted() const { return mInserted; }
+
+private:
+  /// Update mSpsOut for the SPS in mSps
+  void rewrite(const SpsRewriteOptions &options);
+  void updateSprop();
+
+  /// The latest SPS as sent by the camera
+  std::vector<uint8_t> mSps;
+  /// The SPS to send, which is mSps or its rewritten form
+  std::vector<uint8_t> mSpsOut;
+  /// The options mSpsOut was made with
+  SpsRewriteOptions mSpsOptions;
+  std::vector<uint8_t> mPps;
+  float mFps{0};
+  std::atomic<bool> mZeroReorder{false};
+  std::atomic<bool> mTimingInfo{false};
+  std::atomic<std::size_t> mInserted{0};
+
+  /// Guards mSprop, which is read from other threads
+  mutable std::mutex mMutex;
+  std::string mSprop;
+};
+
+/// Base64 encoding as defined in RFC 4648
+std::string base64_encode(const uint8_t *data, std::size_t size);
+
+} // namespace mselph264
+
+#endif
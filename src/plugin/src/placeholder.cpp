@@ -0,0 +1,231 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "placeholder.hpp"
+
+#include <algorithm>
+
+#include "bitstream.hpp"
+
+using namespace std;
+
+namespace mselph264 {
+
+namespace {
+
+uint32_t macroblocks(unsigned pixels) { return (pixels + 15) / 16; }
+
+vector<uint8_t> make_nalu(uint8_t header, const BitWriter &bits) {
+  vector<uint8_t> nalu{header};
+  escape_rbsp(bits.data(), nalu);
+  return nalu;
+}
+
+vector<uint8_t> make_sps(VideoSize size) {
+  const auto width = macroblocks(size.width);
+  const auto height = macroblocks(size.height);
+  // Crop units are 2 pixels for 4:2:0
+  const auto crop_right = (width * 16 - size.width) / 2;
+  const auto crop_bottom = (height * 16 - size.height) / 2;
+
+  BitWriter bits;
+  bits.u(8, 66);    // profile_idc: baseline
+  bits.u(8, 0xC0);  // constraint_set0_flag and constraint_set1_flag
+  bits.u(8, 31);    // level_idc
+  bits.ue(0);       // seq_parameter_set_id
+  bits.ue(0);       // log2_max_frame_num_minus4
+  bits.ue(2);       // pic_order_cnt_type: output in decoding order
+  bits.ue(1);       // max_num_ref_frames
+  bits.flag(false); // gaps_in_frame_num_value_allowed_flag
+  bits.ue(width - 1);
+  bits.ue(height - 1);
+  bits.flag(true); // frame_mbs_only_flag
+  bits.flag(true); // direct_8x8_inference_flag
+  bits.flag(crop_right || crop_bottom);
+  if (crop_right || crop_bottom) {
+    bits.ue(0);
+    bits.ue(crop_right);
+    bits.ue(0);
+    bits.ue(crop_bottom);
+  }
+  bits.flag(false); // vui_parameters_present_flag
+  bits.trailingBits();
+  return make_nalu(0x67, bits);
+}
+
+vector<uint8_t> make_pps() {
+  BitWriter bits;
+  bits.ue(0);       // pic_parameter_set_id
+  bits.ue(0);       // seq_parameter_set_id
+  bits.flag(false); // entropy_coding_mode_flag: CAVLC
+  bits.flag(false); // bottom_field_pic_order_in_frame_present_flag
+  bits.ue(0);       // num_slice_groups_minus1
+  bits.ue(0);       // num_ref_idx_l0_default_active_minus1
+  bits.ue(0);       // num_ref_idx_l1_default_active_minus1
+  bits.flag(false); // weighted_pred_flag
+  bits.u(2, 0);     // weighted_bipred_idc
+  bits.se(0);       // pic_init_qp_minus26
+  bits.se(0);       // pic_init_qs_minus26
+  bits.se(0);       // chroma_qp_index_offset
+  bits.flag(true);  // deblocking_filter_control_present_flag
+  bits.flag(false); // constrained_intra_pred_flag
+  bits.flag(false); // redundant_pic_cnt_present_flag
+  bits.trailingBits();
+  return make_nalu(0x68, bits);
+}
+
+vector<uint8_t> make_idr(VideoSize size) {
+  BitWriter bits;
+  bits.ue(0);       // first_mb_in_slice
+  bits.ue(7);       // slice_type: I, all slices
+  bits.ue(0);       // pic_parameter_set_id
+  bits.u(4, 0);     // frame_num
+  bits.ue(0);       // idr_pic_id
+  bits.flag(false); // no_output_of_prior_pics_flag
+  bits.flag(false); // long_term_reference_flag
+  bits.se(0);       // slice_qp_delta
+  bits.ue(1);       // disable_deblocking_filter_idc
+  const auto count = macroblocks(size.width) * macroblocks(size.height);
+  for (uint32_t mb = 0; mb < count; ++mb) {
+    // I_16x16_2_0_0: DC prediction, which gives 128 without neighbours and
+    // the same value from there on, and no coded residual
+    bits.ue(3);
+    bits.ue(0);   // intra_chroma_pred_mode: DC
+    bits.se(0);   // mb_qp_delta
+    bits.u(1, 1); // coeff_token of Intra16x16DCLevel: no coefficients
+  }
+  bits.trailingBits();
+  return make_nalu(0x65, bits);
+}
+
+vector<uint8_t> make_skip(VideoSize size, uint32_t frame_num) {
+  BitWriter bits;
+  bits.ue(0);            // first_mb_in_slice
+  bits.ue(5);            // slice_type: P, all slices
+  bits.ue(0);            // pic_parameter_set_id
+  bits.u(4, frame_num);  // frame_num
+  bits.flag(false);      // num_ref_idx_active_override_flag
+  bits.flag(false);      // ref_pic_list_modification_flag_l0
+  bits.flag(false);      // adaptive_ref_pic_marking_mode_flag
+  bits.se(0);            // slice_qp_delta
+  bits.ue(1);            // disable_deblocking_filter_idc
+  bits.ue(macroblocks(size.width) * macroblocks(size.height)); // mb_skip_run
+  bits.trailingBits();
+  return make_nalu(0x41, bits);
+}
+
+void push(const vector<uint8_t> &nalu, MSQueue *nalus) {
+  mblk_t *m = allocb(nalu.size(), 0);
+  copy(nalu.begin(), nalu.end(), m->b_wptr);
+  m->b_wptr += nalu.size();
+  ms_queue_put(nalus, m);
+}
+
+} // namespace
+
+PlaceholderStream::PlaceholderStream(VideoSize size)
+    : mSize(size), mSps(make_sps(size)), mPps(make_pps()),
+      mIdr(make_idr(size)) {
+  for (uint32_t frame_num = 0; frame_num < MAX_FRAME_NUM; ++frame_num) {
+    mSkip.push_back(make_skip(size, frame_num));
+  }
+}
+
+void PlaceholderStream::next(MSQueue *nalus) {
+  if (mFrameNum == NO_FRAME) {
+    push(mSps, nalus);
+    push(mPps, nalus);
+    push(mIdr, nalus);
+    mFrameNum = 0;
+    return;
+  }
+  mFrameNum = (mFrameNum + 1) % MAX_FRAME_NUM;
+  push(mSkip[mFrameNum], nalus);
+}
+
+KeepAlive::KeepAlive(const vector<VideoSize> &sizes) {
+  for (const auto &size : sizes) {
+    if (!find(size)) {
+      mStreams.emplace_back(size);
+    }
+  }
+}
+
+void KeepAlive::setTimeout(uint64_t timeout) {
+  lock_guard<mutex> lock(mMutex);
+  mTimeout = timeout;
+}
+
+void KeepAlive::start(uint64_t now) {
+  lock_guard<mutex> lock(mMutex);
+  mLastFrame = now;
+}
+
+bool KeepAlive::frame(const FrameInfo &info, uint64_t now) {
+  lock_guard<mutex> lock(mMutex);
+  if (mWaitingForIdr && !info.has(FrameInfo::HAS_IDR)) {
+    // Placeholders go on until the camera sends an IDR
+    ++mStats.dropped;
+    return false;
+  }
+  mWaitingForIdr = false;
+  mLastFrame = now;
+  return true;
+}
+
+bool KeepAlive::idle(VideoSize size, uint64_t now, MSQueue *nalus) {
+  lock_guard<mutex> lock(mMutex);
+  if (mTimeout == 0 || now - mLastFrame < mTimeout) {
+    return false;
+  }
+  if (mWaitingForIdr && now - mLastPlaceholder < INTERVAL) {
+    return false;
+  }
+  auto stream = find(size);
+  if (!stream) {
+    return false;
+  }
+  if (!mWaitingForIdr || stream != mCurrent) {
+    // Receivers need an IDR of the placeholder stream first
+    stream->restart();
+    mCurrent = stream;
+  }
+  stream->next(nalus);
+  mLastPlaceholder = now;
+  mWaitingForIdr = true;
+  ++mStats.placeholders;
+  return true;
+}
+
+bool KeepAlive::waitingForIdr() const {
+  lock_guard<mutex> lock(mMutex);
+  return mWaitingForIdr;
+}
+
+KeepAlive::Stats KeepAlive::stats() const {
+  lock_guard<mutex> lock(mMutex);
+  return mStats;
+}
+
+PlaceholderStream *KeepAlive::find(VideoSize size) {
+  auto it = find_if(
+      mStreams.begin(), mStreams.end(),
+      [&size](const PlaceholderStream &stream) { return stream.size() == size; });
+  return it == mStreams.end() ? nullptr : &*it;
+}
+
+} // namespace mselph264
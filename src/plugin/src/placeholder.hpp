@@ -0,0 +1,128 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLUGIN_PLACEHOLDER_HPP__
+#define PLUGIN_PLACEHOLDER_HPP__
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <mediastreamer2/msqueue.h>
+#include <h264camera/v4l2_device.hpp>
+
+#include "h264helper.hpp"
+
+namespace mselph264 {
+
+using h264camera::VideoSize;
+
+/// Pre-encoded H.264 stream of a mid-grey picture.
+///
+/// The IDR consists of Intra 16x16 DC macroblocks without residual, 8 bits
+/// each, the P frames skip all macroblocks and take a few bytes.  The
+/// stream is constrained baseline with its own SPS and PPS, so receivers
+/// have to get an IDR of the camera when its frames resume.
+class PlaceholderStream {
+public:
+  explicit PlaceholderStream(VideoSize size);
+
+  VideoSize size() const { return mSize; }
+  /// Append the NALUs of the next access unit to *nalus*: SPS, PPS and the
+  /// IDR first, P frames afterwards.
+  void next(MSQueue *nalus);
+  /// Start over with the IDR
+  void restart() { mFrameNum = NO_FRAME; }
+
+  const std::vector<uint8_t> &sps() const { return mSps; }
+  const std::vector<uint8_t> &pps() const { return mPps; }
+  const std::vector<uint8_t> &idr() const { return mIdr; }
+  /// P frame with frame_num *frame_num*
+  const std::vector<uint8_t> &skip(uint32_t frame_num) const {
+    return mSkip.at(frame_num);
+  }
+
+  /// log2_max_frame_num_minus4 is 0
+  static constexpr uint32_t MAX_FRAME_NUM{16};
+
+private:
+  static constexpr uint32_t NO_FRAME{UINT32_MAX};
+
+  VideoSize mSize;
+  std::vector<uint8_t> mSps;
+  std::vector<uint8_t> mPps;
+  std::vector<uint8_t> mIdr;
+  /// Indexed by frame_num, which wraps around to 0 after the IDR
+  std::vector<std::vector<uint8_t>> mSkip;
+  uint32_t mFrameNum{NO_FRAME};
+};
+
+/// Keep receivers alive while the camera delivers nothing.
+///
+/// If no frame was sent for the timeout, e.g., during a reconfiguration or
+/// a stalled USB transfer, the placeholder stream of the current size is
+/// sent instead, one access unit per interval.  Once the camera frames
+/// resume, frames are dropped until its next IDR, since the receivers hold
+/// the placeholder pictures as reference.
+///
+/// The ticker thread calls everything but setTimeout() and stats().
+class KeepAlive {
+public:
+  struct Stats {
+    /// Placeholder access units sent
+    uint64_t placeholders{0};
+    /// Camera frames dropped while waiting for an IDR afterwards
+    uint64_t dropped{0};
+  };
+
+  /// Build the placeholder streams of all *sizes* at once
+  explicit KeepAlive(const std::vector<VideoSize> &sizes);
+
+  /// Milliseconds between placeholder access units
+  static constexpr uint64_t INTERVAL{100};
+
+  /// Send placeholders after *timeout* ms without frames, 0 disables them
+  void setTimeout(uint64_t timeout);
+
+  /// Restart the timeout, e.g., when the capture starts
+  void start(uint64_t now);
+  /// A camera frame is about to be sent.  Returns false, if it has to be
+  /// dropped since the receivers still decode the placeholder stream.
+  bool frame(const FrameInfo &info, uint64_t now);
+  /// No camera frame is ready.  Appends a placeholder access unit of *size*
+  /// to *nalus* and returns true, if one is due.
+  bool idle(VideoSize size, uint64_t now, MSQueue *nalus);
+  /// Placeholders were sent and no IDR of the camera since
+  bool waitingForIdr() const;
+
+  Stats stats() const;
+
+private:
+  PlaceholderStream *find(VideoSize size);
+
+  mutable std::mutex mMutex;
+  std::vector<PlaceholderStream> mStreams;
+  PlaceholderStream *mCurrent{nullptr};
+  uint64_t mTimeout{0};
+  uint64_t mLastFrame{0};
+  uint64_t mLastPlaceholder{0};
+  bool mWaitingForIdr{false};
+  Stats mStats;
+};
+
+} // namespace mselph264
+
+#endif
@@ -0,0 +1,195 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "preview.hpp"
+
+#include <bctoolbox/logging.h>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <mediastreamer2/msticker.h>
+
+#include "h264camera/preview_source.hpp"
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+namespace mselph264 {
+
+PreviewState::PreviewState(MSFilter *filter) : mFilter(filter) {}
+
+PreviewState::~PreviewState() {
+  if (auto m = mFrame.exchange(nullptr)) {
+    freemsg(m);
+  }
+}
+
+PreviewState *PreviewState::from(MSFilter *filter) {
+  assert(filter);
+  assert(filter->data);
+  return static_cast<PreviewState *>(filter->data);
+}
+
+void PreviewState::setDevice(const std::string &path) {
+  bctbx_message("Set preview device %s", path.c_str());
+  mDevice = std::make_unique<PreviewSource>(path);
+}
+
+bool PreviewState::setPixFmt(MSPixFmt pixfmt) {
+  if (pixfmt != MS_MJPEG && pixfmt != MS_YUYV) {
+    return false;
+  }
+  mPixFmt = pixfmt;
+  return true;
+}
+
+void PreviewState::captureLoop() {
+  assert(mDevice);
+  ms_message("Start preview capture loop");
+  try {
+    const auto conf = mConf.load();
+    const auto requested = conf.vsize;
+    mDevice->reopen();
+    mDevice->configure({static_cast<unsigned int>(requested.width),
+                        static_cast<unsigned int>(requested.height)},
+                       static_cast<uint32_t>(conf.fps));
+    const auto vsize = mDevice->vsize();
+    if (vsize.width != static_cast<unsigned int>(requested.width) ||
+        vsize.height != static_cast<unsigned int>(requested.height)) {
+      bctbx_warning("Preview runs with %ux%u instead of %dx%d", vsize.width,
+                    vsize.height, requested.width, requested.height);
+      setVsize(
+          {static_cast<int>(vsize.width), static_cast<int>(vsize.height)});
+    }
+    mDevice->start();
+
+    while (mRunning) {
+      auto mem = mDevice->dequeue(200ms);
+      if (!mem) {
+        bctbx_warning("Timeout when waiting for a preview frame");
+        continue;
+      }
+      mblk_t *m = nullptr;
+      if (mDevice->complete(*mem)) {
+        m = allocb(mem->used(), 0);
+        std::memcpy(m->b_wptr, mem->ptr, mem->used());
+        m->b_wptr += mem->used();
+      }
+      mem->done();
+      mDevice->queue(mem->index);
+      // Replace a frame process() did not take yet
+      if (auto old = m ? mFrame.exchange(m) : nullptr) {
+        freemsg(old);
+      }
+    }
+    mDevice->stop();
+    mDevice->close();
+  } catch (const std::exception &e) {
+    ms_error("Something went wrong in the preview capture loop %s", e.what());
+  }
+  ms_message("Stop preview capture loop");
+}
+
+void PreviewState::preprocess() {
+  assert(mDevice);
+  mDevice->setPixelformat(mPixFmt == MS_YUYV ? V4L2_PIX_FMT_YUYV
+                                             : V4L2_PIX_FMT_MJPEG);
+  mRunning = true;
+  mCaptureThread = std::thread(&PreviewState::captureLoop, this);
+}
+
+void PreviewState::process() {
+  if (auto m = mFrame.exchange(nullptr)) {
+    // rtp uses a 90 kHz clockrate for video
+    mblk_set_timestamp_info(m,
+                            static_cast<uint32_t>(mFilter->ticker->time * 90));
+    ms_queue_put(mFilter->outputs[0], m);
+  }
+}
+
+void PreviewState::postprocess() {
+  mRunning = false;
+  mCaptureThread.join();
+}
+
+static MSFilterMethod preview_method_table[] = {
+    {MS_FILTER_GET_PIX_FMT,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Preview method: MS_FILTER_GET_PIX_FMT");
+       *static_cast<MSPixFmt *>(arg) = PreviewState::from(f)->pixFmt();
+       return 0;
+     }},
+    {MS_FILTER_SET_PIX_FMT,
+     [](MSFilter *f, void *arg) -> int {
+       auto pixfmt = static_cast<const MSPixFmt *>(arg);
+       bctbx_debug("Preview method: MS_FILTER_SET_PIX_FMT %d", *pixfmt);
+       return PreviewState::from(f)->setPixFmt(*pixfmt) ? 0 : -1;
+     }},
+    {MS_FILTER_GET_VIDEO_SIZE,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Preview method: MS_FILTER_GET_VIDEO_SIZE");
+       *static_cast<MSVideoSize *>(arg) = PreviewState::from(f)->vsize();
+       return 0;
+     }},
+    {MS_FILTER_SET_VIDEO_SIZE,
+     [](MSFilter *f, void *arg) -> int {
+       auto vsize = static_cast<const MSVideoSize *>(arg);
+       bctbx_debug("Preview method: MS_FILTER_SET_VIDEO_SIZE %dx%d",
+                   vsize->width, vsize->height);
+       PreviewState::from(f)->setVsize(*vsize);
+       return 0;
+     }},
+    {MS_FILTER_GET_FPS,
+     [](MSFilter *f, void *arg) -> int {
+       bctbx_debug("Preview method: MS_FILTER_GET_FPS");
+       *static_cast<float *>(arg) = PreviewState::from(f)->fps();
+       return 0;
+     }},
+    {MS_FILTER_SET_FPS,
+     [](MSFilter *f, void *arg) -> int {
+       auto fps = static_cast<const float *>(arg);
+       bctbx_debug("Preview method: MS_FILTER_SET_FPS %f", *fps);
+       if (*fps <= 0) {
+         return -1;
+       }
+       PreviewState::from(f)->setFps(*fps);
+       return 0;
+     }},
+    {0, nullptr}};
+
+// Reader filter of the secondary video node, created by the preview
+// MSWebCamDesc.
+MSFilterDesc preview_filter_description = {
+    MS_FILTER_PLUGIN_ID /*id*/,
+    "h264camera-preview" /*name*/,
+    "Access the MJPEG/YUYV node of an ELP USB100W04H" /*text*/,
+    MS_FILTER_OTHER /*category*/,
+    nullptr /*enc_fmt*/,
+    0 /*ninputs*/,
+    1 /*noutputs*/,
+    [](MSFilter *f) { f->data = new PreviewState(f); } /*init*/,
+    [](MSFilter *f) { PreviewState::from(f)->preprocess(); } /*preprocess*/,
+    [](MSFilter *f) { PreviewState::from(f)->process(); } /*process*/,
+    [](MSFilter *f) { PreviewState::from(f)->postprocess(); } /*postprocess*/,
+    [](MSFilter *f) {
+      delete PreviewState::from(f);
+      f->data = nullptr;
+    } /*uninit*/,
+    preview_method_table,
+    0 /*flags*/};
+
+} // namespace mselph264
@@ -0,0 +1,90 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLUGIN_PREVIEW_HPP__
+#define PLUGIN_PREVIEW_HPP__
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mediastreamer2/msfilter.h>
+#include <mediastreamer2/msvideo.h>
+
+#include "seqlock.hpp"
+
+namespace h264camera {
+class PreviewSource;
+}
+
+namespace mselph264 {
+
+/// State of the preview reader filter.  It streams the MJPEG/YUYV node of
+/// the camera, while the h264camera filter streams the H.264 node.  Only
+/// the latest frame is kept, a preview is not supposed to lag behind.
+///
+/// Format, size and frame rate take effect with the next preprocessing.
+/// Neither the settings nor the frame hand-off take the filter lock, so
+/// the capture thread never waits for the ticker.
+class PreviewState {
+public:
+  PreviewState(MSFilter *filter);
+  ~PreviewState();
+
+  /// Extract the PreviewState from the userdata in a MSFilter
+  static PreviewState *from(MSFilter *filter);
+  /// Set the path of the video node, e.g., /dev/elp-mjpeg
+  void setDevice(const std::string &path);
+
+  void preprocess();
+  void process();
+  void postprocess();
+
+  MSPixFmt pixFmt() const { return mPixFmt; }
+  /// MS_MJPEG and MS_YUYV are supported
+  bool setPixFmt(MSPixFmt pixfmt);
+  MSVideoSize vsize() const { return mConf.load().vsize; }
+  void setVsize(MSVideoSize vsize) {
+    mConf.update([vsize](Conf &conf) { conf.vsize = vsize; });
+  }
+  float fps() const { return mConf.load().fps; }
+  void setFps(float fps) {
+    mConf.update([fps](Conf &conf) { conf.fps = fps; });
+  }
+
+private:
+  struct Conf {
+    MSVideoSize vsize;
+    float fps;
+  };
+
+  void captureLoop();
+
+  MSFilter *mFilter{nullptr};
+  std::unique_ptr<h264camera::PreviewSource> mDevice;
+  std::atomic<MSPixFmt> mPixFmt{MS_MJPEG};
+  Seqlock<Conf> mConf{Conf{{MS_VIDEO_SIZE_VGA_W, MS_VIDEO_SIZE_VGA_H}, 15}};
+
+  std::thread mCaptureThread;
+  std::atomic<bool> mRunning{false};
+  /// Latest frame waiting for process()
+  std::atomic<mblk_t *> mFrame{nullptr};
+};
+
+} // namespace mselph264
+
+#endif
@@ -0,0 +1,56 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "reader_policy.hpp"
+
+#include <cassert>
+
+namespace mselph264 {
+
+void ReaderPolicy::copy(const Frame &frame, MSQueue *out) {
+  assert(ms_queue_empty(out));
+  frame.duplicate(out);
+  const auto sei = mSeiPolicy.load();
+  const bool strip = mStrip;
+  const bool timestamp = mTimestampSei;
+  if (sei == SeiPolicy::KEEP && !strip && !timestamp) {
+    // Most readers, nothing to do
+    return;
+  }
+
+  mInfo = frame.info;
+  const bool drop_sei = sei == SeiPolicy::DROP ||
+                        (sei == SeiPolicy::KEEP_ON_IDR &&
+                         !mInfo.has(FrameInfo::HAS_IDR));
+  for (std::size_t pos = mInfo.nalus.size(); pos-- > 0;) {
+    const auto nalu = mInfo.nalus[pos];
+    if (drop_sei && nalu.type == NALU_SEI) {
+      ++mDroppedSei;
+      mDroppedSeiBytes += nalu.size;
+      remove_nalu(out, mInfo, pos);
+    } else if (strip && nalu.redundant) {
+      ++mStripped;
+      remove_nalu(out, mInfo, pos);
+    }
+  }
+  if (timestamp && !ms_queue_empty(out)) {
+    insert_timestamp_sei(mInfo, out);
+  }
+}
+
+} // namespace mselph264
@@ -0,0 +1,81 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_READER_POLICY_HPP__
+#define PLUGIN_READER_POLICY_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <mediastreamer2/msqueue.h>
+
+#include "h264helper.hpp"
+
+namespace mselph264 {
+
+/// What a reader does with the SEI NALUs of the camera
+enum class SeiPolicy {
+  KEEP,
+  DROP,
+  /// Keep SEI of frames with an IDR slice only
+  KEEP_ON_IDR,
+};
+
+/// Changes of the bitstream a single reader asks for, e.g., a low bitrate
+/// call dropping the SEI of the camera.
+///
+/// The frames of a CaptureSession are shared by all its readers and must
+/// not change.  So these changes are applied to the copy of every reader,
+/// where the FrameInfo tells which NALUs to remove without looking at the
+/// payload.  The settings may change from any thread, copy() is called by
+/// the reader only.
+class ReaderPolicy {
+public:
+  /// What to do with the SEI NALUs of the camera
+  void setSeiPolicy(SeiPolicy policy) { mSeiPolicy = policy; }
+  /// Insert a SEI with the capture timestamp in front of every frame.  The
+  /// SeiPolicy does not apply to it.
+  void enableTimestampSei(bool enable) { mTimestampSei = enable; }
+  /// Remove SPS and PPS in front of non-IDR frames, which ParameterSets
+  /// marked as redundant
+  void stripParameterSets(bool enable) { mStrip = enable; }
+
+  /// Fill the empty *out* with the NALUs of *frame* as the reader wants
+  /// them.  Unchanged NALUs share the data with the frame (see dupb).
+  void copy(const Frame &frame, MSQueue *out);
+
+  /// Count of SEI NALUs dropped due to the policy
+  uint64_t droppedSei() const { return mDroppedSei; }
+  /// Bytes saved by dropping SEI NALUs
+  uint64_t droppedSeiBytes() const { return mDroppedSeiBytes; }
+  /// Count of parameter sets removed
+  uint64_t stripped() const { return mStripped; }
+
+private:
+  std::atomic<SeiPolicy> mSeiPolicy{SeiPolicy::KEEP};
+  std::atomic<bool> mTimestampSei{false};
+  std::atomic<bool> mStrip{false};
+  std::atomic<uint64_t> mDroppedSei{0};
+  std::atomic<uint64_t> mDroppedSeiBytes{0};
+  std::atomic<uint64_t> mStripped{0};
+  // Descriptor of the copy, reused for every frame
+  FrameInfo mInfo;
+};
+
+} // namespace mselph264
+
+#endif
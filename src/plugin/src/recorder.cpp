@@ -0,0 +1,295 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "recorder.hpp"
+
+#include <array>
+#include <bctoolbox/logging.h>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace mselph264 {
+
+namespace {
+
+/// The NALU data of a frame, shares the buffers with the frame
+template <typename Fn> void for_each_nalu(const Frame &frame, Fn fn) {
+  // The queue is only read, ms_queue_* just lack const overloads
+  auto queue = const_cast<MSQueue *>(&frame.nalus);
+  for (mblk_t *m = ms_queue_peek_first(queue); !ms_queue_end(queue, m);
+       m = ms_queue_next(queue, m)) {
+    if (m->b_wptr > m->b_rptr) {
+      fn(m->b_rptr, static_cast<size_t>(m->b_wptr - m->b_rptr));
+    }
+  }
+}
+
+/// Write all of *iov*, which is modified on partial writes
+bool write_all(int fd, vector<iovec> &iov) {
+  size_t idx{0};
+  while (idx < iov.size()) {
+    const auto count = static_cast<int>(min<size_t>(iov.size() - idx, IOV_MAX));
+    auto written = ::writev(fd, iov.data() + idx, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    auto left = static_cast<size_t>(written);
+    while (idx < iov.size() && left >= iov[idx].iov_len) {
+      left -= iov[idx].iov_len;
+      ++idx;
+    }
+    if (left > 0) {
+      iov[idx].iov_base = static_cast<uint8_t *>(iov[idx].iov_base) + left;
+      iov[idx].iov_len -= left;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+Recorder::~Recorder() { stop(); }
+
+void Recorder::start(std::shared_ptr<Subscription> frames) {
+  stop();
+  mFrames = move(frames);
+  mRunning = true;
+  mWriterThread = thread(&Recorder::writeLoop, this);
+}
+
+void Recorder::stop() {
+  if (!mWriterThread.joinable()) {
+    return;
+  }
+  mRunning = false;
+  mWriterThread.join();
+  mFrames.reset();
+}
+
+Recorder::Stats Recorder::stats() const {
+  lock_guard<mutex> lock(mStatsMutex);
+  return mStats;
+}
+
+void Recorder::writeLoop() {
+  bctbx_message("Start recording to %s", mConfig.prefix.c_str());
+  while (mRunning) {
+    if (auto frame = mFrames->pop(100ms)) {
+      add(frame);
+    }
+  }
+  while (auto frame = mFrames->pop()) {
+    add(frame);
+  }
+  writeFragment(0);
+  closeSegment();
+  bctbx_message("Stop recording to %s", mConfig.prefix.c_str());
+}
+
+uint64_t Recorder::mediaTime(uint64_t timestamp_us) const {
+  if (timestamp_us < mSegmentStartUs) {
+    return 0;
+  }
+  return (timestamp_us - mSegmentStartUs) * FMP4_TIMESCALE / 1000000;
+}
+
+void Recorder::add(const SharedFrame &frame) {
+  const auto &info = frame->info;
+  const bool idr = info.has(FrameInfo::HAS_IDR);
+
+  bool new_segment = idr && mFd < 0;
+  if (idr && mFd >= 0) {
+    const bool too_long =
+        mConfig.segment_ms > 0 &&
+        info.timestamp_us >= mSegmentStartUs + mConfig.segment_ms * 1000;
+    const bool too_large =
+        mConfig.segment_bytes > 0 && mSegmentBytes >= mConfig.segment_bytes;
+    bool changed{false};
+    for_each_nalu(*frame, [&](const uint8_t *data, size_t size) {
+      const auto type = data[0] & 0x1F;
+      if ((type == NALU_SPS &&
+           !equal(data, data + size, mSps.begin(), mSps.end())) ||
+          (type == NALU_PPS &&
+           !equal(data, data + size, mPps.begin(), mPps.end()))) {
+        changed = true;
+      }
+    });
+    new_segment = too_long || too_large || changed;
+  }
+
+  if (!mFragment.empty()) {
+    const auto &first = mFragment.front()->info;
+    if (new_segment || idr ||
+        info.timestamp_us >= first.timestamp_us + mConfig.fragment_ms * 1000) {
+      writeFragment(info.timestamp_us);
+    }
+  }
+  if (new_segment && !openSegment(*frame)) {
+    return;
+  }
+  if (mFd >= 0) {
+    mFragment.push_back(frame);
+  }
+}
+
+bool Recorder::openSegment(const Frame &frame) {
+  closeSegment();
+
+  vector<uint8_t> sps;
+  vector<uint8_t> pps;
+  for_each_nalu(frame, [&](const uint8_t *data, size_t size) {
+    const auto type = data[0] & 0x1F;
+    if (type == NALU_SPS && sps.empty()) {
+      sps.assign(data, data + size);
+    } else if (type == NALU_PPS && pps.empty()) {
+      pps.assign(data, data + size);
+    }
+  });
+  if (sps.empty() || pps.empty()) {
+    // Try again with the next IDR
+    bctbx_warning("Recording waits for an IDR with parameter sets");
+    return false;
+  }
+  auto init = fmp4_init_segment(sps, pps);
+  if (init.empty()) {
+    bctbx_error("Cannot record stream with malformed SPS");
+    lock_guard<mutex> lock(mStatsMutex);
+    ++mStats.errors;
+    return false;
+  }
+
+  array<char, 16> suffix;
+  snprintf(suffix.data(), suffix.size(), "-%05u.mp4", ++mSegmentIndex);
+  const auto path = mConfig.prefix + suffix.data();
+  mFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  vector<iovec> iov{{init.data(), init.size()}};
+  if (mFd < 0 || !write_all(mFd, iov)) {
+    bctbx_error("Cannot write %s: %s", path.c_str(), strerror(errno));
+    closeSegment();
+    lock_guard<mutex> lock(mStatsMutex);
+    ++mStats.errors;
+    return false;
+  }
+  bctbx_message("Recording to %s", path.c_str());
+
+  mSps = move(sps);
+  mPps = move(pps);
+  mSegmentStartUs = frame.info.timestamp_us;
+  mSegmentBytes = init.size();
+  mSequence = 0;
+  mDecodeTime = 0;
+  lock_guard<mutex> lock(mStatsMutex);
+  ++mStats.segments;
+  mStats.bytes += init.size();
+  return true;
+}
+
+void Recorder::closeSegment() {
+  if (mFd >= 0) {
+    ::close(mFd);
+    mFd = -1;
+  }
+}
+
+void Recorder::writeFragment(uint64_t next_us) {
+  if (mFragment.empty() || mFd < 0) {
+    mFragment.clear();
+    return;
+  }
+
+  vector<Fmp4Sample> samples;
+  samples.reserve(mFragment.size());
+  size_t nalu_count{0};
+  for (size_t idx = 0; idx < mFragment.size(); ++idx) {
+    const auto &frame = *mFragment[idx];
+    Fmp4Sample sample{mLastDuration, 0, frame.info.has(FrameInfo::HAS_IDR)};
+    const uint64_t next = (idx + 1 < mFragment.size())
+                              ? mFragment[idx + 1]->info.timestamp_us
+                              : next_us;
+    if (next > frame.info.timestamp_us) {
+      sample.duration = static_cast<uint32_t>(
+          mediaTime(next) - mediaTime(frame.info.timestamp_us));
+    }
+    sample.duration = max<uint32_t>(sample.duration, 1);
+    mLastDuration = sample.duration;
+    for_each_nalu(frame, [&](const uint8_t *data, size_t size) {
+      if (fmp4_sample_nalu(data[0] & 0x1F)) {
+        sample.size += static_cast<uint32_t>(4 + size);
+        ++nalu_count;
+      }
+    });
+    samples.push_back(sample);
+  }
+
+  auto header = fmp4_fragment_header(++mSequence, mDecodeTime, samples);
+  // Length prefixes of the NALUs, must not move while iov points to them
+  vector<array<uint8_t, 4>> lengths(nalu_count);
+  vector<iovec> iov;
+  iov.reserve(1 + 2 * nalu_count);
+  iov.push_back({header.data(), header.size()});
+  size_t pos{0};
+  for (const auto &frame : mFragment) {
+    for_each_nalu(*frame, [&](const uint8_t *data, size_t size) {
+      if (!fmp4_sample_nalu(data[0] & 0x1F)) {
+        return;
+      }
+      auto &length = lengths[pos++];
+      for (int idx = 0; idx < 4; ++idx) {
+        length[idx] = static_cast<uint8_t>(size >> (24 - 8 * idx));
+      }
+      iov.push_back({length.data(), length.size()});
+      iov.push_back({const_cast<uint8_t *>(data), size});
+    });
+  }
+
+  uint64_t bytes = header.size();
+  for (const auto &sample : samples) {
+    mDecodeTime += sample.duration;
+    bytes += sample.size;
+  }
+  const bool ok = write_all(mFd, iov);
+  mSegmentBytes += bytes;
+
+  lock_guard<mutex> lock(mStatsMutex);
+  if (ok) {
+    ++mStats.fragments;
+    mStats.frames += mFragment.size();
+    mStats.bytes += bytes;
+  } else {
+    bctbx_error("Cannot write fragment: %s", strerror(errno));
+    ++mStats.errors;
+  }
+  mFragment.clear();
+  if (!ok) {
+    // Start over with a new file at the next IDR
+    closeSegment();
+  }
+}
+
+} // namespace mselph264
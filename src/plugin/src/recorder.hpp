@@ -0,0 +1,118 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_RECORDER_HPP__
+#define PLUGIN_RECORDER_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_session.hpp"
+#include "fmp4.hpp"
+
+namespace mselph264 {
+
+/// Writes the frames of a Subscription to fragmented MP4 files.
+///
+/// The recorder has its own writer thread, so the capture thread only
+/// queues references to the frames and never waits for the disk.  Each
+/// fragment goes to the file with a single writev() of the moof box and
+/// the NALU data of the shared frames, without copying the payload.
+///
+/// The files are named <prefix>-00001.mp4, <prefix>-00002.mp4, ...  A new
+/// file starts at the first IDR after the duration or size limit, or when
+/// the parameter sets change.  A fragment ends at every IDR or when it
+/// exceeds the fragment duration.
+class Recorder {
+public:
+  struct Config {
+    std::string prefix;
+    /// Limits of a file, 0 for none
+    uint64_t segment_ms{0};
+    uint64_t segment_bytes{0};
+    /// Longest fragment, i.e., the delay until frames are in the file
+    uint64_t fragment_ms{1000};
+  };
+
+  struct Stats {
+    /// Files started
+    uint64_t segments{0};
+    uint64_t fragments{0};
+    uint64_t frames{0};
+    /// Bytes written to all files
+    uint64_t bytes{0};
+    /// Failed opens and writes
+    uint64_t errors{0};
+  };
+
+  explicit Recorder(const Config &config) : mConfig(config) {}
+  ~Recorder();
+  Recorder(const Recorder &) = delete;
+  Recorder &operator=(const Recorder &) = delete;
+
+  /// Start the writer thread taking frames from *frames*
+  void start(std::shared_ptr<Subscription> frames);
+  /// Write the frames queued so far and close the file
+  void stop();
+
+  Stats stats() const;
+
+private:
+  void writeLoop();
+  void add(const SharedFrame &frame);
+  /// Close the current file and open the next one for the IDR *frame*
+  bool openSegment(const Frame &frame);
+  void closeSegment();
+  /// Write the pending frames as one fragment.  *next_us* is the capture
+  /// time of the following frame, 0 if unknown.
+  void writeFragment(uint64_t next_us);
+  /// Time since the start of the file in FMP4_TIMESCALE units
+  uint64_t mediaTime(uint64_t timestamp_us) const;
+
+  const Config mConfig;
+  std::shared_ptr<Subscription> mFrames;
+  std::thread mWriterThread;
+  std::atomic<bool> mRunning{false};
+
+  mutable std::mutex mStatsMutex;
+  Stats mStats;
+
+  // Used by the writer thread only
+  int mFd{-1};
+  uint32_t mSegmentIndex{0};
+  uint64_t mSegmentStartUs{0};
+  uint64_t mSegmentBytes{0};
+  std::vector<uint8_t> mSps;
+  std::vector<uint8_t> mPps;
+  uint32_t mSequence{0};
+  /// Decode time of the next fragment
+  uint64_t mDecodeTime{0};
+  /// Last sample duration, used if the next frame is unknown
+  uint32_t mLastDuration{FMP4_TIMESCALE / 30};
+  /// Frames of the fragment being collected
+  std::vector<SharedFrame> mFragment;
+};
+
+} // namespace mselph264
+
+#endif
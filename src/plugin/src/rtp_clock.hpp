@@ -0,0 +1,68 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_RTP_CLOCK_HPP__
+#define PLUGIN_RTP_CLOCK_HPP__
+
+#include <algorithm>
+#include <cstdint>
+
+namespace mselph264 {
+
+/// RTP timestamps (90 kHz) of the frames of one reader.
+///
+/// A frame is stamped with the time of the tick sending it, but never
+/// closer to the previous frame than their capture times are apart.  So a
+/// GOP replayed from the cache in one tick keeps the spacing of its capture
+/// and receivers see a plausible frame rate instead of a burst.
+class RtpClock {
+public:
+  /// Forget the previous frame, e.g., when a stream starts
+  void reset() { mStarted = false; }
+
+  /// Timestamp of a frame captured at *capture_us* and sent at *tick_ms*.
+  /// Frames without a capture time, e.g., placeholders, or with one not
+  /// after the previous frame are spaced by *interval*, one frame at the
+  /// nominal rate in 90 kHz units.
+  uint64_t stamp(uint64_t tick_ms, uint64_t capture_us, uint64_t interval) {
+    uint64_t timestamp = tick_ms * 90;
+    if (mStarted) {
+      uint64_t spacing = interval;
+      if (capture_us != 0 && mLastCapture_us != 0 &&
+          capture_us > mLastCapture_us) {
+        spacing = (capture_us - mLastCapture_us) * 9 / 100;
+      }
+      timestamp = std::max(timestamp, mLast + std::max<uint64_t>(spacing, 1));
+    }
+    mStarted = true;
+    mLast = timestamp;
+    mLastCapture_us = capture_us;
+    return timestamp;
+  }
+
+private:
+  bool mStarted{false};
+  /// Timestamp of the last frame
+  uint64_t mLast{0};
+  /// Capture time of the last frame or 0
+  uint64_t mLastCapture_us{0};
+};
+
+} // namespace mselph264
+
+#endif
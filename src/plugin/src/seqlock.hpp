@@ -0,0 +1,112 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_SEQLOCK_HPP__
+#define PLUGIN_SEQLOCK_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace mselph264 {
+
+/// A value written rarely and read often, e.g., the video configuration
+/// set by the signalling thread and read by the capture and ticker threads.
+///
+/// Readers never block: they copy the value and copy again, if a write
+/// overlapped (sequence lock).  Writers only wait for each other.  The value
+/// is copied word by word through relaxed atomics, so an overlapped copy is
+/// no data race, just discarded.  T has to be trivially copyable.
+template <typename T> class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Seqlock copies the value bytewise");
+
+public:
+  explicit Seqlock(const T &value = T{}) { write(value); }
+  Seqlock(const Seqlock &) = delete;
+  Seqlock &operator=(const Seqlock &) = delete;
+
+  T load() const {
+    std::array<uint64_t, WORDS> words;
+    while (true) {
+      const auto before = mSequence.load(std::memory_order_acquire);
+      if (before & 1) {
+        // A writer is in the middle of the value
+        std::this_thread::yield();
+        continue;
+      }
+      for (std::size_t idx = 0; idx < WORDS; ++idx) {
+        words[idx] = mWords[idx].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (mSequence.load(std::memory_order_relaxed) == before) {
+        break;
+      }
+    }
+    T value;
+    std::memcpy(&value, words.data(), sizeof(T));
+    return value;
+  }
+
+  void store(const T &value) {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    write(value);
+  }
+
+  /// Let *change* modify the value in place, e.g., depending on the current
+  /// one.  Other writers wait meanwhile, readers see the old value.
+  template <typename F> void update(F change) {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    T value = load();
+    change(value);
+    write(value);
+  }
+
+  /// Count of writes, including the initial value
+  uint64_t version() const {
+    return mSequence.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  static constexpr std::size_t WORDS{(sizeof(T) + 7) / 8};
+
+  void write(const T &value) {
+    std::array<uint64_t, WORDS> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+    const auto sequence = mSequence.load(std::memory_order_relaxed);
+    mSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t idx = 0; idx < WORDS; ++idx) {
+      mWords[idx].store(words[idx], std::memory_order_relaxed);
+    }
+    mSequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  std::mutex mWriteMutex;
+  /// Odd while a write is in progress
+  std::atomic<uint64_t> mSequence{0};
+  std::array<std::atomic<uint64_t>, WORDS> mWords;
+};
+
+} // namespace mselph264
+
+#endif
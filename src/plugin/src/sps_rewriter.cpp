@@ -0,0 +1,329 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "sps_rewriter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "bitstream.hpp"
+
+using namespace std;
+
+namespace mselph264 {
+
+namespace {
+
+void skip_scaling_list(BitReader &reader, int size) {
+  int32_t last_scale{8};
+  int32_t next_scale{8};
+  for (int idx = 0; idx < size; ++idx) {
+    if (next_scale != 0) {
+      next_scale = (last_scale + reader.se() + 256) % 256;
+    }
+    last_scale = (next_scale == 0) ? last_scale : next_scale;
+  }
+}
+
+BitRange skip_hrd_parameters(BitReader &reader) {
+  BitRange range;
+  range.begin = reader.position();
+  const uint32_t cpb_cnt = reader.ue() + 1;
+  if (cpb_cnt > 32) {
+    // Makes ok() fail
+    reader.u(32);
+    reader.u(32);
+    return range;
+  }
+  reader.u(4); // bit_rate_scale
+  reader.u(4); // cpb_size_scale
+  for (uint32_t idx = 0; idx < cpb_cnt; ++idx) {
+    reader.ue(); // bit_rate_value_minus1
+    reader.ue(); // cpb_size_value_minus1
+    reader.flag(); // cbr_flag
+  }
+  // initial_cpb_removal_delay_length_minus1, cpb_removal_delay_length_minus1,
+  // dpb_output_delay_length_minus1 and time_offset_length
+  reader.u(20);
+  range.end = reader.position();
+  return range;
+}
+
+void parse_vui(BitReader &reader, Vui &vui) {
+  vui.aspect_ratio_info_present = reader.flag();
+  if (vui.aspect_ratio_info_present) {
+    vui.aspect_ratio_idc = reader.u(8);
+    if (vui.aspect_ratio_idc == 255) { // Extended_SAR
+      vui.sar_width = reader.u(16);
+      vui.sar_height = reader.u(16);
+    }
+  }
+  vui.overscan_info_present = reader.flag();
+  if (vui.overscan_info_present) {
+    vui.overscan_appropriate = reader.flag();
+  }
+  vui.video_signal_type_present = reader.flag();
+  if (vui.video_signal_type_present) {
+    vui.video_format = reader.u(3);
+    vui.video_full_range = reader.flag();
+    vui.colour_description_present = reader.flag();
+    if (vui.colour_description_present) {
+      vui.colour_primaries = reader.u(8);
+      vui.transfer_characteristics = reader.u(8);
+      vui.matrix_coefficients = reader.u(8);
+    }
+  }
+  vui.chroma_loc_info_present = reader.flag();
+  if (vui.chroma_loc_info_present) {
+    vui.chroma_sample_loc_type_top_field = reader.ue();
+    vui.chroma_sample_loc_type_bottom_field = reader.ue();
+  }
+  vui.timing_info_present = reader.flag();
+  if (vui.timing_info_present) {
+    vui.num_units_in_tick = reader.u(32);
+    vui.time_scale = reader.u(32);
+    vui.fixed_frame_rate = reader.flag();
+  }
+  vui.nal_hrd_parameters_present = reader.flag();
+  if (vui.nal_hrd_parameters_present) {
+    vui.nal_hrd_parameters = skip_hrd_parameters(reader);
+  }
+  vui.vcl_hrd_parameters_present = reader.flag();
+  if (vui.vcl_hrd_parameters_present) {
+    vui.vcl_hrd_parameters = skip_hrd_parameters(reader);
+  }
+  if (vui.nal_hrd_parameters_present || vui.vcl_hrd_parameters_present) {
+    vui.low_delay_hrd = reader.flag();
+  }
+  vui.pic_struct_present = reader.flag();
+  vui.bitstream_restriction = reader.flag();
+  if (vui.bitstream_restriction) {
+    vui.motion_vectors_over_pic_boundaries = reader.flag();
+    vui.max_bytes_per_pic_denom = reader.ue();
+    vui.max_bits_per_mb_denom = reader.ue();
+    vui.log2_max_mv_length_horizontal = reader.ue();
+    vui.log2_max_mv_length_vertical = reader.ue();
+    vui.max_num_reorder_frames = reader.ue();
+    vui.max_dec_frame_buffering = reader.ue();
+  }
+}
+
+void write_vui(BitWriter &writer, const Vui &vui, const uint8_t *rbsp) {
+  writer.flag(vui.aspect_ratio_info_present);
+  if (vui.aspect_ratio_info_present) {
+    writer.u(8, vui.aspect_ratio_idc);
+    if (vui.aspect_ratio_idc == 255) {
+      writer.u(16, vui.sar_width);
+      writer.u(16, vui.sar_height);
+    }
+  }
+  writer.flag(vui.overscan_info_present);
+  if (vui.overscan_info_present) {
+    writer.flag(vui.overscan_appropriate);
+  }
+  writer.flag(vui.video_signal_type_present);
+  if (vui.video_signal_type_present) {
+    writer.u(3, vui.video_format);
+    writer.flag(vui.video_full_range);
+    writer.flag(vui.colour_description_present);
+    if (vui.colour_description_present) {
+      writer.u(8, vui.colour_primaries);
+      writer.u(8, vui.transfer_characteristics);
+      writer.u(8, vui.matrix_coefficients);
+    }
+  }
+  writer.flag(vui.chroma_loc_info_present);
+  if (vui.chroma_loc_info_present) {
+    writer.ue(vui.chroma_sample_loc_type_top_field);
+    writer.ue(vui.chroma_sample_loc_type_bottom_field);
+  }
+  writer.flag(vui.timing_info_present);
+  if (vui.timing_info_present) {
+    writer.u(32, vui.num_units_in_tick);
+    writer.u(32, vui.time_scale);
+    writer.flag(vui.fixed_frame_rate);
+  }
+  writer.flag(vui.nal_hrd_parameters_present);
+  if (vui.nal_hrd_parameters_present) {
+    writer.copy(rbsp, vui.nal_hrd_parameters.begin,
+                vui.nal_hrd_parameters.end);
+  }
+  writer.flag(vui.vcl_hrd_parameters_present);
+  if (vui.vcl_hrd_parameters_present) {
+    writer.copy(rbsp, vui.vcl_hrd_parameters.begin,
+                vui.vcl_hrd_parameters.end);
+  }
+  if (vui.nal_hrd_parameters_present || vui.vcl_hrd_parameters_present) {
+    writer.flag(vui.low_delay_hrd);
+  }
+  writer.flag(vui.pic_struct_present);
+  writer.flag(vui.bitstream_restriction);
+  if (vui.bitstream_restriction) {
+    writer.flag(vui.motion_vectors_over_pic_boundaries);
+    writer.ue(vui.max_bytes_per_pic_denom);
+    writer.ue(vui.max_bits_per_mb_denom);
+    writer.ue(vui.log2_max_mv_length_horizontal);
+    writer.ue(vui.log2_max_mv_length_vertical);
+    writer.ue(vui.max_num_reorder_frames);
+    writer.ue(vui.max_dec_frame_buffering);
+  }
+}
+
+bool has_chroma_format_idc(uint8_t profile_idc) {
+  switch (profile_idc) {
+  case 100:
+  case 110:
+  case 122:
+  case 244:
+  case 44:
+  case 83:
+  case 86:
+  case 118:
+  case 128:
+  case 138:
+  case 139:
+  case 134:
+  case 135:
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+bool parse_sps(const uint8_t *nalu, size_t size, Sps &sps) {
+  if (size < 4 || (nalu[0] & 0x1F) != 7) {
+    return false;
+  }
+  sps = Sps();
+  sps.rbsp = unescape_rbsp(nalu + 1, size - 1);
+  BitReader reader(sps.rbsp.data(), sps.rbsp.size());
+
+  sps.profile_idc = reader.u(8);
+  reader.u(8); // constraint_set flags and reserved_zero_2bits
+  sps.level_idc = reader.u(8);
+  sps.seq_parameter_set_id = reader.ue();
+  if (has_chroma_format_idc(sps.profile_idc)) {
+    sps.chroma_format_idc = reader.ue();
+    const uint32_t chroma_format_idc = sps.chroma_format_idc;
+    if (chroma_format_idc == 3) {
+      reader.flag(); // separate_colour_plane_flag
+    }
+    reader.ue(); // bit_depth_luma_minus8
+    reader.ue(); // bit_depth_chroma_minus8
+    reader.flag(); // qpprime_y_zero_transform_bypass_flag
+    if (reader.flag()) { // seq_scaling_matrix_present_flag
+      const int lists = (chroma_format_idc != 3) ? 8 : 12;
+      for (int idx = 0; idx < lists; ++idx) {
+        if (reader.flag()) { // seq_scaling_list_present_flag
+          skip_scaling_list(reader, idx < 6 ? 16 : 64);
+        }
+      }
+    }
+  }
+  reader.ue(); // log2_max_frame_num_minus4
+  const uint32_t pic_order_cnt_type = reader.ue();
+  if (pic_order_cnt_type == 0) {
+    reader.ue(); // log2_max_pic_order_cnt_lsb_minus4
+  } else if (pic_order_cnt_type == 1) {
+    reader.flag(); // delta_pic_order_always_zero_flag
+    reader.se(); // offset_for_non_ref_pic
+    reader.se(); // offset_for_top_to_bottom_field
+    const uint32_t cycle = reader.ue();
+    if (cycle > 255) {
+      return false;
+    }
+    for (uint32_t idx = 0; idx < cycle; ++idx) {
+      reader.se(); // offset_for_ref_frame
+    }
+  }
+  sps.max_num_ref_frames = reader.ue();
+  reader.flag(); // gaps_in_frame_num_value_allowed_flag
+  sps.pic_width_in_mbs = reader.ue() + 1;
+  sps.pic_height_in_map_units = reader.ue() + 1;
+  sps.frame_mbs_only = reader.flag();
+  if (!sps.frame_mbs_only) {
+    reader.flag(); // mb_adaptive_frame_field_flag
+  }
+  reader.flag(); // direct_8x8_inference_flag
+  if (reader.flag()) { // frame_cropping_flag
+    sps.crop_left = reader.ue();
+    sps.crop_right = reader.ue();
+    sps.crop_top = reader.ue();
+    sps.crop_bottom = reader.ue();
+  }
+  sps.vui_flag_position = reader.position();
+  sps.vui_parameters_present = reader.flag();
+  if (sps.vui_parameters_present) {
+    parse_vui(reader, sps.vui);
+  }
+  return reader.ok();
+}
+
+uint32_t Sps::width() const {
+  // CropUnitX of 7.4.2.1.1, 1 for monochrome and 4:4:4
+  const uint32_t unit =
+      (chroma_format_idc == 1 || chroma_format_idc == 2) ? 2 : 1;
+  return pic_width_in_mbs * 16 - unit * (crop_left + crop_right);
+}
+
+uint32_t Sps::height() const {
+  // CropUnitY of 7.4.2.1.1
+  const uint32_t unit = ((chroma_format_idc == 1) ? 2 : 1) *
+                        (frame_mbs_only ? 1 : 2);
+  return pic_height_in_map_units * 16 * (frame_mbs_only ? 1 : 2) -
+         unit * (crop_top + crop_bottom);
+}
+
+bool rewrite_sps(const uint8_t *nalu, size_t size,
+                 const SpsRewriteOptions &options, vector<uint8_t> &out) {
+  Sps sps;
+  if (!parse_sps(nalu, size, sps)) {
+    return false;
+  }
+
+  Vui vui = sps.vui;
+  if (options.zero_reorder) {
+    vui.bitstream_restriction = true;
+    vui.max_num_reorder_frames = 0;
+    // Must not be less than max_num_ref_frames (E.2.1)
+    vui.max_dec_frame_buffering = sps.max_num_ref_frames;
+  }
+  if (options.fps > 0 && !vui.timing_info_present) {
+    // A frame lasts two ticks, since ticks count fields
+    vui.timing_info_present = true;
+    vui.num_units_in_tick = 1000;
+    vui.time_scale = static_cast<uint32_t>(lround(options.fps * 2000));
+    // The camera drops the frame rate in low light
+    vui.fixed_frame_rate = false;
+  }
+
+  BitWriter writer;
+  writer.copy(sps.rbsp.data(), 0, sps.vui_flag_position);
+  writer.flag(true);
+  write_vui(writer, vui, sps.rbsp.data());
+  writer.trailingBits();
+
+  out.clear();
+  out.push_back(nalu[0]);
+  escape_rbsp(writer.data(), out);
+  return true;
+}
+
+} // namespace mselph264
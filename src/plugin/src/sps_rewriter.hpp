@@ -0,0 +1,132 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_SPS_REWRITER_HPP__
+#define PLUGIN_SPS_REWRITER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mselph264 {
+
+/// HRD parameters are never changed, only their position in the RBSP is
+/// kept to copy them.
+struct BitRange {
+  std::size_t begin{0};
+  std::size_t end{0};
+};
+
+/// vui_parameters() of a SPS (H.264 E.1.1)
+struct Vui {
+  bool aspect_ratio_info_present{false};
+  uint8_t aspect_ratio_idc{0};
+  uint16_t sar_width{0};
+  uint16_t sar_height{0};
+  bool overscan_info_present{false};
+  bool overscan_appropriate{false};
+  bool video_signal_type_present{false};
+  uint8_t video_format{5};
+  bool video_full_range{false};
+  bool colour_description_present{false};
+  uint8_t colour_primaries{2};
+  uint8_t transfer_characteristics{2};
+  uint8_t matrix_coefficients{2};
+  bool chroma_loc_info_present{false};
+  uint32_t chroma_sample_loc_type_top_field{0};
+  uint32_t chroma_sample_loc_type_bottom_field{0};
+  bool timing_info_present{false};
+  uint32_t num_units_in_tick{0};
+  uint32_t time_scale{0};
+  bool fixed_frame_rate{false};
+  bool nal_hrd_parameters_present{false};
+  BitRange nal_hrd_parameters;
+  bool vcl_hrd_parameters_present{false};
+  BitRange vcl_hrd_parameters;
+  bool low_delay_hrd{false};
+  bool pic_struct_present{false};
+  bool bitstream_restriction{false};
+  // Defaults as inferred by E.2.1 when bitstream_restriction is absent
+  bool motion_vectors_over_pic_boundaries{true};
+  uint32_t max_bytes_per_pic_denom{2};
+  uint32_t max_bits_per_mb_denom{1};
+  uint32_t log2_max_mv_length_horizontal{16};
+  uint32_t log2_max_mv_length_vertical{16};
+  uint32_t max_num_reorder_frames{16};
+  uint32_t max_dec_frame_buffering{16};
+};
+
+/// The fields of seq_parameter_set_data() needed to rewrite the VUI
+struct Sps {
+  uint8_t profile_idc{0};
+  uint8_t level_idc{0};
+  uint32_t seq_parameter_set_id{0};
+  uint32_t max_num_ref_frames{0};
+  uint32_t pic_width_in_mbs{0};
+  uint32_t pic_height_in_map_units{0};
+  bool frame_mbs_only{true};
+  uint32_t chroma_format_idc{1};
+  /// frame_crop_*_offset in crop units
+  uint32_t crop_left{0};
+  uint32_t crop_right{0};
+  uint32_t crop_top{0};
+  uint32_t crop_bottom{0};
+  bool vui_parameters_present{false};
+  Vui vui;
+
+  /// The unescaped payload after the NALU header
+  std::vector<uint8_t> rbsp;
+  /// Position of vui_parameters_present_flag in *rbsp*, everything before
+  /// is copied unchanged
+  std::size_t vui_flag_position{0};
+
+  /// Picture size in luma samples after cropping
+  uint32_t width() const;
+  uint32_t height() const;
+};
+
+/// Parse the SPS NALU *nalu* including its header.  Returns false if it is
+/// no SPS or malformed.
+bool parse_sps(const uint8_t *nalu, std::size_t size, Sps &sps);
+
+/// How to change the SPS
+struct SpsRewriteOptions {
+  /// Set max_num_reorder_frames to 0 and max_dec_frame_buffering to the
+  /// count of reference frames, so decoders output every frame at once.
+  bool zero_reorder{false};
+  /// Add timing info for this frame rate, if greater than 0.  Present
+  /// timing info is kept.
+  float fps{0};
+
+  bool operator==(const SpsRewriteOptions &other) const {
+    return zero_reorder == other.zero_reorder && fps == other.fps;
+  }
+  bool operator!=(const SpsRewriteOptions &other) const {
+    return !(*this == other);
+  }
+};
+
+/// Rewrite the VUI of the SPS NALU *nalu*.  The result is a complete NALU
+/// with header and emulation prevention.  Returns false, if the SPS could
+/// not be parsed.
+bool rewrite_sps(const uint8_t *nalu, std::size_t size,
+                 const SpsRewriteOptions &options, std::vector<uint8_t> &out);
+
+} // namespace mselph264
+
+#endif
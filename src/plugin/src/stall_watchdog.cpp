@@ -0,0 +1,127 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stall_watchdog.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace mselph264 {
+
+void StallWatchdog::start(uint64_t now) {
+  mLastProgress = now;
+  // The sequence numbers start over with the stream
+  mHasSequence = false;
+  if (mStalled) {
+    // Give the step taken the full delay
+    mNextStep = now + mBackoff;
+  }
+}
+
+bool StallWatchdog::frame(uint32_t sequence, uint64_t now) {
+  if (mHasSequence && sequence == mLastSequence) {
+    // The driver returns the same buffer again and again
+    return false;
+  }
+  mHasSequence = true;
+  mLastSequence = sequence;
+  mLastProgress = now;
+  if (!mStalled) {
+    return false;
+  }
+
+  mStalled = false;
+  lock_guard<mutex> lock(mMutex);
+  const uint64_t latency = now - mDetectedAt;
+  ++mStats.recoveries;
+  mStats.last_recovery = latency;
+  mStats.max_recovery = max(mStats.max_recovery, latency);
+  mStats.last_step = mLastStep;
+  return true;
+}
+
+StallWatchdog::Action StallWatchdog::check(uint64_t now) {
+  lock_guard<mutex> lock(mMutex);
+  if (mConfig.timeout == 0) {
+    return Action::NONE;
+  }
+  if (!mStalled) {
+    if (now - mLastProgress < mConfig.timeout) {
+      return Action::NONE;
+    }
+    mStalled = true;
+    mDetectedAt = now;
+    mLastStep = Action::NONE;
+    mBackoff = mConfig.step_delay;
+    ++mStats.stalls;
+  } else if (now < mNextStep) {
+    return Action::NONE;
+  } else {
+    mBackoff = min(mConfig.max_backoff, mBackoff * 2);
+  }
+
+  switch (mLastStep) {
+  case Action::NONE:
+    mLastStep = Action::REQUEUE;
+    ++mStats.requeues;
+    break;
+  case Action::REQUEUE:
+    mLastStep = Action::RESTART_STREAM;
+    ++mStats.restarts;
+    break;
+  case Action::RESTART_STREAM:
+  case Action::REOPEN:
+    mLastStep = Action::REOPEN;
+    ++mStats.reopens;
+    break;
+  }
+  mNextStep = now + mBackoff;
+  return mLastStep;
+}
+
+void StallWatchdog::setTimeout(uint64_t timeout) {
+  lock_guard<mutex> lock(mMutex);
+  mConfig.timeout = timeout;
+}
+
+StallWatchdog::Config StallWatchdog::config() const {
+  lock_guard<mutex> lock(mMutex);
+  return mConfig;
+}
+
+StallWatchdog::Stats StallWatchdog::stats() const {
+  lock_guard<mutex> lock(mMutex);
+  return mStats;
+}
+
+const char *StallWatchdog::name(Action action) {
+  switch (action) {
+  case Action::NONE:
+    return "none";
+  case Action::REQUEUE:
+    return "requeue";
+  case Action::RESTART_STREAM:
+    return "stream restart";
+  case Action::REOPEN:
+    return "reopen";
+  }
+  return "unknown";
+}
+
+} // namespace mselph264
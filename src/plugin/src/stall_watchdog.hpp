@@ -0,0 +1,114 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_STALL_WATCHDOG_HPP__
+#define PLUGIN_STALL_WATCHDOG_HPP__
+
+#include <cstdint>
+#include <mutex>
+
+namespace mselph264 {
+
+/// Detect a capture which is running but delivers nothing and decide how
+/// to recover.
+///
+/// After a hiccup of the USB bus the camera may stay open and streaming
+/// without ever filling a buffer again, or repeat the same v4l2 sequence
+/// number.  Once no new frame arrived for the timeout, the watchdog asks
+/// for recovery steps of increasing cost: requeue the buffers, restart the
+/// stream, reopen the device.  The reopen is repeated until a frame
+/// arrives.  The wait after each step starts at the step delay and doubles
+/// up to the maximal backoff.
+///
+/// The capture thread calls everything but config(), setTimeout() and
+/// stats().  All times are in milliseconds.
+class StallWatchdog {
+public:
+  enum class Action {
+    NONE,
+    /// Give all buffers back to the driver
+    REQUEUE,
+    /// VIDIOC_STREAMOFF and VIDIOC_STREAMON
+    RESTART_STREAM,
+    /// Close and configure the device again
+    REOPEN,
+  };
+
+  struct Config {
+    /// Time without a new frame taken as stall, 0 disables the watchdog
+    uint64_t timeout{500};
+    /// Wait after the first step
+    uint64_t step_delay{100};
+    /// Longest wait between two steps
+    uint64_t max_backoff{8000};
+  };
+
+  struct Stats {
+    uint64_t stalls{0};
+    /// Steps taken
+    uint64_t requeues{0};
+    uint64_t restarts{0};
+    uint64_t reopens{0};
+    /// Stalls ended by a frame
+    uint64_t recoveries{0};
+    /// Milliseconds from the detection to the next frame
+    uint64_t last_recovery{0};
+    uint64_t max_recovery{0};
+    /// The step after which the last stall ended
+    Action last_step{Action::NONE};
+  };
+
+  StallWatchdog() = default;
+  explicit StallWatchdog(const Config &config) : mConfig(config) {}
+
+  /// The capture (re)starts, frames are expected from *now* on.  A running
+  /// escalation continues, so a reopen does not start over with a requeue.
+  void start(uint64_t now);
+  /// A frame with the v4l2 *sequence* number was captured.  Returns true,
+  /// if it ended a stall.
+  bool frame(uint32_t sequence, uint64_t now);
+  /// The next recovery step due at *now*, if any
+  Action check(uint64_t now);
+  /// No frame arrived since the stall was detected
+  bool stalled() const { return mStalled; }
+  /// Milliseconds since the last frame or the start
+  uint64_t idle(uint64_t now) const { return now - mLastProgress; }
+
+  void setTimeout(uint64_t timeout);
+  Config config() const;
+  Stats stats() const;
+
+  static const char *name(Action action);
+
+private:
+  mutable std::mutex mMutex;
+  Config mConfig;
+  Stats mStats;
+  uint64_t mLastProgress{0};
+  bool mHasSequence{false};
+  uint32_t mLastSequence{0};
+  bool mStalled{false};
+  uint64_t mDetectedAt{0};
+  Action mLastStep{Action::NONE};
+  uint64_t mNextStep{0};
+  uint64_t mBackoff{0};
+};
+
+} // namespace mselph264
+
+#endif
@@ -0,0 +1,89 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "ticker_wakeup.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace mselph264 {
+
+namespace {
+
+// The ticker thread may still wait in wait_next_tick() while the filter is
+// detached, so it finds the subscription here instead of in its user data
+mutex sMutex;
+map<MSTicker *, shared_ptr<Subscription>> sDriven;
+
+shared_ptr<Subscription> driver(MSTicker *ticker) {
+  lock_guard<mutex> lock(sMutex);
+  auto it = sDriven.find(ticker);
+  return (it == sDriven.end()) ? nullptr : it->second;
+}
+
+// Replaces the wait of the ticker, which sleeps until the clock reaches
+// the virtual time of the next tick.  Returns how late the tick is in
+// milliseconds, like the original.
+int wait_next_tick(void *data, uint64_t virt_ticker_time) {
+  auto ticker = static_cast<MSTicker *>(data);
+  const auto subscription = driver(ticker);
+  while (true) {
+    const uint64_t realtime =
+        ticker->get_cur_time_ptr(ticker->get_cur_time_data) - ticker->orig;
+    const int64_t diff = static_cast<int64_t>(virt_ticker_time - realtime);
+    if (diff <= 0) {
+      return static_cast<int>(-diff);
+    }
+    const auto interval = static_cast<int64_t>(ticker->interval);
+    if (!subscription) {
+      this_thread::sleep_for(chrono::milliseconds(min(diff, interval)));
+    } else if (diff > interval) {
+      // A tick now would put the time more than one tick ahead
+      this_thread::sleep_for(chrono::milliseconds(diff - interval));
+    } else if (subscription->wait(chrono::milliseconds(diff))) {
+      return 0;
+    }
+  }
+}
+
+} // namespace
+
+bool drive_ticker(MSTicker *ticker,
+                  const shared_ptr<Subscription> &subscription) {
+  {
+    lock_guard<mutex> lock(sMutex);
+    if (!sDriven.emplace(ticker, subscription).second) {
+      return false;
+    }
+  }
+  ms_ticker_set_tick_func(ticker, wait_next_tick, ticker);
+  return true;
+}
+
+void release_ticker(MSTicker *ticker) {
+  ms_ticker_set_tick_func(ticker, nullptr, nullptr);
+  lock_guard<mutex> lock(sMutex);
+  sDriven.erase(ticker);
+}
+
+} // namespace mselph264
@@ -0,0 +1,47 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLUGIN_TICKER_WAKEUP_HPP__
+#define PLUGIN_TICKER_WAKEUP_HPP__
+
+#include <memory>
+#include <mediastreamer2/msticker.h>
+
+#include "capture_session.hpp"
+
+namespace mselph264 {
+
+/// Let the frames of *subscription* wake *ticker*.
+///
+/// The ticker runs its graphs every interval, 10 ms by default, so a frame
+/// waits half a tick on average before the filter sends it.  Driven by the
+/// frames, the ticker waits for the next tick or the next frame, whatever
+/// comes first.  A tick taken early for a frame is one of the regular
+/// ones, so the ticker keeps its cadence and its time is never more than
+/// one interval ahead of the clock.
+///
+/// A ticker is driven by one subscription at most.  Returns false, if
+/// another one drives it already.
+bool drive_ticker(MSTicker *ticker,
+                  const std::shared_ptr<Subscription> &subscription);
+/// Give the ticker back its own wait for the next tick
+void release_ticker(MSTicker *ticker);
+
+} // namespace mselph264
+
+#endif
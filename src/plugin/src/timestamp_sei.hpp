@@ -0,0 +1,126 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLUGIN_TIMESTAMP_SEI_HPP__
+#define PLUGIN_TIMESTAMP_SEI_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mselph264 {
+
+// The capture timestamp is carried in a SEI "user data unregistered"
+// message (payload type 5), identified by the UUID below.  This header
+// has no dependency on mediastreamer, so receive side tools can use it
+// to extract the timestamps again.
+
+constexpr uint8_t SEI_NALU_TYPE{6};
+constexpr uint8_t SEI_USER_DATA_UNREGISTERED{5};
+
+constexpr std::array<uint8_t, 16> TIMESTAMP_SEI_UUID{
+    {0x6d, 0x73, 0x65, 0x6c, 0x70, 0x68, 0x32, 0x36, 0x34, 0x2d, 0x74, 0x73,
+     0x2d, 0x76, 0x30, 0x31}};
+
+/// Content of the timestamp SEI
+struct TimestampSei {
+  /// Capture time in microseconds as taken from v4l2_buffer (usually
+  /// CLOCK_MONOTONIC)
+  uint64_t capture_us{0};
+  /// Frame sequence number as taken from v4l2_buffer
+  uint32_t sequence{0};
+};
+
+/// Create a complete SEI NALU (without start code) holding *sei*.
+inline std::vector<uint8_t> make_timestamp_sei(const TimestampSei &sei) {
+  std::vector<uint8_t> payload;
+  payload.reserve(TIMESTAMP_SEI_UUID.size() + 12);
+  payload.insert(payload.end(), TIMESTAMP_SEI_UUID.begin(),
+                 TIMESTAMP_SEI_UUID.end());
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    payload.push_back(static_cast<uint8_t>(sei.capture_us >> shift));
+  }
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    payload.push_back(static_cast<uint8_t>(sei.sequence >> shift));
+  }
+
+  std::vector<uint8_t> rbsp{SEI_USER_DATA_UNREGISTERED,
+                            static_cast<uint8_t>(payload.size())};
+  rbsp.insert(rbsp.end(), payload.begin(), payload.end());
+  // rbsp_trailing_bits
+  rbsp.push_back(0x80);
+
+  // Insert emulation prevention bytes while copying into the NALU
+  std::vector<uint8_t> nalu{SEI_NALU_TYPE};
+  nalu.reserve(rbsp.size() + 4);
+  std::size_t zero_cnt{0};
+  for (auto byte : rbsp) {
+    if (zero_cnt >= 2 && byte <= 3) {
+      nalu.push_back(0x03);
+      zero_cnt = 0;
+    }
+    nalu.push_back(byte);
+    zero_cnt = (byte == 0) ? zero_cnt + 1 : 0;
+  }
+  return nalu;
+}
+
+/// Try to read a timestamp SEI from the NALU [*begin*, *end*).  Return
+/// false if the NALU is no timestamp SEI.
+inline bool read_timestamp_sei(const uint8_t *begin, const uint8_t *end,
+                               TimestampSei &sei) {
+  if (begin == end || (*begin & 0x1F) != SEI_NALU_TYPE) {
+    return false;
+  }
+  // Remove emulation prevention bytes
+  std::vector<uint8_t> rbsp;
+  rbsp.reserve(end - begin);
+  std::size_t zero_cnt{0};
+  for (auto cur = begin + 1; cur != end; ++cur) {
+    if (zero_cnt >= 2 && *cur == 0x03) {
+      zero_cnt = 0;
+      continue;
+    }
+    rbsp.push_back(*cur);
+    zero_cnt = (*cur == 0) ? zero_cnt + 1 : 0;
+  }
+  constexpr std::size_t payload_size = TIMESTAMP_SEI_UUID.size() + 12;
+  if (rbsp.size() < 2 + payload_size ||
+      rbsp[0] != SEI_USER_DATA_UNREGISTERED || rbsp[1] != payload_size) {
+    return false;
+  }
+  auto data = rbsp.data() + 2;
+  for (auto byte : TIMESTAMP_SEI_UUID) {
+    if (*data++ != byte) {
+      return false;
+    }
+  }
+  sei.capture_us = 0;
+  for (int idx = 0; idx < 8; ++idx) {
+    sei.capture_us = (sei.capture_us << 8) | *data++;
+  }
+  sei.sequence = 0;
+  for (int idx = 0; idx < 4; ++idx) {
+    sei.sequence = (sei.sequence << 8) | *data++;
+  }
+  return true;
+}
+
+} // namespace mselph264
+
+#endif
@@ -19,6 +19,7 @@
 #define PLUGIN_UTILS_HPP__
 
 #include <mediastreamer2/formats.h>
+#include <mediastreamer2/msfilter.h>
 
 constexpr bool operator==(const MSVideoSize &a, const MSVideoSize &b) {
   return (a.width == b.width && a.height == b.height);
@@ -28,4 +29,15 @@ constexpr bool operator!=(const MSVideoSize &a, const MSVideoSize &b) {
   return !(a == b);
 }
 
+namespace mselph264 {
+
+/// MSFilter is locked during lifetime of FilterLock
+struct FilterLock {
+  FilterLock(MSFilter *f) : filter(f) { ms_filter_lock(filter); }
+  ~FilterLock() { ms_filter_unlock(filter); }
+  MSFilter *filter{nullptr};
+};
+
+} // namespace mselph264
+
 #endif
\ No newline at end of file
@@ -0,0 +1,150 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLUGIN_TEST_ANNEXB_CORPUS_HPP__
+#define PLUGIN_TEST_ANNEXB_CORPUS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Synthetic H.264 Annex-B streams and a reference NALU parser.  Both are
+// shared by the plugin tests and the parser benchmark in tools/.
+
+namespace annexb {
+
+using Nalu = std::vector<uint8_t>;
+
+/// Parameters of a synthetic stream
+struct Options {
+  /// Count of NALUs in the stream
+  std::size_t nalu_count{4};
+  /// Size range of the NALU payload before emulation prevention
+  std::size_t min_size{2};
+  std::size_t max_size{1500};
+  /// Probability of a 3-byte instead of a 4-byte start code
+  double short_start_code{0.5};
+  /// Probability of a zero run inside a NALU and its maximal length.  The
+  /// run is protected by emulation prevention bytes.
+  double zero_run{0.0};
+  std::size_t max_zero_run{64};
+  /// Maximal count of trailing_zero_8bits after each NALU
+  std::size_t max_trailing_zeros{0};
+  /// NALU header bytes to pick from, e.g., 0x67 for SPS
+  std::vector<uint8_t> headers{0x67, 0x68, 0x06, 0x65, 0x41};
+  uint32_t seed{1};
+};
+
+/// A synthetic stream with the NALUs it is made of
+struct Stream {
+  std::vector<uint8_t> data;
+  std::vector<Nalu> nalus;
+};
+
+/// Append *rbsp* to *nalu* inserting emulation prevention bytes
+inline void escape(const std::vector<uint8_t> &rbsp, Nalu &nalu) {
+  std::size_t zero_cnt{0};
+  for (auto byte : rbsp) {
+    if (zero_cnt >= 2 && byte <= 3) {
+      nalu.push_back(0x03);
+      zero_cnt = 0;
+    }
+    nalu.push_back(byte);
+    zero_cnt = (byte == 0) ? zero_cnt + 1 : 0;
+  }
+}
+
+/// Generate a random but well formed Annex-B byte stream
+inline Stream generate(const Options &opt) {
+  std::mt19937 rng(opt.seed);
+  std::uniform_int_distribution<std::size_t> size(opt.min_size, opt.max_size);
+  std::uniform_int_distribution<std::size_t> header(0, opt.headers.size() - 1);
+  std::uniform_int_distribution<std::size_t> run(1, opt.max_zero_run);
+  std::uniform_int_distribution<std::size_t> trailing(0,
+                                                      opt.max_trailing_zeros);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::bernoulli_distribution short_code(opt.short_start_code);
+  std::bernoulli_distribution zero_run(opt.zero_run);
+
+  Stream stream;
+  std::vector<uint8_t> rbsp;
+  for (std::size_t idx = 0; idx < opt.nalu_count; ++idx) {
+    const auto payload = size(rng);
+    rbsp.clear();
+    while (rbsp.size() < payload) {
+      if (zero_run(rng)) {
+        rbsp.insert(rbsp.end(), run(rng), 0);
+      } else {
+        rbsp.push_back(static_cast<uint8_t>(byte(rng)));
+      }
+    }
+    rbsp.resize(payload);
+    // The last byte of a NALU is never zero (rbsp_stop_one_bit)
+    rbsp.back() |= 0x80;
+
+    Nalu nalu{opt.headers[header(rng)]};
+    escape(rbsp, nalu);
+
+    if (!short_code(rng)) {
+      stream.data.push_back(0);
+    }
+    stream.data.insert(stream.data.end(), {0, 0, 1});
+    stream.data.insert(stream.data.end(), nalu.begin(), nalu.end());
+    stream.data.insert(stream.data.end(), trailing(rng), 0);
+    stream.nalus.push_back(std::move(nalu));
+  }
+  return stream;
+}
+
+/// Reference parser following the byte stream syntax of H.264 Annex B.  A
+/// NALU starts after 00 00 01 and ends before the next 00 00 00 or
+/// 00 00 01.  Since 00 00 00 may only be followed by more zeros and a start
+/// code, the NALU is cut at the next 00 00 01 and zeros are stripped from its
+/// end, which also gives a defined result for broken streams.  It is kept
+/// simple on purpose and used to verify the optimized parser of the plugin.
+inline std::vector<Nalu> reference_parse(const uint8_t *data,
+                                         std::size_t size) {
+  auto is_start_code = [&](std::size_t pos) {
+    return pos + 3 <= size && data[pos] == 0 && data[pos + 1] == 0 &&
+           data[pos + 2] == 1;
+  };
+  std::vector<Nalu> nalus;
+  std::size_t pos = 0;
+  while (pos < size && !is_start_code(pos)) {
+    ++pos;
+  }
+  while (pos < size) {
+    pos += 3;
+    const std::size_t begin = pos;
+    while (pos < size && !is_start_code(pos)) {
+      ++pos;
+    }
+    std::size_t end = pos;
+    while (end > begin && data[end - 1] == 0) {
+      --end;
+    }
+    if (end > begin) {
+      nalus.emplace_back(data + begin, data + end);
+    }
+  }
+  return nalus;
+}
+
+} // namespace annexb
+
+#endif
@@ -18,6 +18,10 @@
 #include "helper.hpp"
 
 #include <bctoolbox/list.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <vector>
 
 MSWebCam *find_camera(MSWebCamManager *manager) {
   auto cam_list = ms_web_cam_manager_get_list(manager);
@@ -35,4 +39,36 @@ MSWebCam *find_camera(MSWebCamManager *manager) {
       },
       &cam);
   return cam;
-}
\ No newline at end of file
+}
+
+namespace {
+
+const char *const REPLAY_FILE = "plugin_test_replay.h264";
+
+void remove_replay() { std::remove(REPLAY_FILE); }
+
+} // namespace
+
+void use_replay_without_camera() {
+  struct stat st;
+  if (0 == stat("/dev/elp-h264", &st) || std::getenv("ELPH264_REPLAY")) {
+    return;
+  }
+  const std::vector<uint8_t> key_frame{
+      0, 0, 0, 1, 0x67, 0x42, 0xC0, 0x1F, 0, 0, 0, 1, 0x68, 0xCE, 0x3C, 0x80,
+      0, 0, 0, 1, 0x65, 0x88, 0x84, 0x21};
+  const std::vector<uint8_t> p_frame{0, 0, 0, 1, 0x41, 0x9A, 0x02, 0x03};
+  const auto fname = REPLAY_FILE;
+  auto stream = std::fopen(fname, "wb");
+  if (!stream) {
+    return;
+  }
+  std::fwrite(key_frame.data(), key_frame.size(), 1, stream);
+  for (int idx = 0; idx < 29; ++idx) {
+    std::fwrite(p_frame.data(), p_frame.size(), 1, stream);
+  }
+  std::fclose(stream);
+  std::atexit(remove_replay);
+  setenv("ELPH264_REPLAY", fname, 1);
+  ms_message("No camera, replay %s", fname);
+}
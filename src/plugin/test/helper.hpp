@@ -22,4 +22,8 @@
 
 MSWebCam *find_camera(MSWebCamManager *manager);
 
+/// Without a camera attached, write a short recording and make the plugin
+/// replay it by setting ELPH264_REPLAY.
+void use_replay_without_camera();
+
 #endif
\ No newline at end of file
@@ -20,9 +20,12 @@
 
 #include <bctoolbox/logging.h>
 
+#include "helper.hpp"
+
 int main(int argc, char *argv[]) {
   bctbx_set_log_level("mediastreamer", BCTBX_LOG_WARNING);
   bctbx_set_log_level(BCTBX_LOG_DOMAIN, BCTBX_LOG_DEBUG);
+  use_replay_without_camera();
   int result = Catch::Session().run(argc, argv);
   return result;
 }
\ No newline at end of file
@@ -0,0 +1,307 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "capture_session.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <catch.hpp>
+
+using namespace mselph264;
+using namespace std::chrono_literals;
+
+namespace {
+
+SharedFrame make_frame(bool idr) {
+  auto frame = std::make_shared<Frame>();
+  const uint8_t header = idr ? 0x65 : 0x41;
+  mblk_t *m = allocb(1, 0);
+  *m->b_wptr++ = header;
+  ms_queue_put(&frame->nalus, m);
+  frame->info.nalus.push_back({0, 1, static_cast<uint8_t>(header & 0x1F), 3,
+                               false});
+  frame->info.flags = idr ? uint32_t{FrameInfo::HAS_IDR} : 0;
+  return frame;
+}
+
+/// Write a recording of *gops* GOPs of 10 frames to *fname*
+std::string write_recording(int gops,
+                            const std::string &fname =
+                                "capture_session_test.h264") {
+  const std::vector<uint8_t> key_frame{
+      0, 0, 0, 1, 0x67, 0x42, 0xC0, 0x1F, 0, 0, 0, 1, 0x68, 0xCE, 0x3C, 0x80,
+      0, 0, 0, 1, 0x65, 0x88, 0x84, 0x21};
+  const std::vector<uint8_t> p_frame{0, 0, 0, 1, 0x41, 0x9A, 0x02, 0x03};
+  auto stream = std::fopen(fname.c_str(), "wb");
+  REQUIRE(stream);
+  for (int gop = 0; gop < gops; ++gop) {
+    std::fwrite(key_frame.data(), key_frame.size(), 1, stream);
+    for (int idx = 0; idx < 9; ++idx) {
+      std::fwrite(p_frame.data(), p_frame.size(), 1, stream);
+    }
+  }
+  std::fclose(stream);
+  return fname;
+}
+
+/// Pop frames from *subscription* until *count* arrived or a second passed
+std::vector<SharedFrame> receive(Subscription &subscription,
+                                 std::size_t count) {
+  std::vector<SharedFrame> frames;
+  const auto deadline = std::chrono::steady_clock::now() + 1s;
+  while (frames.size() < count &&
+         std::chrono::steady_clock::now() < deadline) {
+    if (auto frame = subscription.pop()) {
+      frames.push_back(frame);
+    } else {
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+  return frames;
+}
+
+/// Poll *done* until it returns true or a second passed
+template <typename F> bool eventually(F done) {
+  const auto deadline = std::chrono::steady_clock::now() + 1s;
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+  return true;
+}
+
+} // namespace
+
+TEST_CASE("Subscription starts with an IDR", "[session]") {
+  Subscription subscription(4, Subscription::Overflow::REQUEST_IDR);
+  CHECK_FALSE(subscription.push(make_frame(false)));
+  CHECK_FALSE(subscription.pop());
+  CHECK_FALSE(subscription.push(make_frame(true)));
+  CHECK_FALSE(subscription.push(make_frame(false)));
+
+  auto frame = subscription.pop();
+  REQUIRE(frame);
+  CHECK(frame->info.has(FrameInfo::HAS_IDR));
+  CHECK(subscription.pop());
+  CHECK_FALSE(subscription.pop());
+
+  const auto stats = subscription.stats();
+  CHECK(stats.delivered == 2);
+  CHECK(stats.dropped == 1);
+  CHECK(stats.overflows == 0);
+}
+
+TEST_CASE("Wait for a frame without taking it", "[session]") {
+  Subscription subscription(4, Subscription::Overflow::REQUEST_IDR);
+  CHECK_FALSE(subscription.wait(1ms));
+  std::thread capture([&subscription] {
+    std::this_thread::sleep_for(10ms);
+    subscription.push(make_frame(true));
+  });
+  CHECK(subscription.wait(2s));
+  capture.join();
+  CHECK(subscription.wait(0ms));
+  CHECK(subscription.pop());
+  CHECK_FALSE(subscription.wait(1ms));
+}
+
+TEST_CASE("Subscription overflow", "[session]") {
+  auto overflow = GENERATE(Subscription::Overflow::REQUEST_IDR,
+                           Subscription::Overflow::WAIT_FOR_IDR);
+  Subscription subscription(2, overflow);
+  subscription.push(make_frame(true));
+  subscription.push(make_frame(false));
+
+  SECTION("Skip to the next IDR") {
+    CHECK(subscription.push(make_frame(false)) ==
+          (overflow == Subscription::Overflow::REQUEST_IDR));
+    CHECK_FALSE(subscription.pop());
+    CHECK_FALSE(subscription.push(make_frame(false)));
+    CHECK_FALSE(subscription.pop());
+    CHECK_FALSE(subscription.push(make_frame(true)));
+    auto frame = subscription.pop();
+    REQUIRE(frame);
+    CHECK(frame->info.has(FrameInfo::HAS_IDR));
+    const auto stats = subscription.stats();
+    CHECK(stats.dropped == 4);
+    CHECK(stats.overflows == 1);
+  }
+
+  SECTION("Overflow by an IDR") {
+    CHECK_FALSE(subscription.push(make_frame(true)));
+    auto frame = subscription.pop();
+    REQUIRE(frame);
+    CHECK(frame->info.has(FrameInfo::HAS_IDR));
+    CHECK_FALSE(subscription.pop());
+    CHECK(subscription.stats().dropped == 2);
+  }
+}
+
+TEST_CASE("Share frame between readers", "[session]") {
+  auto frame = make_frame(true);
+  Subscription first(2, Subscription::Overflow::REQUEST_IDR);
+  Subscription second(2, Subscription::Overflow::REQUEST_IDR);
+  first.push(frame);
+  second.push(frame);
+  CHECK(frame.use_count() == 3);
+
+  auto nalus = const_cast<MSQueue *>(&frame->nalus);
+  MSQueue out;
+  ms_queue_init(&out);
+  first.pop()->duplicate(&out);
+  REQUIRE(ms_queue_peek_first(&out));
+  CHECK(ms_queue_peek_first(&out)->b_rptr ==
+        ms_queue_peek_first(nalus)->b_rptr);
+  ms_queue_flush(&out);
+  CHECK_FALSE(ms_queue_empty(nalus));
+  second.pop();
+  CHECK(frame.use_count() == 1);
+}
+
+TEST_CASE("Capture session", "[session]") {
+  const auto fname = write_recording(3);
+  const auto name = "replay:" + fname;
+  auto session = CaptureSession::get(name);
+  REQUIRE(session);
+  CHECK(CaptureSession::get(name) == session);
+  CHECK(session->subscriptions() == 0);
+  session->initVideoConf(MS_VIDEO_CONF(0, 150000, QCIF, 100, 0));
+
+  SECTION("Multiple readers") {
+    auto first = session->subscribe(64);
+    auto second = session->subscribe(64);
+    CHECK(session->subscriptions() == 2);
+
+    const auto frames = receive(*first, 20);
+    REQUIRE(frames.size() == 20);
+    CHECK(frames.front()->info.has(FrameInfo::HAS_IDR));
+    const auto other = receive(*second, 1);
+    REQUIRE(other.size() == 1);
+    CHECK(other.front()->info.has(FrameInfo::HAS_IDR));
+
+    session->unsubscribe(first);
+    session->unsubscribe(second);
+    CHECK(session->subscriptions() == 0);
+  }
+
+  SECTION("Join from the GOP cache") {
+    auto first = session->subscribe(64);
+    REQUIRE(receive(*first, 5).size() == 5);
+    auto second = session->subscribe(64);
+    auto frame = second->pop();
+    REQUIRE(frame);
+    CHECK(frame->info.has(FrameInfo::HAS_IDR));
+    CHECK(session->gopCache().stats().hits == 1);
+    session->unsubscribe(second);
+    session->unsubscribe(first);
+  }
+
+  SECTION("Receivers do not limit each other") {
+    // Every filter requests with an id of its own
+    const auto storm = IFrameArbiter::uniqueReceiver();
+    const auto quiet = IFrameArbiter::uniqueReceiver();
+    REQUIRE(storm != quiet);
+    auto &arbiter = session->iframeArbiter();
+    arbiter.setWindow(0);
+    auto first = session->subscribe(64);
+    auto second = session->subscribe(64);
+    REQUIRE(receive(*first, 15).size() == 15);
+
+    auto stats = arbiter.stats();
+    for (int idx = 0; idx < 5; ++idx) {
+      session->requestIFrame(storm);
+    }
+    REQUIRE(eventually([&] { return arbiter.stats().sent > stats.sent; }));
+    stats = arbiter.stats();
+    CHECK(stats.coalesced >= 4);
+    INFO("The IDR answering the storm ends the request in flight");
+    REQUIRE(eventually(
+        [&] { return arbiter.stats().idr_frames > stats.idr_frames; }));
+
+    stats = arbiter.stats();
+    session->requestIFrame(quiet);
+    CHECK(eventually([&] { return arbiter.stats().sent > stats.sent; }));
+    session->unsubscribe(second);
+    session->unsubscribe(first);
+  }
+
+  SECTION("Export to shared memory") {
+    const auto ring = "session-test-" + std::to_string(getpid());
+    REQUIRE(session->exportFrames(ring));
+    h264camera::ShmSubscriber reader(ring, 15);
+    auto subscription = session->subscribe(64);
+    std::vector<h264camera::ShmFrame> frames;
+    const auto deadline = std::chrono::steady_clock::now() + 1s;
+    while (frames.size() < 15 && std::chrono::steady_clock::now() < deadline) {
+      reader.wait(10ms);
+      while (auto frame = reader.next()) {
+        frames.push_back(*frame);
+      }
+    }
+    session->unsubscribe(subscription);
+    REQUIRE(frames.size() >= 15);
+    CHECK(reader.dropped() == 0);
+    for (std::size_t idx = 1; idx < frames.size(); ++idx) {
+      CHECK(frames[idx].sequence == frames[idx - 1].sequence + 1);
+    }
+    CHECK(std::count_if(frames.begin(), frames.end(),
+                        [](const h264camera::ShmFrame &frame) {
+                          return frame.keyframe;
+                        }) >= 1);
+    CHECK(session->exportFrames(""));
+  }
+
+  SECTION("Slow reader") {
+    auto fast = session->subscribe(64);
+    auto slow = session->subscribe(1, Subscription::Overflow::WAIT_FOR_IDR);
+    REQUIRE(receive(*fast, 40).size() == 40);
+    session->unsubscribe(slow);
+    session->unsubscribe(fast);
+    CHECK(slow->stats().overflows > 0);
+    CHECK(fast->stats().overflows == 0);
+  }
+  std::remove(fname.c_str());
+}
+
+TEST_CASE("Restart a failed capture for a new reader", "[session]") {
+  INFO("A recording without frames fails and cannot be reattached");
+  const auto fname = write_recording(0, "capture_session_failing.h264");
+  auto session = CaptureSession::get("replay:" + fname);
+  session->initVideoConf(MS_VIDEO_CONF(0, 150000, QCIF, 100, 0));
+  auto first = session->subscribe(64);
+  CHECK(eventually([&] { return !session->capturing(); }));
+  CHECK(receive(*first, 1).empty());
+
+  write_recording(3, fname);
+  auto second = session->subscribe(64);
+  CHECK(session->capturing());
+  const auto frames = receive(*second, 1);
+  REQUIRE(frames.size() == 1);
+  CHECK(frames.front()->info.has(FrameInfo::HAS_IDR));
+  CHECK(receive(*first, 1).size() == 1);
+  session->unsubscribe(second);
+  session->unsubscribe(first);
+  std::remove(fname.c_str());
+}
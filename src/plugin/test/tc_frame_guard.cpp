@@ -0,0 +1,150 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "frame_guard.hpp"
+
+#include <vector>
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+/// A captured buffer holding *data*
+struct TestBuffer {
+  TestBuffer(std::vector<uint8_t> bytes, uint32_t v4l2_flags = 0)
+      : data(std::move(bytes)), mem(0, data.data(), data.size() + 64, false) {
+    mem.video_buffer = {};
+    mem.video_buffer.bytesused = static_cast<uint32_t>(data.size());
+    mem.video_buffer.flags = v4l2_flags;
+    mem.state = Device::Mem::State::READY;
+  }
+
+  /// Parse the buffer and return its descriptor
+  FrameInfo parse() {
+    MSQueue queue;
+    ms_queue_init(&queue);
+    FrameInfo info;
+    separate_h264_nalus(&mem, &queue, info);
+    ms_queue_flush(&queue);
+    return info;
+  }
+
+  std::vector<uint8_t> data;
+  Device::Mem mem;
+};
+
+const std::vector<uint8_t> idr_frame{0, 0, 0, 1, 0x67, 0x42, 0,    0,
+                                     0, 1, 0x68, 0xCE, 0,    0,    0,
+                                     1, 0x65, 0x88, 0x80};
+const std::vector<uint8_t> p_frame{0, 0, 0, 1, 0x41, 0x9A, 0x80};
+
+/// Run both checks like the capture loop does
+FrameGuard::Verdict check(FrameGuard &guard, TestBuffer &&buffer) {
+  const auto verdict = guard.checkBuffer(buffer.mem);
+  if (verdict != FrameGuard::Verdict::FORWARD) {
+    return verdict;
+  }
+  return guard.checkFrame(buffer.parse());
+}
+
+} // namespace
+
+TEST_CASE("Forward intact frames", "[guard]") {
+  FrameGuard guard;
+  CHECK(check(guard, {idr_frame}) == FrameGuard::Verdict::FORWARD);
+  CHECK(check(guard, {p_frame}) == FrameGuard::Verdict::FORWARD);
+  CHECK_FALSE(guard.recovering());
+  CHECK(guard.stats().frames == 2);
+}
+
+TEST_CASE("Drop broken buffers", "[guard]") {
+  FrameGuard guard;
+  SECTION("Error flag") {
+    CHECK(check(guard, {p_frame, V4L2_BUF_FLAG_ERROR}) ==
+          FrameGuard::Verdict::BAD);
+    CHECK(guard.stats().errored == 1);
+  }
+  SECTION("Empty") {
+    CHECK(check(guard, {{}}) == FrameGuard::Verdict::BAD);
+    CHECK(guard.stats().empty == 1);
+  }
+  SECTION("Truncated") {
+    TestBuffer buffer(p_frame);
+    buffer.mem.mapped = true;
+    buffer.mem.len = static_cast<uint32_t>(p_frame.size());
+    CHECK(guard.checkBuffer(buffer.mem) == FrameGuard::Verdict::BAD);
+    buffer.mem.mapped = false;
+    CHECK(guard.stats().truncated == 1);
+  }
+  SECTION("Forbidden zero bit") {
+    CHECK(check(guard, {{0, 0, 1, 0xC1, 0x9A, 0x80}}) ==
+          FrameGuard::Verdict::BAD);
+    CHECK(guard.stats().malformed == 1);
+  }
+  SECTION("Invalid NALU type") {
+    CHECK(check(guard, {{0, 0, 1, 0x00, 0x9A}}) == FrameGuard::Verdict::BAD);
+    CHECK(check(guard, {{0, 0, 1, 0x5C, 0x9A}}) == FrameGuard::Verdict::BAD);
+    CHECK(guard.stats().malformed == 2);
+  }
+  SECTION("No start code") {
+    CHECK(check(guard, {{0x41, 0x9A, 0x80}}) == FrameGuard::Verdict::BAD);
+    CHECK(guard.stats().malformed == 1);
+  }
+  CHECK(guard.recovering());
+}
+
+TEST_CASE("Drop dependent frames until the next IDR", "[guard]") {
+  FrameGuard guard;
+  CHECK(check(guard, {idr_frame}) == FrameGuard::Verdict::FORWARD);
+  CHECK(check(guard, {p_frame, V4L2_BUF_FLAG_ERROR}) ==
+        FrameGuard::Verdict::BAD);
+  CHECK(check(guard, {p_frame}) == FrameGuard::Verdict::DEPENDENT);
+  CHECK(check(guard, {p_frame}) == FrameGuard::Verdict::DEPENDENT);
+
+  INFO("Parameter sets on their own pass");
+  CHECK(check(guard, {{0, 0, 1, 0x67, 0x42, 0, 0, 1, 0x68, 0xCE}}) ==
+        FrameGuard::Verdict::FORWARD);
+  CHECK(guard.recovering());
+
+  CHECK(check(guard, {idr_frame}) == FrameGuard::Verdict::FORWARD);
+  CHECK(check(guard, {p_frame}) == FrameGuard::Verdict::FORWARD);
+
+  const auto stats = guard.stats();
+  CHECK(stats.frames == 7);
+  CHECK(stats.errored == 1);
+  CHECK(stats.dependent == 2);
+}
+
+TEST_CASE("A restart ends the recovery", "[guard]") {
+  FrameGuard guard;
+  CHECK(check(guard, {{}}) == FrameGuard::Verdict::BAD);
+  guard.reset();
+  CHECK(check(guard, {p_frame}) == FrameGuard::Verdict::FORWARD);
+}
+
+TEST_CASE("A lost stream resumes with an IDR", "[guard]") {
+  FrameGuard guard;
+  CHECK(check(guard, {p_frame}) == FrameGuard::Verdict::FORWARD);
+  guard.lost();
+  CHECK(guard.recovering());
+  CHECK(check(guard, {p_frame}) == FrameGuard::Verdict::DEPENDENT);
+  CHECK(check(guard, {idr_frame}) == FrameGuard::Verdict::FORWARD);
+  CHECK(check(guard, {p_frame}) == FrameGuard::Verdict::FORWARD);
+  CHECK(guard.stats().dependent == 1);
+}
@@ -0,0 +1,114 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "gop_cache.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+SharedFrame make_frame(bool idr, std::size_t bytes = 100) {
+  auto frame = std::make_shared<Frame>();
+  frame->info.flags = idr ? uint32_t{FrameInfo::HAS_IDR} : 0;
+  frame->info.bytes = bytes;
+  return frame;
+}
+
+} // namespace
+
+TEST_CASE("Cache the GOP", "[gop]") {
+  GopCache cache;
+  std::vector<SharedFrame> frames;
+  cache.add(make_frame(false));
+  CHECK(cache.stats().frames == 0);
+  CHECK_FALSE(cache.get(10, frames));
+
+  auto idr = make_frame(true);
+  cache.add(idr);
+  cache.add(make_frame(false));
+  cache.add(make_frame(false));
+  REQUIRE(cache.get(10, frames));
+  REQUIRE(frames.size() == 3);
+  CHECK(frames.front() == idr);
+
+  INFO("The next IDR starts over");
+  cache.add(make_frame(true));
+  CHECK(cache.stats().frames == 1);
+  CHECK(cache.stats().bytes == 100);
+
+  INFO("The GOP has to fit into the queue of the reader");
+  cache.add(make_frame(false));
+  CHECK_FALSE(cache.get(1, frames));
+  CHECK(frames.size() == 3);
+
+  const auto stats = cache.stats();
+  CHECK(stats.hits == 1);
+  CHECK(stats.misses == 2);
+
+  cache.reset();
+  CHECK(cache.stats().frames == 0);
+  CHECK(idr.use_count() == 2);
+}
+
+TEST_CASE("Limit the GOP cache", "[gop]") {
+  GopCache cache;
+  GopCache::Limits limits;
+  limits.frames = 4;
+  limits.bytes = 1000;
+  cache.setLimits(limits);
+  std::vector<SharedFrame> frames;
+
+  SECTION("Frames") {
+    for (int idx = 0; idx < 4; ++idx) {
+      cache.add(make_frame(idx == 0));
+    }
+    CHECK(cache.stats().frames == 4);
+    cache.add(make_frame(false));
+  }
+
+  SECTION("Bytes") {
+    cache.add(make_frame(true, 600));
+    cache.add(make_frame(false, 400));
+    CHECK(cache.stats().bytes == 1000);
+    cache.add(make_frame(false, 1));
+  }
+
+  CHECK(cache.stats().overflows == 1);
+  CHECK(cache.stats().frames == 0);
+  INFO("Empty up to the next IDR");
+  cache.add(make_frame(false));
+  CHECK_FALSE(cache.get(10, frames));
+  cache.add(make_frame(true));
+  CHECK(cache.get(10, frames));
+}
+
+TEST_CASE("Disable the GOP cache", "[gop]") {
+  GopCache cache;
+  cache.add(make_frame(true));
+  cache.add(make_frame(false));
+  GopCache::Limits limits;
+  limits.frames = 0;
+  cache.setLimits(limits);
+  CHECK(cache.stats().frames == 0);
+  cache.add(make_frame(true));
+  std::vector<SharedFrame> frames;
+  CHECK_FALSE(cache.get(10, frames));
+  CHECK(cache.stats().overflows == 0);
+}
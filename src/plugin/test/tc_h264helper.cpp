@@ -0,0 +1,187 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "h264helper.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "annexb_corpus.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+/// Run the plugin's parser on *data* and collect the NALUs
+std::vector<annexb::Nalu> parse(std::vector<uint8_t> data,
+                                FrameInfo *info = nullptr,
+                                uint32_t v4l2_flags = 0) {
+  Device::Mem mem(0, data.data(), data.size(), false);
+  mem.video_buffer = {};
+  mem.video_buffer.bytesused = static_cast<uint32_t>(data.size());
+  mem.video_buffer.flags = v4l2_flags;
+  mem.video_buffer.sequence = 42;
+  mem.video_buffer.timestamp = {1, 500};
+  mem.state = Device::Mem::State::READY;
+
+  MSQueue queue;
+  ms_queue_init(&queue);
+  FrameInfo local;
+  separate_h264_nalus(&mem, &queue, info ? *info : local);
+  CHECK(mem.isUnused());
+
+  std::vector<annexb::Nalu> nalus;
+  while (auto m = ms_queue_get(&queue)) {
+    nalus.emplace_back(m->b_rptr, m->b_wptr);
+    freemsg(m);
+  }
+  return nalus;
+}
+
+} // namespace
+
+TEST_CASE("Separate NALUs", "[h264]") {
+  SECTION("4-byte start codes") {
+    const std::vector<uint8_t> data{0, 0, 0, 1, 0x67, 0x42, 0,   0,
+                                    0, 1, 0x68, 0xCE, 0, 0, 0, 1,
+                                    0x65, 0x88, 0x80};
+    const std::vector<annexb::Nalu> expected{
+        {0x67, 0x42}, {0x68, 0xCE}, {0x65, 0x88, 0x80}};
+    CHECK(parse(data) == expected);
+  }
+  SECTION("3-byte start codes and trailing zeros") {
+    const std::vector<uint8_t> data{0,    0, 1, 0x67, 0x42, 0, 0,   1,
+                                    0x68, 0, 0, 0,    0,    0, 1,   0x65,
+                                    0x88, 0, 0, 3,    0,    0, 0};
+    const std::vector<annexb::Nalu> expected{
+        {0x67, 0x42}, {0x68}, {0x65, 0x88, 0, 0, 3}};
+    CHECK(parse(data) == expected);
+  }
+  SECTION("No start code") {
+    CHECK(parse({0x65, 0x88, 0x80}).empty());
+    CHECK(parse({}).empty());
+  }
+}
+
+TEST_CASE("Parser matches the reference implementation", "[h264]") {
+  annexb::Options opt;
+  SECTION("Typical frames") {
+    opt.nalu_count = 4;
+    opt.max_size = 8000;
+  }
+  SECTION("Many small NALUs") {
+    opt.nalu_count = 200;
+    opt.min_size = 1;
+    opt.max_size = 8;
+  }
+  SECTION("Long zero runs") {
+    opt.zero_run = 0.05;
+    opt.max_zero_run = 300;
+  }
+  SECTION("Trailing zeros") {
+    opt.max_trailing_zeros = 16;
+    opt.short_start_code = 0.9;
+  }
+
+  for (uint32_t seed = 1; seed <= 50; ++seed) {
+    opt.seed = seed;
+    const auto stream = annexb::generate(opt);
+    const auto nalus = parse(stream.data);
+    INFO("seed " << seed);
+    REQUIRE(nalus == stream.nalus);
+    REQUIRE(nalus ==
+            annexb::reference_parse(stream.data.data(), stream.data.size()));
+  }
+}
+
+TEST_CASE("Parser matches the reference implementation on garbage",
+          "[h264]") {
+  // Random bytes with many zeros and ones hit every corner of the start code
+  // detection, the result has to be identical anyway.
+  std::mt19937 rng(4711);
+  std::discrete_distribution<int> byte({40, 30, 5, 5, 20});
+  for (int run = 0; run < 500; ++run) {
+    std::vector<uint8_t> data(rng() % 64);
+    for (auto &b : data) {
+      b = static_cast<uint8_t>(byte(rng));
+    }
+    INFO("run " << run);
+    REQUIRE(parse(data) == annexb::reference_parse(data.data(), data.size()));
+  }
+}
+
+TEST_CASE("Frame descriptor", "[h264]") {
+  const std::vector<uint8_t> data{0,    0,    0, 1, 0x67, 0x42, 0, 0,
+                                  1,    0x68, 0, 0, 0,    0,    1, 0x06,
+                                  0x05, 0,    0, 0, 1,    0x65, 0x88, 0x80};
+  FrameInfo info;
+  info.nalus.push_back({0, 0, 0, 0, false});
+  const auto nalus = parse(data, &info, V4L2_BUF_FLAG_KEYFRAME);
+  REQUIRE(info.nalus.size() == nalus.size());
+  REQUIRE(info.nalus.size() == 4);
+
+  const uint8_t types[] = {NALU_SPS, NALU_PPS, NALU_SEI, NALU_IDR};
+  std::size_t bytes{0};
+  for (std::size_t idx = 0; idx < info.nalus.size(); ++idx) {
+    const auto &nalu = info.nalus[idx];
+    CHECK(nalu.type == types[idx]);
+    CHECK(nalu.size == nalus[idx].size());
+    CHECK(std::equal(nalus[idx].begin(), nalus[idx].end(),
+                     data.begin() + nalu.offset));
+    bytes += nalu.size;
+  }
+  CHECK(info.nalus[0].ref_idc == 3);
+  CHECK(info.nalus[2].ref_idc == 0);
+  CHECK(info.bytes == bytes);
+  CHECK(info.has(FrameInfo::HAS_IDR));
+  CHECK(info.has(FrameInfo::HAS_SPS));
+  CHECK(info.has(FrameInfo::HAS_PPS));
+  CHECK(info.has(FrameInfo::HAS_SEI));
+  CHECK(info.has(FrameInfo::KEYFRAME));
+  CHECK(info.sequence == 42);
+  CHECK(info.timestamp_us == 1000500);
+
+  parse({0, 0, 1, 0x41, 0x9A}, &info);
+  REQUIRE(info.nalus.size() == 1);
+  CHECK(info.nalus[0].isVcl());
+  CHECK(info.flags == 0);
+}
+
+TEST_CASE("Timestamp SEI precedes the first slice", "[h264][sei]") {
+  std::vector<uint8_t> data{0, 0, 0, 1, 0x67, 0x42, 0, 0, 0, 1, 0x68, 0xCE,
+                            0, 0, 0, 1, 0x65, 0x88, 0, 0, 0, 1, 0x65, 0x99};
+  Device::Mem mem(0, data.data(), data.size(), false);
+  mem.video_buffer = {};
+  mem.video_buffer.bytesused = static_cast<uint32_t>(data.size());
+  MSQueue queue;
+  ms_queue_init(&queue);
+  FrameInfo info;
+  separate_h264_nalus(&mem, &queue, info);
+  insert_timestamp_sei(info, &queue);
+
+  std::vector<uint8_t> types;
+  while (auto m = ms_queue_get(&queue)) {
+    types.push_back(*m->b_rptr & 0x1F);
+    freemsg(m);
+  }
+  const std::vector<uint8_t> expected{NALU_SPS, NALU_PPS, NALU_SEI, NALU_IDR,
+                                      NALU_IDR};
+  CHECK(types == expected);
+}
@@ -0,0 +1,133 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "iframe_arbiter.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+TEST_CASE("Pass a single request", "[iframe]") {
+  IFrameArbiter arbiter;
+  CHECK_FALSE(arbiter.takeRequest(0));
+  arbiter.request(1, 1000);
+  CHECK(arbiter.takeRequest(1000));
+  CHECK_FALSE(arbiter.takeRequest(1010));
+  CHECK(arbiter.stats().sent == 1);
+}
+
+TEST_CASE("Suppress requests after a captured IDR", "[iframe]") {
+  IFrameArbiter::Config config;
+  config.window = 300;
+  IFrameArbiter arbiter(config);
+
+  arbiter.idrCaptured(1000);
+  arbiter.request(1, 1200);
+  CHECK_FALSE(arbiter.takeRequest(1200));
+  CHECK(arbiter.stats().suppressed == 1);
+
+  INFO("Outside of the window");
+  arbiter.request(2, 1400);
+  CHECK(arbiter.takeRequest(1400));
+}
+
+TEST_CASE("Coalesce requests of several receivers", "[iframe]") {
+  IFrameArbiter arbiter;
+  for (uint32_t receiver = 1; receiver <= 10; ++receiver) {
+    arbiter.request(receiver, 1000 + receiver);
+  }
+  CHECK(arbiter.takeRequest(1020));
+  INFO("Requests arriving while the IDR is in flight are merged");
+  arbiter.request(11, 1030);
+  CHECK_FALSE(arbiter.takeRequest(1030));
+  arbiter.idrCaptured(1050);
+
+  const auto stats = arbiter.stats();
+  CHECK(stats.requests == 11);
+  CHECK(stats.sent == 1);
+  CHECK(stats.coalesced == 10);
+}
+
+TEST_CASE("A natural IDR satisfies a pending request", "[iframe]") {
+  IFrameArbiter arbiter;
+  arbiter.request(1, 1000);
+  arbiter.idrCaptured(1005);
+  CHECK_FALSE(arbiter.takeRequest(1010));
+}
+
+TEST_CASE("Repeat a request the camera did not serve", "[iframe]") {
+  IFrameArbiter::Config config;
+  config.timeout = 500;
+  IFrameArbiter arbiter(config);
+  arbiter.request(1, 1000);
+  CHECK(arbiter.takeRequest(1000));
+  CHECK_FALSE(arbiter.takeRequest(1400));
+  CHECK(arbiter.takeRequest(1500));
+  arbiter.idrCaptured(1550);
+  CHECK_FALSE(arbiter.takeRequest(2100));
+}
+
+TEST_CASE("Adapt the interval per receiver", "[iframe]") {
+  IFrameArbiter::Config config;
+  config.window = 0;
+  config.min_interval = 250;
+  config.max_interval = 2000;
+  IFrameArbiter arbiter(config);
+
+  uint64_t now = 1000;
+  auto serve = [&]() {
+    if (arbiter.takeRequest(now)) {
+      arbiter.idrCaptured(now + 20);
+      return true;
+    }
+    return false;
+  };
+
+  // A receiver under heavy loss asks every 100 ms
+  int sent{0};
+  for (int idx = 0; idx < 50; ++idx, now += 100) {
+    arbiter.request(1, now);
+    sent += serve() ? 1 : 0;
+  }
+  INFO("sent " << sent);
+  CHECK(sent <= 5);
+  CHECK(sent >= 2);
+
+  INFO("Another receiver is not limited by the first one");
+  arbiter.request(2, now);
+  CHECK(serve());
+
+  INFO("After a quiet period the interval shrinks again");
+  now += 20000;
+  arbiter.request(1, now);
+  CHECK(serve());
+  now += 1100;
+  arbiter.request(1, now);
+  CHECK(serve());
+}
+
+TEST_CASE("Recover regardless of the window", "[iframe]") {
+  IFrameArbiter arbiter;
+  arbiter.idrCaptured(1000);
+  arbiter.requestRecovery();
+  CHECK(arbiter.takeRequest(1010));
+  INFO("Coalesced with the request in flight");
+  arbiter.requestRecovery();
+  CHECK_FALSE(arbiter.takeRequest(1020));
+  CHECK(arbiter.stats().coalesced == 1);
+}
@@ -0,0 +1,206 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "parameter_sets.hpp"
+#include "sps_rewriter.hpp"
+
+#include <vector>
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+const std::vector<uint8_t> SPS{0x67, 0x42, 0xC0, 0x1F};
+const std::vector<uint8_t> PPS{0x68, 0xCE, 0x3C, 0x80};
+const std::vector<uint8_t> IDR{0x65, 0x88, 0x80};
+const std::vector<uint8_t> SLICE{0x41, 0x9A, 0x80};
+
+/// A frame as delivered by separate_h264_nalus()
+struct TestFrame {
+  explicit TestFrame(const std::vector<std::vector<uint8_t>> &nalus) {
+    for (const auto &nalu : nalus) {
+      data.insert(data.end(), {0, 0, 0, 1});
+      data.insert(data.end(), nalu.begin(), nalu.end());
+    }
+    ms_queue_init(&queue);
+    Device::Mem mem(0, data.data(), data.size(), false);
+    mem.video_buffer = {};
+    mem.video_buffer.bytesused = static_cast<uint32_t>(data.size());
+    separate_h264_nalus(&mem, &queue, info);
+  }
+  ~TestFrame() { ms_queue_flush(&queue); }
+
+  /// NALU types in queue order, checked against the descriptor
+  std::vector<uint8_t> types() {
+    std::vector<uint8_t> result;
+    std::size_t pos{0};
+    for (mblk_t *m = ms_queue_peek_first(&queue); !ms_queue_end(&queue, m);
+         m = ms_queue_next(&queue, m)) {
+      REQUIRE(pos < info.nalus.size());
+      CHECK(info.nalus[pos++].type == (*m->b_rptr & 0x1F));
+      result.push_back(*m->b_rptr & 0x1F);
+    }
+    CHECK(pos == info.nalus.size());
+    return result;
+  }
+
+  std::vector<uint8_t> data;
+  MSQueue queue;
+  FrameInfo info;
+};
+
+} // namespace
+
+TEST_CASE("Parameter sets precede every IDR frame", "[h264][sprop]") {
+  ParameterSets sets;
+  {
+    TestFrame frame({IDR});
+    sets.process(&frame.queue, frame.info);
+    INFO("Nothing to insert before SPS and PPS are known");
+    CHECK(frame.types() == std::vector<uint8_t>{NALU_IDR});
+  }
+  {
+    TestFrame frame({SPS, PPS, IDR});
+    sets.process(&frame.queue, frame.info);
+    CHECK(frame.types() ==
+          std::vector<uint8_t>{NALU_SPS, NALU_PPS, NALU_IDR});
+  }
+  {
+    TestFrame frame({IDR});
+    sets.process(&frame.queue, frame.info);
+    CHECK(frame.types() ==
+          std::vector<uint8_t>{NALU_SPS, NALU_PPS, NALU_IDR});
+    CHECK(frame.info.has(FrameInfo::HAS_SPS));
+    CHECK(frame.info.has(FrameInfo::HAS_PPS));
+    CHECK(frame.info.bytes == SPS.size() + PPS.size() + IDR.size());
+    CHECK(frame.info.nalus[0].offset == NaluInfo::INSERTED);
+  }
+  {
+    TestFrame frame({PPS, IDR});
+    sets.process(&frame.queue, frame.info);
+    CHECK(frame.types() ==
+          std::vector<uint8_t>{NALU_SPS, NALU_PPS, NALU_IDR});
+  }
+  CHECK(sets.inserted() == 3);
+
+  sets.clear();
+  {
+    TestFrame frame({IDR});
+    sets.process(&frame.queue, frame.info);
+    INFO("No stale parameter sets after reconfiguration");
+    CHECK(frame.types() == std::vector<uint8_t>{NALU_IDR});
+  }
+}
+
+TEST_CASE("Mark redundant parameter sets", "[h264][sprop]") {
+  ParameterSets sets;
+  auto redundant = [](const FrameInfo &info) {
+    std::vector<bool> result;
+    for (const auto &nalu : info.nalus) {
+      result.push_back(nalu.redundant);
+    }
+    return result;
+  };
+  {
+    TestFrame frame({SPS, PPS, IDR});
+    sets.process(&frame.queue, frame.info);
+    CHECK(redundant(frame.info) == std::vector<bool>{false, false, false});
+  }
+  {
+    TestFrame frame({SPS, PPS, SLICE});
+    sets.process(&frame.queue, frame.info);
+    CHECK(frame.types() ==
+          std::vector<uint8_t>{NALU_SPS, NALU_PPS, NALU_SLICE});
+    CHECK(redundant(frame.info) == std::vector<bool>{true, true, false});
+  }
+  {
+    INFO("Changed parameter sets are not redundant");
+    const std::vector<uint8_t> sps{0x67, 0x42, 0xC0, 0x20};
+    TestFrame frame({sps, PPS, SLICE});
+    sets.process(&frame.queue, frame.info);
+    CHECK(redundant(frame.info) == std::vector<bool>{false, true, false});
+    CHECK(sets.sprop() == "Z0LAIA==,aM48gA==");
+  }
+  {
+    INFO("IDR frames need their parameter sets");
+    TestFrame frame({SPS, PPS, IDR});
+    sets.process(&frame.queue, frame.info);
+    CHECK(redundant(frame.info) == std::vector<bool>{false, false, false});
+  }
+}
+
+TEST_CASE("sprop-parameter-sets", "[h264][sprop]") {
+  ParameterSets sets;
+  CHECK(sets.sprop().empty());
+  {
+    TestFrame frame({SPS, IDR});
+    sets.process(&frame.queue, frame.info);
+    CHECK(sets.sprop().empty());
+  }
+  {
+    TestFrame frame({PPS, SLICE});
+    sets.process(&frame.queue, frame.info);
+    CHECK(sets.sprop() == "Z0LAHw==,aM48gA==");
+  }
+  sets.clear();
+  CHECK(sets.sprop().empty());
+}
+
+TEST_CASE("Rewritten SPS", "[h264][sps]") {
+  // 1280x720 SPS of a high profile encoder with frame reordering
+  const std::vector<uint8_t> sps{0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40,
+                                 0x50, 0x05, 0xbb, 0x01, 0x10, 0x00, 0x00,
+                                 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03,
+                                 0xc0, 0xf1, 0x83, 0x19, 0x60};
+  ParameterSets sets;
+  sets.clear(30);
+  sets.rewriteSps(true, false);
+  auto sent_sps = [&](const std::vector<std::vector<uint8_t>> &nalus) {
+    TestFrame frame(nalus);
+    sets.process(&frame.queue, frame.info);
+    mblk_t *m = ms_queue_peek_first(&frame.queue);
+    REQUIRE((*m->b_rptr & 0x1F) == NALU_SPS);
+    CHECK(frame.info.nalus[0].size == m->b_wptr - m->b_rptr);
+    return std::vector<uint8_t>(m->b_rptr, m->b_wptr);
+  };
+
+  const auto first = sent_sps({sps, PPS, IDR});
+  Sps parsed;
+  REQUIRE(parse_sps(first.data(), first.size(), parsed));
+  CHECK(parsed.vui.max_num_reorder_frames == 0);
+  INFO("The cached result is used for later frames");
+  CHECK(sent_sps({sps, PPS, IDR}) == first);
+  CHECK(sent_sps({IDR}) == first);
+
+  sets.rewriteSps(false, false);
+  CHECK(sent_sps({sps, PPS, IDR}) == sps);
+}
+
+TEST_CASE("Base64", "[sprop]") {
+  auto encode = [](const std::string &in) {
+    return base64_encode(reinterpret_cast<const uint8_t *>(in.data()),
+                         in.size());
+  };
+  CHECK(encode("") == "");
+  CHECK(encode("f") == "Zg==");
+  CHECK(encode("fo") == "Zm8=");
+  CHECK(encode("foo") == "Zm9v");
+  CHECK(encode("foobar") == "Zm9vYmFy");
+}
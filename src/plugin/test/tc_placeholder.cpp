@@ -0,0 +1,188 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "placeholder.hpp"
+
+#include <vector>
+
+#include "bitstream.hpp"
+#include "sps_rewriter.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+/// Take the NALUs out of *queue*
+std::vector<std::vector<uint8_t>> take(MSQueue *queue) {
+  std::vector<std::vector<uint8_t>> nalus;
+  while (auto m = ms_queue_get(queue)) {
+    nalus.emplace_back(m->b_rptr, m->b_wptr);
+    freemsg(m);
+  }
+  return nalus;
+}
+
+/// Everything after *reader* is rbsp_trailing_bits
+bool at_trailing_bits(BitReader &reader, std::size_t size) {
+  if (reader.u(1) != 1) {
+    return false;
+  }
+  while (reader.position() < size * 8) {
+    if (reader.u(1) != 0) {
+      return false;
+    }
+  }
+  return reader.ok();
+}
+
+FrameInfo frame_with(uint32_t flags) {
+  FrameInfo info;
+  info.flags = flags;
+  return info;
+}
+
+} // namespace
+
+TEST_CASE("Placeholder parameter sets", "[placeholder]") {
+  PlaceholderStream stream(h264camera::VIDEO_SIZE_SVGA);
+  Sps sps;
+  REQUIRE(parse_sps(stream.sps().data(), stream.sps().size(), sps));
+  CHECK(sps.profile_idc == 66);
+  CHECK(sps.pic_width_in_mbs == 50);
+  CHECK(sps.pic_height_in_map_units == 38);
+  CHECK(sps.width() == 800);
+  CHECK(sps.height() == 600);
+  CHECK(sps.max_num_ref_frames == 1);
+  CHECK(stream.pps()[0] == 0x68);
+}
+
+TEST_CASE("Placeholder slices", "[placeholder]") {
+  const VideoSize size = h264camera::VIDEO_SIZE_720P;
+  const uint32_t count = (size.width / 16) * (size.height / 16);
+  PlaceholderStream stream(size);
+
+  SECTION("IDR") {
+    const auto &idr = stream.idr();
+    REQUIRE(idr[0] == 0x65);
+    const auto rbsp = unescape_rbsp(idr.data() + 1, idr.size() - 1);
+    BitReader reader(rbsp.data(), rbsp.size());
+    CHECK(reader.ue() == 0);
+    CHECK(reader.ue() == 7);
+    CHECK(reader.ue() == 0);
+    CHECK(reader.u(4) == 0);
+    CHECK(reader.ue() == 0);
+    CHECK(reader.u(2) == 0);
+    CHECK(reader.se() == 0);
+    CHECK(reader.ue() == 1);
+    uint32_t mbs = 0;
+    for (; mbs < count && reader.ok(); ++mbs) {
+      if (reader.ue() != 3 || reader.ue() != 0 || reader.se() != 0 ||
+          reader.u(1) != 1) {
+        break;
+      }
+    }
+    CHECK(mbs == count);
+    CHECK(at_trailing_bits(reader, rbsp.size()));
+    // One byte per macroblock
+    CHECK(idr.size() < count + 16);
+  }
+  SECTION("Skip") {
+    for (uint32_t frame_num = 0; frame_num < PlaceholderStream::MAX_FRAME_NUM;
+         ++frame_num) {
+      const auto &skip = stream.skip(frame_num);
+      REQUIRE(skip[0] == 0x41);
+      const auto rbsp = unescape_rbsp(skip.data() + 1, skip.size() - 1);
+      BitReader reader(rbsp.data(), rbsp.size());
+      CHECK(reader.ue() == 0);
+      CHECK(reader.ue() == 5);
+      CHECK(reader.ue() == 0);
+      CHECK(reader.u(4) == frame_num);
+      CHECK(reader.u(3) == 0);
+      CHECK(reader.se() == 0);
+      CHECK(reader.ue() == 1);
+      CHECK(reader.ue() == count);
+      CHECK(at_trailing_bits(reader, rbsp.size()));
+    }
+  }
+}
+
+TEST_CASE("Placeholder access units", "[placeholder]") {
+  PlaceholderStream stream(h264camera::VIDEO_SIZE_VGA);
+  MSQueue queue;
+  ms_queue_init(&queue);
+
+  stream.next(&queue);
+  const std::vector<std::vector<uint8_t>> first{stream.sps(), stream.pps(),
+                                                stream.idr()};
+  CHECK(take(&queue) == first);
+  for (uint32_t cnt = 1; cnt <= 20; ++cnt) {
+    stream.next(&queue);
+    const auto nalus = take(&queue);
+    REQUIRE(nalus.size() == 1);
+    CHECK(nalus[0] == stream.skip(cnt % PlaceholderStream::MAX_FRAME_NUM));
+  }
+  stream.restart();
+  stream.next(&queue);
+  CHECK(take(&queue) == first);
+}
+
+TEST_CASE("Keep alive while the camera stalls", "[placeholder]") {
+  KeepAlive keepalive({h264camera::VIDEO_SIZE_720P, h264camera::VIDEO_SIZE_VGA,
+                       h264camera::VIDEO_SIZE_VGA});
+  MSQueue queue;
+  ms_queue_init(&queue);
+  const auto p_frame = frame_with(0);
+  const auto idr_frame = frame_with(FrameInfo::HAS_IDR);
+
+  keepalive.start(1000);
+  CHECK_FALSE(keepalive.idle(h264camera::VIDEO_SIZE_VGA, 1500, &queue));
+  INFO("Disabled by default");
+  CHECK(keepalive.frame(p_frame, 1500));
+
+  keepalive.setTimeout(300);
+  CHECK_FALSE(keepalive.idle(h264camera::VIDEO_SIZE_VGA, 1700, &queue));
+  CHECK(keepalive.idle(h264camera::VIDEO_SIZE_VGA, 1800, &queue));
+  CHECK(take(&queue).size() == 3);
+  CHECK(keepalive.waitingForIdr());
+
+  INFO("One access unit per interval");
+  CHECK_FALSE(keepalive.idle(h264camera::VIDEO_SIZE_VGA, 1850, &queue));
+  CHECK(keepalive.idle(h264camera::VIDEO_SIZE_VGA, 1900, &queue));
+  CHECK(take(&queue).size() == 1);
+
+  INFO("Camera frames resume, but the receivers need an IDR");
+  CHECK_FALSE(keepalive.frame(p_frame, 1950));
+  CHECK(keepalive.idle(h264camera::VIDEO_SIZE_VGA, 2000, &queue));
+  CHECK(take(&queue).size() == 1);
+  CHECK(keepalive.frame(idr_frame, 2010));
+  CHECK_FALSE(keepalive.waitingForIdr());
+  CHECK_FALSE(keepalive.idle(h264camera::VIDEO_SIZE_VGA, 2100, &queue));
+
+  INFO("A new stall starts with an IDR again");
+  CHECK(keepalive.idle(h264camera::VIDEO_SIZE_720P, 2400, &queue));
+  CHECK(take(&queue).size() == 3);
+
+  INFO("Unknown sizes get no placeholder");
+  keepalive.frame(idr_frame, 2500);
+  CHECK_FALSE(keepalive.idle(h264camera::VIDEO_SIZE_SVGA, 3000, &queue));
+
+  const auto stats = keepalive.stats();
+  CHECK(stats.placeholders == 4);
+  CHECK(stats.dropped == 1);
+}
@@ -48,6 +48,7 @@ TEST_CASE("Load plugin", "[plugin][camera]") {
 
   SECTION("Find plugin") {
     CHECK(ms_factory_lookup_filter_by_name(factory, "h264camera"));
+    CHECK(ms_factory_lookup_filter_by_name(factory, "h264camera-preview"));
   }
 
   SECTION("Supported format") {
@@ -0,0 +1,142 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "reader_policy.hpp"
+
+#include <vector>
+
+#include "parameter_sets.hpp"
+#include "timestamp_sei.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+const std::vector<uint8_t> SPS{0x67, 0x42, 0xC0, 0x1F};
+const std::vector<uint8_t> PPS{0x68, 0xCE, 0x3C, 0x80};
+const std::vector<uint8_t> SEI{0x06, 0x05, 0x01, 0xFF, 0x80};
+const std::vector<uint8_t> IDR{0x65, 0x88, 0x80};
+const std::vector<uint8_t> SLICE{0x41, 0x9A, 0x80};
+
+/// A frame as published by the CaptureSession
+std::shared_ptr<Frame>
+make_frame(const std::vector<std::vector<uint8_t>> &nalus) {
+  std::vector<uint8_t> data;
+  for (const auto &nalu : nalus) {
+    data.insert(data.end(), {0, 0, 0, 1});
+    data.insert(data.end(), nalu.begin(), nalu.end());
+  }
+  auto frame = std::make_shared<Frame>();
+  Device::Mem mem(0, data.data(), data.size(), false);
+  mem.video_buffer = {};
+  mem.video_buffer.bytesused = static_cast<uint32_t>(data.size());
+  mem.video_buffer.sequence = 7;
+  separate_h264_nalus(&mem, &frame->nalus, frame->info);
+  return frame;
+}
+
+/// NALU types of the copy of *frame* for *reader*
+std::vector<uint8_t> types(ReaderPolicy &reader, const Frame &frame) {
+  MSQueue queue;
+  ms_queue_init(&queue);
+  reader.copy(frame, &queue);
+  std::vector<uint8_t> result;
+  while (auto m = ms_queue_get(&queue)) {
+    result.push_back(*m->b_rptr & 0x1F);
+    freemsg(m);
+  }
+  return result;
+}
+
+} // namespace
+
+TEST_CASE("Readers do not share their SEI policy", "[reader]") {
+  const auto idr = make_frame({SEI, IDR});
+  const auto slice = make_frame({SEI, SLICE});
+  ReaderPolicy keep;
+  ReaderPolicy drop;
+  drop.setSeiPolicy(SeiPolicy::DROP);
+  ReaderPolicy on_idr;
+  on_idr.setSeiPolicy(SeiPolicy::KEEP_ON_IDR);
+
+  CHECK(types(drop, *idr) == std::vector<uint8_t>{NALU_IDR});
+  CHECK(types(keep, *idr) == std::vector<uint8_t>{NALU_SEI, NALU_IDR});
+  CHECK(types(on_idr, *idr) == std::vector<uint8_t>{NALU_SEI, NALU_IDR});
+  CHECK(types(drop, *slice) == std::vector<uint8_t>{NALU_SLICE});
+  CHECK(types(keep, *slice) == std::vector<uint8_t>{NALU_SEI, NALU_SLICE});
+  CHECK(types(on_idr, *slice) == std::vector<uint8_t>{NALU_SLICE});
+
+  INFO("The shared frames are unchanged");
+  CHECK(idr->info.nalus.size() == 2);
+  CHECK(ms_queue_get_size(&idr->nalus) == 2);
+  CHECK(slice->info.has(FrameInfo::HAS_SEI));
+
+  CHECK(keep.droppedSei() == 0);
+  CHECK(drop.droppedSei() == 2);
+  CHECK(drop.droppedSeiBytes() == 2 * SEI.size());
+  CHECK(on_idr.droppedSei() == 1);
+}
+
+TEST_CASE("Readers strip redundant parameter sets", "[reader]") {
+  ParameterSets sets;
+  auto process = [&sets](std::shared_ptr<Frame> frame) {
+    sets.process(&frame->nalus, frame->info);
+    return frame;
+  };
+  const auto idr = process(make_frame({SPS, PPS, IDR}));
+  const auto repeated = process(make_frame({SPS, PPS, SLICE}));
+  ReaderPolicy keep;
+  ReaderPolicy strip;
+  strip.stripParameterSets(true);
+
+  CHECK(types(strip, *idr) ==
+        std::vector<uint8_t>{NALU_SPS, NALU_PPS, NALU_IDR});
+  CHECK(types(strip, *repeated) == std::vector<uint8_t>{NALU_SLICE});
+  CHECK(types(keep, *repeated) ==
+        std::vector<uint8_t>{NALU_SPS, NALU_PPS, NALU_SLICE});
+  CHECK(strip.stripped() == 2);
+
+  INFO("Changed parameter sets are kept");
+  const std::vector<uint8_t> sps{0x67, 0x42, 0xC0, 0x20};
+  const auto changed = process(make_frame({sps, PPS, SLICE}));
+  CHECK(types(strip, *changed) == std::vector<uint8_t>{NALU_SPS, NALU_SLICE});
+}
+
+TEST_CASE("Readers add the timestamp SEI", "[reader][sei]") {
+  const auto frame = make_frame({SEI, SLICE});
+  ReaderPolicy reader;
+  reader.enableTimestampSei(true);
+  reader.setSeiPolicy(SeiPolicy::DROP);
+
+  MSQueue queue;
+  ms_queue_init(&queue);
+  reader.copy(*frame, &queue);
+  REQUIRE(ms_queue_get_size(&queue) == 2);
+  mblk_t *m = ms_queue_peek_first(&queue);
+  TimestampSei sei;
+  INFO("The policy drops the SEI of the camera only");
+  REQUIRE(read_timestamp_sei(m->b_rptr, m->b_wptr, sei));
+  CHECK(sei.sequence == 7);
+  ms_queue_flush(&queue);
+
+  ReaderPolicy other;
+  CHECK(types(other, *frame) == std::vector<uint8_t>{NALU_SEI, NALU_SLICE});
+  CHECK(ms_queue_get_size(&frame->nalus) == 2);
+}
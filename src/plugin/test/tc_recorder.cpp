@@ -0,0 +1,166 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "recorder.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "placeholder.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+/// Frames of the placeholder stream with a GOP of 10 frames at 25 fps
+class FrameFeed {
+public:
+  FrameFeed() : mStream(h264camera::VIDEO_SIZE_VGA) {}
+
+  SharedFrame next() {
+    if (mCount % 10 == 0) {
+      mStream.restart();
+    }
+    auto frame = std::make_shared<Frame>();
+    mStream.next(&frame->nalus);
+    frame->info.flags = (mCount % 10 == 0) ? uint32_t{FrameInfo::HAS_IDR} : 0;
+    frame->info.timestamp_us = 1000000 + mCount * 40000;
+    ++mCount;
+    return frame;
+  }
+
+private:
+  PlaceholderStream mStream;
+  uint64_t mCount{0};
+};
+
+struct Box {
+  std::string type;
+  std::size_t size;
+};
+
+/// The top level boxes of *path*
+std::vector<Box> read_boxes(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>(file),
+                                  std::istreambuf_iterator<char>()};
+  std::vector<Box> boxes;
+  std::size_t pos{0};
+  while (pos + 8 <= data.size()) {
+    const std::size_t size = (std::size_t{data[pos]} << 24) |
+                             (std::size_t{data[pos + 1]} << 16) |
+                             (std::size_t{data[pos + 2]} << 8) | data[pos + 3];
+    boxes.push_back({std::string(data.begin() + pos + 4,
+                                 data.begin() + pos + 8),
+                     size});
+    if (size < 8) {
+      break;
+    }
+    pos += size;
+  }
+  CHECK(pos == data.size());
+  return boxes;
+}
+
+std::size_t count(const std::vector<Box> &boxes, const std::string &type) {
+  std::size_t result{0};
+  for (const auto &box : boxes) {
+    result += (box.type == type) ? 1 : 0;
+  }
+  return result;
+}
+
+} // namespace
+
+TEST_CASE("Fragmented MP4 init segment", "[recorder]") {
+  PlaceholderStream stream(h264camera::VIDEO_SIZE_SVGA);
+  CHECK(fmp4_init_segment({0x67, 0x42}, stream.pps()).empty());
+  const auto init = fmp4_init_segment(stream.sps(), stream.pps());
+  REQUIRE(init.size() > 100);
+  CHECK(std::string(init.begin() + 4, init.begin() + 8) == "ftyp");
+  const std::string boxes(init.begin(), init.end());
+  CHECK(boxes.find("avcC") != std::string::npos);
+  CHECK(boxes.find("trex") != std::string::npos);
+}
+
+TEST_CASE("Fragmented MP4 fragment header", "[recorder]") {
+  const std::vector<Fmp4Sample> samples{{3600, 1000, true}, {3600, 20, false}};
+  const auto header = fmp4_fragment_header(7, 90000, samples);
+  // moof followed by the mdat header
+  const std::size_t moof = (std::size_t{header[2]} << 8) | header[3];
+  REQUIRE(moof + 8 == header.size());
+  CHECK(std::string(header.end() - 4, header.end()) == "mdat");
+  CHECK(header[header.size() - 6] == (1028 >> 8));
+  CHECK(header[header.size() - 5] == (1028 & 0xFF));
+}
+
+TEST_CASE("Record fragmented MP4", "[recorder]") {
+  const std::string prefix = "recorder_test";
+  Recorder::Config config;
+  config.prefix = prefix;
+  config.fragment_ms = 200;
+  auto frames = std::make_shared<Subscription>(
+      100, Subscription::Overflow::WAIT_FOR_IDR);
+  FrameFeed feed;
+
+  SECTION("Single file") {
+    Recorder recorder(config);
+    recorder.start(frames);
+    for (int idx = 0; idx < 30; ++idx) {
+      frames->push(feed.next());
+    }
+    recorder.stop();
+
+    const auto stats = recorder.stats();
+    CHECK(stats.segments == 1);
+    CHECK(stats.frames == 30);
+    CHECK(stats.errors == 0);
+    // Every IDR and every 200 ms (5 frames) start a fragment
+    CHECK(stats.fragments == 6);
+
+    const auto boxes = read_boxes(prefix + "-00001.mp4");
+    REQUIRE(boxes.size() == 2 + 2 * 6);
+    CHECK(boxes[0].type == "ftyp");
+    CHECK(boxes[1].type == "moov");
+    CHECK(count(boxes, "moof") == 6);
+    CHECK(count(boxes, "mdat") == 6);
+  }
+
+  SECTION("Rotate by duration") {
+    config.segment_ms = 800;
+    Recorder recorder(config);
+    recorder.start(frames);
+    for (int idx = 0; idx < 30; ++idx) {
+      frames->push(feed.next());
+    }
+    recorder.stop();
+
+    INFO("The files start at the IDR after 800 ms");
+    CHECK(recorder.stats().segments == 2);
+    CHECK(count(read_boxes(prefix + "-00001.mp4"), "moof") == 4);
+    CHECK(count(read_boxes(prefix + "-00002.mp4"), "moof") == 2);
+  }
+
+  std::remove((prefix + "-00001.mp4").c_str());
+  std::remove((prefix + "-00002.mp4").c_str());
+}
@@ -0,0 +1,61 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "rtp_clock.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+TEST_CASE("RTP clock", "[rtp_clock]") {
+  RtpClock clock;
+  // 30 fps
+  const uint64_t interval{3000};
+
+  SECTION("Live frames use the tick time") {
+    CHECK(clock.stamp(1000, 5000000, interval) == 90000);
+    CHECK(clock.stamp(1040, 5033333, interval) == 93600);
+    CHECK(clock.stamp(1080, 5066666, interval) == 97200);
+    // Not closer than the capture times
+    CHECK(clock.stamp(1100, 5100000, interval) == 100200);
+  }
+
+  SECTION("Cached frames keep their capture spacing") {
+    // A GOP of four frames sent in one tick
+    CHECK(clock.stamp(1000, 5000000, interval) == 90000);
+    CHECK(clock.stamp(1000, 5033333, interval) == 92999);
+    CHECK(clock.stamp(1000, 5066666, interval) == 95998);
+    CHECK(clock.stamp(1000, 5100000, interval) == 98998);
+    // The live frame is not stamped before the cached ones
+    CHECK(clock.stamp(1010, 5133333, interval) == 101997);
+  }
+
+  SECTION("Frames without capture time are one interval apart") {
+    CHECK(clock.stamp(1000, 0, interval) == 90000);
+    CHECK(clock.stamp(1000, 0, interval) == 93000);
+    CHECK(clock.stamp(1000, 5000000, interval) == 96000);
+    // Capture time going back
+    CHECK(clock.stamp(1000, 4000000, interval) == 99000);
+  }
+
+  SECTION("Reset") {
+    CHECK(clock.stamp(1000, 5000000, interval) == 90000);
+    clock.reset();
+    CHECK(clock.stamp(1000, 5033333, interval) == 90000);
+  }
+}
@@ -0,0 +1,100 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "seqlock.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+/// Odd size, so the last word is partially used
+struct Settings {
+  uint32_t width;
+  uint32_t height;
+  float fps;
+  uint32_t check;
+  uint8_t flag;
+};
+
+Settings make_settings(uint32_t n) {
+  return Settings{n, n * 3, static_cast<float>(n % 60), ~n, 1};
+}
+
+bool consistent(const Settings &s) {
+  return s.height == s.width * 3 && s.check == ~s.width &&
+         s.fps == static_cast<float>(s.width % 60) && s.flag == 1;
+}
+
+} // namespace
+
+TEST_CASE("Seqlock stores and updates", "[seqlock]") {
+  Seqlock<Settings> value(make_settings(2));
+  CHECK(value.version() == 1);
+  CHECK(value.load().width == 2);
+
+  value.store(make_settings(5));
+  CHECK(value.version() == 2);
+  CHECK(consistent(value.load()));
+  CHECK(value.load().width == 5);
+
+  value.update([](Settings &s) { s = make_settings(s.width + 1); });
+  CHECK(value.version() == 3);
+  CHECK(value.load().width == 6);
+}
+
+TEST_CASE("Seqlock readers see whole values only", "[seqlock]") {
+  Seqlock<Settings> value(make_settings(0));
+  std::atomic<bool> reading{false};
+  std::atomic<bool> done{false};
+  uint64_t reads{0};
+  uint64_t broken{0};
+  std::thread reader([&] {
+    do {
+      broken += consistent(value.load()) ? 0 : 1;
+      ++reads;
+      reading = true;
+    } while (!done);
+  });
+  std::vector<std::thread> writers;
+  for (uint32_t idx = 0; idx < 2; ++idx) {
+    writers.emplace_back([&value, &reading, idx] {
+      // Overlap with the reader
+      while (!reading) {
+        std::this_thread::yield();
+      }
+      for (uint32_t n = 1; n <= 20000; ++n) {
+        value.store(make_settings(n * 2 + idx));
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+
+  CHECK(reads > 0);
+  CHECK(broken == 0);
+  CHECK(value.version() == 40001);
+}
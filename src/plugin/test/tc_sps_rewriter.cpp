@@ -0,0 +1,186 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "bitstream.hpp"
+#include "sps_rewriter.hpp"
+
+#include <vector>
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+namespace {
+
+// High profile 1280x720 SPS with timing info and bitstream_restriction
+const std::vector<uint8_t> HIGH_SPS{
+    0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50, 0x05,
+    0xbb, 0x01, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00,
+    0x00, 0x03, 0x03, 0xc0, 0xf1, 0x83, 0x19, 0x60};
+
+/// Baseline SPS without VUI as sent by the camera
+std::vector<uint8_t> baseline_sps(uint32_t width_mbs, uint32_t height_mbs) {
+  BitWriter writer;
+  writer.u(8, 66); // profile_idc
+  writer.u(8, 0xC0); // constraint_set0_flag, constraint_set1_flag
+  writer.u(8, 31); // level_idc
+  writer.ue(0); // seq_parameter_set_id
+  writer.ue(0); // log2_max_frame_num_minus4
+  writer.ue(2); // pic_order_cnt_type
+  writer.ue(1); // max_num_ref_frames
+  writer.flag(false); // gaps_in_frame_num_value_allowed_flag
+  writer.ue(width_mbs - 1);
+  writer.ue(height_mbs - 1);
+  writer.flag(true); // frame_mbs_only_flag
+  writer.flag(true); // direct_8x8_inference_flag
+  writer.flag(false); // frame_cropping_flag
+  writer.flag(false); // vui_parameters_present_flag
+  writer.trailingBits();
+  std::vector<uint8_t> nalu{0x67};
+  escape_rbsp(writer.data(), nalu);
+  return nalu;
+}
+
+} // namespace
+
+TEST_CASE("Exp-Golomb round trip", "[bitstream]") {
+  const std::vector<uint32_t> values{0,   1,     2,
+                                     3,   7,     8,
+                                     255, 65535, UINT32_MAX - 1};
+  BitWriter writer;
+  for (auto value : values) {
+    writer.ue(value);
+    writer.se(static_cast<int32_t>(value % 1000) - 500);
+    writer.u(3, 5);
+  }
+  writer.trailingBits();
+  CHECK(writer.position() % 8 == 0);
+
+  BitReader reader(writer.data().data(), writer.data().size());
+  for (auto value : values) {
+    CHECK(reader.ue() == value);
+    CHECK(reader.se() == static_cast<int32_t>(value % 1000) - 500);
+    CHECK(reader.u(3) == 5);
+  }
+  CHECK(reader.ok());
+  CHECK(reader.u(1) == 1);
+  while (reader.position() % 8 != 0) {
+    CHECK(reader.u(1) == 0);
+  }
+  reader.u(1);
+  CHECK_FALSE(reader.ok());
+}
+
+TEST_CASE("Known Exp-Golomb codes", "[bitstream]") {
+  BitWriter writer;
+  writer.ue(0); // 1
+  writer.ue(3); // 00100
+  writer.se(-1); // 011
+  writer.trailingBits();
+  const std::vector<uint8_t> expected{0x91, 0xC0};
+  CHECK(writer.data() == expected);
+}
+
+TEST_CASE("Emulation prevention", "[bitstream]") {
+  const std::vector<uint8_t> rbsp{0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+                                  0x00, 0x00, 0x03, 0xFF};
+  std::vector<uint8_t> nalu;
+  escape_rbsp(rbsp, nalu);
+  const std::vector<uint8_t> expected{0x00, 0x00, 0x03, 0x00, 0x00, 0x03,
+                                      0x00, 0x01, 0x00, 0x00, 0x03, 0x03,
+                                      0xFF};
+  CHECK(nalu == expected);
+  CHECK(unescape_rbsp(nalu.data(), nalu.size()) == rbsp);
+}
+
+TEST_CASE("Parse SPS", "[sps]") {
+  Sps sps;
+  REQUIRE(parse_sps(HIGH_SPS.data(), HIGH_SPS.size(), sps));
+  CHECK(sps.profile_idc == 100);
+  CHECK(sps.level_idc == 31);
+  CHECK(sps.max_num_ref_frames == 4);
+  CHECK(sps.pic_width_in_mbs * 16 == 1280);
+  CHECK(sps.pic_height_in_map_units * 16 == 720);
+  REQUIRE(sps.vui_parameters_present);
+  CHECK(sps.vui.timing_info_present);
+  CHECK(sps.vui.num_units_in_tick == 1);
+  CHECK(sps.vui.time_scale == 60);
+  CHECK(sps.vui.bitstream_restriction);
+  CHECK(sps.vui.max_num_reorder_frames == 2);
+  CHECK(sps.vui.max_dec_frame_buffering == 4);
+
+  const uint8_t pps[] = {0x68, 0xCE, 0x3C, 0x80};
+  CHECK_FALSE(parse_sps(pps, sizeof pps, sps));
+  INFO("Truncated SPS");
+  CHECK_FALSE(parse_sps(HIGH_SPS.data(), 12, sps));
+}
+
+TEST_CASE("Rewrite SPS", "[sps]") {
+  std::vector<uint8_t> out;
+  SECTION("Unchanged options reproduce the SPS") {
+    REQUIRE(rewrite_sps(HIGH_SPS.data(), HIGH_SPS.size(), {}, out));
+    CHECK(out == HIGH_SPS);
+  }
+
+  SECTION("Patch present bitstream_restriction") {
+    SpsRewriteOptions options;
+    options.zero_reorder = true;
+    options.fps = 20;
+    REQUIRE(rewrite_sps(HIGH_SPS.data(), HIGH_SPS.size(), options, out));
+    Sps sps;
+    REQUIRE(parse_sps(out.data(), out.size(), sps));
+    CHECK(sps.pic_width_in_mbs * 16 == 1280);
+    CHECK(sps.vui.max_num_reorder_frames == 0);
+    CHECK(sps.vui.max_dec_frame_buffering == 4);
+    INFO("Present timing info is kept");
+    CHECK(sps.vui.time_scale == 60);
+  }
+
+  SECTION("Add VUI") {
+    const auto in = baseline_sps(80, 45);
+    SpsRewriteOptions options;
+    options.zero_reorder = true;
+    options.fps = 30;
+    REQUIRE(rewrite_sps(in.data(), in.size(), options, out));
+    Sps sps;
+    REQUIRE(parse_sps(out.data(), out.size(), sps));
+    CHECK(sps.profile_idc == 66);
+    CHECK(sps.pic_width_in_mbs == 80);
+    CHECK(sps.pic_height_in_map_units == 45);
+    REQUIRE(sps.vui_parameters_present);
+    CHECK(sps.vui.bitstream_restriction);
+    CHECK(sps.vui.max_num_reorder_frames == 0);
+    CHECK(sps.vui.max_dec_frame_buffering == 1);
+    CHECK(sps.vui.log2_max_mv_length_horizontal == 16);
+    REQUIRE(sps.vui.timing_info_present);
+    CHECK(sps.vui.time_scale / sps.vui.num_units_in_tick / 2 == 30);
+    CHECK_FALSE(sps.vui.fixed_frame_rate);
+
+    std::vector<uint8_t> again;
+    REQUIRE(rewrite_sps(out.data(), out.size(), options, again));
+    CHECK(again == out);
+  }
+
+  // No start code emulation must be left
+  for (std::size_t idx = 2; idx < out.size(); ++idx) {
+    CHECK_FALSE((out[idx - 2] == 0 && out[idx - 1] == 0 && out[idx] <= 2));
+  }
+  if (!out.empty()) {
+    CHECK(out.back() != 0);
+  }
+}
@@ -0,0 +1,119 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "stall_watchdog.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+using Action = StallWatchdog::Action;
+
+namespace {
+
+StallWatchdog::Config test_config() {
+  StallWatchdog::Config config;
+  config.timeout = 500;
+  config.step_delay = 100;
+  config.max_backoff = 400;
+  return config;
+}
+
+} // namespace
+
+TEST_CASE("No stall while frames arrive", "[stall]") {
+  StallWatchdog watchdog(test_config());
+  watchdog.start(1000);
+  for (uint32_t seq = 0; seq < 10; ++seq) {
+    const uint64_t now = 1000 + seq * 100;
+    CHECK_FALSE(watchdog.frame(seq, now));
+    CHECK(watchdog.check(now + 50) == Action::NONE);
+  }
+  CHECK_FALSE(watchdog.stalled());
+  CHECK(watchdog.stats().stalls == 0);
+}
+
+TEST_CASE("Escalate until a frame arrives", "[stall]") {
+  StallWatchdog watchdog(test_config());
+  watchdog.start(1000);
+  watchdog.frame(1, 1000);
+  CHECK(watchdog.check(1499) == Action::NONE);
+  CHECK(watchdog.check(1500) == Action::REQUEUE);
+  CHECK(watchdog.stalled());
+  CHECK(watchdog.check(1599) == Action::NONE);
+  CHECK(watchdog.check(1600) == Action::RESTART_STREAM);
+  CHECK(watchdog.check(1799) == Action::NONE);
+  CHECK(watchdog.check(1800) == Action::REOPEN);
+
+  INFO("The reopen restarts the capture, the escalation goes on");
+  watchdog.start(1850);
+  CHECK(watchdog.check(2249) == Action::NONE);
+  CHECK(watchdog.check(2250) == Action::REOPEN);
+  INFO("Backoff is limited");
+  CHECK(watchdog.check(2650) == Action::REOPEN);
+
+  CHECK(watchdog.frame(0, 2700));
+  CHECK_FALSE(watchdog.stalled());
+  CHECK(watchdog.check(2800) == Action::NONE);
+
+  const auto stats = watchdog.stats();
+  CHECK(stats.stalls == 1);
+  CHECK(stats.requeues == 1);
+  CHECK(stats.restarts == 1);
+  CHECK(stats.reopens == 3);
+  CHECK(stats.recoveries == 1);
+  CHECK(stats.last_recovery == 1200);
+  CHECK(stats.last_step == Action::REOPEN);
+}
+
+TEST_CASE("A requeue fixes the stall", "[stall]") {
+  StallWatchdog watchdog(test_config());
+  watchdog.start(0);
+  CHECK(watchdog.check(500) == Action::REQUEUE);
+  CHECK(watchdog.frame(7, 520));
+
+  INFO("The next stall starts over with a requeue");
+  CHECK(watchdog.check(1020) == Action::REQUEUE);
+  CHECK(watchdog.frame(8, 1050));
+
+  const auto stats = watchdog.stats();
+  CHECK(stats.stalls == 2);
+  CHECK(stats.requeues == 2);
+  CHECK(stats.last_recovery == 30);
+  CHECK(stats.max_recovery == 30);
+  CHECK(stats.last_step == Action::REQUEUE);
+}
+
+TEST_CASE("A repeated sequence number is no progress", "[stall]") {
+  StallWatchdog watchdog(test_config());
+  watchdog.start(0);
+  watchdog.frame(42, 0);
+  for (uint64_t now = 100; now < 500; now += 100) {
+    watchdog.frame(42, now);
+  }
+  CHECK(watchdog.check(500) == Action::REQUEUE);
+  CHECK_FALSE(watchdog.frame(42, 550));
+  CHECK(watchdog.frame(43, 560));
+}
+
+TEST_CASE("Disabled watchdog", "[stall]") {
+  StallWatchdog watchdog(test_config());
+  watchdog.setTimeout(0);
+  watchdog.start(0);
+  CHECK(watchdog.check(100000) == Action::NONE);
+}
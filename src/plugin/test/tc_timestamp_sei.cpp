@@ -0,0 +1,54 @@
+// Copyright (C) 2019 SmartWireless GmbH & Co. KG
+// 
+// This file is part of mselph264.
+// 
+// mselph264 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// mselph264 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with mselph264.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "timestamp_sei.hpp"
+
+#include <catch.hpp>
+
+using namespace mselph264;
+
+TEST_CASE("Timestamp SEI round trip", "[sei]") {
+  TimestampSei in;
+  SECTION("Plain values") {
+    in.capture_us = 0x0123456789ABCDEF;
+    in.sequence = 4711;
+  }
+  SECTION("Values needing emulation prevention") {
+    in.capture_us = 0x0000000100000002;
+    in.sequence = 0x00000003;
+  }
+  const auto nalu = make_timestamp_sei(in);
+  REQUIRE(nalu.size() > 2);
+  CHECK(SEI_NALU_TYPE == (nalu[0] & 0x1F));
+  for (std::size_t idx = 2; idx < nalu.size(); ++idx) {
+    // No start code emulation must be left
+    CHECK_FALSE((nalu[idx - 2] == 0 && nalu[idx - 1] == 0 && nalu[idx] <= 2));
+  }
+
+  TimestampSei out;
+  REQUIRE(read_timestamp_sei(nalu.data(), nalu.data() + nalu.size(), out));
+  CHECK(in.capture_us == out.capture_us);
+  CHECK(in.sequence == out.sequence);
+}
+
+TEST_CASE("Ignore other SEI", "[sei]") {
+  const uint8_t other[] = {0x06, 0x05, 0x01, 0xFF, 0x80};
+  TimestampSei out;
+  CHECK_FALSE(read_timestamp_sei(other, other + sizeof other, out));
+  const uint8_t slice[] = {0x65, 0x88, 0x80};
+  CHECK_FALSE(read_timestamp_sei(slice, slice + sizeof slice, out));
+}
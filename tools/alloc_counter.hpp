@@ -0,0 +1,35 @@
+#ifndef TOOLS_ALLOC_COUNTER_HPP__
+#define TOOLS_ALLOC_COUNTER_HPP__
+
+// Count every allocation of the process.  The glibc entry points are
+// wrapped, so allocations of mediastreamer and ortp are counted as well.
+// Include this header in exactly one translation unit of a tool.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+std::atomic<uint64_t> gAllocations{0};
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+void *calloc(size_t nmemb, size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(nmemb, size);
+}
+void *realloc(void *ptr, size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+#endif
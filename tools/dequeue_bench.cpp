@@ -0,0 +1,244 @@
+// Compare the dequeue latency of a capture thread under different thread
+// policies (see h264camera::ThreadPolicy), while busy threads compete for
+// the CPUs like audio, SIP and analytics do on a loaded gateway.
+//
+// Every policy gets its own run: the camera is opened and started in a new
+// capture thread, which applies the policy and dequeues for the given
+// time.  Two latencies are measured per frame:
+// - from the capture timestamp of the driver to the return of the dequeue.
+//   A replay source stamps its frames at the dequeue, so this is zero.
+// - the deviation of the time between two dequeues from the median, which
+//   shows late wake ups of any source.
+//
+// Usage: dequeue_bench [options] <device>
+//   --policy <text>      policy to measure, repeated for more.  By default
+//                        "other", "nice:-10", "fifo:50" and "fifo:50 mlock".
+//   --seconds <n>        duration of every run, 10 by default
+//   --load <n>           busy threads, one per CPU by default
+//   --size <w>x<h>       resolution, 1280x720 by default
+//   --fps <n>            frame rate, 30 by default
+//
+// A device is a camera path or replay:<file> as for the plugin.  Parts of
+// a policy failing due to missing privileges are reported and left out.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <h264camera/frame_source.hpp>
+#include <h264camera/thread_policy.hpp>
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct Options {
+  VideoSize vsize{VIDEO_SIZE_720P};
+  uint32_t fps{30};
+  int seconds{10};
+  unsigned load{std::thread::hardware_concurrency()};
+  std::vector<std::string> policies;
+  std::string device;
+};
+
+struct Result {
+  std::vector<std::string> errors;
+  std::string failure;
+  uint64_t frames{0};
+  uint64_t timeouts{0};
+  std::vector<uint32_t> latency_us;
+  std::vector<uint32_t> jitter_us;
+};
+
+uint64_t monotonic_us() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t timestamp_us(const v4l2_buffer &buf) {
+  return static_cast<uint64_t>(buf.timestamp.tv_sec) * 1000000 +
+         static_cast<uint64_t>(buf.timestamp.tv_usec);
+}
+
+/// Value at *p* of the sorted *values* in milliseconds
+double percentile(const std::vector<uint32_t> &values, double p) {
+  return values.empty()
+             ? 0.0
+             : values[static_cast<std::size_t>(p * (values.size() - 1))] /
+                   1000.0;
+}
+
+void capture(const Options &opt, const ThreadPolicy &policy, Result &result) {
+  result.errors = apply_thread_policy(policy);
+  try {
+    auto source = make_frame_source(opt.device);
+    source->reopen();
+    source->configure(opt.vsize, opt.fps);
+    source->start();
+    if (policy.lock_memory) {
+      try {
+        source->lockMemory();
+      } catch (const std::system_error &e) {
+        result.errors.push_back(e.what());
+      }
+    }
+
+    std::vector<uint64_t> dequeued;
+    const auto end = monotonic_us() + static_cast<uint64_t>(opt.seconds) *
+                                          1000000;
+    while (monotonic_us() < end) {
+      auto mem = source->dequeue(200ms);
+      const auto now = monotonic_us();
+      if (!mem) {
+        ++result.timeouts;
+        continue;
+      }
+      ++result.frames;
+      dequeued.push_back(now);
+      const auto &buf = mem->video_buffer;
+      if (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        const auto captured = timestamp_us(buf);
+        result.latency_us.push_back(
+            static_cast<uint32_t>(now > captured ? now - captured : 0));
+      }
+      mem->done();
+      source->queue(mem->index);
+    }
+    source->stop();
+    source->close();
+
+    std::vector<uint32_t> intervals;
+    for (std::size_t idx = 1; idx < dequeued.size(); ++idx) {
+      intervals.push_back(
+          static_cast<uint32_t>(dequeued[idx] - dequeued[idx - 1]));
+    }
+    std::sort(intervals.begin(), intervals.end());
+    const uint32_t median =
+        intervals.empty() ? 0 : intervals[intervals.size() / 2];
+    for (std::size_t idx = 1; idx < dequeued.size(); ++idx) {
+      const auto interval =
+          static_cast<uint32_t>(dequeued[idx] - dequeued[idx - 1]);
+      result.jitter_us.push_back(interval > median ? interval - median
+                                                   : median - interval);
+    }
+  } catch (const std::exception &e) {
+    result.failure = e.what();
+  }
+  std::sort(result.latency_us.begin(), result.latency_us.end());
+  std::sort(result.jitter_us.begin(), result.jitter_us.end());
+}
+
+Options parse(int argc, const char *argv[]) {
+  Options opt;
+  auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " [--policy <text>]... [--seconds <n>] [--load <n>]"
+                 " [--size <w>x<h>] [--fps <n>] <device>\n";
+    std::exit(EXIT_FAILURE);
+  };
+  for (int idx = 1; idx < argc; ++idx) {
+    std::string arg = argv[idx];
+    const bool has_value = idx + 1 < argc;
+    if (arg == "--policy" && has_value) {
+      opt.policies.push_back(argv[++idx]);
+    } else if (arg == "--seconds" && has_value) {
+      opt.seconds = std::stoi(argv[++idx]);
+    } else if (arg == "--load" && has_value) {
+      opt.load = static_cast<unsigned>(std::stoul(argv[++idx]));
+    } else if (arg == "--size" && has_value) {
+      if (std::sscanf(argv[++idx], "%ux%u", &opt.vsize.width,
+                      &opt.vsize.height) != 2) {
+        usage();
+      }
+    } else if (arg == "--fps" && has_value) {
+      opt.fps = static_cast<uint32_t>(std::stoul(argv[++idx]));
+    } else if (arg.compare(0, 2, "--") != 0 && opt.device.empty()) {
+      opt.device = arg;
+    } else {
+      usage();
+    }
+  }
+  if (opt.device.empty() || opt.fps == 0 || opt.seconds <= 0) {
+    usage();
+  }
+  if (opt.policies.empty()) {
+    opt.policies = {"other", "nice:-10", "fifo:50", "fifo:50 mlock"};
+  }
+  return opt;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  const auto opt = parse(argc, argv);
+  std::vector<ThreadPolicy> policies;
+  for (const auto &text : opt.policies) {
+    try {
+      policies.push_back(parse_thread_policy(text));
+    } catch (const std::invalid_argument &e) {
+      std::cerr << "Invalid policy \"" << text << "\": " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::atomic<bool> loaded{true};
+  std::vector<std::thread> load;
+  for (unsigned idx = 0; idx < opt.load; ++idx) {
+    load.emplace_back([&loaded] {
+      volatile uint64_t sink{0};
+      while (loaded.load(std::memory_order_relaxed)) {
+        sink = sink + 1;
+      }
+    });
+  }
+
+  std::printf("%s %ux%u@%u, %u busy threads, %d s per policy\n",
+              opt.device.c_str(), opt.vsize.width, opt.vsize.height, opt.fps,
+              opt.load, opt.seconds);
+  std::printf("%-24s %7s %8s %8s %8s %8s %8s %8s %8s\n", "policy", "frames",
+              "timeouts", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms",
+              "jit99 ms");
+  bool failed{false};
+  for (const auto &policy : policies) {
+    Result result;
+    std::thread thread(capture, std::cref(opt), std::cref(policy),
+                       std::ref(result));
+    thread.join();
+    for (const auto &error : result.errors) {
+      std::fprintf(stderr, "%s: %s\n", to_string(policy).c_str(),
+                   error.c_str());
+    }
+    if (!result.failure.empty()) {
+      std::fprintf(stderr, "%s: %s\n", to_string(policy).c_str(),
+                   result.failure.c_str());
+      failed = true;
+      continue;
+    }
+    const auto &lat = result.latency_us;
+    std::printf("%-24s %7llu %8llu %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+                to_string(policy).c_str(),
+                static_cast<unsigned long long>(result.frames),
+                static_cast<unsigned long long>(result.timeouts),
+                percentile(lat, 0.5), percentile(lat, 0.9),
+                percentile(lat, 0.99), percentile(lat, 0.999),
+                percentile(lat, 1.0), percentile(result.jitter_us, 0.99));
+  }
+
+  loaded = false;
+  for (auto &thread : load) {
+    thread.join();
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
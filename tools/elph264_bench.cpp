@@ -0,0 +1,260 @@
+// Benchmark of the complete plugin path without a camera.
+//
+// For every entry of the filter's configuration list a synthetic H.264
+// recording with the entry's bitrate is replayed by the plugin.  The frames
+// are split into NALUs, handed to process(), packed into RTP and sent by a
+// VideoStream to a loopback receiver, which extracts the capture timestamp
+// SEI.  One JSON object per configuration is printed on stdout, with the
+// size and frame rate read back from the filter.  Configurations the filter
+// rejects, e.g., sizes the camera does not support, are skipped.  The CPU
+// time is the one of the ticker thread running the filter.
+//
+// Usage: elph264_bench [--seconds <n>] [--max-speed] [--input <file>]
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <pthread.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bctoolbox/list.h>
+#include <mediastreamer2/mediastream.h>
+#include <mediastreamer2/msfactory.h>
+#include <mediastreamer2/msvideo.h>
+
+#include "alloc_counter.hpp"
+#include "latency_probe.hpp"
+#include "methods.hpp"
+
+#define H264_PAYLOAD_TYPE 102
+
+namespace {
+
+uint64_t cpu_time_us(clockid_t clock) {
+  timespec ts;
+  if (clock_gettime(clock, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// Write *seconds* of a synthetic stream with *bitrate* and *fps*.  Every
+/// second starts with SPS, PPS and an IDR slice, which is four times the
+/// size of a P slice.  The payload is random without start code emulation.
+void write_synthetic_stream(const std::string &fname, int bitrate, float fps,
+                            int seconds) {
+  auto stream = std::fopen(fname.c_str(), "wb");
+  assert(stream);
+  const int gop = std::max(1, static_cast<int>(fps));
+  const std::size_t gop_bytes = std::max(bitrate, 64000) / 8 * gop / fps;
+  const std::size_t p_size = std::max<std::size_t>(gop_bytes / (gop + 3), 16);
+  const uint8_t start_code[] = {0, 0, 0, 1};
+  const uint8_t sps[] = {0x67, 0x42, 0xC0, 0x1F, 0xDA, 0x01, 0x40, 0x16};
+  const uint8_t pps[] = {0x68, 0xCE, 0x3C, 0x80};
+  std::mt19937 rng(4711);
+  std::uniform_int_distribution<int> byte(1, 255);
+  std::vector<uint8_t> slice;
+  for (int idx = 0; idx < gop * seconds; ++idx) {
+    const bool key = idx % gop == 0;
+    if (key) {
+      std::fwrite(start_code, sizeof start_code, 1, stream);
+      std::fwrite(sps, sizeof sps, 1, stream);
+      std::fwrite(start_code, sizeof start_code, 1, stream);
+      std::fwrite(pps, sizeof pps, 1, stream);
+    }
+    slice.resize(key ? 4 * p_size : p_size);
+    for (auto &b : slice) {
+      b = static_cast<uint8_t>(byte(rng));
+    }
+    slice[0] = key ? 0x65 : 0x41;
+    // first_mb_in_slice = 0
+    slice[1] |= 0x80;
+    std::fwrite(start_code, sizeof start_code, 1, stream);
+    std::fwrite(slice.data(), slice.size(), 1, stream);
+  }
+  std::fclose(stream);
+}
+
+/// Find a camera of this plugin, optionally by name
+MSWebCam *find_camera(MSWebCamManager *manager, const std::string &name) {
+  for (auto elem = ms_web_cam_manager_get_list(manager); elem;
+       elem = elem->next) {
+    auto cam = static_cast<MSWebCam *>(elem->data);
+    if (strcmp("ELP-USB100W04H", ms_web_cam_get_driver_type(cam)) == 0 &&
+        (name.empty() || name == ms_web_cam_get_name(cam))) {
+      return cam;
+    }
+  }
+  return nullptr;
+}
+
+struct Options {
+  int seconds{5};
+  bool max_speed{false};
+  std::string input;
+};
+
+Options parse(int argc, const char *argv[]) {
+  Options opt;
+  for (int idx = 1; idx < argc; ++idx) {
+    std::string arg = argv[idx];
+    if (arg == "--seconds" && idx + 1 < argc) {
+      opt.seconds = std::stoi(argv[++idx]);
+    } else if (arg == "--max-speed") {
+      opt.max_speed = true;
+    } else if (arg == "--input" && idx + 1 < argc) {
+      opt.input = argv[++idx];
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--seconds <n>] [--max-speed] [--input <file>]\n";
+      std::exit(EXIT_FAILURE);
+    }
+  }
+  return opt;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  const auto opt = parse(argc, argv);
+  const std::string prefix = opt.max_speed ? "replay-max:" : "replay:";
+
+  // The plugin registers replay cameras on detection, at least one is needed
+  // to query the configuration list.
+  const std::string bootstrap = "elph264_bench_bootstrap.h264";
+  if (opt.input.empty()) {
+    write_synthetic_stream(bootstrap, 1000000, 30, 1);
+  }
+  const std::string first = opt.input.empty() ? bootstrap : opt.input;
+  setenv("ELPH264_REPLAY", (prefix + first).c_str(), 1);
+
+  ortp_init();
+  ortp_set_log_level_mask(ORTP_LOG_DOMAIN, ORTP_ERROR | ORTP_FATAL);
+  bctbx_set_log_level("mediastreamer", BCTBX_LOG_ERROR);
+  bctbx_set_log_level("mselph264", BCTBX_LOG_ERROR);
+  auto factory =
+      ms_factory_new_with_voip_and_directories(MS_PLUGIN_DIRECTORY, nullptr);
+  assert(factory);
+  auto cam_manager = ms_factory_get_web_cam_manager(factory);
+  auto first_cam = find_camera(cam_manager, prefix + first);
+  if (!first_cam) {
+    std::cerr << "Plugin not found in " MS_PLUGIN_DIRECTORY "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<MSVideoConfiguration> vconfs;
+  {
+    auto reader = ms_web_cam_create_reader(first_cam);
+    const MSVideoConfiguration *list = nullptr;
+    ms_filter_call_method(reader, MS_VIDEO_ENCODER_GET_CONFIGURATION_LIST,
+                          &list);
+    // The list ends with the entry requiring no bitrate
+    for (; list; ++list) {
+      if (ms_filter_call_method(reader, MS_VIDEO_ENCODER_SET_CONFIGURATION,
+                                const_cast<MSVideoConfiguration *>(list)) ==
+          0) {
+        vconfs.push_back(*list);
+      } else {
+        std::cerr << "Skip unsupported configuration " << list->vsize.width
+                  << "x" << list->vsize.height << "\n";
+      }
+      if (list->required_bitrate == 0) {
+        break;
+      }
+    }
+    ms_filter_destroy(reader);
+  }
+
+  RtpProfile rtp_profile;
+  rtp_profile_clear_all(&rtp_profile);
+  rtp_profile_set_payload(&rtp_profile, H264_PAYLOAD_TYPE, &payload_type_h264);
+
+  // Each configuration gets its own recording matching its bitrate.  They
+  // are replayed by a single camera, since the manager cannot remove one.
+  MSWebCam *cam = first_cam;
+  const std::string fname = "elph264_bench_stream.h264";
+  if (opt.input.empty()) {
+    cam = ms_web_cam_new(first_cam->desc);
+    cam->name = ms_strdup((prefix + fname).c_str());
+    ms_web_cam_manager_add_cam(cam_manager, cam);
+  }
+
+  const auto warmup = std::chrono::milliseconds(1000);
+  for (const auto &vconf : vconfs) {
+    if (opt.input.empty()) {
+      write_synthetic_stream(fname, vconf.bitrate_limit, vconf.fps,
+                             opt.seconds + 2);
+    }
+
+    LatencyProbe probe(&rtp_profile, H264_PAYLOAD_TYPE);
+    auto vs = video_stream_new2(factory, "127.0.0.1", -1, -1);
+    video_stream_set_direction(vs, MediaStreamSendOnly);
+    video_stream_set_fps(vs, vconf.fps);
+    video_stream_set_sent_video_size(vs, vconf.vsize);
+    video_stream_send_only_start(vs, &rtp_profile, "127.0.0.1",
+                                 probe.rtpPort(), probe.rtcpPort(),
+                                 H264_PAYLOAD_TYPE, 50, cam);
+    bool enable = true;
+    ms_filter_call_method(vs->source, MS_ELPH264_ENABLE_TIMESTAMP_SEI,
+                          &enable);
+    MSVideoConfiguration applied = vconf;
+    if (ms_filter_call_method(vs->source, MS_VIDEO_ENCODER_SET_CONFIGURATION,
+                              &applied) != 0) {
+      std::cerr << "Configuration " << vconf.vsize.width << "x"
+                << vconf.vsize.height << " rejected\n";
+      video_stream_send_only_stop(vs);
+      continue;
+    }
+    ms_filter_call_method(vs->source, MS_VIDEO_ENCODER_GET_CONFIGURATION,
+                          &applied);
+    // CPU clock of the ticker thread running the filter
+    clockid_t clock{CLOCK_THREAD_CPUTIME_ID};
+    auto ticker = vs->ms.sessions.ticker;
+    const bool has_clock =
+        ticker && pthread_getcpuclockid(ticker->thread, &clock) == 0;
+
+    probe.run(warmup);
+    probe.reset();
+    const auto cpu_begin = has_clock ? cpu_time_us(clock) : 0;
+    const auto alloc_begin = gAllocations.load();
+    const auto wall_begin = std::chrono::steady_clock::now();
+    probe.run(std::chrono::seconds(opt.seconds));
+    const double wall_s = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - wall_begin)
+                              .count();
+    const double cpu_us =
+        has_clock ? static_cast<double>(cpu_time_us(clock) - cpu_begin) : 0;
+    const double allocs =
+        static_cast<double>(gAllocations.load() - alloc_begin);
+    const double frames = static_cast<double>(probe.frames());
+    const double per_frame = frames > 0 ? 1.0 / frames : 0.0;
+
+    std::printf(
+        "{\"width\": %d, \"height\": %d, \"fps\": %.1f, \"bitrate\": %d, "
+        "\"frames\": %zu, \"frames_per_s\": %.2f, \"gaps\": %zu, "
+        "\"kbit_per_s\": %.1f, \"cpu_us_per_frame\": %.1f, "
+        "\"allocs_per_frame\": %.1f, \"latency_ms\": {\"p50\": %.3f, "
+        "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}\n",
+        applied.vsize.width, applied.vsize.height, applied.fps,
+        vconf.bitrate_limit, probe.frames(), frames / wall_s, probe.gaps(),
+        probe.bytes() * 8 / wall_s / 1000, cpu_us * per_frame,
+        allocs * per_frame, probe.percentile(0.5), probe.percentile(0.9),
+        probe.percentile(0.99), probe.percentile(1.0));
+    std::fflush(stdout);
+
+    video_stream_send_only_stop(vs);
+  }
+
+  ms_factory_destroy(factory);
+  if (opt.input.empty()) {
+    std::remove(fname.c_str());
+  }
+  std::remove(bootstrap.c_str());
+  return EXIT_SUCCESS;
+}
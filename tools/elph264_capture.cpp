@@ -0,0 +1,477 @@
+// Capture any number of cameras concurrently into capture files (see
+// h264camera::CaptureWriter), which the replay source plays back.
+//
+// Every camera has a capture thread and a writer thread.  The capture thread
+// copies each frame into one half of a double buffer and gives the v4l2
+// buffer back right away, while the writer thread writes the other half.  A
+// slow disk thus only costs frames once both halves are full, and those are
+// counted, instead of stalling the dequeue loop until the driver runs out
+// of buffers.  After a dropped frame the capture skips to the next IDR, so
+// the files always decode.
+//
+// At the end one summary per camera is printed: throughput, frames dropped
+// by the tool and lost by the driver (sequence gaps), and the latency from
+// the capture timestamp to the dequeue.
+//
+// Usage: elph264_capture [options] <device>...
+//   --size <w>x<h>       resolution, 1280x720 by default
+//   --fps <n>            frame rate, 30 by default
+//   --bitrate <bit/s>    encoder bitrate of ELP cameras
+//   --mode cbr|vbr       encoder mode of ELP cameras
+//   --seconds <n>        capture duration, 0 runs until interrupted
+//   --rotate-seconds <n> start a new file after n seconds
+//   --rotate-mb <n>      start a new file after n MiB
+//   --buffer-mb <n>      size of each half of the double buffer, 8 MiB
+//   --output <prefix>    file name prefix, "capture" by default
+//
+// A device is a camera path or replay:<file> as for the plugin.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <h264camera/annexb.hpp>
+#include <h264camera/camera_source.hpp>
+#include <h264camera/capture_file.hpp>
+#include <h264camera/frame_source.hpp>
+
+using namespace h264camera;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::atomic<bool> sInterrupted{false};
+
+struct Options {
+  VideoSize vsize{VIDEO_SIZE_720P};
+  uint32_t fps{30};
+  double bitrate{0};
+  Mode mode{Mode::CBR};
+  bool set_mode{false};
+  int seconds{10};
+  uint64_t rotate_seconds{0};
+  uint64_t rotate_bytes{0};
+  std::size_t buffer_bytes{8 << 20};
+  std::string output{"capture"};
+  std::vector<std::string> devices;
+};
+
+uint64_t monotonic_us() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t timestamp_us(const v4l2_buffer &buf) {
+  return static_cast<uint64_t>(buf.timestamp.tv_sec) * 1000000 +
+         static_cast<uint64_t>(buf.timestamp.tv_usec);
+}
+
+/// Latency distribution of fixed size, however long the capture runs
+class LatencyHistogram {
+public:
+  void add(uint64_t us) {
+    ++mCounts[std::min<uint64_t>(us / BUCKET_US, BUCKETS - 1)];
+    ++mTotal;
+    mMax = std::max(mMax, us);
+  }
+
+  /// The *p* quantile in ms, with the resolution of a bucket
+  double percentile(double p) const {
+    if (mTotal == 0) {
+      return 0.0;
+    }
+    const auto rank = static_cast<uint64_t>(p * (mTotal - 1));
+    uint64_t count{0};
+    for (std::size_t idx = 0; idx < BUCKETS; ++idx) {
+      count += mCounts[idx];
+      if (count > rank) {
+        return std::min<uint64_t>((idx + 1) * BUCKET_US, mMax) / 1000.0;
+      }
+    }
+    return mMax / 1000.0;
+  }
+
+private:
+  static constexpr uint64_t BUCKET_US{50};
+  /// Up to 1 s, beyond that only the maximum is exact
+  static constexpr std::size_t BUCKETS{20000};
+
+  std::array<uint64_t, BUCKETS> mCounts{};
+  uint64_t mTotal{0};
+  uint64_t mMax{0};
+};
+
+/// Frames copied out of the v4l2 buffers
+struct Batch {
+  struct Entry {
+    v4l2_buffer buf;
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  std::vector<uint8_t> data;
+  std::vector<Entry> frames;
+
+  bool fits(std::size_t size) const {
+    return data.size() + size <= data.capacity();
+  }
+  void add(const Device::Mem &mem) {
+    frames.push_back({mem.video_buffer, data.size(), mem.used()});
+    auto begin = static_cast<const uint8_t *>(mem.ptr);
+    data.insert(data.end(), begin, begin + mem.used());
+  }
+  void clear() {
+    data.clear();
+    frames.clear();
+  }
+};
+
+struct Stats {
+  uint64_t frames{0};
+  uint64_t written{0};
+  /// Frames not written, since both buffers were full, or up to the next
+  /// IDR after such a frame
+  uint64_t dropped{0};
+  /// Frames the driver lost according to v4l2_buffer::sequence
+  uint64_t lost{0};
+  uint64_t errors{0};
+  uint64_t timeouts{0};
+  uint64_t bytes{0};
+  uint64_t segments{0};
+  uint64_t longest_write_us{0};
+  /// Capture timestamp to dequeue
+  LatencyHistogram latency;
+};
+
+/// Capture of a single camera
+class Capture {
+public:
+  Capture(const Options &opt, std::size_t index, const std::string &device)
+      : mOpt(opt), mIndex(index), mDevice(device) {
+    for (auto &batch : mBatches) {
+      batch.data.reserve(opt.buffer_bytes);
+    }
+    mFill = &mBatches[0];
+    mSpare = &mBatches[1];
+  }
+
+  void start() {
+    mStart = monotonic_us();
+    mCaptureThread = std::thread(&Capture::captureLoop, this);
+    mWriterThread = std::thread(&Capture::writeLoop, this);
+  }
+
+  void stop() {
+    mRunning = false;
+    mCaptureThread.join();
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mDone = true;
+    }
+    mFilled.notify_one();
+    mWriterThread.join();
+    mStop = monotonic_us();
+  }
+
+  void print() {
+    const double seconds = (mStop - mStart) / 1e6;
+    const auto &latency = mStats.latency;
+    std::printf("%s: %ux%u@%u for %.1f s\n", mDevice.c_str(),
+                mOpt.vsize.width, mOpt.vsize.height, mOpt.fps, seconds);
+    std::printf("  frames %llu (%.1f fps), written %llu, dropped %llu, "
+                "lost %llu, errors %llu, timeouts %llu\n",
+                ull(mStats.frames), mStats.frames / seconds,
+                ull(mStats.written), ull(mStats.dropped), ull(mStats.lost),
+                ull(mStats.errors), ull(mStats.timeouts));
+    std::printf("  written %.1f MiB (%.2f Mbit/s) in %llu files, longest "
+                "write %.1f ms\n",
+                mStats.bytes / 1048576.0, mStats.bytes * 8 / seconds / 1e6,
+                ull(mStats.segments), mStats.longest_write_us / 1000.0);
+    std::printf("  latency p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                latency.percentile(0.5), latency.percentile(0.99),
+                latency.percentile(1.0));
+  }
+
+  bool failed() const { return mFailed; }
+  /// Neither thread gave up yet
+  bool active() const { return mRunning && !mFailed; }
+
+private:
+  static unsigned long long ull(uint64_t value) { return value; }
+
+  void configure(FrameSource &source) {
+    source.reopen();
+    source.configure(mOpt.vsize, mOpt.fps);
+    if (auto camera = dynamic_cast<CameraSource *>(&source)) {
+      if (mOpt.bitrate > 0) {
+        camera->device().xuSetBitrate(mOpt.bitrate);
+      }
+      if (mOpt.set_mode) {
+        camera->device().xuSetMode(mOpt.mode);
+      }
+    }
+    source.start();
+  }
+
+  void captureLoop() {
+    try {
+      auto source = make_frame_source(mDevice);
+      configure(*source);
+      // Files start with an IDR, the source starts with one anyway
+      bool skip_to_idr{true};
+      auto skip = [&] {
+        if (!skip_to_idr) {
+          skip_to_idr = true;
+          source->requestIFrame();
+        }
+      };
+      bool first{true};
+      uint32_t next_sequence{0};
+
+      while (mRunning && !sInterrupted) {
+        if (mRequestIdr.exchange(false)) {
+          source->requestIFrame();
+        }
+        auto mem = source->dequeue(200ms);
+        if (!mem) {
+          ++mStats.timeouts;
+          continue;
+        }
+        const auto &buf = mem->video_buffer;
+        ++mStats.frames;
+        if (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+          const auto now = monotonic_us();
+          const auto captured = timestamp_us(buf);
+          mStats.latency.add(now > captured ? now - captured : 0);
+        }
+        if (!first && buf.sequence != next_sequence) {
+          mStats.lost += buf.sequence - next_sequence;
+        }
+        first = false;
+        next_sequence = buf.sequence + 1;
+
+        const auto data = static_cast<const uint8_t *>(mem->ptr);
+        if (mem->hasError() || mem->truncated()) {
+          ++mStats.errors;
+          skip();
+        } else if (skip_to_idr &&
+                   !is_keyframe(data, mem->used(), buf.flags)) {
+          ++mStats.dropped;
+        } else {
+          bool notify{false};
+          {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mFill->fits(mem->used())) {
+              mFill->add(*mem);
+              skip_to_idr = false;
+              notify = mFill->data.size() >= mFill->data.capacity() / 2;
+            } else {
+              ++mStats.dropped;
+              skip();
+            }
+          }
+          if (notify) {
+            mFilled.notify_one();
+          }
+        }
+        mem->done();
+        source->queue(mem->index);
+      }
+      source->stop();
+      source->close();
+    } catch (const std::exception &e) {
+      std::cerr << mDevice << ": " << e.what() << "\n";
+      mFailed = true;
+    }
+  }
+
+  void writeLoop() {
+    std::unique_ptr<CaptureWriter> writer;
+    uint64_t segment_start{0};
+    uint32_t segment{0};
+    try {
+      while (true) {
+        {
+          std::unique_lock<std::mutex> lock(mMutex);
+          mFilled.wait_for(lock, 100ms, [this] {
+            return mDone ||
+                   mFill->data.size() >= mFill->data.capacity() / 2;
+          });
+          if (mFill->frames.empty()) {
+            if (mDone) {
+              break;
+            }
+            continue;
+          }
+          std::swap(mFill, mSpare);
+        }
+
+        const auto begin = monotonic_us();
+        for (const auto &entry : mSpare->frames) {
+          const auto data = mSpare->data.data() + entry.offset;
+          const auto ts = timestamp_us(entry.buf);
+          const bool rotate =
+              writer &&
+              ((mOpt.rotate_seconds > 0 &&
+                ts >= segment_start + mOpt.rotate_seconds * 1000000) ||
+               (mOpt.rotate_bytes > 0 && writer->size() >= mOpt.rotate_bytes));
+          if (rotate && !is_keyframe(data, entry.size, entry.buf.flags)) {
+            // A file has to start with an IDR
+            mRequestIdr = true;
+          } else if (!writer || rotate) {
+            if (writer) {
+              mStats.bytes += writer->size();
+              writer->close();
+            }
+            char name[64];
+            std::snprintf(name, sizeof name, "-%zu-%ux%u-%u-%04u.elpcap",
+                          mIndex, mOpt.vsize.width, mOpt.vsize.height,
+                          mOpt.fps, segment++);
+            writer.reset(
+                new CaptureWriter(mOpt.output + name, mOpt.vsize, mOpt.fps));
+            segment_start = ts;
+            ++mStats.segments;
+          }
+          writer->write(data, entry.size, entry.buf);
+          ++mStats.written;
+        }
+        mStats.longest_write_us =
+            std::max(mStats.longest_write_us, monotonic_us() - begin);
+        mSpare->clear();
+      }
+      if (writer) {
+        mStats.bytes += writer->size();
+        writer->close();
+      }
+    } catch (const std::exception &e) {
+      std::cerr << mDevice << ": " << e.what() << "\n";
+      mFailed = true;
+      mRunning = false;
+    }
+  }
+
+  const Options &mOpt;
+  const std::size_t mIndex;
+  const std::string mDevice;
+  std::thread mCaptureThread;
+  std::thread mWriterThread;
+  std::atomic<bool> mRunning{true};
+  std::atomic<bool> mRequestIdr{false};
+  std::atomic<bool> mFailed{false};
+
+  std::mutex mMutex;
+  std::condition_variable mFilled;
+  Batch mBatches[2];
+  /// Filled by the capture thread, guarded by mMutex
+  Batch *mFill;
+  /// Written by the writer thread
+  Batch *mSpare;
+  bool mDone{false};
+
+  // The counters are split between the threads, they are read after both
+  // have been joined.
+  Stats mStats;
+  uint64_t mStart{0};
+  uint64_t mStop{0};
+};
+
+Options parse(int argc, const char *argv[]) {
+  Options opt;
+  auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " [--size <w>x<h>] [--fps <n>] [--bitrate <bit/s>]"
+                 " [--mode cbr|vbr] [--seconds <n>] [--rotate-seconds <n>]"
+                 " [--rotate-mb <n>] [--buffer-mb <n>] [--output <prefix>]"
+                 " <device>...\n";
+    std::exit(EXIT_FAILURE);
+  };
+  for (int idx = 1; idx < argc; ++idx) {
+    std::string arg = argv[idx];
+    const bool has_value = idx + 1 < argc;
+    if (arg == "--size" && has_value) {
+      if (std::sscanf(argv[++idx], "%ux%u", &opt.vsize.width,
+                      &opt.vsize.height) != 2) {
+        usage();
+      }
+    } else if (arg == "--fps" && has_value) {
+      opt.fps = static_cast<uint32_t>(std::stoul(argv[++idx]));
+    } else if (arg == "--bitrate" && has_value) {
+      opt.bitrate = std::stod(argv[++idx]);
+    } else if (arg == "--mode" && has_value) {
+      const std::string mode = argv[++idx];
+      if (mode != "cbr" && mode != "vbr") {
+        usage();
+      }
+      opt.mode = (mode == "cbr") ? Mode::CBR : Mode::VBR;
+      opt.set_mode = true;
+    } else if (arg == "--seconds" && has_value) {
+      opt.seconds = std::stoi(argv[++idx]);
+    } else if (arg == "--rotate-seconds" && has_value) {
+      opt.rotate_seconds = std::stoull(argv[++idx]);
+    } else if (arg == "--rotate-mb" && has_value) {
+      opt.rotate_bytes = std::stoull(argv[++idx]) << 20;
+    } else if (arg == "--buffer-mb" && has_value) {
+      opt.buffer_bytes = std::stoull(argv[++idx]) << 20;
+    } else if (arg == "--output" && has_value) {
+      opt.output = argv[++idx];
+    } else if (arg.compare(0, 2, "--") != 0) {
+      opt.devices.push_back(arg);
+    } else {
+      usage();
+    }
+  }
+  if (opt.devices.empty() || opt.fps == 0 || opt.buffer_bytes == 0) {
+    usage();
+  }
+  return opt;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  const auto opt = parse(argc, argv);
+  std::signal(SIGINT, [](int) { sInterrupted = true; });
+  std::signal(SIGTERM, [](int) { sInterrupted = true; });
+
+  std::vector<std::unique_ptr<Capture>> captures;
+  for (const auto &device : opt.devices) {
+    captures.emplace_back(new Capture(opt, captures.size(), device));
+  }
+  for (auto &capture : captures) {
+    capture->start();
+  }
+
+  const auto end = std::chrono::steady_clock::now() +
+                   std::chrono::seconds(opt.seconds);
+  auto active = [&] {
+    return std::any_of(captures.begin(), captures.end(),
+                       [](const auto &capture) { return capture->active(); });
+  };
+  // Stop early once every capture failed
+  while (!sInterrupted && active() &&
+         (opt.seconds == 0 || std::chrono::steady_clock::now() < end)) {
+    std::this_thread::sleep_for(100ms);
+  }
+
+  bool failed{false};
+  for (auto &capture : captures) {
+    capture->stop();
+    capture->print();
+    failed |= capture->failed();
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+// Microbenchmark of the NALU parser of the plugin.
+//
+// separate_h264_nalus() splits every captured frame, so it runs once per
+// frame on the capture thread.  The benchmark feeds synthetic Annex-B frames
+// of different shapes to the parser and prints one JSON object per shape
+// with throughput and allocations per frame.
+//
+// With --check the parser is instead compared byte for byte with the
+// reference implementation on random streams, the exit code tells the result.
+//
+// Usage: h264helper_bench [--frames <n>] [--check <streams>]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "alloc_counter.hpp"
+#include "annexb_corpus.hpp"
+#include "h264helper.hpp"
+
+using mselph264::Device;
+
+namespace {
+
+struct Shape {
+  const char *name;
+  annexb::Options options;
+};
+
+std::vector<Shape> shapes() {
+  std::vector<Shape> result;
+  annexb::Options opt;
+  // SPS, PPS, SEI and a large IDR slice as sent by the camera at 720p
+  opt.nalu_count = 4;
+  opt.min_size = 4;
+  opt.max_size = 120000;
+  opt.short_start_code = 0.0;
+  result.push_back({"idr_720p", opt});
+  // A typical P frame
+  opt.nalu_count = 1;
+  opt.min_size = 2000;
+  opt.max_size = 12000;
+  result.push_back({"p_frame", opt});
+  // Many small slices
+  opt.nalu_count = 64;
+  opt.min_size = 16;
+  opt.max_size = 256;
+  opt.short_start_code = 0.5;
+  result.push_back({"small_nalus", opt});
+  // Flat content producing lots of emulation prevention bytes
+  opt.nalu_count = 2;
+  opt.min_size = 10000;
+  opt.max_size = 40000;
+  opt.zero_run = 0.2;
+  opt.max_zero_run = 512;
+  result.push_back({"zero_runs", opt});
+  // Padding after each NALU
+  opt.nalu_count = 8;
+  opt.min_size = 500;
+  opt.max_size = 4000;
+  opt.zero_run = 0.0;
+  opt.max_trailing_zeros = 64;
+  result.push_back({"trailing_zeros", opt});
+  return result;
+}
+
+/// Run the parser on *frame* and return the count of NALUs
+std::size_t parse(std::vector<uint8_t> &frame, MSQueue *nalus,
+                  mselph264::FrameInfo &info) {
+  Device::Mem mem(0, frame.data(), frame.size(), false);
+  mem.video_buffer = {};
+  mem.video_buffer.bytesused = static_cast<uint32_t>(frame.size());
+  mselph264::separate_h264_nalus(&mem, nalus, info);
+  const std::size_t count = ms_queue_get_size(nalus);
+  ms_queue_flush(nalus);
+  return count;
+}
+
+void bench(const Shape &shape, int frames) {
+  // A set of different frames, so branch prediction can not learn one frame
+  std::vector<std::vector<uint8_t>> corpus;
+  std::size_t corpus_bytes{0};
+  annexb::Options opt = shape.options;
+  for (uint32_t seed = 1; seed <= 16; ++seed) {
+    opt.seed = seed;
+    corpus.push_back(annexb::generate(opt).data);
+    corpus_bytes += corpus.back().size();
+  }
+
+  MSQueue queue;
+  ms_queue_init(&queue);
+  // Reused like the frames of the filter, so the descriptor does not
+  // allocate after the first frames
+  mselph264::FrameInfo info;
+  std::size_t bytes{0};
+  std::size_t nalus{0};
+  const auto alloc_begin = gAllocations.load();
+  const auto begin = std::chrono::steady_clock::now();
+  for (int idx = 0; idx < frames; ++idx) {
+    auto &frame = corpus[idx % corpus.size()];
+    nalus += parse(frame, &queue, info);
+    bytes += frame.size();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count();
+  const double allocs = static_cast<double>(gAllocations.load() - alloc_begin);
+
+  std::printf("{\"shape\": \"%s\", \"frames\": %d, \"bytes_per_frame\": %.0f, "
+              "\"nalus_per_frame\": %.1f, \"mb_per_s\": %.1f, "
+              "\"ns_per_frame\": %.0f, \"allocs_per_frame\": %.2f}\n",
+              shape.name, frames,
+              static_cast<double>(corpus_bytes) / corpus.size(),
+              static_cast<double>(nalus) / frames, bytes / seconds / 1e6,
+              seconds * 1e9 / frames, allocs / frames);
+  std::fflush(stdout);
+}
+
+/// Compare the parser with the reference implementation on *streams*
+/// random streams of every shape.  Returns the count of mismatches.
+int check(int streams) {
+  MSQueue queue;
+  ms_queue_init(&queue);
+  mselph264::FrameInfo info;
+  int mismatches{0};
+  for (const auto &shape : shapes()) {
+    annexb::Options opt = shape.options;
+    for (int idx = 0; idx < streams; ++idx) {
+      opt.seed = static_cast<uint32_t>(idx + 1);
+      auto data = annexb::generate(opt).data;
+      const auto expected = annexb::reference_parse(data.data(), data.size());
+
+      Device::Mem mem(0, data.data(), data.size(), false);
+
+      mem.video_buffer = {};
+      mem.video_buffer.bytesused = static_cast<uint32_t>(data.size());
+      mselph264::separate_h264_nalus(&mem, &queue, info);
+      std::vector<annexb::Nalu> actual;
+      while (auto m = ms_queue_get(&queue)) {
+        actual.emplace_back(m->b_rptr, m->b_wptr);
+        freemsg(m);
+      }
+      if (actual != expected) {
+        std::cerr << "Mismatch for shape " << shape.name << " seed " << opt.seed
+                  << ": " << actual.size() << " NALUs instead of "
+                  << expected.size() << "\n";
+        ++mismatches;
+      }
+    }
+  }
+  return mismatches;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  int frames{20000};
+  int streams{0};
+  for (int idx = 1; idx < argc; ++idx) {
+    std::string arg = argv[idx];
+    if (arg == "--frames" && idx + 1 < argc) {
+      frames = std::stoi(argv[++idx]);
+    } else if (arg == "--check" && idx + 1 < argc) {
+      streams = std::stoi(argv[++idx]);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--frames <n>] [--check <streams>]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (streams > 0) {
+    const int mismatches = check(streams);
+    std::cout << (mismatches ? "FAILED" : "OK") << ": " << mismatches
+              << " mismatches\n";
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  for (const auto &shape : shapes()) {
+    bench(shape, frames);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+#ifndef TOOLS_LATENCY_PROBE_HPP__
+#define TOOLS_LATENCY_PROBE_HPP__
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include <ortp/ortp.h>
+
+#include "timestamp_sei.hpp"
+
+/// Receive side of a loopback session, which does not decode or display
+/// anything.  It extracts the capture timestamp SEI from the RTP payload and
+/// records the latency between capture and reception.
+class LatencyProbe {
+public:
+  LatencyProbe(RtpProfile *profile, int payload_type) {
+    mSession = rtp_session_new(RTP_SESSION_RECVONLY);
+    assert(mSession);
+    rtp_session_set_local_addr(mSession, "127.0.0.1", -1, -1);
+    rtp_session_set_profile(mSession, profile);
+    rtp_session_set_payload_type(mSession, payload_type);
+    rtp_session_enable_jitter_buffer(mSession, FALSE);
+  }
+  ~LatencyProbe() { rtp_session_destroy(mSession); }
+  LatencyProbe(const LatencyProbe &) = delete;
+  LatencyProbe &operator=(const LatencyProbe &) = delete;
+
+  int rtpPort() const { return rtp_session_get_local_port(mSession); }
+  int rtcpPort() const { return rtp_session_get_local_rtcp_port(mSession); }
+
+  /// Receive packets for the given duration
+  void run(std::chrono::milliseconds duration) {
+    const auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+      if (poll() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }
+
+  /// Receive the packets available now without waiting, returns their
+  /// count.  Many probes can be polled by one thread this way.
+  std::size_t poll() {
+    std::size_t count = 0;
+    const auto now_us = monotonic_us();
+    // 90 kHz user timestamp following the wall clock
+    mUserTs = static_cast<uint32_t>((now_us - mStartUs) * 9 / 100);
+    while (mblk_t *packet = rtp_session_recvm_with_ts(mSession, mUserTs)) {
+      ++count;
+      ++mPackets;
+      handleRtp(packet, now_us);
+      unsigned char *payload = nullptr;
+      int size = rtp_get_payload(packet, &payload);
+      if (size > 0) {
+        mBytes += size;
+        handlePayload(payload, payload + size);
+      }
+      freemsg(packet);
+    }
+    return count;
+  }
+
+  /// Forget everything received so far, e.g., after a warm up
+  void reset() {
+    mLatencies.clear();
+    mHasSequence = false;
+    mGaps = 0;
+    mPackets = 0;
+    mBytes = 0;
+    mRtpFrames = 0;
+    mHasRtp = false;
+    mJitter = 0;
+  }
+
+  /// Count of timestamped frames
+  std::size_t frames() const { return mLatencies.size(); }
+  /// Count of gaps in the frame sequence numbers
+  std::size_t gaps() const { return mGaps; }
+  std::size_t packets() const { return mPackets; }
+  /// RTP payload bytes
+  std::size_t bytes() const { return mBytes; }
+  /// Frames by RTP marker bit, with or without timestamp SEI
+  std::size_t rtpFrames() const { return mRtpFrames; }
+  /// Packets missing in the RTP sequence numbers
+  std::size_t lost() const {
+    if (!mHasRtp) {
+      return 0;
+    }
+    const uint64_t expected = mMaxSequence - mFirstSequence + 1;
+    return expected > mPackets ? expected - mPackets : 0;
+  }
+  /// Interarrival jitter (RFC 3550) in ms
+  double jitter() const { return mJitter / 90.0; }
+
+  /// Latency percentile in ms, *p* in [0, 1]
+  double percentile(double p) {
+    if (mLatencies.empty()) {
+      return 0.0;
+    }
+    if (!mSorted) {
+      std::sort(mLatencies.begin(), mLatencies.end());
+      mSorted = true;
+    }
+    auto idx = static_cast<std::size_t>(p * (mLatencies.size() - 1));
+    return mLatencies[idx] / 1000.0;
+  }
+
+  /// Print latency percentiles
+  void report(std::ostream &os) {
+    os << "Received " << frames() << " timestamped frames";
+    if (mLatencies.empty()) {
+      os << " (is the timestamp SEI enabled?)\n";
+      return;
+    }
+    os << ", " << mGaps << " sequence gaps\n"
+       << "latency [ms] min: " << percentile(0.0)
+       << " p50: " << percentile(0.5) << " p90: " << percentile(0.9)
+       << " p99: " << percentile(0.99) << " max: " << percentile(1.0) << "\n";
+  }
+
+private:
+  static uint64_t monotonic_us() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+  }
+
+  // Loss and jitter as in RFC 3550, appendix A
+  void handleRtp(mblk_t *packet, uint64_t now_us) {
+    const uint16_t sequence = rtp_get_seqnumber(packet);
+    const uint32_t timestamp = rtp_get_timestamp(packet);
+    const auto arrival = static_cast<uint32_t>(now_us * 9 / 100);
+    if (rtp_get_markbit(packet)) {
+      ++mRtpFrames;
+    }
+    if (!mHasRtp) {
+      mFirstSequence = mMaxSequence = sequence;
+      mHasRtp = true;
+    } else {
+      const auto delta = static_cast<int16_t>(
+          sequence - static_cast<uint16_t>(mMaxSequence));
+      if (delta > 0) {
+        mMaxSequence += static_cast<uint64_t>(delta);
+      }
+      const auto transit = static_cast<int32_t>(arrival - timestamp);
+      const auto d = std::abs(transit - mTransit);
+      mJitter += (static_cast<double>(d) - mJitter) / 16.0;
+    }
+    mTransit = static_cast<int32_t>(arrival - timestamp);
+  }
+
+  // Only single NALU and STAP-A packets are inspected, the SEI is too small
+  // to be fragmented.
+  void handlePayload(const uint8_t *begin, const uint8_t *end) {
+    const uint8_t type = *begin & 0x1F;
+    if (type >= 1 && type <= 23) {
+      handleNalu(begin, end);
+    } else if (type == 24) {
+      for (auto cur = begin + 1; cur + 2 <= end;) {
+        std::size_t size = (cur[0] << 8) | cur[1];
+        cur += 2;
+        if (cur + size > end) {
+          break;
+        }
+        handleNalu(cur, cur + size);
+        cur += size;
+      }
+    }
+  }
+
+  void handleNalu(const uint8_t *begin, const uint8_t *end) {
+    mselph264::TimestampSei sei;
+    if (!mselph264::read_timestamp_sei(begin, end, sei)) {
+      return;
+    }
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t now_us =
+        static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+    mLatencies.push_back(now_us - static_cast<int64_t>(sei.capture_us));
+    mSorted = false;
+    if (mHasSequence && sei.sequence != mSequence + 1) {
+      ++mGaps;
+    }
+    mSequence = sei.sequence;
+    mHasSequence = true;
+  }
+
+  RtpSession *mSession{nullptr};
+  const uint64_t mStartUs{monotonic_us()};
+  uint32_t mUserTs{0};
+  std::vector<int64_t> mLatencies;
+  bool mSorted{false};
+  uint32_t mSequence{0};
+  bool mHasSequence{false};
+  std::size_t mGaps{0};
+  std::size_t mPackets{0};
+  std::size_t mBytes{0};
+  std::size_t mRtpFrames{0};
+  bool mHasRtp{false};
+  uint64_t mFirstSequence{0};
+  /// Extended highest sequence number
+  uint64_t mMaxSequence{0};
+  int32_t mTransit{0};
+  double mJitter{0};
+};
+
+#endif
@@ -1,29 +1,56 @@
+// Loopback RTP sessions with the plugin as video source.
+//
+// Usage: local_rtp [--probe <seconds>]
+//        local_rtp --streams <n> [--seconds <n>] [--replay <file>]...
+//                  [--size <w>x<h>] [--fps <n>]
+//
+// Without options one stream is sent to a decoding receiver until a key is
+// pressed.  With --probe the latency is measured instead, see LatencyProbe.
+//
+// With --streams the tool runs headless: n send-only VideoStreams are
+// started and received by probes, which do not decode.  The streams take
+// the replay files round-robin or the camera without any.  Streams of the
+// same source share its capture session, just like calls of a gateway.
+// After the given duration one line per stream reports received frame
+// rate, bitrate, RTP loss and jitter and the CPU time of the stream's
+// ticker thread, followed by the CPU usage of the whole process.
+
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <memory>
+#include <pthread.h>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
 
 #include <bctoolbox/list.h>
 #include <mediastreamer2/mediastream.h>
 #include <mediastreamer2/msfactory.h>
 #include <mediastreamer2/msrtp.h>
 
+#include "latency_probe.hpp"
+#include "methods.hpp"
+
 #define H264_PAYLOAD_TYPE 102
 
-MSWebCam *find_camera(MSWebCamManager *manager) {
-  auto cam_list = ms_web_cam_manager_get_list(manager);
-  MSWebCam *cam{nullptr};
-  bctbx_list_for_each2(
-      cam_list,
-      [](void *ptr, void *data) {
-        auto cam = static_cast<MSWebCam *>(ptr);
-        auto rv = static_cast<MSWebCam **>(data);
-
-        if (strcmp("ELP-USB100W04H", ms_web_cam_get_driver_type(cam)) == 0) {
-          ms_message("Found camera %s", ms_web_cam_get_string_id(cam));
-          *rv = cam;
-        }
-      },
-      &cam);
-  return cam;
+/// Find a camera of this plugin, optionally by name
+MSWebCam *find_camera(MSWebCamManager *manager, const std::string &name = {}) {
+  for (auto elem = ms_web_cam_manager_get_list(manager); elem;
+       elem = elem->next) {
+    auto cam = static_cast<MSWebCam *>(elem->data);
+    if (strcmp("ELP-USB100W04H", ms_web_cam_get_driver_type(cam)) == 0 &&
+        (name.empty() || name == ms_web_cam_get_name(cam))) {
+      ms_message("Found camera %s", ms_web_cam_get_string_id(cam));
+      return cam;
+    }
+  }
+  return nullptr;
 }
 
 struct StreamParam {
@@ -35,26 +62,242 @@ struct StreamParam {
   MSWebCam *cam{nullptr};
 };
 
+struct Options {
+  int probe_seconds{0};
+  int streams{0};
+  int seconds{10};
+  std::vector<std::string> replays;
+  MSVideoSize vsize = MS_VIDEO_SIZE_720P;
+  float fps{15.f};
+};
+
+Options parse(int argc, const char *argv[]) {
+  Options opt;
+  auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " [--probe <seconds>]\n"
+                 "       "
+              << argv[0]
+              << " --streams <n> [--seconds <n>] [--replay <file>]..."
+                 " [--size <w>x<h>] [--fps <n>]\n";
+    std::exit(EXIT_FAILURE);
+  };
+  for (int idx = 1; idx < argc; ++idx) {
+    std::string arg = argv[idx];
+    const bool has_value = idx + 1 < argc;
+    if (arg == "--probe" && has_value) {
+      opt.probe_seconds = std::stoi(argv[++idx]);
+    } else if (arg == "--streams" && has_value) {
+      opt.streams = std::stoi(argv[++idx]);
+    } else if (arg == "--seconds" && has_value) {
+      opt.seconds = std::stoi(argv[++idx]);
+    } else if (arg == "--replay" && has_value) {
+      opt.replays.push_back(argv[++idx]);
+    } else if (arg == "--size" && has_value) {
+      if (std::sscanf(argv[++idx], "%dx%d", &opt.vsize.width,
+                      &opt.vsize.height) != 2) {
+        usage();
+      }
+    } else if (arg == "--fps" && has_value) {
+      opt.fps = std::stof(argv[++idx]);
+    } else {
+      usage();
+    }
+  }
+  if (opt.streams < 0 || opt.seconds <= 0 || opt.fps <= 0 ||
+      (opt.streams > 0 && opt.probe_seconds > 0)) {
+    usage();
+  }
+  return opt;
+}
+
+uint64_t cpu_time_us(clockid_t clock) {
+  timespec ts;
+  if (clock_gettime(clock, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t to_us(const timeval &tv) {
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+/// Send *opt.streams* streams to probes and report what arrived
+int run_load(MSFactory *factory, RtpProfile *profile, const Options &opt) {
+  auto cam_manager = ms_factory_get_web_cam_manager(factory);
+  std::vector<MSWebCam *> cams;
+  if (opt.replays.empty()) {
+    if (auto cam = find_camera(cam_manager)) {
+      cams.push_back(cam);
+    }
+  }
+  for (const auto &file : opt.replays) {
+    auto cam = find_camera(cam_manager, "replay:" + file);
+    if (!cam) {
+      std::cerr << "Replay source " << file << " not registered\n";
+      return EXIT_FAILURE;
+    }
+    cams.push_back(cam);
+  }
+  if (cams.empty()) {
+    std::cerr << "No camera found\n";
+    return EXIT_FAILURE;
+  }
+
+  struct LoadStream {
+    VideoStream *vs{nullptr};
+    std::unique_ptr<LatencyProbe> probe;
+    MSWebCam *cam{nullptr};
+    // CPU clock of the ticker thread running the stream's graph
+    clockid_t clock{CLOCK_THREAD_CPUTIME_ID};
+    bool has_clock{false};
+    uint64_t cpu_begin{0};
+  };
+  std::vector<LoadStream> streams(static_cast<std::size_t>(opt.streams));
+  // Streams must not outlive the factory
+  auto stop_all = [&streams] {
+    for (auto &stream : streams) {
+      if (stream.vs) {
+        video_stream_send_only_stop(stream.vs);
+        stream.vs = nullptr;
+      }
+    }
+  };
+  for (std::size_t idx = 0; idx < streams.size(); ++idx) {
+    auto &stream = streams[idx];
+    stream.cam = cams[idx % cams.size()];
+    stream.probe.reset(new LatencyProbe(profile, H264_PAYLOAD_TYPE));
+    stream.vs = video_stream_new2(factory, "127.0.0.1", -1, -1);
+    assert(stream.vs);
+    video_stream_set_direction(stream.vs, MediaStreamSendOnly);
+    video_stream_set_fps(stream.vs, opt.fps);
+    video_stream_set_sent_video_size(stream.vs, opt.vsize);
+    if (video_stream_send_only_start(stream.vs, profile, "127.0.0.1",
+                                     stream.probe->rtpPort(),
+                                     stream.probe->rtcpPort(),
+                                     H264_PAYLOAD_TYPE, 50, stream.cam) != 0) {
+      std::cerr << "Stream " << idx << " failed to start\n";
+      video_stream_free(stream.vs);
+      stream.vs = nullptr;
+      stop_all();
+      return EXIT_FAILURE;
+    }
+    bool enable = true;
+    ms_filter_call_method(stream.vs->source, MS_ELPH264_ENABLE_TIMESTAMP_SEI,
+                          &enable);
+    auto ticker = stream.vs->ms.sessions.ticker;
+    stream.has_clock =
+        ticker && pthread_getcpuclockid(ticker->thread, &stream.clock) == 0;
+  }
+
+  auto poll_all = [&](std::chrono::milliseconds duration) {
+    const auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+      std::size_t received = 0;
+      for (auto &stream : streams) {
+        received += stream.probe->poll();
+      }
+      if (received == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  };
+
+  // Let the capture sessions start and the first IDR arrive
+  poll_all(std::chrono::milliseconds(1000));
+  for (auto &stream : streams) {
+    stream.probe->reset();
+    stream.cpu_begin = stream.has_clock ? cpu_time_us(stream.clock) : 0;
+  }
+  rusage usage_begin;
+  getrusage(RUSAGE_SELF, &usage_begin);
+  const auto wall_begin = std::chrono::steady_clock::now();
+  poll_all(std::chrono::seconds(opt.seconds));
+  const double wall_s = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - wall_begin)
+                            .count();
+  rusage usage_end;
+  getrusage(RUSAGE_SELF, &usage_end);
+
+  std::printf("%-6s %-32s %7s %9s %7s %9s %9s %7s\n", "stream", "source",
+              "fps", "kbit/s", "loss %", "jitter ms", "p50 ms", "cpu %");
+  for (std::size_t idx = 0; idx < streams.size(); ++idx) {
+    auto &stream = streams[idx];
+    auto &probe = *stream.probe;
+    const double lost = static_cast<double>(probe.lost());
+    const double packets = static_cast<double>(probe.packets()) + lost;
+    const double cpu_us =
+        stream.has_clock
+            ? static_cast<double>(cpu_time_us(stream.clock) - stream.cpu_begin)
+            : 0.0;
+    std::printf("%-6zu %-32s %7.2f %9.1f %7.2f %9.2f %9.2f %7.1f\n", idx,
+                ms_web_cam_get_name(stream.cam), probe.rtpFrames() / wall_s,
+                probe.bytes() * 8 / wall_s / 1000,
+                packets > 0 ? 100.0 * lost / packets : 0.0, probe.jitter(),
+                probe.percentile(0.5), cpu_us / wall_s / 1e4);
+  }
+  const double user_us = static_cast<double>(to_us(usage_end.ru_utime) -
+                                             to_us(usage_begin.ru_utime));
+  const double sys_us = static_cast<double>(to_us(usage_end.ru_stime) -
+                                            to_us(usage_begin.ru_stime));
+  std::printf("process cpu %.1f %% (user %.1f %%, sys %.1f %%), %.2f %% per "
+              "stream\n",
+              (user_us + sys_us) / wall_s / 1e4, user_us / wall_s / 1e4,
+              sys_us / wall_s / 1e4,
+              (user_us + sys_us) / wall_s / 1e4 / streams.size());
+  std::fflush(stdout);
+
+  stop_all();
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, const char *argv[]) {
+  // With "--probe <seconds>" no receiving video stream is started.  Instead
+  // the frames are timestamped on capture and a probe measures the latency.
+  const auto opt = parse(argc, argv);
+  const int probe_seconds = opt.probe_seconds;
+
+  if (!opt.replays.empty()) {
+    // The plugin registers these cameras on detection
+    std::string replays;
+    for (const auto &file : opt.replays) {
+      replays += "replay:" + file + ";";
+    }
+    setenv("ELPH264_REPLAY", replays.c_str(), 1);
+  }
+
   ortp_init();
   ortp_set_log_level_mask(
       ORTP_LOG_DOMAIN, ORTP_MESSAGE | ORTP_WARNING | ORTP_ERROR | ORTP_FATAL);
+  if (opt.streams > 0) {
+    // Keep the report readable
+    ortp_set_log_level_mask(ORTP_LOG_DOMAIN, ORTP_ERROR | ORTP_FATAL);
+    bctbx_set_log_level("mediastreamer", BCTBX_LOG_ERROR);
+    bctbx_set_log_level("mselph264", BCTBX_LOG_ERROR);
+  }
 
   auto factory =
       ms_factory_new_with_voip_and_directories(MS_PLUGIN_DIRECTORY, nullptr);
   assert(factory);
 
-  // NOTE: You have to copy or link the msopenh264 into the MS_PLUGIN_DIRECTORY
-  // directory.
-  assert(ms_factory_codec_supported(factory, "H264"));
-
   RtpProfile rtp_profile;
   rtp_profile_clear_all(&rtp_profile);
   rtp_profile_set_payload(&rtp_profile, H264_PAYLOAD_TYPE, &payload_type_h264);
   int payload_type = H264_PAYLOAD_TYPE;
 
-  float fps = 15.f;
-  MSVideoSize vsize = MS_VIDEO_SIZE_720P;
+  if (opt.streams > 0) {
+    const int result = run_load(factory, &rtp_profile, opt);
+    ms_factory_destroy(factory);
+    return result;
+  }
+
+  // NOTE: You have to copy or link the msopenh264 into the MS_PLUGIN_DIRECTORY
+  // directory.
+  assert(ms_factory_codec_supported(factory, "H264"));
+
+  float fps = opt.fps;
+  MSVideoSize vsize = opt.vsize;
 
   auto make_stream = [&]() {
     StreamParam p;
@@ -76,6 +319,22 @@ int main(int argc, const char *argv[]) {
   p1.cam = find_camera(cam_manager);
   assert(p1.cam);
 
+  if (probe_seconds > 0) {
+    LatencyProbe probe(&rtp_profile, payload_type);
+    video_stream_set_direction(p1.vs, MediaStreamSendOnly);
+    video_stream_send_only_start(p1.vs, &rtp_profile, "127.0.0.1",
+                                 probe.rtpPort(), probe.rtcpPort(),
+                                 payload_type, 50, p1.cam);
+    bool enable = true;
+    ms_filter_call_method(p1.vs->source, MS_ELPH264_ENABLE_TIMESTAMP_SEI,
+                          &enable);
+    probe.run(std::chrono::seconds(probe_seconds));
+    video_stream_send_only_stop(p1.vs);
+    probe.report(std::cout);
+    ms_factory_destroy(factory);
+    return 0;
+  }
+
   StreamParam p2 = make_stream();
 
   video_stream_send_only_start(p1.vs, &rtp_profile, p2.ip, p2.rtp_port,